@@ -12,6 +12,8 @@
 #include "./build.h"
 
 #include "./base/assembler.h"
+#include "./base/codeartifact.h"
+#include "./base/codecache.h"
 #include "./base/constpool.h"
 #include "./base/containers.h"
 #include "./base/cpuinfo.h"
@@ -107,7 +107,10 @@ Assembler::Assembler(Runtime* runtime) noexcept
     _comment(nullptr),
     _unusedLinks(nullptr),
     _labels(),
-    _relocations() {}
+    _relocations() {
+
+  _stats.reset();
+}
 
 Assembler::~Assembler() noexcept {
   reset(true);
@@ -144,6 +147,7 @@ void Assembler::reset(bool releaseMemory) noexcept {
   _sections.reset(releaseMemory);
   _labels.reset(releaseMemory);
   _relocations.reset(releaseMemory);
+  _picSlots.reset(releaseMemory);
 }
 
 // ============================================================================
@@ -416,7 +420,87 @@ Error Assembler::embed(const void* data, uint32_t size) noexcept {
 size_t Assembler::relocCode(void* dst, Ptr baseAddress) const noexcept {
   if (baseAddress == kNoBaseAddress)
     baseAddress = static_cast<Ptr>((uintptr_t)dst);
-  return _relocCode(dst, baseAddress);
+
+  if (!hasAsmOption(kOptionProfile))
+    return _relocCode(dst, baseAddress);
+
+  // Statistics don't change the code, so the assembler is still `const`.
+  uint64_t startTime = Utils::getNanoTime();
+  size_t relocSize = _relocCode(dst, baseAddress);
+
+  AssemblerStats& stats = const_cast<Assembler*>(this)->_stats;
+  stats._relocCount++;
+  stats._relocTime += Utils::getNanoTime() - startTime;
+
+  return relocSize;
+}
+
+Error Assembler::setCode(const void* code, size_t codeSize, const RelocData* relocData, size_t relocCount, size_t trampolinesSize) noexcept {
+  reset(false);
+
+  Error error = _reserve(codeSize);
+  if (error != kErrorOk)
+    return error;
+
+  error = _relocations._reserve(relocCount);
+  if (error != kErrorOk)
+    return setLastError(error);
+
+  ::memcpy(_buffer, code, codeSize);
+  _cursor = _buffer + codeSize;
+  _trampolinesSize = static_cast<uint32_t>(trampolinesSize);
+
+  for (size_t i = 0; i < relocCount; i++)
+    _relocations.append(relocData[i]);
+
+  return kErrorOk;
+}
+
+// ============================================================================
+// [asmjit::Assembler - PIC]
+// ============================================================================
+
+Error Assembler::embedPICSlots() noexcept {
+  size_t count = _picSlots.getLength();
+  if (count == 0)
+    return kErrorOk;
+
+  ASMJIT_PROPAGATE_ERROR(align(kAlignData, 8));
+
+  const PICSlot* slots = _picSlots.getData();
+  for (size_t i = 0; i < count; i++) {
+    uint64_t target = static_cast<uint64_t>(slots[i].target);
+
+    ASMJIT_PROPAGATE_ERROR(bind(Label(slots[i].labelId)));
+    ASMJIT_PROPAGATE_ERROR(embed(&target, 8));
+  }
+
+  _picSlots.reset(false);
+  return kErrorOk;
+}
+
+uint32_t Assembler::_getPICSlot(Ptr target) noexcept {
+  size_t count = _picSlots.getLength();
+  const PICSlot* slots = _picSlots.getData();
+
+  for (size_t i = 0; i < count; i++) {
+    if (slots[i].target == target)
+      return slots[i].labelId;
+  }
+
+  PICSlot slot;
+  slot.target = target;
+  slot.labelId = _newLabelId();
+
+  if (slot.labelId == kInvalidValue)
+    return kInvalidValue;
+
+  if (_picSlots.append(slot) != kErrorOk) {
+    setLastError(kErrorNoHeapMemory);
+    return kInvalidValue;
+  }
+
+  return slot.labelId;
 }
 
 // ============================================================================
@@ -223,6 +223,21 @@ struct RelocData {
   Ptr data;
 };
 
+// ============================================================================
+// [asmjit::PICSlot]
+// ============================================================================
+
+//! \internal
+//!
+//! Data slot that holds an absolute address referenced by position independent
+//! code, see `Assembler::kOptionPIC`.
+struct PICSlot {
+  //! Absolute address stored in the slot.
+  Ptr target;
+  //! Label bound to the slot when it's embedded.
+  uint32_t labelId;
+};
+
 // ============================================================================
 // [asmjit::ErrorHandler]
 // ============================================================================
@@ -396,6 +411,49 @@ class ASMJIT_VIRTAPI ExternalTool {
   uint32_t _lastError;
 };
 
+// ============================================================================
+// [asmjit::AssemblerStats]
+// ============================================================================
+
+//! Statistics collected by `Assembler` if `Assembler::kOptionProfile` is set.
+//!
+//! Statistics are accumulated until reset by `Assembler::resetStats()`, they
+//! are not reset by `Assembler::reset()`.
+struct AssemblerStats {
+  // --------------------------------------------------------------------------
+  // [Reset]
+  // --------------------------------------------------------------------------
+
+  //! Reset all statistics to zero.
+  ASMJIT_INLINE void reset() noexcept { ::memset(this, 0, sizeof(AssemblerStats)); }
+
+  // --------------------------------------------------------------------------
+  // [Accessors]
+  // --------------------------------------------------------------------------
+
+  //! Get count of encoded instructions.
+  ASMJIT_INLINE uint64_t getEncodeCount() const noexcept { return _encodeCount; }
+  //! Get time spent by encoding instructions in nanoseconds.
+  ASMJIT_INLINE uint64_t getEncodeTime() const noexcept { return _encodeTime; }
+  //! Get count of `Assembler::relocCode()` calls.
+  ASMJIT_INLINE uint64_t getRelocCount() const noexcept { return _relocCount; }
+  //! Get time spent by `Assembler::relocCode()` in nanoseconds.
+  ASMJIT_INLINE uint64_t getRelocTime() const noexcept { return _relocTime; }
+
+  // --------------------------------------------------------------------------
+  // [Members]
+  // --------------------------------------------------------------------------
+
+  //! Count of encoded instructions.
+  uint64_t _encodeCount;
+  //! Time spent by encoding.
+  uint64_t _encodeTime;
+  //! Count of relocations of the code.
+  uint64_t _relocCount;
+  //! Time spent by relocations of the code.
+  uint64_t _relocTime;
+};
+
 // ============================================================================
 // [asmjit::Assembler]
 // ============================================================================
@@ -449,7 +507,36 @@ class ASMJIT_VIRTAPI Assembler {
     //! This feature is disabled by default, because the only processor that
     //! used to take into consideration prediction hints was P4. Newer processors
     //! implement heuristics for branch prediction that ignores any static hints.
-    kOptionPredictedJumps = 1
+    kOptionPredictedJumps = 1,
+
+    //! Emit position independent code (`Assembler` and `Compiler`).
+    //!
+    //! Default `false`.
+    //!
+    //! Absolute addresses referenced by the code are not relocated, they are
+    //! stored in data slots that are embedded after the code and referenced
+    //! relative to the instruction pointer. The code doesn't need relocation
+    //! and can be copied as is, see `embedPICSlots()`.
+    //!
+    //! X86/X64 Specific
+    //! ----------------
+    //!
+    //! Only used in 64-bit mode, where `jmp` and `call` to an absolute address
+    //! are emitted as `jmp/call [rip + slot]` instead of a relative jump that
+    //! may need a trampoline. Labels are already addressed relative to RIP in
+    //! 64-bit mode, only `embedLabel()` still needs a relocation. 32-bit mode
+    //! has no RIP-relative addressing, the option is ignored there.
+    kOptionPIC = 2,
+
+    //! Measure time spent by encoding and relocation (`Assembler` and `Compiler`).
+    //!
+    //! Default `false`.
+    //!
+    //! If enabled, each instruction encoded and each `relocCode()` call reads
+    //! a monotonic clock twice and the time is accumulated in `getStats()`.
+    //! Phases of `Compiler` are profiled separately, see
+    //! `kCompilerFeatureProfile`.
+    kOptionProfile = 4
   };
 
   // --------------------------------------------------------------------------
@@ -553,6 +640,15 @@ class ASMJIT_VIRTAPI Assembler {
   //! Clear the last error code.
   ASMJIT_INLINE void resetLastError() noexcept { _lastError = kErrorOk; }
 
+  // --------------------------------------------------------------------------
+  // [Statistics]
+  // --------------------------------------------------------------------------
+
+  //! Get statistics, see `AssemblerStats`.
+  ASMJIT_INLINE const AssemblerStats& getStats() const noexcept { return _stats; }
+  //! Reset statistics.
+  ASMJIT_INLINE void resetStats() noexcept { _stats.reset(); }
+
   // --------------------------------------------------------------------------
   // [Serializers]
   // --------------------------------------------------------------------------
@@ -896,6 +992,35 @@ class ASMJIT_VIRTAPI Assembler {
   //! Reloc code.
   virtual size_t _relocCode(void* dst, Ptr baseAddress) const noexcept = 0;
 
+  //! Replace the content of the assembler by `codeSize` bytes of `code` and
+  //! `relocCount` relocations, which were produced by another assembler of the
+  //! same architecture (see `getBuffer()`, `getOffset()` and `getRelocations()`).
+  //!
+  //! Used to relocate code that was stored, for example by `CodeArtifact`.
+  ASMJIT_API Error setCode(const void* code, size_t codeSize, const RelocData* relocData, size_t relocCount, size_t trampolinesSize) noexcept;
+
+  //! Get relocations.
+  ASMJIT_INLINE const PodVector<RelocData>& getRelocations() const noexcept { return _relocations; }
+
+  // --------------------------------------------------------------------------
+  // [PIC]
+  // --------------------------------------------------------------------------
+
+  //! Get whether there are PIC data slots that have not been embedded yet.
+  ASMJIT_INLINE bool hasPICSlots() const noexcept { return !_picSlots.isEmpty(); }
+
+  //! Embed PIC data slots at the current offset (aligned to 8 bytes).
+  //!
+  //! Called by all runtimes before the code is relocated, so it's only needed
+  //! to call it explicitly if the buffer is copied without using a runtime.
+  //! Slots needed by code emitted after this call are embedded by a next call.
+  ASMJIT_API Error embedPICSlots() noexcept;
+
+  //! \internal
+  //!
+  //! Get a label of the PIC data slot that holds `target`, created if needed.
+  ASMJIT_API uint32_t _getPICSlot(Ptr target) noexcept;
+
   // --------------------------------------------------------------------------
   // [Make]
   // --------------------------------------------------------------------------
@@ -963,6 +1088,9 @@ class ASMJIT_VIRTAPI Assembler {
   //! Last error code.
   uint32_t _lastError;
 
+  //! Statistics, only collected if `kOptionProfile` is set.
+  AssemblerStats _stats;
+
   //! External tool ID generator.
   uint64_t _exIdGenerator;
   //! Count of external tools currently attached.
@@ -992,6 +1120,8 @@ class ASMJIT_VIRTAPI Assembler {
   PodVectorTmp<LabelData*, 16> _labels;
   //! Table of relocations.
   PodVector<RelocData> _relocations;
+  //! PIC data slots not embedded yet.
+  PodVector<PICSlot> _picSlots;
 };
 
 //! \}
@@ -0,0 +1,572 @@
+// [AsmJit]
+// Complete x86/x64 JIT and Remote Assembler for C++.
+//
+// [License]
+// Zlib - See LICENSE.md file in the package.
+
+// [Export]
+#define ASMJIT_EXPORTS
+
+// [Dependencies]
+#include "../base/codeartifact.h"
+#include "../base/utils.h"
+
+#if ASMJIT_OS_POSIX
+# include <fcntl.h>
+# include <sys/mman.h>
+# include <sys/stat.h>
+# include <unistd.h>
+#endif // ASMJIT_OS_POSIX
+
+// [Api-Begin]
+#include "../apibegin.h"
+
+namespace asmjit {
+
+// ============================================================================
+// [asmjit::CodeArtifact - Format]
+// ============================================================================
+
+//! \internal
+enum {
+  //! Magic number ("AJCA" when stored in little-endian), also detects files
+  //! stored by a machine of a different endianness.
+  kCodeArtifactMagic = 0x41434A41,
+  //! Version of the format.
+  kCodeArtifactVersion = 1
+};
+
+//! \internal
+//!
+//! Header of the code artifact file.
+//!
+//! The header is followed by `entryCount` entries (sorted by key), code of all
+//! entries (`codeSize` bytes) and relocations of all entries (`relocCount`
+//! `RelocData` records). All values are stored in the native byte order.
+struct CodeArtifactHeader {
+  uint32_t magic;        // Magic number.
+  uint32_t version;      // Version of the format.
+  uint32_t arch;         // Architecture of the code.
+  uint32_t vendorId;     // CPU vendor.
+  uint32_t features[8];  // CPU features.
+  uint64_t userTag;      // User tag.
+
+  uint64_t entryCount;   // Count of entries.
+  uint64_t codeOffset;   // Offset of code (from the beginning of the file).
+  uint64_t codeSize;     // Size of code.
+  uint64_t relocOffset;  // Offset of relocations.
+  uint64_t relocCount;   // Count of relocations.
+};
+
+typedef CodeArtifactWriter::Entry CodeArtifactEntry;
+
+static const CpuInfo& CodeArtifact_getCpuInfo(const CpuInfo* cpuInfo) noexcept {
+  return cpuInfo ? *cpuInfo : CpuInfo::getHost();
+}
+
+static int CodeArtifact_compareEntries(const void* a, const void* b) {
+  const CodeCacheKey& aKey = static_cast<const CodeArtifactEntry*>(a)->key;
+  const CodeCacheKey& bKey = static_cast<const CodeArtifactEntry*>(b)->key;
+
+  if (aKey.hi != bKey.hi)
+    return aKey.hi < bKey.hi ? -1 : 1;
+  if (aKey.lo != bKey.lo)
+    return aKey.lo < bKey.lo ? -1 : 1;
+  return 0;
+}
+
+// ============================================================================
+// [asmjit::CodeArtifactWriter - Construction / Destruction]
+// ============================================================================
+
+CodeArtifactWriter::CodeArtifactWriter(const CpuInfo* cpuInfo, uint64_t userTag) noexcept
+  : _cpuInfo(CodeArtifact_getCpuInfo(cpuInfo)),
+    _userTag(userTag),
+    _arch(kArchNone),
+    _code(nullptr),
+    _codeSize(0),
+    _codeCapacity(0) {}
+
+CodeArtifactWriter::~CodeArtifactWriter() noexcept {
+  ASMJIT_FREE(_code);
+}
+
+// ============================================================================
+// [asmjit::CodeArtifactWriter - Reset]
+// ============================================================================
+
+void CodeArtifactWriter::reset() noexcept {
+  _arch = kArchNone;
+  _entries.reset();
+  _relocations.reset();
+  _codeSize = 0;
+}
+
+// ============================================================================
+// [asmjit::CodeArtifactWriter - Interface]
+// ============================================================================
+
+Error CodeArtifactWriter::add(const CodeCacheKey& key, Assembler* assembler) noexcept {
+  ASMJIT_PROPAGATE_ERROR(assembler->embedPICSlots());
+
+  size_t codeSize = assembler->getOffset();
+  if (codeSize == 0)
+    return kErrorNoCodeGenerated;
+
+  if (assembler->getLastError() != kErrorOk)
+    return kErrorInvalidState;
+
+  if (_arch != kArchNone && _arch != assembler->getArch())
+    return kErrorInvalidArch;
+
+  if (_codeCapacity - _codeSize < codeSize) {
+    size_t capacity = Utils::iMax<size_t>(_codeCapacity * 2, _codeSize + codeSize);
+    uint8_t* newCode = static_cast<uint8_t*>(ASMJIT_REALLOC(_code, capacity));
+
+    if (newCode == nullptr)
+      return kErrorNoHeapMemory;
+
+    _code = newCode;
+    _codeCapacity = capacity;
+  }
+
+  const PodVector<RelocData>& relocations = assembler->getRelocations();
+  size_t relocCount = relocations.getLength();
+
+  Entry entry;
+  entry.key = key;
+  entry.codeOffset = _codeSize;
+  entry.relocIndex = _relocations.getLength();
+  entry.codeSize = static_cast<uint32_t>(codeSize);
+  entry.relocCount = static_cast<uint32_t>(relocCount);
+  entry.trampolinesSize = static_cast<uint32_t>(assembler->getTrampolinesSize());
+  entry.reserved = 0;
+
+  ASMJIT_PROPAGATE_ERROR(_entries.append(entry));
+  for (size_t i = 0; i < relocCount; i++) {
+    Error error = _relocations.append(relocations[i]);
+    if (error != kErrorOk) {
+      _entries.removeAt(_entries.getLength() - 1);
+      return error;
+    }
+  }
+
+  ::memcpy(_code + _codeSize, assembler->getBuffer(), codeSize);
+  _codeSize += codeSize;
+  _arch = assembler->getArch();
+
+  return kErrorOk;
+}
+
+Error CodeArtifactWriter::save(const char* fileName) noexcept {
+  size_t count = _entries.getLength();
+  Entry* entries = _entries.getData();
+
+  // Entries are sorted by key so `CodeArtifact` can use a binary search.
+  if (count > 1) {
+    ::qsort(entries, count, sizeof(Entry), CodeArtifact_compareEntries);
+
+    for (size_t i = 1; i < count; i++) {
+      if (entries[i - 1].key == entries[i].key)
+        return kErrorInvalidArgument;
+    }
+  }
+
+  CodeArtifactHeader header;
+  ::memset(&header, 0, sizeof(CodeArtifactHeader));
+
+  header.magic = kCodeArtifactMagic;
+  header.version = kCodeArtifactVersion;
+  header.arch = _arch;
+  header.vendorId = _cpuInfo.getVendorId();
+  ::memcpy(header.features, _cpuInfo._features, sizeof(header.features));
+  header.userTag = _userTag;
+
+  header.entryCount = count;
+  header.codeOffset = sizeof(CodeArtifactHeader) + count * sizeof(Entry);
+  header.codeSize = _codeSize;
+  header.relocOffset = Utils::alignTo<uint64_t>(header.codeOffset + _codeSize, 8);
+  header.relocCount = _relocations.getLength();
+
+  FILE* file = ::fopen(fileName, "wb");
+  if (file == nullptr)
+    return kErrorInvalidArgument;
+
+  static const uint8_t padding[8] = { 0 };
+  size_t paddingSize = static_cast<size_t>(header.relocOffset - (header.codeOffset + _codeSize));
+
+  bool ok = ::fwrite(&header, sizeof(CodeArtifactHeader), 1, file) == 1 &&
+            ::fwrite(entries, sizeof(Entry), count, file) == count &&
+            ::fwrite(_code, 1, _codeSize, file) == _codeSize &&
+            ::fwrite(padding, 1, paddingSize, file) == paddingSize &&
+            ::fwrite(_relocations.getData(), sizeof(RelocData), _relocations.getLength(), file) == _relocations.getLength();
+
+  if (::fclose(file) != 0)
+    ok = false;
+
+  return ok ? kErrorOk : kErrorInvalidState;
+}
+
+// ============================================================================
+// [asmjit::CodeArtifact - Construction / Destruction]
+// ============================================================================
+
+CodeArtifact::CodeArtifact() noexcept
+  : _data(nullptr),
+    _size(0),
+    _count(0),
+    _arch(kArchNone) {
+#if ASMJIT_OS_WINDOWS
+  _hMapping = nullptr;
+#endif // ASMJIT_OS_WINDOWS
+}
+
+CodeArtifact::~CodeArtifact() noexcept {
+  close();
+}
+
+// ============================================================================
+// [asmjit::CodeArtifact - Open / Close]
+// ============================================================================
+
+//! \internal
+//!
+//! Validate the header and all entries of the mapped file.
+static Error CodeArtifact_validate(const uint8_t* data, size_t size, const CpuInfo& cpuInfo, uint64_t userTag) noexcept {
+  if (size < sizeof(CodeArtifactHeader))
+    return kErrorInvalidState;
+
+  const CodeArtifactHeader* header = reinterpret_cast<const CodeArtifactHeader*>(data);
+  if (header->magic != kCodeArtifactMagic || header->version != kCodeArtifactVersion)
+    return kErrorInvalidState;
+
+  // Sections have to be within the file (checked without overflows).
+  uint64_t fileSize = size;
+  if (header->entryCount > (fileSize - sizeof(CodeArtifactHeader)) / sizeof(CodeArtifactEntry) ||
+      header->codeOffset != sizeof(CodeArtifactHeader) + header->entryCount * sizeof(CodeArtifactEntry) ||
+      header->codeSize > fileSize - header->codeOffset ||
+      header->relocOffset < header->codeOffset + header->codeSize ||
+      header->relocOffset > fileSize ||
+      (header->relocOffset & 7) != 0 ||
+      header->relocCount > (fileSize - header->relocOffset) / sizeof(RelocData))
+    return kErrorInvalidState;
+
+  // Only code generated by `X86Assembler` is stored.
+  if (header->arch != kArchX86 && header->arch != kArchX64)
+    return kErrorInvalidState;
+
+  const CodeArtifactEntry* entries = reinterpret_cast<const CodeArtifactEntry*>(data + sizeof(CodeArtifactHeader));
+  const RelocData* relocations = reinterpret_cast<const RelocData*>(data + header->relocOffset);
+
+  for (uint64_t i = 0; i < header->entryCount; i++) {
+    const CodeArtifactEntry& entry = entries[i];
+    if (entry.codeSize == 0 ||
+        entry.codeOffset > header->codeSize ||
+        entry.codeSize > header->codeSize - entry.codeOffset ||
+        entry.relocIndex > header->relocCount ||
+        entry.relocCount > header->relocCount - entry.relocIndex)
+      return kErrorInvalidState;
+
+    // Relocations are patched by `Assembler::relocCode()`, which only asserts
+    // they are valid, so each one has to be within the code of its entry. A
+    // trampoline also patches the two bytes before the displacement and needs
+    // 8 bytes reserved after the code (at most `relocCount * 8` bytes).
+    const RelocData* rd = relocations + static_cast<size_t>(entry.relocIndex);
+    uint64_t trampolinesSize = 0;
+
+    for (uint32_t j = 0; j < entry.relocCount; j++) {
+      if (rd[j].type > kRelocTrampoline ||
+          (rd[j].size != 4 && rd[j].size != 8) ||
+          rd[j].size > entry.codeSize ||
+          rd[j].from > entry.codeSize - rd[j].size)
+        return kErrorInvalidState;
+
+      if (rd[j].type == kRelocTrampoline) {
+        if (header->arch != kArchX64 || rd[j].size != 4 || rd[j].from < 2)
+          return kErrorInvalidState;
+        trampolinesSize += 8;
+      }
+    }
+
+    if (entry.trampolinesSize != trampolinesSize)
+      return kErrorInvalidState;
+  }
+
+  // The code can only be used by the same CPU (and the same user).
+  if (header->vendorId != cpuInfo.getVendorId() ||
+      ::memcmp(header->features, cpuInfo._features, sizeof(header->features)) != 0 ||
+      header->userTag != userTag)
+    return kErrorInvalidArch;
+
+  return kErrorOk;
+}
+
+Error CodeArtifact::open(const char* fileName, const CpuInfo* cpuInfo, uint64_t userTag) noexcept {
+  close();
+
+  const uint8_t* data = nullptr;
+  size_t size = 0;
+
+#if ASMJIT_OS_WINDOWS
+  HANDLE hFile = ::CreateFileA(fileName, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (hFile == INVALID_HANDLE_VALUE)
+    return kErrorInvalidArgument;
+
+  LARGE_INTEGER fileSize;
+  if (!::GetFileSizeEx(hFile, &fileSize) || fileSize.QuadPart == 0 || static_cast<uint64_t>(fileSize.QuadPart) > ~static_cast<size_t>(0)) {
+    ::CloseHandle(hFile);
+    return kErrorInvalidState;
+  }
+
+  HANDLE hMapping = ::CreateFileMappingW(hFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  ::CloseHandle(hFile);
+
+  if (hMapping == nullptr)
+    return kErrorInvalidState;
+
+  data = static_cast<const uint8_t*>(::MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0));
+  if (data == nullptr) {
+    ::CloseHandle(hMapping);
+    return kErrorInvalidState;
+  }
+
+  size = static_cast<size_t>(fileSize.QuadPart);
+  _hMapping = hMapping;
+#else
+  int fd = ::open(fileName, O_RDONLY);
+  if (fd == -1)
+    return kErrorInvalidArgument;
+
+  struct stat st;
+  if (::fstat(fd, &st) != 0 || st.st_size <= 0) {
+    ::close(fd);
+    return kErrorInvalidState;
+  }
+
+  size = static_cast<size_t>(st.st_size);
+  void* p = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+
+  if (p == MAP_FAILED)
+    return kErrorInvalidState;
+  data = static_cast<const uint8_t*>(p);
+#endif // ASMJIT_OS_WINDOWS
+
+  _data = data;
+  _size = size;
+
+  Error error = CodeArtifact_validate(data, size, CodeArtifact_getCpuInfo(cpuInfo), userTag);
+  if (error != kErrorOk) {
+    close();
+    return error;
+  }
+
+  const CodeArtifactHeader* header = reinterpret_cast<const CodeArtifactHeader*>(data);
+  _count = static_cast<size_t>(header->entryCount);
+  _arch = header->arch;
+
+  return kErrorOk;
+}
+
+void CodeArtifact::close() noexcept {
+  if (_data == nullptr)
+    return;
+
+#if ASMJIT_OS_WINDOWS
+  ::UnmapViewOfFile(_data);
+  ::CloseHandle(_hMapping);
+  _hMapping = nullptr;
+#else
+  ::munmap(const_cast<uint8_t*>(_data), _size);
+#endif // ASMJIT_OS_WINDOWS
+
+  _data = nullptr;
+  _size = 0;
+  _count = 0;
+  _arch = kArchNone;
+}
+
+// ============================================================================
+// [asmjit::CodeArtifact - Accessors]
+// ============================================================================
+
+static ASMJIT_INLINE const CodeArtifactEntry* CodeArtifact_getEntries(const uint8_t* data) noexcept {
+  return reinterpret_cast<const CodeArtifactEntry*>(data + sizeof(CodeArtifactHeader));
+}
+
+CodeCacheKey CodeArtifact::getKey(size_t index) const noexcept {
+  ASMJIT_ASSERT(index < _count);
+  return CodeArtifact_getEntries(_data)[index].key;
+}
+
+size_t CodeArtifact::indexOf(const CodeCacheKey& key) const noexcept {
+  const CodeArtifactEntry* entries = CodeArtifact_getEntries(_data);
+
+  CodeArtifactEntry entry;
+  entry.key = key;
+
+  size_t lo = 0;
+  size_t hi = _count;
+
+  while (lo < hi) {
+    size_t mid = (lo + hi) / 2;
+    int cmp = CodeArtifact_compareEntries(&entry, &entries[mid]);
+
+    if (cmp == 0)
+      return mid;
+
+    if (cmp < 0)
+      hi = mid;
+    else
+      lo = mid + 1;
+  }
+
+  return kInvalidIndex;
+}
+
+// ============================================================================
+// [asmjit::CodeArtifact - Load]
+// ============================================================================
+
+Error CodeArtifact::load(void** dst, size_t index, Assembler* assembler) const noexcept {
+  *dst = nullptr;
+
+  if (index >= _count)
+    return kErrorInvalidArgument;
+
+  if (assembler->getArch() != _arch)
+    return kErrorInvalidArch;
+
+  const CodeArtifactHeader* header = reinterpret_cast<const CodeArtifactHeader*>(_data);
+  const CodeArtifactEntry& entry = CodeArtifact_getEntries(_data)[index];
+
+  const uint8_t* code = _data + header->codeOffset + entry.codeOffset;
+  const RelocData* relocData = reinterpret_cast<const RelocData*>(_data + header->relocOffset) + entry.relocIndex;
+
+  ASMJIT_PROPAGATE_ERROR(assembler->setCode(code, entry.codeSize, relocData, entry.relocCount, entry.trampolinesSize));
+  return assembler->getRuntime()->add(dst, assembler);
+}
+
+// ============================================================================
+// [asmjit::CodeArtifact - Test]
+// ============================================================================
+
+#if defined(ASMJIT_TEST)
+//! Artifact with a single entry, the layout matches `CodeArtifactWriter`.
+struct CodeArtifactTestFile {
+  CodeArtifactHeader header;
+  CodeArtifactEntry entry;
+  uint8_t code[16];
+  RelocData relocations[2];
+};
+
+static void CodeArtifactTest_init(CodeArtifactTestFile& f) noexcept {
+  const CpuInfo& cpuInfo = CpuInfo::getHost();
+  ::memset(&f, 0, sizeof(CodeArtifactTestFile));
+
+  f.header.magic = kCodeArtifactMagic;
+  f.header.version = kCodeArtifactVersion;
+  f.header.arch = kArchX64;
+  f.header.vendorId = cpuInfo.getVendorId();
+  ::memcpy(f.header.features, cpuInfo._features, sizeof(f.header.features));
+
+  f.header.entryCount = 1;
+  f.header.codeOffset = ASMJIT_OFFSET_OF(CodeArtifactTestFile, code);
+  f.header.codeSize = sizeof(f.code);
+  f.header.relocOffset = ASMJIT_OFFSET_OF(CodeArtifactTestFile, relocations);
+  f.header.relocCount = 2;
+
+  f.entry.key = CodeCacheKey(1, 2);
+  f.entry.codeSize = sizeof(f.code);
+  f.entry.relocCount = 2;
+  f.entry.trampolinesSize = 8;
+
+  ::memset(f.code, 0xCC, sizeof(f.code));
+
+  f.relocations[0].type = kRelocAbsToAbs;
+  f.relocations[0].size = 8;
+  f.relocations[0].from = 8;
+
+  f.relocations[1].type = kRelocTrampoline;
+  f.relocations[1].size = 4;
+  f.relocations[1].from = 2;
+}
+
+static Error CodeArtifactTest_open(const CodeArtifactTestFile& f, size_t size) noexcept {
+  static const char fileName[] = "asmjit_test_codeartifact.bin";
+
+  FILE* file = ::fopen(fileName, "wb");
+  if (file == nullptr)
+    return kErrorInvalidArgument;
+
+  bool ok = ::fwrite(&f, 1, size, file) == size;
+  if (::fclose(file) != 0 || !ok)
+    return kErrorInvalidArgument;
+
+  CodeArtifact artifact;
+  Error error = artifact.open(fileName);
+
+  ::remove(fileName);
+  return error;
+}
+
+UNIT(base_codeartifact) {
+  CodeArtifactTestFile f;
+
+  INFO("Opening a valid artifact.");
+  CodeArtifactTest_init(f);
+  EXPECT(CodeArtifactTest_open(f, sizeof(f)) == kErrorOk,
+    "CodeArtifact::open() - Should accept a valid artifact.");
+
+  INFO("Opening a truncated artifact.");
+  EXPECT(CodeArtifactTest_open(f, sizeof(f) - 8) == kErrorInvalidState,
+    "CodeArtifact::open() - Should reject a truncated artifact.");
+
+  INFO("Opening artifacts with a corrupted header or entry.");
+  CodeArtifactTest_init(f);
+  f.header.arch = kArchArm64;
+  EXPECT(CodeArtifactTest_open(f, sizeof(f)) == kErrorInvalidState,
+    "CodeArtifact::open() - Should reject an unknown architecture.");
+
+  CodeArtifactTest_init(f);
+  f.entry.trampolinesSize = 0xFFFFFFF8U;
+  EXPECT(CodeArtifactTest_open(f, sizeof(f)) == kErrorInvalidState,
+    "CodeArtifact::open() - Should reject too large trampolines.");
+
+  CodeArtifactTest_init(f);
+  f.entry.trampolinesSize = 0;
+  EXPECT(CodeArtifactTest_open(f, sizeof(f)) == kErrorInvalidState,
+    "CodeArtifact::open() - Should reject missing trampolines.");
+
+  INFO("Opening artifacts with corrupted relocations.");
+  CodeArtifactTest_init(f);
+  f.relocations[0].type = kRelocTrampoline + 1;
+  EXPECT(CodeArtifactTest_open(f, sizeof(f)) == kErrorInvalidState,
+    "CodeArtifact::open() - Should reject an unknown relocation type.");
+
+  CodeArtifactTest_init(f);
+  f.relocations[0].size = 2;
+  EXPECT(CodeArtifactTest_open(f, sizeof(f)) == kErrorInvalidState,
+    "CodeArtifact::open() - Should reject an invalid relocation size.");
+
+  CodeArtifactTest_init(f);
+  f.relocations[0].from = sizeof(f.code) - 4;
+  EXPECT(CodeArtifactTest_open(f, sizeof(f)) == kErrorInvalidState,
+    "CodeArtifact::open() - Should reject a relocation crossing the end of code.");
+
+  CodeArtifactTest_init(f);
+  f.relocations[0].from = ~static_cast<Ptr>(0) - 3;
+  EXPECT(CodeArtifactTest_open(f, sizeof(f)) == kErrorInvalidState,
+    "CodeArtifact::open() - Should reject a relocation outside of code.");
+
+  CodeArtifactTest_init(f);
+  f.relocations[1].from = 1;
+  EXPECT(CodeArtifactTest_open(f, sizeof(f)) == kErrorInvalidState,
+    "CodeArtifact::open() - Should reject a trampoline without an opcode.");
+}
+#endif // ASMJIT_TEST
+
+} // asmjit namespace
+
+// [Api-End]
+#include "../apiend.h"
@@ -0,0 +1,219 @@
+// [AsmJit]
+// Complete x86/x64 JIT and Remote Assembler for C++.
+//
+// [License]
+// Zlib - See LICENSE.md file in the package.
+
+// [Guard]
+#ifndef _ASMJIT_BASE_CODEARTIFACT_H
+#define _ASMJIT_BASE_CODEARTIFACT_H
+
+// [Dependencies]
+#include "../base/assembler.h"
+#include "../base/codecache.h"
+#include "../base/cpuinfo.h"
+#include "../base/podvector.h"
+
+// [Api-Begin]
+#include "../apibegin.h"
+
+namespace asmjit {
+
+//! \addtogroup asmjit_base
+//! \{
+
+// ============================================================================
+// [asmjit::CodeArtifactWriter]
+// ============================================================================
+
+//! Writer of code artifacts, see \ref CodeArtifact.
+//!
+//! Stores code and relocations of many assemblers, each under a unique key,
+//! together with the CPU features the code was generated for.
+class CodeArtifactWriter {
+ public:
+  ASMJIT_NO_COPY(CodeArtifactWriter)
+
+  // --------------------------------------------------------------------------
+  // [Construction / Destruction]
+  // --------------------------------------------------------------------------
+
+  //! Create a `CodeArtifactWriter` instance.
+  //!
+  //! The `cpuInfo` describes the CPU the code is generated for, the host CPU
+  //! is used if it's `nullptr`. The `userTag` is stored as is and has to be
+  //! matched by `CodeArtifact::open()`.
+  ASMJIT_API CodeArtifactWriter(const CpuInfo* cpuInfo = nullptr, uint64_t userTag = 0) noexcept;
+  //! Destroy the `CodeArtifactWriter` instance.
+  ASMJIT_API ~CodeArtifactWriter() noexcept;
+
+  // --------------------------------------------------------------------------
+  // [Reset]
+  // --------------------------------------------------------------------------
+
+  //! Remove all entries.
+  ASMJIT_API void reset() noexcept;
+
+  // --------------------------------------------------------------------------
+  // [Accessors]
+  // --------------------------------------------------------------------------
+
+  //! Get count of entries.
+  ASMJIT_INLINE size_t getCount() const noexcept { return _entries.getLength(); }
+
+  // --------------------------------------------------------------------------
+  // [Interface]
+  // --------------------------------------------------------------------------
+
+  //! Add code generated by `assembler` as `key`.
+  //!
+  //! All assemblers must target the same architecture and keys must be unique.
+  //! Pending PIC data slots are embedded first, see `Assembler::embedPICSlots()`.
+  ASMJIT_API Error add(const CodeCacheKey& key, Assembler* assembler) noexcept;
+
+  //! Save all entries to `fileName`.
+  ASMJIT_API Error save(const char* fileName) noexcept;
+
+  // --------------------------------------------------------------------------
+  // [Members]
+  // --------------------------------------------------------------------------
+
+  //! \internal
+  struct Entry {
+    CodeCacheKey key;
+    uint64_t codeOffset;
+    uint64_t relocIndex;
+    uint32_t codeSize;
+    uint32_t relocCount;
+    uint32_t trampolinesSize;
+    uint32_t reserved;
+  };
+
+  //! CPU features the code is generated for.
+  CpuInfo _cpuInfo;
+  //! User tag.
+  uint64_t _userTag;
+  //! Architecture of all entries (or `kArchNone` if there is no entry).
+  uint32_t _arch;
+
+  //! Entries.
+  PodVector<Entry> _entries;
+  //! Relocations of all entries.
+  PodVector<RelocData> _relocations;
+
+  //! Code of all entries.
+  uint8_t* _code;
+  //! Size of code.
+  size_t _codeSize;
+  //! Capacity of `_code`.
+  size_t _codeCapacity;
+};
+
+// ============================================================================
+// [asmjit::CodeArtifact]
+// ============================================================================
+
+//! Code artifact - code stored by `CodeArtifactWriter` to skip recompilation.
+//!
+//! The file is mapped into memory and each entry is relocated on demand by
+//! `load()`, which uses an `Assembler` of the same architecture and thus the
+//! same relocation path as the code that is generated at runtime.
+//!
+//! The file is rejected by `open()` if it has been created for a CPU that has
+//! a different vendor or a different set of features than the host CPU (or a
+//! given `CpuInfo`), or if it was created with a different `userTag`.
+//!
+//! NOTE: Absolute addresses referenced by the code (calls to host functions,
+//! embedded pointers) are stored as is. Use `userTag` to identify everything
+//! these addresses depend on, for example the build of the application and
+//! the base address of modules, if they can change between runs.
+class CodeArtifact {
+ public:
+  ASMJIT_NO_COPY(CodeArtifact)
+
+  // --------------------------------------------------------------------------
+  // [Construction / Destruction]
+  // --------------------------------------------------------------------------
+
+  //! Create a `CodeArtifact` instance.
+  ASMJIT_API CodeArtifact() noexcept;
+  //! Destroy the `CodeArtifact` instance.
+  ASMJIT_API ~CodeArtifact() noexcept;
+
+  // --------------------------------------------------------------------------
+  // [Open / Close]
+  // --------------------------------------------------------------------------
+
+  //! Map a code artifact file `fileName` into memory and validate it.
+  //!
+  //! Returns `kErrorInvalidArgument` if the file can't be opened,
+  //! `kErrorInvalidState` if it's not a valid artifact and `kErrorInvalidArch`
+  //! if it doesn't match `cpuInfo` (the host CPU if `nullptr`) or `userTag`.
+  ASMJIT_API Error open(const char* fileName, const CpuInfo* cpuInfo = nullptr, uint64_t userTag = 0) noexcept;
+
+  //! Unmap the file.
+  ASMJIT_API void close() noexcept;
+
+  // --------------------------------------------------------------------------
+  // [Accessors]
+  // --------------------------------------------------------------------------
+
+  //! Get whether the artifact is open.
+  ASMJIT_INLINE bool isOpen() const noexcept { return _data != nullptr; }
+  //! Get architecture of the code.
+  ASMJIT_INLINE uint32_t getArch() const noexcept { return _arch; }
+  //! Get count of entries.
+  ASMJIT_INLINE size_t getCount() const noexcept { return _count; }
+
+  //! Get key of the entry at `index`.
+  ASMJIT_API CodeCacheKey getKey(size_t index) const noexcept;
+  //! Get index of an entry of `key`, or `kInvalidIndex` if not found.
+  ASMJIT_API size_t indexOf(const CodeCacheKey& key) const noexcept;
+
+  // --------------------------------------------------------------------------
+  // [Load]
+  // --------------------------------------------------------------------------
+
+  //! Load the entry at `index` into `assembler` and add it to its runtime.
+  //!
+  //! The content of `assembler` is replaced, see `Assembler::setCode()`.
+  ASMJIT_API Error load(void** dst, size_t index, Assembler* assembler) const noexcept;
+
+  //! Load the entry of `key` into `assembler` and add it to its runtime.
+  ASMJIT_INLINE Error load(void** dst, const CodeCacheKey& key, Assembler* assembler) const noexcept {
+    size_t index = indexOf(key);
+    if (index == kInvalidIndex) {
+      *dst = nullptr;
+      return kErrorInvalidArgument;
+    }
+    return load(dst, index, assembler);
+  }
+
+  // --------------------------------------------------------------------------
+  // [Members]
+  // --------------------------------------------------------------------------
+
+  //! Mapped file.
+  const uint8_t* _data;
+  //! Size of the mapped file.
+  size_t _size;
+  //! Count of entries.
+  size_t _count;
+  //! Architecture of the code.
+  uint32_t _arch;
+
+#if ASMJIT_OS_WINDOWS
+  //! File mapping handle.
+  HANDLE _hMapping;
+#endif // ASMJIT_OS_WINDOWS
+};
+
+//! \}
+
+} // asmjit namespace
+
+// [Api-End]
+#include "../apiend.h"
+
+// [Guard]
+#endif // _ASMJIT_BASE_CODEARTIFACT_H
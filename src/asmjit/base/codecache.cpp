@@ -0,0 +1,400 @@
+// [AsmJit]
+// Complete x86/x64 JIT and Remote Assembler for C++.
+//
+// [License]
+// Zlib - See LICENSE.md file in the package.
+
+// [Export]
+#define ASMJIT_EXPORTS
+
+// [Dependencies]
+#include "../base/assembler.h"
+#include "../base/codecache.h"
+
+// [Api-Begin]
+#include "../apibegin.h"
+
+namespace asmjit {
+
+// ============================================================================
+// [asmjit::CodeCache - Private]
+// ============================================================================
+
+//! \internal
+enum {
+  //! Initial count of hash table buckets.
+  kCodeCacheInitialBuckets = 64
+};
+
+//! \internal
+//!
+//! Find an entry of `key`, `_lock` has to be held by the caller.
+static CodeCacheEntry* CodeCache_find(CodeCache* self, const CodeCacheKey& key) noexcept {
+  if (self->_bucketCount == 0)
+    return nullptr;
+
+  CodeCacheEntry* entry = self->_buckets[key.getHashCode() & (self->_bucketCount - 1)];
+  while (entry != nullptr && !entry->_key.eq(key))
+    entry = entry->_hashNext;
+  return entry;
+}
+
+//! \internal
+//!
+//! Double the count of hash table buckets.
+static bool CodeCache_grow(CodeCache* self) noexcept {
+  uint32_t oldCount = self->_bucketCount;
+  uint32_t newCount = oldCount ? oldCount * 2 : static_cast<uint32_t>(kCodeCacheInitialBuckets);
+
+  CodeCacheEntry** newBuckets = static_cast<CodeCacheEntry**>(ASMJIT_ALLOC(newCount * sizeof(CodeCacheEntry*)));
+  if (newBuckets == nullptr)
+    return false;
+
+  ::memset(newBuckets, 0, newCount * sizeof(CodeCacheEntry*));
+  uint32_t mask = newCount - 1;
+
+  for (uint32_t i = 0; i < oldCount; i++) {
+    CodeCacheEntry* entry = self->_buckets[i];
+    while (entry != nullptr) {
+      CodeCacheEntry* next = entry->_hashNext;
+      CodeCacheEntry** pBucket = &newBuckets[entry->_key.getHashCode() & mask];
+
+      entry->_hashNext = *pBucket;
+      *pBucket = entry;
+      entry = next;
+    }
+  }
+
+  ASMJIT_FREE(self->_buckets);
+  self->_buckets = newBuckets;
+  self->_bucketCount = newCount;
+  return true;
+}
+
+static ASMJIT_INLINE void CodeCache_lruInsert(CodeCache* self, CodeCacheEntry* entry) noexcept {
+  CodeCacheEntry* next = self->_lruFirst;
+
+  entry->_lruPrev = nullptr;
+  entry->_lruNext = next;
+
+  if (next)
+    next->_lruPrev = entry;
+  else
+    self->_lruLast = entry;
+  self->_lruFirst = entry;
+}
+
+static ASMJIT_INLINE void CodeCache_lruRemove(CodeCache* self, CodeCacheEntry* entry) noexcept {
+  CodeCacheEntry* prev = entry->_lruPrev;
+  CodeCacheEntry* next = entry->_lruNext;
+
+  if (prev)
+    prev->_lruNext = next;
+  else
+    self->_lruFirst = next;
+
+  if (next)
+    next->_lruPrev = prev;
+  else
+    self->_lruLast = prev;
+}
+
+//! \internal
+//!
+//! Drop a reference of `entry` and free it if it was the last one, `_lock`
+//! has to be held by the caller.
+static void CodeCache_deref(CodeCache* self, CodeCacheEntry* entry) noexcept {
+  ASMJIT_ASSERT(entry->_refCount > 0);
+
+  if (--entry->_refCount != 0)
+    return;
+
+  ASMJIT_ASSERT(entry->_evicted);
+  self->_runtime->release(entry->_func);
+  ASMJIT_FREE(entry);
+}
+
+//! \internal
+//!
+//! Remove `entry` from the hash table and the LRU list, `_lock` has to be held
+//! by the caller. The entry is freed when it's not referenced anymore.
+static void CodeCache_evict(CodeCache* self, CodeCacheEntry* entry) noexcept {
+  CodeCacheEntry** pPrev = &self->_buckets[entry->_key.getHashCode() & (self->_bucketCount - 1)];
+  while (*pPrev != entry)
+    pPrev = &(*pPrev)->_hashNext;
+
+  *pPrev = entry->_hashNext;
+  CodeCache_lruRemove(self, entry);
+
+  self->_count--;
+  self->_usedBytes -= entry->_size;
+
+  entry->_evicted = true;
+  CodeCache_deref(self, entry);
+}
+
+//! \internal
+//!
+//! Evict least recently used entries until the limit is satisfied, but never
+//! `keep`, `_lock` has to be held by the caller.
+static void CodeCache_evictToLimit(CodeCache* self, CodeCacheEntry* keep) noexcept {
+  if (self->_maxUsedBytes == 0)
+    return;
+
+  while (self->_usedBytes > self->_maxUsedBytes) {
+    CodeCacheEntry* entry = self->_lruLast;
+    if (entry == nullptr || entry == keep)
+      break;
+
+    CodeCache_evict(self, entry);
+    self->_evictionCount++;
+  }
+}
+
+// ============================================================================
+// [asmjit::CodeCache - Construction / Destruction]
+// ============================================================================
+
+CodeCache::CodeCache(JitRuntime* runtime, size_t maxUsedBytes) noexcept
+  : _runtime(runtime),
+    _buckets(nullptr),
+    _bucketCount(0),
+    _lruFirst(nullptr),
+    _lruLast(nullptr),
+    _count(0),
+    _usedBytes(0),
+    _maxUsedBytes(maxUsedBytes),
+    _hitCount(0),
+    _missCount(0),
+    _evictionCount(0) {}
+
+CodeCache::~CodeCache() noexcept {
+  reset();
+  ASMJIT_FREE(_buckets);
+}
+
+// ============================================================================
+// [asmjit::CodeCache - Reset]
+// ============================================================================
+
+void CodeCache::reset() noexcept {
+  AutoLock locked(_lock);
+
+  while (_lruFirst != nullptr)
+    CodeCache_evict(this, _lruFirst);
+}
+
+// ============================================================================
+// [asmjit::CodeCache - Accessors]
+// ============================================================================
+
+void CodeCache::setMaxUsedBytes(size_t maxUsedBytes) noexcept {
+  AutoLock locked(_lock);
+
+  _maxUsedBytes = maxUsedBytes;
+  CodeCache_evictToLimit(this, nullptr);
+}
+
+// ============================================================================
+// [asmjit::CodeCache - Interface]
+// ============================================================================
+
+CodeCacheEntry* CodeCache::get(const CodeCacheKey& key) noexcept {
+  AutoLock locked(_lock);
+
+  CodeCacheEntry* entry = CodeCache_find(this, key);
+  if (entry == nullptr) {
+    _missCount++;
+    return nullptr;
+  }
+
+  if (_lruFirst != entry) {
+    CodeCache_lruRemove(this, entry);
+    CodeCache_lruInsert(this, entry);
+  }
+
+  entry->_refCount++;
+  _hitCount++;
+  return entry;
+}
+
+Error CodeCache::add(CodeCacheEntry** out, const CodeCacheKey& key, Assembler* assembler) noexcept {
+  *out = nullptr;
+  ASMJIT_PROPAGATE_ERROR(assembler->embedPICSlots());
+
+  // The code size includes space for trampolines, which is what `VMemMgr` has
+  // to allocate before the code is relocated and shrunk.
+  size_t size = Utils::alignTo<size_t>(assembler->getCodeSize(), _runtime->getMemMgr()->getBlockDensity());
+
+  // Don't relocate the code if the key is already cached.
+  {
+    AutoLock locked(_lock);
+
+    CodeCacheEntry* entry = CodeCache_find(this, key);
+    if (entry != nullptr) {
+      entry->_refCount++;
+      *out = entry;
+      return kErrorOk;
+    }
+  }
+
+  void* func;
+  Error err = _runtime->add(&func, assembler);
+
+  if (err != kErrorOk)
+    return err;
+
+  return addFunc(out, key, func, size);
+}
+
+Error CodeCache::addFunc(CodeCacheEntry** out, const CodeCacheKey& key, void* func, size_t size) noexcept {
+  AutoLock locked(_lock);
+
+  CodeCacheEntry* entry = CodeCache_find(this, key);
+  if (entry != nullptr) {
+    _runtime->release(func);
+
+    entry->_refCount++;
+    *out = entry;
+    return kErrorOk;
+  }
+
+  if (_count >= _bucketCount && !CodeCache_grow(this) && _bucketCount == 0) {
+    _runtime->release(func);
+
+    *out = nullptr;
+    return kErrorNoHeapMemory;
+  }
+
+  entry = static_cast<CodeCacheEntry*>(ASMJIT_ALLOC(sizeof(CodeCacheEntry)));
+  if (entry == nullptr) {
+    _runtime->release(func);
+
+    *out = nullptr;
+    return kErrorNoHeapMemory;
+  }
+
+  // One reference is held by the cache and one by the caller.
+  entry->_key = key;
+  entry->_func = func;
+  entry->_size = size;
+  entry->_refCount = 2;
+  entry->_evicted = false;
+
+  CodeCacheEntry** pBucket = &_buckets[key.getHashCode() & (_bucketCount - 1)];
+  entry->_hashNext = *pBucket;
+  *pBucket = entry;
+  CodeCache_lruInsert(this, entry);
+
+  _count++;
+  _usedBytes += size;
+  CodeCache_evictToLimit(this, entry);
+
+  *out = entry;
+  return kErrorOk;
+}
+
+void CodeCache::release(CodeCacheEntry* entry) noexcept {
+  if (entry == nullptr)
+    return;
+
+  AutoLock locked(_lock);
+  CodeCache_deref(this, entry);
+}
+
+Error CodeCache::remove(const CodeCacheKey& key) noexcept {
+  AutoLock locked(_lock);
+
+  CodeCacheEntry* entry = CodeCache_find(this, key);
+  if (entry == nullptr)
+    return kErrorInvalidArgument;
+
+  CodeCache_evict(this, entry);
+  return kErrorOk;
+}
+
+// ============================================================================
+// [asmjit::CodeCache - Test]
+// ============================================================================
+
+#if defined(ASMJIT_TEST)
+static void* CodeCacheTest_alloc(JitRuntime* runtime, size_t size) noexcept {
+  void* func = runtime->getMemMgr()->alloc(size);
+  EXPECT(func != nullptr,
+    "Couldn't allocate %u bytes of virtual memory.", static_cast<unsigned int>(size));
+  return func;
+}
+
+UNIT(base_codecache) {
+  JitRuntime runtime;
+  CodeCache cache(&runtime, 64 * 10);
+
+  uint32_t i;
+  CodeCacheEntry* entry;
+
+  INFO("Adding 10 functions to the cache.");
+  for (i = 0; i < 10; i++) {
+    EXPECT(cache.addFunc(&entry, CodeCacheKey(i, ~static_cast<uint64_t>(i)), CodeCacheTest_alloc(&runtime, 64), 64) == kErrorOk,
+      "cache.addFunc() - Returned error.");
+    cache.release(entry);
+  }
+
+  EXPECT(cache.getCount() == 10 && cache.getUsedBytes() == 64 * 10,
+    "cache.getCount() - Expected 10 functions.");
+  EXPECT(cache.getEvictionCount() == 0,
+    "cache.getEvictionCount() - Nothing should be evicted.");
+
+  INFO("Checking hits and misses.");
+  CodeCacheEntry* held = cache.get(CodeCacheKey(0, ~static_cast<uint64_t>(0)));
+  EXPECT(held != nullptr && held->getKey() == CodeCacheKey(0, ~static_cast<uint64_t>(0)),
+    "cache.get() - Should find the function.");
+  EXPECT(cache.get(CodeCacheKey(0, 0)) == nullptr,
+    "cache.get() - Should not find the function.");
+  EXPECT(cache.getHitCount() == 1 && cache.getMissCount() == 1,
+    "cache.getHitCount() / getMissCount() - Expected 1 hit and 1 miss.");
+
+  INFO("Adding a key that is already cached.");
+  {
+    CodeCacheEntry* existing;
+    EXPECT(cache.addFunc(&existing, held->getKey(), CodeCacheTest_alloc(&runtime, 64), 64) == kErrorOk && existing == held,
+      "cache.addFunc() - Should return the existing function.");
+    cache.release(existing);
+  }
+
+  INFO("Checking LRU eviction (function #0 was used recently and is referenced).");
+  EXPECT(cache.addFunc(&entry, CodeCacheKey(10, 0), CodeCacheTest_alloc(&runtime, 128), 128) == kErrorOk,
+    "cache.addFunc() - Returned error.");
+  cache.release(entry);
+
+  EXPECT(cache.getEvictionCount() == 2,
+    "cache.getEvictionCount() - Expected 2 evictions, got %u.", static_cast<unsigned int>(cache.getEvictionCount()));
+  EXPECT(cache.get(CodeCacheKey(1, ~static_cast<uint64_t>(1))) == nullptr && cache.get(CodeCacheKey(2, ~static_cast<uint64_t>(2))) == nullptr,
+    "cache.get() - Least recently used functions should be evicted.");
+
+  entry = cache.get(CodeCacheKey(0, ~static_cast<uint64_t>(0)));
+  EXPECT(entry == held,
+    "cache.get() - Recently used function should be kept.");
+  cache.release(entry);
+
+  INFO("Checking that referenced functions are kept until released.");
+  size_t usedBefore = runtime.getMemMgr()->getUsedBytes();
+  EXPECT(cache.remove(CodeCacheKey(0, ~static_cast<uint64_t>(0))) == kErrorOk,
+    "cache.remove() - Returned error.");
+  EXPECT(runtime.getMemMgr()->getUsedBytes() == usedBefore,
+    "cache.remove() - Referenced function should not be released.");
+
+  // Release the reference acquired by the first `get()`.
+  cache.release(held);
+  EXPECT(runtime.getMemMgr()->getUsedBytes() == usedBefore - 64,
+    "cache.release() - Evicted function should be released.");
+
+  cache.reset();
+  EXPECT(cache.getCount() == 0 && runtime.getMemMgr()->getUsedBytes() == 0,
+    "cache.reset() - All functions should be released.");
+}
+#endif // ASMJIT_TEST
+
+} // asmjit namespace
+
+// [Api-End]
+#include "../apiend.h"
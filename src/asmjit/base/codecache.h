@@ -0,0 +1,257 @@
+// [AsmJit]
+// Complete x86/x64 JIT and Remote Assembler for C++.
+//
+// [License]
+// Zlib - See LICENSE.md file in the package.
+
+// [Guard]
+#ifndef _ASMJIT_BASE_CODECACHE_H
+#define _ASMJIT_BASE_CODECACHE_H
+
+// [Dependencies]
+#include "../base/runtime.h"
+#include "../base/utils.h"
+
+// [Api-Begin]
+#include "../apibegin.h"
+
+namespace asmjit {
+
+//! \addtogroup asmjit_base
+//! \{
+
+// ============================================================================
+// [Forward Declarations]
+// ============================================================================
+
+class Assembler;
+
+// ============================================================================
+// [asmjit::CodeCacheKey]
+// ============================================================================
+
+//! Key of \ref CodeCache (128-bit value provided by the user).
+struct CodeCacheKey {
+  // --------------------------------------------------------------------------
+  // [Construction / Destruction]
+  // --------------------------------------------------------------------------
+
+  ASMJIT_INLINE CodeCacheKey() noexcept : lo(0), hi(0) {}
+  ASMJIT_INLINE CodeCacheKey(uint64_t loValue, uint64_t hiValue) noexcept : lo(loValue), hi(hiValue) {}
+
+  // --------------------------------------------------------------------------
+  // [Accessors]
+  // --------------------------------------------------------------------------
+
+  //! Get a hash code of the key.
+  ASMJIT_INLINE uint32_t getHashCode() const noexcept {
+    uint64_t h = (lo ^ (hi * ASMJIT_UINT64_C(0x9E3779B97F4A7C15))) * ASMJIT_UINT64_C(0xFF51AFD7ED558CCD);
+    return static_cast<uint32_t>(h >> 32) ^ static_cast<uint32_t>(h);
+  }
+
+  //! Get whether the key is equal to `other`.
+  ASMJIT_INLINE bool eq(const CodeCacheKey& other) const noexcept {
+    return lo == other.lo && hi == other.hi;
+  }
+
+  // --------------------------------------------------------------------------
+  // [Operator Overload]
+  // --------------------------------------------------------------------------
+
+  ASMJIT_INLINE bool operator==(const CodeCacheKey& other) const noexcept { return eq(other); }
+  ASMJIT_INLINE bool operator!=(const CodeCacheKey& other) const noexcept { return !eq(other); }
+
+  // --------------------------------------------------------------------------
+  // [Members]
+  // --------------------------------------------------------------------------
+
+  //! Low 64 bits of the key.
+  uint64_t lo;
+  //! High 64 bits of the key.
+  uint64_t hi;
+};
+
+// ============================================================================
+// [asmjit::CodeCacheEntry]
+// ============================================================================
+
+//! Entry of \ref CodeCache.
+//!
+//! Entries are reference counted handles returned by `CodeCache::get()` and
+//! `CodeCache::add()`. The function is guaranteed to stay in memory until
+//! the entry is released by `CodeCache::release()`, even if it has been
+//! evicted from the cache meanwhile.
+struct CodeCacheEntry {
+  // --------------------------------------------------------------------------
+  // [Accessors]
+  // --------------------------------------------------------------------------
+
+  //! Get the key of the entry.
+  ASMJIT_INLINE const CodeCacheKey& getKey() const noexcept { return _key; }
+  //! Get the function.
+  ASMJIT_INLINE void* getFunc() const noexcept { return _func; }
+  //! Get the size of the function (memory accounted by the cache).
+  ASMJIT_INLINE size_t getSize() const noexcept { return _size; }
+
+  // --------------------------------------------------------------------------
+  // [Members]
+  // --------------------------------------------------------------------------
+
+  //! Key.
+  CodeCacheKey _key;
+  //! Function.
+  void* _func;
+  //! Size of the function.
+  size_t _size;
+
+  //! \internal
+  //! \{
+
+  // Next entry in the same hash bucket.
+  CodeCacheEntry* _hashNext;
+  // LRU list (most recently used first).
+  CodeCacheEntry* _lruPrev;
+  CodeCacheEntry* _lruNext;
+
+  // Count of references (the cache itself holds one unless evicted).
+  uint32_t _refCount;
+  // Whether the entry has been evicted (not in hash table and LRU list).
+  uint32_t _evicted;
+
+  //! \}
+};
+
+// ============================================================================
+// [asmjit::CodeCache]
+// ============================================================================
+
+//! Keyed JIT code cache.
+//!
+//! Maps a user-provided 128-bit `CodeCacheKey` to a function added to a
+//! `JitRuntime`. The memory used by cached functions is bounded, the least
+//! recently used functions are evicted (and released by the runtime) when a
+//! new function doesn't fit. Functions are accessed through reference counted
+//! `CodeCacheEntry` handles, so a function that is evicted while some thread
+//! still uses it is only released after its last handle is released.
+//!
+//! All methods are thread-safe.
+class CodeCache {
+ public:
+  ASMJIT_NO_COPY(CodeCache)
+
+  // --------------------------------------------------------------------------
+  // [Construction / Destruction]
+  // --------------------------------------------------------------------------
+
+  //! Create a `CodeCache` instance that adds functions to `runtime`.
+  //!
+  //! The `maxUsedBytes` limits how many bytes of `runtime`'s `VMemMgr` can be
+  //! used by cached functions, zero means no limit.
+  ASMJIT_API CodeCache(JitRuntime* runtime, size_t maxUsedBytes = 0) noexcept;
+  //! Destroy the `CodeCache` instance and release all functions.
+  //!
+  //! NOTE: All entries must be released before the cache is destroyed.
+  ASMJIT_API ~CodeCache() noexcept;
+
+  // --------------------------------------------------------------------------
+  // [Reset]
+  // --------------------------------------------------------------------------
+
+  //! Evict all functions (functions still referenced are released later).
+  ASMJIT_API void reset() noexcept;
+
+  // --------------------------------------------------------------------------
+  // [Accessors]
+  // --------------------------------------------------------------------------
+
+  //! Get the runtime.
+  ASMJIT_INLINE JitRuntime* getRuntime() const noexcept { return _runtime; }
+
+  //! Get the maximum count of bytes used by cached functions (zero if unlimited).
+  ASMJIT_INLINE size_t getMaxUsedBytes() const noexcept { return _maxUsedBytes; }
+  //! Set the maximum count of bytes used by cached functions, may evict.
+  ASMJIT_API void setMaxUsedBytes(size_t maxUsedBytes) noexcept;
+
+  //! Get count of bytes used by cached functions.
+  ASMJIT_INLINE size_t getUsedBytes() const noexcept { return _usedBytes; }
+  //! Get count of cached functions.
+  ASMJIT_INLINE size_t getCount() const noexcept { return _count; }
+
+  //! Get count of `get()` calls that found the function.
+  ASMJIT_INLINE uint64_t getHitCount() const noexcept { return _hitCount; }
+  //! Get count of `get()` calls that didn't find the function.
+  ASMJIT_INLINE uint64_t getMissCount() const noexcept { return _missCount; }
+  //! Get count of functions evicted to make space for others.
+  ASMJIT_INLINE uint64_t getEvictionCount() const noexcept { return _evictionCount; }
+
+  // --------------------------------------------------------------------------
+  // [Interface]
+  // --------------------------------------------------------------------------
+
+  //! Get an entry of `key`, returns `nullptr` if the key is not cached.
+  //!
+  //! The returned entry has to be released by `release()`.
+  ASMJIT_API CodeCacheEntry* get(const CodeCacheKey& key) noexcept;
+
+  //! Add code generated by `assembler` to the runtime and cache it as `key`.
+  //!
+  //! If the `key` has been added meanwhile (by another thread) the new code
+  //! is discarded and the existing entry is returned. The entry stored to
+  //! `out` has to be released by `release()`.
+  ASMJIT_API Error add(CodeCacheEntry** out, const CodeCacheKey& key, Assembler* assembler) noexcept;
+
+  //! Cache a function `func` of `size` bytes, already added to the runtime.
+  //!
+  //! The cache takes the ownership of `func`, which is released by the runtime
+  //! when evicted (or immediately if `key` is already cached).
+  ASMJIT_API Error addFunc(CodeCacheEntry** out, const CodeCacheKey& key, void* func, size_t size) noexcept;
+
+  //! Release the `entry` returned by `get()` or `add()`.
+  ASMJIT_API void release(CodeCacheEntry* entry) noexcept;
+
+  //! Evict the function of `key` (if it's cached).
+  ASMJIT_API Error remove(const CodeCacheKey& key) noexcept;
+
+  // --------------------------------------------------------------------------
+  // [Members]
+  // --------------------------------------------------------------------------
+
+  //! Runtime.
+  JitRuntime* _runtime;
+  //! Lock.
+  Lock _lock;
+
+  //! Hash table buckets.
+  CodeCacheEntry** _buckets;
+  //! Count of hash table buckets (power of 2).
+  uint32_t _bucketCount;
+
+  //! Most recently used entry.
+  CodeCacheEntry* _lruFirst;
+  //! Least recently used entry.
+  CodeCacheEntry* _lruLast;
+
+  //! Count of cached functions.
+  size_t _count;
+  //! Count of bytes used by cached functions.
+  size_t _usedBytes;
+  //! Maximum count of bytes used by cached functions.
+  size_t _maxUsedBytes;
+
+  //! Count of hits.
+  uint64_t _hitCount;
+  //! Count of misses.
+  uint64_t _missCount;
+  //! Count of evictions.
+  uint64_t _evictionCount;
+};
+
+//! \}
+
+} // asmjit namespace
+
+// [Api-End]
+#include "../apiend.h"
+
+// [Guard]
+#endif // _ASMJIT_BASE_CODECACHE_H
@@ -39,6 +39,7 @@ enum { kCompilerDefaultLookAhead = 64 };
 Compiler::Compiler() noexcept
   : _features(0),
     _maxLookAhead(kCompilerDefaultLookAhead),
+    _threadCount(1),
     _instOptions(0),
     _tokenGenerator(0),
     _nodeFlowId(0),
@@ -53,7 +54,11 @@ Compiler::Compiler() noexcept
     _stringAllocator(4096 - Zone::kZoneOverhead),
     _constAllocator(4096 - Zone::kZoneOverhead),
     _localConstPool(&_constAllocator),
-    _globalConstPool(&_zoneAllocator) {}
+    _globalConstPool(&_zoneAllocator),
+    _labelLock(nullptr) {
+
+  _stats.reset();
+}
 Compiler::~Compiler() noexcept {}
 
 // ============================================================================
@@ -72,6 +77,7 @@ void Compiler::reset(bool releaseMemory) noexcept {
 
   _features = 0;
   _maxLookAhead = kCompilerDefaultLookAhead;
+  _threadCount = 1;
 
   _instOptions = 0;
   _tokenGenerator = 0;
@@ -125,8 +131,18 @@ HLLabel* Compiler::newLabelNode() noexcept {
   Assembler* assembler = getAssembler();
   if (assembler == nullptr) return nullptr;
 
-  uint32_t id = assembler->_newLabelId();
-  LabelData* ld = assembler->getLabelData(id);
+  uint32_t id;
+  LabelData* ld;
+
+  if (_labelLock != nullptr) {
+    AutoLock locked(*_labelLock);
+    id = assembler->_newLabelId();
+    ld = assembler->getLabelData(id);
+  }
+  else {
+    id = assembler->_newLabelId();
+    ld = assembler->getLabelData(id);
+  }
 
   HLLabel* node = newNode<HLLabel>(id);
   if (node == nullptr) return nullptr;
@@ -370,7 +386,15 @@ HLLabel* Compiler::getHLLabel(uint32_t id) const noexcept {
   Assembler* assembler = getAssembler();
   if (assembler == nullptr) return nullptr;
 
-  LabelData* ld = assembler->getLabelData(id);
+  LabelData* ld;
+  if (_labelLock != nullptr) {
+    AutoLock locked(*_labelLock);
+    ld = assembler->getLabelData(id);
+  }
+  else {
+    ld = assembler->getLabelData(id);
+  }
+
   if (ld->exId == _exId)
     return static_cast<HLLabel*>(ld->exData);
   else
@@ -510,6 +534,9 @@ VarData* Compiler::_newVd(const VarInfo& vi, const char* name) noexcept {
   vd->_size = vi.getSize();
   vd->_homeMask = 0;
 
+  vd->_spillCost = 0;
+  vd->_loopDepth = 0;
+
   vd->_memOffset = 0;
   vd->_memCell = nullptr;
 
@@ -56,8 +56,295 @@ ASMJIT_ENUM(CompilerFeatures) {
   //! minimize the dependency chain. Scheduler always runs after the registers
   //! are allocated so it doesn't change count of register allocs/spills.
   //!
-  //! This feature is highly experimental and untested.
-  kCompilerFeatureEnableScheduler = 0
+  //! Only instructions within a basic block are reordered. Instructions that
+  //! have implicit operands or side effects (calls, jumps, fences, x87, ...)
+  //! are never moved and split the block.
+  kCompilerFeatureEnableScheduler = 0,
+
+  //! Baseline register allocation, for code that doesn't run often (`Compiler` only).
+  //!
+  //! Default `false` - the whole function is analyzed (liveness analysis) and
+  //! variables are kept in registers as long as possible.
+  //!
+  //! If enabled the liveness analysis is skipped and each variable lives in
+  //! its stack slot, it's only loaded into a register by the instruction that
+  //! uses it and stored back right after the instruction if it was modified.
+  //! The generated code is slower, but it's generated much faster as there
+  //! is no state to merge at jumps and labels. The same `HLNode` stream can
+  //! be compiled again without this feature, see `HLFunc::setCallCounter()`
+  //! for a way to find functions that are worth it.
+  kCompilerFeatureBaseline = 1,
+
+  //! Assign registers to live intervals before allocation (`Compiler` only).
+  //!
+  //! Default `false` - the allocator picks registers node by node, it only
+  //! looks ahead (up to `getMaxLookAhead()` nodes) to avoid registers that
+  //! are needed soon.
+  //!
+  //! If enabled the live interval of each variable is computed once from the
+  //! results of the liveness analysis and registers are assigned to all the
+  //! intervals by a single linear-scan pass - intervals alive after a call
+  //! get preserved registers, others get registers that make the code the
+  //! shortest (no REX prefix, no save in the prolog), and the cheapest
+  //! intervals lose their registers when there are not enough of them. The
+  //! allocator then prefers the assigned registers, the code is usually
+  //! shorter and has fewer moves, spills don't change much.
+  kCompilerFeatureLiveIntervals = 2,
+
+  //! Peephole optimization of the generated code (`Compiler` only).
+  //!
+  //! Default `false` - the code is serialized as translated.
+  //!
+  //! If enabled the translated code is matched against a table of rules that
+  //! remove or simplify instructions (self-moves, reloads of spilled variables,
+  //! jumps to the next instruction, ...). How many times each rule was applied
+  //! is reported by `CompilerStats::getPeepholeCount()`.
+  //!
+  //! X86/X64 Specific
+  //! ----------------
+  //!
+  //! Rules are listed in \ref X86PeepholeRule.
+  kCompilerFeaturePeephole = 3,
+
+  //! Constant folding and immediate propagation (`Compiler` only).
+  //!
+  //! Default `false` - variables initialized by immediates are used as is.
+  //!
+  //! If enabled, variables known to hold an immediate (within a basic block)
+  //! are replaced by immediates where the instruction accepts one, arithmetic
+  //! on such variables is computed at compile-time, and moves of immediates
+  //! overwritten before being read are removed. This happens before the code
+  //! is analyzed, so the register allocator sees fewer variable uses.
+  kCompilerFeatureFoldConstants = 4,
+
+  //! Dead code elimination (`Compiler` only).
+  //!
+  //! Default `false` - all instructions are emitted.
+  //!
+  //! If enabled, instructions without side effects whose results (variables
+  //! and EFLAGS) are never used are removed. Removing an instruction can make
+  //! other instructions dead, so the liveness analysis is repeated until there
+  //! is nothing left to remove. The count of removed instructions is reported
+  //! by `CompilerStats::getDeadCount()` and logged, if a logger is attached.
+  //!
+  //! Ignored if `kCompilerFeatureBaseline` is enabled, as there is no liveness
+  //! analysis in that case.
+  kCompilerFeatureEliminateDeadCode = 5,
+
+  //! Common subexpression elimination (`Compiler` only).
+  //!
+  //! Default `false` - each instruction computes its result.
+  //!
+  //! If enabled, an instruction that computes the same value as a previous
+  //! instruction of the same basic block (same instruction, same operands,
+  //! and no memory write in between if it reads memory) is replaced by a move
+  //! of the variable that holds the value, if it wasn't overwritten. Only
+  //! general purpose variables are considered. This happens before the code
+  //! is analyzed, after `kCompilerFeatureFoldConstants`. The count of reused
+  //! values is reported by `CompilerStats::getReuseCount()`.
+  kCompilerFeatureEliminateCommonSubexpr = 6,
+
+  //! Coalesce variables connected by copies (`Compiler` only).
+  //!
+  //! Default `false` - each variable is allocated on its own.
+  //!
+  //! If enabled, a register-to-register copy between two variables of the
+  //! same class and size is removed and one variable is renamed to the other,
+  //! so both get the same register. This is only done if neither variable is
+  //! written while the other is alive (except by the copy), so both always
+  //! hold the same value where they are alive at the same time. Variables required in different registers (like
+  //! a function argument and a return value) are not coalesced, as the copy
+  //! would only be moved elsewhere. In addition, variables passed to function calls
+  //! or returned in registers prefer these registers when they are allocated,
+  //! which saves a move before the call or return. The count of coalesced
+  //! variables is reported by `CompilerStats::getCoalesceCount()`.
+  //!
+  //! Ignored if `kCompilerFeatureBaseline` is enabled, as there is no liveness
+  //! analysis in that case.
+  kCompilerFeatureCoalesceVars = 7,
+
+  //! Collect time and memory statistics of each compiler phase (`Compiler` only).
+  //!
+  //! Default `false` - only counters are collected, which are almost free.
+  //!
+  //! If enabled, time spent by each phase listed in \ref CompilerPhase, count
+  //! of nodes and variables the phase worked with and size of memory allocated
+  //! by zones during the phase are accumulated, see `CompilerStats::getPhase()`.
+  //! Each phase is also logged, if a logger is attached. Time spent by encoding
+  //! and relocation is collected by `Assembler`, see `Assembler::kOptionProfile`.
+  kCompilerFeatureProfile = 8
+};
+
+// ============================================================================
+// [asmjit::CompilerPhase]
+// ============================================================================
+
+//! Phases of `Compiler` profiled by `kCompilerFeatureProfile`.
+ASMJIT_ENUM(CompilerPhase) {
+  //! Fetch - creation of variable maps of nodes.
+  kCompilerPhaseFetch = 0,
+  //! Removal of unreachable code.
+  kCompilerPhaseRemoveUnreachableCode = 1,
+  //! Liveness analysis (not run by `kCompilerFeatureBaseline`).
+  kCompilerPhaseLivenessAnalysis = 2,
+  //! Annotation of nodes (only run if a logger is attached).
+  kCompilerPhaseAnnotate = 3,
+  //! Translation - register allocation.
+  kCompilerPhaseTranslate = 4,
+  //! Serialization of nodes to `Assembler`, includes encoding.
+  kCompilerPhaseSerialize = 5,
+
+  //! Count of phases.
+  kCompilerPhaseCount = 6
+};
+
+// ============================================================================
+// [asmjit::CompilerPhaseStats]
+// ============================================================================
+
+//! Statistics of a single phase, see `CompilerStats::getPhase()`.
+struct CompilerPhaseStats {
+  // --------------------------------------------------------------------------
+  // [Accessors]
+  // --------------------------------------------------------------------------
+
+  //! Get average time of a single run in nanoseconds.
+  ASMJIT_INLINE double getTimeAvg() const noexcept {
+    if (runCount == 0)
+      return 0.0;
+    return static_cast<double>(time) / static_cast<double>(runCount);
+  }
+
+  // --------------------------------------------------------------------------
+  // [Members]
+  // --------------------------------------------------------------------------
+
+  //! Count of runs (one per function, or per serialized block of nodes).
+  uint64_t runCount;
+  //! Time spent by all runs in nanoseconds.
+  uint64_t time;
+  //! Count of nodes after each run, summed.
+  uint64_t nodeCount;
+  //! Count of variables used by the function of each run, summed.
+  uint64_t varCount;
+  //! Bytes allocated by zones (context and nodes) during all runs.
+  uint64_t zoneSize;
+};
+
+// ============================================================================
+// [asmjit::CompilerStats]
+// ============================================================================
+
+//! Statistics collected by `Compiler`.
+//!
+//! Statistics are accumulated by all `Compiler::finalize()` calls until reset
+//! by `Compiler::resetStats()`.
+struct CompilerStats {
+  //! Maximum count of peephole rules.
+  enum { kMaxPeepholeRules = 16 };
+
+  // --------------------------------------------------------------------------
+  // [Reset]
+  // --------------------------------------------------------------------------
+
+  //! Reset all statistics to zero.
+  ASMJIT_INLINE void reset() noexcept { ::memset(this, 0, sizeof(CompilerStats)); }
+
+  //! Add all statistics of `other` to this.
+  ASMJIT_INLINE void add(const CompilerStats& other) noexcept {
+    _loadCount += other._loadCount;
+    _saveCount += other._saveCount;
+    _moveCount += other._moveCount;
+    _reorderCount += other._reorderCount;
+    _propagateCount += other._propagateCount;
+    _foldCount += other._foldCount;
+    _deadCount += other._deadCount;
+    _reuseCount += other._reuseCount;
+    _coalesceCount += other._coalesceCount;
+
+    for (uint32_t i = 0; i < kMaxPeepholeRules; i++)
+      _peepholeCount[i] += other._peepholeCount[i];
+
+    for (uint32_t i = 0; i < kCompilerPhaseCount; i++) {
+      _phases[i].runCount += other._phases[i].runCount;
+      _phases[i].time += other._phases[i].time;
+      _phases[i].nodeCount += other._phases[i].nodeCount;
+      _phases[i].varCount += other._phases[i].varCount;
+      _phases[i].zoneSize += other._phases[i].zoneSize;
+    }
+  }
+
+  // --------------------------------------------------------------------------
+  // [Accessors]
+  // --------------------------------------------------------------------------
+
+  //! Get count of variables loaded from memory to registers.
+  ASMJIT_INLINE uint32_t getLoadCount() const noexcept { return _loadCount; }
+  //! Get count of variables saved from registers to memory.
+  ASMJIT_INLINE uint32_t getSaveCount() const noexcept { return _saveCount; }
+  //! Get count of variables moved (or swapped) between registers.
+  ASMJIT_INLINE uint32_t getMoveCount() const noexcept { return _moveCount; }
+  //! Get count of instructions reordered by the scheduler.
+  ASMJIT_INLINE uint32_t getReorderCount() const noexcept { return _reorderCount; }
+
+  //! Get count of variable operands replaced by immediates.
+  ASMJIT_INLINE uint32_t getPropagateCount() const noexcept { return _propagateCount; }
+  //! Get count of instructions computed at compile-time or removed by folding.
+  ASMJIT_INLINE uint32_t getFoldCount() const noexcept { return _foldCount; }
+  //! Get count of instructions removed by dead code elimination.
+  ASMJIT_INLINE uint32_t getDeadCount() const noexcept { return _deadCount; }
+  //! Get count of instructions replaced by a reuse of a previously computed value.
+  ASMJIT_INLINE uint32_t getReuseCount() const noexcept { return _reuseCount; }
+  //! Get count of variables merged with another variable by coalescing.
+  ASMJIT_INLINE uint32_t getCoalesceCount() const noexcept { return _coalesceCount; }
+
+  //! Get count of instructions removed or simplified by peephole `rule`.
+  ASMJIT_INLINE uint32_t getPeepholeCount(uint32_t rule) const noexcept {
+    ASMJIT_ASSERT(rule < kMaxPeepholeRules);
+    return _peepholeCount[rule];
+  }
+
+  //! Get count of instructions removed or simplified by all peephole rules.
+  ASMJIT_INLINE uint32_t getPeepholeCount() const noexcept {
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < kMaxPeepholeRules; i++)
+      count += _peepholeCount[i];
+    return count;
+  }
+
+  //! Get statistics of `phase`, only collected if `kCompilerFeatureProfile`
+  //! is enabled.
+  ASMJIT_INLINE const CompilerPhaseStats& getPhase(uint32_t phase) const noexcept {
+    ASMJIT_ASSERT(phase < kCompilerPhaseCount);
+    return _phases[phase];
+  }
+
+  // --------------------------------------------------------------------------
+  // [Members]
+  // --------------------------------------------------------------------------
+
+  //! Count of loads.
+  uint32_t _loadCount;
+  //! Count of saves (spills).
+  uint32_t _saveCount;
+  //! Count of moves.
+  uint32_t _moveCount;
+  //! Count of reordered instructions.
+  uint32_t _reorderCount;
+  //! Count of propagated immediates.
+  uint32_t _propagateCount;
+  //! Count of folded instructions.
+  uint32_t _foldCount;
+  //! Count of removed dead instructions.
+  uint32_t _deadCount;
+  //! Count of reused values.
+  uint32_t _reuseCount;
+  //! Count of coalesced variables.
+  uint32_t _coalesceCount;
+  //! Count of applied peephole rules, per rule.
+  uint32_t _peepholeCount[kMaxPeepholeRules];
+  //! Statistics of phases, see \ref CompilerPhase.
+  CompilerPhaseStats _phases[kCompilerPhaseCount];
 };
 
 // ============================================================================
@@ -180,8 +467,7 @@ class ASMJIT_VIRTAPI Compiler : public ExternalTool {
   //! Set code-generator `feature` to `value`.
   ASMJIT_INLINE void setFeature(uint32_t feature, bool value) noexcept {
     ASMJIT_ASSERT(feature < 32);
-    feature = static_cast<uint32_t>(value) << feature;
-    _features = (_features & ~feature) | feature;
+    _features = (_features & ~(1 << feature)) | (static_cast<uint32_t>(value) << feature);
   }
 
   //! Get maximum look ahead.
@@ -193,6 +479,32 @@ class ASMJIT_VIRTAPI Compiler : public ExternalTool {
     _maxLookAhead = val;
   }
 
+  //! Get count of threads used to compile functions.
+  ASMJIT_INLINE uint32_t getThreadCount() const noexcept {
+    return _threadCount;
+  }
+  //! Set count of threads used by `finalize()` to compile functions.
+  //!
+  //! Default 1 - functions are compiled one by one by the calling thread. If
+  //! `val` is greater than 1 (or zero, which means count of hardware threads)
+  //! functions are compiled concurrently and then serialized in their order.
+  //! All functions are compiled by the calling thread if they aren't
+  //! independent (they share variables or jump to each other's labels), or
+  //! if a logger or an error handler is attached to the assembler, as these
+  //! are only called by the calling thread.
+  ASMJIT_INLINE void setThreadCount(uint32_t val) noexcept {
+    _threadCount = val;
+  }
+
+  // --------------------------------------------------------------------------
+  // [Stats]
+  // --------------------------------------------------------------------------
+
+  //! Get statistics, see `CompilerStats`.
+  ASMJIT_INLINE const CompilerStats& getStats() const noexcept { return _stats; }
+  //! Reset statistics.
+  ASMJIT_INLINE void resetStats() noexcept { _stats.reset(); }
+
   // --------------------------------------------------------------------------
   // [Token ID]
   // --------------------------------------------------------------------------
@@ -496,6 +808,11 @@ class ASMJIT_VIRTAPI Compiler : public ExternalTool {
   //! Maximum count of nodes to look ahead when allocating/spilling
   //! registers.
   uint32_t _maxLookAhead;
+  //! Count of threads used to compile functions.
+  uint32_t _threadCount;
+
+  //! Statistics (not reset by `reset()`).
+  CompilerStats _stats;
 
   //! Options affecting the next instruction.
   uint32_t _instOptions;
@@ -544,6 +861,10 @@ class ASMJIT_VIRTAPI Compiler : public ExternalTool {
   Label _localConstPoolLabel;
   //! Label to start of the global constant pool.
   Label _globalConstPoolLabel;
+
+  //! Lock of the assembler's labels, used if functions are compiled by more
+  //! threads.
+  Lock* _labelLock;
 };
 
 //! \}
@@ -70,6 +70,13 @@ void Context::reset(bool releaseMemory) {
   _memAllTotal = 0;
   _annotationLength = 12;
 
+  _phaseTime = 0;
+  _phaseZoneSize = 0;
+
+  _liveStart = nullptr;
+  _liveEnd = nullptr;
+  _liveReg = nullptr;
+  _liveAcrossCall = nullptr;
   _state = nullptr;
 }
 
@@ -535,6 +542,226 @@ _NoMemory:
   return setLastError(kErrorNoHeapMemory);
 }
 
+// ============================================================================
+// [asmjit::Context - Loop Analysis]
+// ============================================================================
+
+//! \internal
+//!
+//! Weight of a use per loop it's nested in (as a shift).
+static const uint32_t kLoopWeightShift = 3;
+
+//! \internal
+//!
+//! Maximum loop depth that increases the weight of a use.
+static const uint32_t kLoopMaxDepth = 5;
+
+Error Context::loopAnalysis() {
+  uint32_t vdCount = static_cast<uint32_t>(_contextVd.getLength());
+  if (vdCount == 0)
+    return kErrorOk;
+
+  HLFunc* func = getFunc();
+  HLNode* stop = getStop();
+  HLNode* node;
+
+  uint32_t i;
+  uint32_t flowCount = func->getEnd()->getFlowId() + 1;
+
+  int32_t* depth = static_cast<int32_t*>(
+    _zoneAllocator.allocZeroed(static_cast<size_t>(flowCount + 1) * sizeof(int32_t)));
+  if (depth == nullptr)
+    return setLastError(kErrorNoHeapMemory);
+
+  for (i = 0; i < vdCount; i++) {
+    VarData* vd = _contextVd[i];
+    vd->_spillCost = 0;
+    vd->_loopDepth = 0;
+  }
+
+  // Each label targeted by a backward jump starts a loop that ends at the
+  // last such jump. Nodes of the loop are marked by +1/-1 at both ends.
+  node = func;
+  do {
+    if (node->getType() == HLNode::kTypeLabel && node->isFetched()) {
+      uint32_t start = node->getFlowId();
+      uint32_t end = 0;
+
+      for (HLJump* from = static_cast<HLLabel*>(node)->getFrom(); from != nullptr; from = from->getJumpNext()) {
+        if (from->isFetched() && from->getFlowId() >= start && from->getFlowId() > end)
+          end = from->getFlowId();
+      }
+
+      if (end != 0 && end < flowCount) {
+        depth[start]++;
+        depth[end + 1]--;
+      }
+    }
+
+    node = node->getNext();
+  } while (node != stop);
+
+  for (i = 1; i < flowCount; i++)
+    depth[i] += depth[i - 1];
+
+  size_t varMapToVaListOffset = _varMapToVaListOffset;
+
+  node = func;
+  do {
+    VarMap* map = node->getMap();
+    uint32_t flowId = node->getFlowId();
+
+    if (map != nullptr && node->isFetched() && flowId < flowCount) {
+      uint32_t loopDepth = static_cast<uint32_t>(depth[flowId]);
+      uint32_t weight = 1U << (Utils::iMin<uint32_t>(loopDepth, kLoopMaxDepth) * kLoopWeightShift);
+
+      uint32_t vaCount = map->getVaCount();
+      VarAttr* vaList = reinterpret_cast<VarAttr*>(((uint8_t*)map) + varMapToVaListOffset);
+
+      for (i = 0; i < vaCount; i++) {
+        VarAttr* va = &vaList[i];
+        VarData* vd = va->getVd();
+
+        uint32_t cost = va->getVarCount() * weight;
+        vd->_spillCost = cost > ~vd->_spillCost ? ~static_cast<uint32_t>(0) : vd->_spillCost + cost;
+
+        if (vd->_loopDepth < loopDepth)
+          vd->_loopDepth = loopDepth;
+      }
+    }
+
+    node = node->getNext();
+  } while (node != stop);
+
+  return kErrorOk;
+}
+
+// ============================================================================
+// [asmjit::Context - Live Intervals]
+// ============================================================================
+
+Error Context::liveIntervals() {
+  uint32_t vdCount = static_cast<uint32_t>(_contextVd.getLength());
+  if (vdCount == 0)
+    return kErrorOk;
+
+  uint32_t* liveStart = static_cast<uint32_t*>(
+    _zoneAllocator.alloc(static_cast<size_t>(vdCount) * sizeof(uint32_t)));
+  uint32_t* liveEnd = static_cast<uint32_t*>(
+    _zoneAllocator.allocZeroed(static_cast<size_t>(vdCount) * sizeof(uint32_t)));
+
+  if (liveStart == nullptr || liveEnd == nullptr)
+    return setLastError(kErrorNoHeapMemory);
+  ::memset(liveStart, 0xFF, static_cast<size_t>(vdCount) * sizeof(uint32_t));
+
+  uint32_t bLen = static_cast<uint32_t>(
+    ((vdCount + BitArray::kEntityBits - 1) / BitArray::kEntityBits));
+
+  BitArray* liveAcrossCall = newBits(bLen);
+  if (liveAcrossCall == nullptr)
+    return setLastError(kErrorNoHeapMemory);
+
+  HLNode* node = getFunc();
+  HLNode* stop = getStop();
+
+  // A variable is alive from the first to the last node (in flow order) that
+  // has it in its liveness, which includes all nodes of loops it's alive in.
+  do {
+    BitArray* liveness = node->getLiveness();
+    if (liveness != nullptr) {
+      HLNode* next = node->getNext();
+      if (node->getType() == HLNode::kTypeCall && next != nullptr && next->hasLiveness())
+        liveAcrossCall->addBits(next->getLiveness(), bLen);
+
+      uint32_t flowId = node->getFlowId();
+
+      for (uint32_t i = 0; i < bLen; i++) {
+        uintptr_t bits = liveness->data[i];
+        uint32_t localId = i * BitArray::kEntityBits;
+
+        for (; bits != 0; bits >>= 1, localId++) {
+          if (!(bits & 0x1))
+            continue;
+
+          if (liveStart[localId] > flowId)
+            liveStart[localId] = flowId;
+
+          if (liveEnd[localId] < flowId)
+            liveEnd[localId] = flowId;
+        }
+      }
+    }
+
+    node = node->getNext();
+  } while (node != stop);
+
+  _liveStart = liveStart;
+  _liveEnd = liveEnd;
+  _liveAcrossCall = liveAcrossCall;
+  return kErrorOk;
+}
+
+// ============================================================================
+// [asmjit::Context - Dead Code]
+// ============================================================================
+
+Error Context::removeDeadCode() {
+  Compiler* compiler = getCompiler();
+  uint32_t count = 0;
+
+  for (;;) {
+    uint32_t prevCount = count;
+    ASMJIT_PROPAGATE_ERROR(removeDeadNodes(count));
+
+    if (count == prevCount)
+      break;
+
+    // Removed instructions could be the only readers of other variables,
+    // analyze again from scratch.
+    HLNode* node = getFunc();
+    HLNode* stop = getStop();
+
+    do {
+      node->setLiveness(nullptr);
+      node = node->getNext();
+    } while (node != stop);
+
+    ASMJIT_PROPAGATE_ERROR(livenessAnalysis());
+  }
+
+  compiler->_stats._deadCount += count;
+
+#if !defined(ASMJIT_DISABLE_LOGGER)
+  Logger* logger = compiler->getAssembler()->getLogger();
+  if (logger != nullptr && count != 0)
+    logger->logFormat(Logger::kStyleComment,
+      "%s; Removed %u dead instruction(s)\n", logger->getIndentation(), count);
+#endif // !ASMJIT_DISABLE_LOGGER
+
+  return kErrorOk;
+}
+
+// ============================================================================
+// [asmjit::Context - Coalesce]
+// ============================================================================
+
+Error Context::coalesceVars() {
+  Compiler* compiler = getCompiler();
+  uint32_t count = 0;
+
+  ASMJIT_PROPAGATE_ERROR(coalesceCopies(count));
+  compiler->_stats._coalesceCount += count;
+
+#if !defined(ASMJIT_DISABLE_LOGGER)
+  Logger* logger = compiler->getAssembler()->getLogger();
+  if (logger != nullptr && count != 0)
+    logger->logFormat(Logger::kStyleComment,
+      "%s; Coalesced %u variable(s)\n", logger->getIndentation(), count);
+#endif // !ASMJIT_DISABLE_LOGGER
+
+  return kErrorOk;
+}
+
 // ============================================================================
 // [asmjit::Context - Annotate]
 // ============================================================================
@@ -609,6 +836,73 @@ void Context::cleanup() {
 
   _contextVd.reset(false);
   _extraBlock = nullptr;
+  _liveStart = nullptr;
+  _liveEnd = nullptr;
+  _liveReg = nullptr;
+  _liveAcrossCall = nullptr;
+}
+
+// ============================================================================
+// [asmjit::Context - Profile]
+// ============================================================================
+
+#if !defined(ASMJIT_DISABLE_LOGGER)
+//! \internal
+//!
+//! Names of phases, see \ref CompilerPhase.
+static const char Context_phaseNames[] =
+  "Fetch\0"
+  "RemoveUnreachableCode\0"
+  "LivenessAnalysis\0"
+  "Annotate\0"
+  "Translate\0"
+  "Serialize\0";
+#endif // !ASMJIT_DISABLE_LOGGER
+
+//! \internal
+//!
+//! Get size of memory allocated by zones the compilation uses.
+static ASMJIT_INLINE size_t Context_getZoneSize(Context* self) {
+  return self->_zoneAllocator.getUsedSize() + self->getCompiler()->_zoneAllocator.getUsedSize();
+}
+
+void Context::beginPhase() {
+  _phaseZoneSize = Context_getZoneSize(this);
+  _phaseTime = Utils::getNanoTime();
+}
+
+void Context::endPhase(uint32_t phase, HLNode* start, HLNode* stop) {
+  uint64_t time = Utils::getNanoTime() - _phaseTime;
+  size_t zoneSize = Context_getZoneSize(this) - _phaseZoneSize;
+
+  uint32_t nodeCount = 0;
+  for (HLNode* node = start; node != stop; node = node->getNext())
+    nodeCount++;
+
+  uint32_t varCount = static_cast<uint32_t>(_contextVd.getLength());
+
+  Compiler* compiler = getCompiler();
+  CompilerPhaseStats& stats = compiler->_stats._phases[phase];
+
+  stats.runCount++;
+  stats.time += time;
+  stats.nodeCount += nodeCount;
+  stats.varCount += varCount;
+  stats.zoneSize += zoneSize;
+
+#if !defined(ASMJIT_DISABLE_LOGGER)
+  Logger* logger = compiler->getAssembler()->getLogger();
+  if (logger != nullptr) {
+    const char* name = Context_phaseNames;
+    for (uint32_t i = 0; i < phase; i++)
+      name += ::strlen(name) + 1;
+
+    logger->logFormat(Logger::kStyleComment,
+      "%s; Phase %s: %.1f us, %u node(s), %u variable(s), %u byte(s)\n",
+      logger->getIndentation(), name, static_cast<double>(time) / 1000.0,
+      nodeCount, varCount, static_cast<unsigned int>(zoneSize));
+  }
+#endif // !ASMJIT_DISABLE_LOGGER
 }
 
 // ============================================================================
@@ -623,18 +917,71 @@ Error Context::compile(HLFunc* func) {
   _stop = stop;
   _extraBlock = end;
 
+  Compiler* compiler = getCompiler();
+  if (compiler->hasFeature(kCompilerFeatureFoldConstants))
+    ASMJIT_PROPAGATE_ERROR(foldConstants());
+
+  if (compiler->hasFeature(kCompilerFeatureEliminateCommonSubexpr))
+    ASMJIT_PROPAGATE_ERROR(eliminateCommonSubexpr());
+
+  // Phases are only measured if asked for, it costs a branch otherwise.
+  bool profile = compiler->hasFeature(kCompilerFeatureProfile);
+
+  if (profile)
+    beginPhase();
   ASMJIT_PROPAGATE_ERROR(fetch());
+  if (profile)
+    endPhase(kCompilerPhaseFetch, func, stop);
+
+  if (profile)
+    beginPhase();
   ASMJIT_PROPAGATE_ERROR(removeUnreachableCode());
-  ASMJIT_PROPAGATE_ERROR(livenessAnalysis());
+  if (profile)
+    endPhase(kCompilerPhaseRemoveUnreachableCode, func, stop);
 
-  Compiler* compiler = getCompiler();
+  // Baseline allocation doesn't keep variables in registers across nodes.
+  if (!compiler->hasFeature(kCompilerFeatureBaseline)) {
+    if (profile)
+      beginPhase();
+    ASMJIT_PROPAGATE_ERROR(livenessAnalysis());
+    if (profile)
+      endPhase(kCompilerPhaseLivenessAnalysis, func, stop);
+
+    if (compiler->hasFeature(kCompilerFeatureEliminateDeadCode))
+      ASMJIT_PROPAGATE_ERROR(removeDeadCode());
+
+    if (compiler->hasFeature(kCompilerFeatureCoalesceVars))
+      ASMJIT_PROPAGATE_ERROR(coalesceVars());
+
+    ASMJIT_PROPAGATE_ERROR(loopAnalysis());
+
+    if (compiler->hasFeature(kCompilerFeatureLiveIntervals)) {
+      ASMJIT_PROPAGATE_ERROR(liveIntervals());
+      ASMJIT_PROPAGATE_ERROR(allocIntervals());
+    }
+  }
 
 #if !defined(ASMJIT_DISABLE_LOGGER)
-  if (compiler->getAssembler()->hasLogger())
+  if (compiler->getAssembler()->hasLogger()) {
+    if (profile)
+      beginPhase();
     ASMJIT_PROPAGATE_ERROR(annotate());
+    if (profile)
+      endPhase(kCompilerPhaseAnnotate, func, stop);
+  }
 #endif // !ASMJIT_DISABLE_LOGGER
 
+  if (profile)
+    beginPhase();
   ASMJIT_PROPAGATE_ERROR(translate());
+  if (profile)
+    endPhase(kCompilerPhaseTranslate, func, stop);
+
+  if (compiler->hasFeature(kCompilerFeaturePeephole))
+    ASMJIT_PROPAGATE_ERROR(peephole());
+
+  if (compiler->hasFeature(kCompilerFeatureEnableScheduler))
+    ASMJIT_PROPAGATE_ERROR(schedule());
 
   // We alter the compiler cursor, because it doesn't make sense to reference
   // it after compilation - some nodes may disappear and it's forbidden to add
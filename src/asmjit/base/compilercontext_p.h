@@ -252,6 +252,15 @@ struct VarData {
   //! Add a home register index to the home registers mask.
   ASMJIT_INLINE void addHomeIndex(uint32_t regIndex) { _homeMask |= Utils::mask(regIndex); }
 
+  // --------------------------------------------------------------------------
+  // [Accessors - Spill Cost]
+  // --------------------------------------------------------------------------
+
+  //! Get estimated cost of spilling the variable, see `Context::loopAnalysis()`.
+  ASMJIT_INLINE uint32_t getSpillCost() const { return _spillCost; }
+  //! Get the deepest loop nesting the variable is used at (zero if not in a loop).
+  ASMJIT_INLINE uint32_t getLoopDepth() const { return _loopDepth; }
+
   // --------------------------------------------------------------------------
   // [Accessors - Flags]
   // --------------------------------------------------------------------------
@@ -351,6 +360,11 @@ struct VarData {
   //! Mask of all registers variable has been allocated to.
   uint32_t _homeMask;
 
+  //! Count of uses, each weighted by the loop depth it's at.
+  uint32_t _spillCost;
+  //! The deepest loop nesting the variable is used at.
+  uint32_t _loopDepth;
+
   //! Home memory offset.
   int32_t _memOffset;
   //! Home memory cell, used by `Context` (initially nullptr).
@@ -697,6 +711,26 @@ struct Context {
       _zoneAllocator.dup(src, static_cast<size_t>(len) * BitArray::kEntitySize));
   }
 
+  // --------------------------------------------------------------------------
+  // [Fold Constants]
+  // --------------------------------------------------------------------------
+
+  //! Replace variables known to hold immediates by immediates and compute
+  //! constant arithmetic.
+  //!
+  //! Called before `fetch()`, thus only sees variables.
+  virtual Error foldConstants() = 0;
+
+  // --------------------------------------------------------------------------
+  // [Common Subexpressions]
+  // --------------------------------------------------------------------------
+
+  //! Replace instructions that compute a value already held by a variable
+  //! by a move of that variable.
+  //!
+  //! Called before `fetch()`, thus only sees variables.
+  virtual Error eliminateCommonSubexpr() = 0;
+
   // --------------------------------------------------------------------------
   // [Fetch]
   // --------------------------------------------------------------------------
@@ -772,6 +806,88 @@ struct Context {
   //! repeats until all variables are resolved.
   virtual Error livenessAnalysis();
 
+  //! Compute live intervals (used by `kCompilerFeatureLiveIntervals`).
+  //!
+  //! Uses the results of `livenessAnalysis()` to find the live interval of
+  //! each variable, which spans from the lowest to the highest flow id of all
+  //! nodes the variable is alive at, and whether the variable is alive after
+  //! any function call. Registers are then assigned to the intervals by
+  //! `allocIntervals()`.
+  virtual Error liveIntervals();
+
+  //! Assign registers to live intervals (used by `kCompilerFeatureLiveIntervals`).
+  //!
+  //! Intervals are visited once, in the order they start. Each gets a free
+  //! register, if there is none the interval (either the new one or one that
+  //! already has a register) that is the cheapest to spill loses it. The
+  //! register allocator prefers the assigned registers, see `getIntervalReg()`.
+  virtual Error allocIntervals() = 0;
+
+  //! Compute loop nesting depth of nodes and spill cost of variables.
+  //!
+  //! A loop is formed by a label and the last jump to it found by `fetch()`
+  //! after the label (a back-edge), the loop depth of a node is the count of
+  //! loops its flow id is within. The spill cost of a variable is the count
+  //! of its uses, each multiplied by 8 per loop it's nested in, and is used
+  //! by the register allocator to pick a variable to spill.
+  virtual Error loopAnalysis();
+
+  //! Get whether live intervals were computed.
+  ASMJIT_INLINE bool hasLiveIntervals() const { return _liveEnd != nullptr; }
+
+  //! Get the start of the live interval of `vd`.
+  ASMJIT_INLINE uint32_t getLiveStart(VarData* vd) const {
+    ASMJIT_ASSERT(_liveStart != nullptr);
+    return _liveStart[vd->getLocalId()];
+  }
+
+  //! Get the end of the live interval of `vd` (zero if never alive).
+  ASMJIT_INLINE uint32_t getLiveEnd(VarData* vd) const {
+    ASMJIT_ASSERT(_liveEnd != nullptr);
+    return _liveEnd[vd->getLocalId()];
+  }
+
+  //! Get register assigned to the live interval of `vd` by `allocIntervals()`,
+  //! `kInvalidReg` if the variable didn't get one.
+  ASMJIT_INLINE uint32_t getIntervalReg(VarData* vd) const {
+    return _liveReg != nullptr ? _liveReg[vd->getLocalId()] : static_cast<uint32_t>(kInvalidReg);
+  }
+
+  //! Get whether `vd` is alive after a function call.
+  ASMJIT_INLINE bool isLiveAcrossCall(VarData* vd) const {
+    ASMJIT_ASSERT(_liveAcrossCall != nullptr);
+    return _liveAcrossCall->getBit(vd->getLocalId()) != 0;
+  }
+
+  // --------------------------------------------------------------------------
+  // [Dead Code]
+  // --------------------------------------------------------------------------
+
+  //! Remove instructions whose results are never used.
+  //!
+  //! Calls `removeDeadNodes()` and repeats `livenessAnalysis()` until there
+  //! is nothing to remove.
+  virtual Error removeDeadCode();
+
+  //! Remove instructions whose results are dead according to the current
+  //! liveness and add count of removed instructions to `count`.
+  virtual Error removeDeadNodes(uint32_t& count) = 0;
+
+  // --------------------------------------------------------------------------
+  // [Coalesce]
+  // --------------------------------------------------------------------------
+
+  //! Merge variables connected by copies.
+  //!
+  //! Calls `coalesceCopies()`, which keeps the liveness up to date.
+  virtual Error coalesceVars();
+
+  //! Remove copies between variables that don't interfere according to the
+  //! current liveness, rename one variable to the other, and add count of
+  //! removed copies to `count`. Variables passed to calls and returns in
+  //! registers get these registers as home registers.
+  virtual Error coalesceCopies(uint32_t& count) = 0;
+
   // --------------------------------------------------------------------------
   // [Annotate]
   // --------------------------------------------------------------------------
@@ -786,12 +902,39 @@ struct Context {
   //! Translate code by allocating registers and handling state changes.
   virtual Error translate() = 0;
 
+  // --------------------------------------------------------------------------
+  // [Peephole]
+  // --------------------------------------------------------------------------
+
+  //! Remove or simplify instructions by using peephole rules.
+  //!
+  //! Called after `translate()`, thus only sees physical registers.
+  virtual Error peephole() = 0;
+
+  // --------------------------------------------------------------------------
+  // [Schedule]
+  // --------------------------------------------------------------------------
+
+  //! Reorder instructions of each basic block to shorten dependency chains.
+  //!
+  //! Called after `translate()`, thus only sees physical registers.
+  virtual Error schedule() = 0;
+
   // --------------------------------------------------------------------------
   // [Cleanup]
   // --------------------------------------------------------------------------
 
   virtual void cleanup();
 
+  // --------------------------------------------------------------------------
+  // [Profile]
+  // --------------------------------------------------------------------------
+
+  //! Start profiling a phase, see `kCompilerFeatureProfile`.
+  void beginPhase();
+  //! Stop profiling `phase`, which worked with nodes from `start` to `stop`.
+  void endPhase(uint32_t phase, HLNode* start, HLNode* stop);
+
   // --------------------------------------------------------------------------
   // [Compile]
   // --------------------------------------------------------------------------
@@ -885,6 +1028,21 @@ struct Context {
   //! Default lenght of annotated instruction.
   uint32_t _annotationLength;
 
+  //! Time when the profiled phase started.
+  uint64_t _phaseTime;
+  //! Size of zones when the profiled phase started.
+  size_t _phaseZoneSize;
+
+  //! Start of the live interval of each variable, indexed by local id.
+  uint32_t* _liveStart;
+  //! End of the live interval of each variable, indexed by local id.
+  uint32_t* _liveEnd;
+  //! Register assigned to the live interval of each variable, indexed by
+  //! local id.
+  uint8_t* _liveReg;
+  //! Variables alive after a function call.
+  BitArray* _liveAcrossCall;
+
   //! Current state (used by register allocator).
   VarState* _state;
 };
@@ -785,6 +785,7 @@ class HLFunc : public HLNode {
       _decl(nullptr),
       _end(nullptr),
       _args(nullptr),
+      _callCounter(nullptr),
       _funcHints(Utils::mask(kFuncHintNaked)),
       _funcFlags(0),
       _expectedStackAlignment(0),
@@ -840,6 +841,17 @@ class HLFunc : public HLNode {
     _args[i] = nullptr;
   }
 
+  //! Get call counter, see `setCallCounter()`.
+  ASMJIT_INLINE uint32_t* getCallCounter() const noexcept { return _callCounter; }
+  //! Set call counter to `counter`.
+  //!
+  //! If set the prolog increments the 32-bit integer at `counter` each time
+  //! the function is called, so a function compiled with \ref
+  //! kCompilerFeatureBaseline can be compiled again without it when it gets
+  //! hot. The increment is not atomic, the counter is only approximate if the
+  //! function is called from more threads.
+  ASMJIT_INLINE void setCallCounter(uint32_t* counter) noexcept { _callCounter = counter; }
+
   //! Get function hints.
   ASMJIT_INLINE uint32_t getFuncHints() const noexcept { return _funcHints; }
   //! Get function flags.
@@ -953,6 +965,8 @@ class HLFunc : public HLNode {
 
   //! Arguments list as `VarData`.
   VarData** _args;
+  //! Call counter incremented by the prolog (optional).
+  uint32_t* _callCounter;
 
   //! Function hints;
   uint32_t _funcHints;
@@ -85,6 +85,16 @@ Runtime::Runtime() noexcept
 }
 Runtime::~Runtime() noexcept {}
 
+// ============================================================================
+// [asmjit::Runtime - Interface]
+// ============================================================================
+
+Ptr Runtime::_getVeneer(Ptr target, Ptr address) noexcept {
+  ASMJIT_UNUSED(target);
+  ASMJIT_UNUSED(address);
+  return 0;
+}
+
 // ============================================================================
 // [asmjit::HostRuntime - Construction / Destruction]
 // ============================================================================
@@ -122,6 +132,12 @@ StaticRuntime::~StaticRuntime() noexcept {}
 // ============================================================================
 
 Error StaticRuntime::add(void** dst, Assembler* assembler) noexcept {
+  Error error = assembler->embedPICSlots();
+  if (error != kErrorOk) {
+    *dst = nullptr;
+    return error;
+  }
+
   size_t codeSize = assembler->getCodeSize();
   size_t sizeLimit = _sizeLimit;
 
@@ -167,28 +183,51 @@ Error StaticRuntime::release(void* p) noexcept {
 // [asmjit::JitRuntime - Construction / Destruction]
 // ============================================================================
 
-JitRuntime::JitRuntime() noexcept {}
-JitRuntime::~JitRuntime() noexcept {}
+#if !ASMJIT_OS_WINDOWS
+JitRuntime::JitRuntime(uint32_t memMgrOptions) noexcept
+  : _memMgr(memMgrOptions),
+#else
+JitRuntime::JitRuntime(uint32_t memMgrOptions) noexcept
+  : _memMgr(static_cast<HANDLE>(0), memMgrOptions),
+#endif // ASMJIT_OS_WINDOWS
+    _veneerZone(4096 - Zone::kZoneOverhead),
+    _veneerBuckets(nullptr),
+    _veneerBucketCount(0),
+    _veneerCount(0) {}
+
+JitRuntime::~JitRuntime() noexcept {
+  // Veneer pages are freeable blocks of `_memMgr`, its destructor releases them.
+  if (_veneerBuckets != nullptr)
+    ASMJIT_FREE(_veneerBuckets);
+}
 
 // ============================================================================
 // [asmjit::JitRuntime - Interface]
 // ============================================================================
 
 Error JitRuntime::add(void** dst, Assembler* assembler) noexcept {
+  Error error = assembler->embedPICSlots();
+  if (error != kErrorOk) {
+    *dst = nullptr;
+    return error;
+  }
+
   size_t codeSize = assembler->getCodeSize();
   if (codeSize == 0) {
     *dst = nullptr;
     return kErrorNoCodeGenerated;
   }
 
-  void* p = _memMgr.alloc(codeSize, getAllocType());
+  void* rw;
+  void* p = _memMgr.alloc(codeSize, getAllocType(), &rw);
   if (p == nullptr) {
     *dst = nullptr;
     return kErrorNoVirtualMemory;
   }
 
-  // Relocate the code and release the unused memory back to `VMemMgr`.
-  size_t relocSize = assembler->relocCode(p);
+  // Relocate the code and release the unused memory back to `VMemMgr`. The
+  // code is written to `rw`, which differs from `p` in dual mapping mode.
+  size_t relocSize = assembler->relocCode(rw, static_cast<Ptr>((uintptr_t)p));
   if (relocSize == 0) {
     *dst = nullptr;
     _memMgr.release(p);
@@ -208,6 +247,212 @@ Error JitRuntime::release(void* p) noexcept {
   return _memMgr.release(p);
 }
 
+Error JitRuntime::addBatch(void** dst, Assembler* const* assemblers, size_t count, uint32_t alignment) noexcept {
+  size_t i;
+
+  for (i = 0; i < count; i++)
+    dst[i] = nullptr;
+
+  if (count == 0)
+    return kErrorOk;
+
+  if (alignment == 0 || !Utils::isPowerOf2(alignment))
+    return kErrorInvalidArgument;
+
+  uint32_t allocType = getAllocType();
+  size_t align = alignment;
+
+  // Each function has to start a new block to be freeable individually.
+  if (allocType == kVMemAllocFreeable)
+    align = Utils::iMax<size_t>(align, _memMgr.getBlockDensity());
+
+  size_t* offsets = static_cast<size_t*>(ASMJIT_ALLOC(count * sizeof(size_t)));
+  if (offsets == nullptr)
+    return kErrorNoHeapMemory;
+
+  // Lay out all functions, `codeSize` includes the space for trampolines so
+  // no function can overflow into the next one after it has been relocated.
+  size_t totalSize = 0;
+  for (i = 0; i < count; i++) {
+    Error error = assemblers[i]->embedPICSlots();
+    if (error != kErrorOk) {
+      ASMJIT_FREE(offsets);
+      return error;
+    }
+
+    size_t codeSize = assemblers[i]->getCodeSize();
+    if (codeSize == 0) {
+      ASMJIT_FREE(offsets);
+      return kErrorNoCodeGenerated;
+    }
+
+    totalSize = Utils::alignTo<size_t>(totalSize, align);
+    offsets[i] = totalSize;
+    totalSize += codeSize;
+  }
+
+  // Freeable memory is split into separate allocations right away, under the
+  // same lock that is used to allocate it.
+  void* rw;
+  uint8_t* p = static_cast<uint8_t*>(allocType == kVMemAllocFreeable
+    ? _memMgr.allocSplit(totalSize, offsets, count, &rw)
+    : _memMgr.alloc(totalSize, allocType, &rw));
+
+  if (p == nullptr) {
+    ASMJIT_FREE(offsets);
+    return kErrorNoVirtualMemory;
+  }
+
+  for (i = 0; i < count; i++)
+    dst[i] = p + offsets[i];
+
+  for (i = 0; i < count; i++) {
+    uint8_t* funcRw = static_cast<uint8_t*>(rw) + offsets[i];
+
+    if (assemblers[i]->relocCode(funcRw, static_cast<Ptr>((uintptr_t)dst[i])) == 0) {
+      if (allocType == kVMemAllocFreeable)
+        _memMgr.releaseBatch(dst, count);
+
+      for (i = 0; i < count; i++)
+        dst[i] = nullptr;
+
+      ASMJIT_FREE(offsets);
+      return kErrorInvalidState;
+    }
+  }
+
+  flush(p, totalSize);
+
+  ASMJIT_FREE(offsets);
+  return kErrorOk;
+}
+
+Error JitRuntime::releaseBatch(void* const* funcs, size_t count) noexcept {
+  return _memMgr.releaseBatch(funcs, count);
+}
+
+// ============================================================================
+// [asmjit::JitRuntime - Veneers]
+// ============================================================================
+
+//! \internal
+//!
+//! Size of a page that holds veneers.
+static const size_t kJitVeneerPageSize = 512;
+
+//! \internal
+//!
+//! Initial count of veneer hash table buckets.
+static const uint32_t kJitVeneerInitialBuckets = 16;
+
+static ASMJIT_INLINE uint32_t JitRuntime_hashTarget(Ptr target) noexcept {
+  uint64_t h = static_cast<uint64_t>(target) * ASMJIT_UINT64_C(0x9E3779B97F4A7C15);
+  return static_cast<uint32_t>(h >> 32);
+}
+
+static ASMJIT_INLINE bool JitRuntime_isInReach(Ptr veneer, Ptr address) noexcept {
+  return Utils::isInt32(static_cast<SignedPtr>(veneer - address));
+}
+
+static bool JitRuntime_growVeneers(JitRuntime* self) noexcept {
+  uint32_t oldCount = self->_veneerBucketCount;
+  uint32_t newCount = oldCount ? oldCount * 2 : kJitVeneerInitialBuckets;
+
+  JitVeneer** newBuckets = static_cast<JitVeneer**>(ASMJIT_ALLOC(newCount * sizeof(JitVeneer*)));
+  if (newBuckets == nullptr)
+    return false;
+
+  ::memset(newBuckets, 0, newCount * sizeof(JitVeneer*));
+  uint32_t mask = newCount - 1;
+
+  for (uint32_t i = 0; i < oldCount; i++) {
+    JitVeneer* veneer = self->_veneerBuckets[i];
+    while (veneer != nullptr) {
+      JitVeneer* next = veneer->next;
+      JitVeneer** pBucket = &newBuckets[JitRuntime_hashTarget(veneer->target) & mask];
+
+      veneer->next = *pBucket;
+      *pBucket = veneer;
+      veneer = next;
+    }
+  }
+
+  if (self->_veneerBuckets != nullptr)
+    ASMJIT_FREE(self->_veneerBuckets);
+
+  self->_veneerBuckets = newBuckets;
+  self->_veneerBucketCount = newCount;
+  return true;
+}
+
+Ptr JitRuntime::_getVeneer(Ptr target, Ptr address) noexcept {
+  AutoLock locked(_veneerLock);
+  uint32_t hashCode = JitRuntime_hashTarget(target);
+
+  // Reuse a veneer of `target` if there is one within reach.
+  if (_veneerBucketCount != 0) {
+    JitVeneer* veneer = _veneerBuckets[hashCode & (_veneerBucketCount - 1)];
+    while (veneer != nullptr) {
+      if (veneer->target == target && JitRuntime_isInReach(veneer->address, address))
+        return veneer->address;
+      veneer = veneer->next;
+    }
+  }
+
+  if (_veneerCount >= _veneerBucketCount && !JitRuntime_growVeneers(this) && _veneerBucketCount == 0)
+    return 0;
+
+  // Find a page within reach that has a free slot, allocate a new one if none.
+  JitVeneerPage* page = nullptr;
+  size_t pageCount = _veneerPages.getLength();
+
+  for (size_t i = 0; i < pageCount; i++) {
+    JitVeneerPage& cur = _veneerPages[i];
+    if (cur.used < kJitVeneerPageSize && JitRuntime_isInReach(cur.address + cur.used, address)) {
+      page = &cur;
+      break;
+    }
+  }
+
+  if (page == nullptr) {
+    // The page is freeable, so it can be returned if it's not in reach,
+    // otherwise each far call that can't use a veneer would keep a page.
+    void* rw;
+    void* p = _memMgr.alloc(kJitVeneerPageSize, kVMemAllocFreeable, &rw);
+    if (p == nullptr)
+      return 0;
+
+    JitVeneerPage newPage;
+    newPage.address = static_cast<Ptr>((uintptr_t)p);
+    newPage.rw = static_cast<uint8_t*>(rw);
+    newPage.used = 0;
+
+    if (!JitRuntime_isInReach(newPage.address, address) || _veneerPages.append(newPage) != kErrorOk) {
+      _memMgr.release(p);
+      return 0;
+    }
+
+    page = &_veneerPages[pageCount];
+  }
+
+  JitVeneer* veneer = _veneerZone.allocT<JitVeneer>();
+  if (veneer == nullptr)
+    return 0;
+
+  veneer->target = target;
+  veneer->address = page->address + page->used;
+
+  Utils::writeU64u(page->rw + page->used, static_cast<uint64_t>(target));
+  page->used += 8;
+
+  JitVeneer** pBucket = &_veneerBuckets[hashCode & (_veneerBucketCount - 1)];
+  veneer->next = *pBucket;
+  *pBucket = veneer;
+
+  _veneerCount++;
+  return veneer->address;
+}
+
 } // asmjit namespace
 
 // [Api-End]
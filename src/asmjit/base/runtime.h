@@ -10,7 +10,9 @@
 
 // [Dependencies]
 #include "../base/cpuinfo.h"
+#include "../base/podvector.h"
 #include "../base/vmem.h"
+#include "../base/zone.h"
 
 // [Api-Begin]
 #include "../apibegin.h"
@@ -101,6 +103,14 @@ class ASMJIT_VIRTAPI Runtime {
   //! Release memory allocated by `add`.
   virtual Error release(void* p) noexcept = 0;
 
+  //! \internal
+  //!
+  //! Get an address of a veneer - a data slot that holds `target` and that is
+  //! within ±2GB of `address`, so a far call or jump at `address` can be done
+  //! indirectly through it. Returns zero if the runtime doesn't provide one,
+  //! in which case the assembler uses a trampoline within the function.
+  ASMJIT_API virtual Ptr _getVeneer(Ptr target, Ptr address) noexcept;
+
   // --------------------------------------------------------------------------
   // [Members]
   // --------------------------------------------------------------------------
@@ -210,11 +220,44 @@ class ASMJIT_VIRTAPI StaticRuntime : public HostRuntime {
   ASMJIT_API virtual Error release(void* p) noexcept;
 };
 
+// ============================================================================
+// [asmjit::JitVeneer]
+// ============================================================================
+
+//! \internal
+//!
+//! Veneer shared by all functions of `JitRuntime`.
+struct JitVeneer {
+  //! Next veneer in the same hash bucket.
+  JitVeneer* next;
+  //! Target address stored in the veneer.
+  Ptr target;
+  //! Address of the veneer.
+  Ptr address;
+};
+
+//! \internal
+//!
+//! Page of `JitRuntime` veneers.
+struct JitVeneerPage {
+  //! Address of the page.
+  Ptr address;
+  //! Writable view of the page (differs from `address` in dual mapping mode).
+  uint8_t* rw;
+  //! Count of bytes used.
+  size_t used;
+};
+
 // ============================================================================
 // [asmjit::JitRuntime]
 // ============================================================================
 
 //! JIT runtime.
+//!
+//! Far calls and jumps (x64 calls to targets out of ±2GB) are done through
+//! veneers that are shared by all functions of the runtime, so each target
+//! needs a single 8-byte slot in each ±2GB region instead of a trampoline
+//! after each call site. Veneers are kept until the runtime is destroyed.
 class ASMJIT_VIRTAPI JitRuntime : public HostRuntime {
  public:
   ASMJIT_NO_COPY(JitRuntime)
@@ -224,7 +267,10 @@ class ASMJIT_VIRTAPI JitRuntime : public HostRuntime {
   // --------------------------------------------------------------------------
 
   //! Create a `JitRuntime` instance.
-  ASMJIT_API JitRuntime() noexcept;
+  //!
+  //! The `memMgrOptions` are passed to the virtual memory manager, see
+  //! \ref VMemMgrOptions.
+  ASMJIT_API JitRuntime(uint32_t memMgrOptions = kVMemMgrOptionNone) noexcept;
   //! Destroy the `JitRuntime` instance.
   ASMJIT_API virtual ~JitRuntime() noexcept;
 
@@ -240,12 +286,44 @@ class ASMJIT_VIRTAPI JitRuntime : public HostRuntime {
   //! Get the virtual memory manager.
   ASMJIT_INLINE VMemMgr* getMemMgr() const noexcept { return const_cast<VMemMgr*>(&_memMgr); }
 
+  //! Set the address the code should be allocated near, for example a function
+  //! of the host executable that the code calls, see `VMemMgr::setAddressHint()`.
+  //!
+  //! Calls and jumps from the code to functions within ±2GB of `hint` are then
+  //! direct (`call rel32`) in the common case, without veneers.
+  ASMJIT_INLINE void setAddressHint(const void* hint) noexcept { _memMgr.setAddressHint(hint); }
+
+  //! Get count of veneers created for far calls and jumps.
+  ASMJIT_INLINE size_t getVeneerCount() const noexcept { return _veneerCount; }
+
   // --------------------------------------------------------------------------
   // [Interface]
   // --------------------------------------------------------------------------
 
   ASMJIT_API virtual Error add(void** dst, Assembler* assembler) noexcept;
   ASMJIT_API virtual Error release(void* p) noexcept;
+  ASMJIT_API virtual Ptr _getVeneer(Ptr target, Ptr address) noexcept;
+
+  // --------------------------------------------------------------------------
+  // [Batch]
+  // --------------------------------------------------------------------------
+
+  //! Add code generated by `count` `assemblers` at once.
+  //!
+  //! All functions are placed into a single contiguous block of memory that
+  //! is allocated and made executable only once, each function starts at an
+  //! address aligned to `alignment`, which must be a power of 2. Entry points
+  //! are stored in `dst`, which must have space for `count` pointers. If the
+  //! allocation type is `kVMemAllocFreeable` the alignment is at least the
+  //! block density of the memory manager, so each function can be released
+  //! either individually by `release()` or all together by `releaseBatch()`.
+  //!
+  //! Either all functions are added or none, in which case all `dst` entries
+  //! are set to `nullptr`.
+  ASMJIT_API Error addBatch(void** dst, Assembler* const* assemblers, size_t count, uint32_t alignment = 16) noexcept;
+
+  //! Release `count` functions, typically added by `addBatch()`, at once.
+  ASMJIT_API Error releaseBatch(void* const* funcs, size_t count) noexcept;
 
   // --------------------------------------------------------------------------
   // [Members]
@@ -253,6 +331,19 @@ class ASMJIT_VIRTAPI JitRuntime : public HostRuntime {
 
   //! Virtual memory manager.
   VMemMgr _memMgr;
+
+  //! Lock that protects veneers.
+  Lock _veneerLock;
+  //! Zone used to allocate `JitVeneer` records.
+  Zone _veneerZone;
+  //! Hash table of veneers (by target address).
+  JitVeneer** _veneerBuckets;
+  //! Count of hash table buckets (power of 2).
+  uint32_t _veneerBucketCount;
+  //! Count of veneers.
+  size_t _veneerCount;
+  //! Pages that hold veneers.
+  PodVector<JitVeneerPage> _veneerPages;
 };
 
 //! \}
@@ -77,6 +77,27 @@ uint32_t Utils::getTickCount() noexcept {
   return ::GetTickCount();
 }
 
+uint64_t Utils::getNanoTime() noexcept {
+  static volatile LONGLONG freq;
+
+  LARGE_INTEGER now;
+  if (!::QueryPerformanceCounter(&now))
+    return static_cast<uint64_t>(::GetTickCount()) * 1000000;
+
+  LONGLONG f = freq;
+  if (f == 0) {
+    LARGE_INTEGER qpf;
+    if (!::QueryPerformanceFrequency(&qpf) || qpf.QuadPart == 0)
+      return static_cast<uint64_t>(::GetTickCount()) * 1000000;
+    freq = f = qpf.QuadPart;
+  }
+
+  // Split the conversion to not overflow 64 bits.
+  uint64_t c = static_cast<uint64_t>(now.QuadPart);
+  uint64_t d = static_cast<uint64_t>(f);
+  return (c / d) * 1000000000 + ((c % d) * 1000000000) / d;
+}
+
 // ============================================================================
 // [asmjit::CpuTicks - Mac]
 // ============================================================================
@@ -98,6 +119,15 @@ uint32_t Utils::getTickCount() noexcept {
   return static_cast<uint32_t>(t & 0xFFFFFFFFU);
 }
 
+uint64_t Utils::getNanoTime() noexcept {
+  if (CpuTicks_machTime.denom == 0) {
+    if (mach_timebase_info(&CpuTicks_machTime) != KERN_SUCCESS)
+      return 0;
+  }
+
+  return mach_absolute_time() * CpuTicks_machTime.numer / CpuTicks_machTime.denom;
+}
+
 // ============================================================================
 // [asmjit::CpuTicks - Posix]
 // ============================================================================
@@ -117,6 +147,20 @@ uint32_t Utils::getTickCount() noexcept {
   return 0;
 #endif  // _POSIX_MONOTONIC_CLOCK
 }
+
+uint64_t Utils::getNanoTime() noexcept {
+#if defined(_POSIX_MONOTONIC_CLOCK) && _POSIX_MONOTONIC_CLOCK >= 0
+  struct timespec ts;
+
+  if (clock_gettime(CLOCK_MONOTONIC, &ts) != 0)
+    return 0;
+
+  return (uint64_t(ts.tv_sec) * 1000000000) + uint64_t(ts.tv_nsec);
+#else  // _POSIX_MONOTONIC_CLOCK
+#error "[asmjit] Utils::getNanoTime() is not implemented for your target OS."
+  return 0;
+#endif  // _POSIX_MONOTONIC_CLOCK
+}
 #endif // ASMJIT_OS
 
 // ============================================================================
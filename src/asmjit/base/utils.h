@@ -975,6 +975,10 @@ struct Utils {
 
   //! Get the current CPU tick count, used for benchmarking (1ms resolution).
   static ASMJIT_API uint32_t getTickCount() noexcept;
+
+  //! Get the current value of a monotonic clock in nanoseconds, used to
+  //! measure short intervals (the resolution depends on the target OS).
+  static ASMJIT_API uint64_t getNanoTime() noexcept;
 };
 
 // ============================================================================
@@ -1337,6 +1341,64 @@ struct AutoLock {
   Lock& _target;
 };
 
+// ============================================================================
+// [asmjit::CondVar]
+// ============================================================================
+
+//! \internal
+//!
+//! Condition variable, used together with `Lock`.
+struct CondVar {
+  ASMJIT_NO_COPY(CondVar)
+
+  // --------------------------------------------------------------------------
+  // [Windows]
+  // --------------------------------------------------------------------------
+
+#if ASMJIT_OS_WINDOWS
+  typedef CONDITION_VARIABLE Handle;
+
+  //! Create a new `CondVar` instance.
+  ASMJIT_INLINE CondVar() noexcept { InitializeConditionVariable(&_handle); }
+  //! Destroy the `CondVar` instance.
+  ASMJIT_INLINE ~CondVar() noexcept {}
+
+  //! Unlock `lock`, wait until signaled and lock `lock` again.
+  ASMJIT_INLINE void wait(Lock& lock) noexcept { SleepConditionVariableCS(&_handle, &lock._handle, INFINITE); }
+  //! Wake up one waiting thread.
+  ASMJIT_INLINE void signal() noexcept { WakeConditionVariable(&_handle); }
+  //! Wake up all waiting threads.
+  ASMJIT_INLINE void broadcast() noexcept { WakeAllConditionVariable(&_handle); }
+#endif // ASMJIT_OS_WINDOWS
+
+  // --------------------------------------------------------------------------
+  // [Posix]
+  // --------------------------------------------------------------------------
+
+#if ASMJIT_OS_POSIX
+  typedef pthread_cond_t Handle;
+
+  //! Create a new `CondVar` instance.
+  ASMJIT_INLINE CondVar() noexcept { pthread_cond_init(&_handle, nullptr); }
+  //! Destroy the `CondVar` instance.
+  ASMJIT_INLINE ~CondVar() noexcept { pthread_cond_destroy(&_handle); }
+
+  //! Unlock `lock`, wait until signaled and lock `lock` again.
+  ASMJIT_INLINE void wait(Lock& lock) noexcept { pthread_cond_wait(&_handle, &lock._handle); }
+  //! Wake up one waiting thread.
+  ASMJIT_INLINE void signal() noexcept { pthread_cond_signal(&_handle); }
+  //! Wake up all waiting threads.
+  ASMJIT_INLINE void broadcast() noexcept { pthread_cond_broadcast(&_handle); }
+#endif // ASMJIT_OS_POSIX
+
+  // --------------------------------------------------------------------------
+  // [Members]
+  // --------------------------------------------------------------------------
+
+  //! Native handle.
+  Handle _handle;
+};
+
 //! \}
 
 } // asmjit namespace
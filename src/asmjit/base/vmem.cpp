@@ -14,9 +14,14 @@
 #if ASMJIT_OS_POSIX
 # include <sys/types.h>
 # include <sys/mman.h>
+# include <fcntl.h>
 # include <unistd.h>
 #endif // ASMJIT_OS_POSIX
 
+#if ASMJIT_OS_LINUX
+# include <sys/syscall.h>
+#endif // ASMJIT_OS_LINUX
+
 // [Api-Begin]
 #include "../apibegin.h"
 
@@ -61,6 +66,56 @@
 
 namespace asmjit {
 
+// ============================================================================
+// [asmjit::VMemUtil - Near]
+// ============================================================================
+
+//! \internal
+//!
+//! Distance between addresses probed for an allocation near a hint.
+static const size_t kVMemNearProbeStep = static_cast<size_t>(32) * 1024 * 1024;
+
+//! \internal
+//!
+//! Count of addresses probed for an allocation near a hint (half above it and
+//! half below it), which covers the whole ±2GB range.
+static const uint32_t kVMemNearProbeCount = 128;
+
+//! \internal
+//!
+//! Get whether `[p, p + length)` can reach `hint` by a 32-bit displacement.
+static ASMJIT_INLINE bool vMemIsNear(const void* p, size_t length, const void* hint) noexcept {
+#if ASMJIT_ARCH_64BIT
+  intptr_t first = static_cast<intptr_t>((uintptr_t)p - (uintptr_t)hint);
+  intptr_t last = static_cast<intptr_t>((uintptr_t)p + length - (uintptr_t)hint);
+  return Utils::isInt32(first) && Utils::isInt32(last);
+#else
+  ASMJIT_UNUSED(p);
+  ASMJIT_UNUSED(length);
+  ASMJIT_UNUSED(hint);
+  return true;
+#endif // ASMJIT_ARCH_64BIT
+}
+
+//! \internal
+//!
+//! Get the `i`th address to probe for an allocation of `length` bytes near
+//! `hint`, alternating above and below it, or zero if it's out of the address
+//! space.
+static uintptr_t vMemGetNearCandidate(const void* hint, size_t length, size_t granularity, uint32_t i) noexcept {
+  uintptr_t base = Utils::alignTo<uintptr_t>((uintptr_t)hint, granularity);
+  uintptr_t distance = static_cast<uintptr_t>(i / 2 + 1) * kVMemNearProbeStep;
+
+  if ((i & 1) == 0) {
+    uintptr_t p = base + distance;
+    return p > base ? p : 0;
+  }
+  else {
+    uintptr_t size = Utils::alignTo<uintptr_t>(length, granularity);
+    return base > distance + size ? base - distance - size : 0;
+  }
+}
+
 // ============================================================================
 // [asmjit::VMemUtil - Windows]
 // ============================================================================
@@ -76,6 +131,7 @@ struct VMemLocal {
 
   size_t pageSize;
   size_t pageGranularity;
+  size_t hugePageSize;
   HANDLE hProcess;
 };
 static VMemLocal vMemLocal;
@@ -90,6 +146,12 @@ static const VMemLocal& vMemGet() noexcept {
     vMem.pageSize = Utils::alignToPowerOf2<uint32_t>(info.dwPageSize);
     vMem.pageGranularity = info.dwAllocationGranularity;
 
+    // Large pages require `SeLockMemoryPrivilege`, fall back to 2MB if the
+    // system doesn't report their size.
+    vMem.hugePageSize = ::GetLargePageMinimum();
+    if (vMem.hugePageSize == 0)
+      vMem.hugePageSize = 2 * 1024 * 1024;
+
     vMem.hProcess = ::GetCurrentProcess();
   }
 
@@ -106,11 +168,38 @@ size_t VMemUtil::getPageGranularity() noexcept {
   return vMem.pageGranularity;
 }
 
-void* VMemUtil::alloc(size_t length, size_t* allocated, uint32_t flags) noexcept {
-  return allocProcessMemory(static_cast<HANDLE>(0), length, allocated, flags);
+size_t VMemUtil::getHugePageSize() noexcept {
+  const VMemLocal& vMem = vMemGet();
+  return vMem.hugePageSize;
+}
+
+void* VMemUtil::alloc(size_t length, size_t* allocated, uint32_t flags, const void* hint) noexcept {
+  return allocProcessMemory(static_cast<HANDLE>(0), length, allocated, flags, hint);
+}
+
+//! \internal
+//!
+//! Allocate `size` bytes by `VirtualAllocEx` near `hint`, `nullptr` if there
+//! is no free region in reach.
+static LPVOID vMemVirtualAllocNear(HANDLE hProcess, size_t size, DWORD allocFlags, DWORD protectFlags, const void* hint, size_t granularity) noexcept {
+  for (uint32_t i = 0; i < kVMemNearProbeCount; i++) {
+    uintptr_t candidate = vMemGetNearCandidate(hint, size, granularity, i);
+    if (candidate == 0)
+      continue;
+
+    LPVOID p = ::VirtualAllocEx(hProcess, (LPVOID)candidate, size, allocFlags, protectFlags);
+    if (p == nullptr)
+      continue;
+
+    if (vMemIsNear(p, size, hint))
+      return p;
+    ::VirtualFreeEx(hProcess, p, 0, MEM_RELEASE);
+  }
+
+  return nullptr;
 }
 
-void* VMemUtil::allocProcessMemory(HANDLE hProcess, size_t length, size_t* allocated, uint32_t flags) noexcept {
+void* VMemUtil::allocProcessMemory(HANDLE hProcess, size_t length, size_t* allocated, uint32_t flags, const void* hint) noexcept {
   if (length == 0)
     return nullptr;
 
@@ -128,7 +217,29 @@ void* VMemUtil::allocProcessMemory(HANDLE hProcess, size_t length, size_t* alloc
   else
     protectFlags |= (flags & kVMemFlagWritable) ? PAGE_READWRITE : PAGE_READONLY;
 
-  LPVOID mBase = ::VirtualAllocEx(hProcess, nullptr, mSize, MEM_COMMIT | MEM_RESERVE, protectFlags);
+  LPVOID mBase = nullptr;
+
+  // Large pages fail without `SeLockMemoryPrivilege`, use regular pages then.
+  if (flags & kVMemFlagHugePages) {
+    size_t hSize = Utils::alignTo(length, vMem.hugePageSize);
+    DWORD allocFlags = MEM_COMMIT | MEM_RESERVE | MEM_LARGE_PAGES;
+
+    if (hint != nullptr)
+      mBase = vMemVirtualAllocNear(hProcess, hSize, allocFlags, protectFlags, hint, vMem.hugePageSize);
+
+    if (mBase == nullptr)
+      mBase = ::VirtualAllocEx(hProcess, nullptr, hSize, allocFlags, protectFlags);
+
+    if (mBase != nullptr)
+      mSize = hSize;
+  }
+
+  if (mBase == nullptr && hint != nullptr)
+    mBase = vMemVirtualAllocNear(hProcess, mSize, MEM_COMMIT | MEM_RESERVE, protectFlags, hint, vMem.pageGranularity);
+
+  if (mBase == nullptr)
+    mBase = ::VirtualAllocEx(hProcess, nullptr, mSize, MEM_COMMIT | MEM_RESERVE, protectFlags);
+
   if (mBase == nullptr)
     return nullptr;
 
@@ -150,6 +261,62 @@ Error VMemUtil::releaseProcessMemory(HANDLE hProcess, void* addr, size_t /* leng
     return kErrorInvalidState;
   return kErrorOk;
 }
+
+void* VMemUtil::allocDualMapping(size_t length, size_t* allocated, void** rwPtr, const void* hint) noexcept {
+  if (length == 0)
+    return nullptr;
+
+  const VMemLocal& vMem = vMemGet();
+  size_t mSize = Utils::alignTo(length, vMem.pageGranularity);
+
+  DWORD sizeHi = static_cast<DWORD>((static_cast<uint64_t>(mSize) >> 32) & 0xFFFFFFFFU);
+  DWORD sizeLo = static_cast<DWORD>(mSize & 0xFFFFFFFFU);
+
+  HANDLE hMapping = ::CreateFileMappingW(INVALID_HANDLE_VALUE, nullptr, PAGE_EXECUTE_READWRITE, sizeHi, sizeLo, nullptr);
+  if (hMapping == nullptr)
+    return nullptr;
+
+  void* rx = nullptr;
+
+  if (hint != nullptr) {
+    for (uint32_t i = 0; i < kVMemNearProbeCount && rx == nullptr; i++) {
+      uintptr_t candidate = vMemGetNearCandidate(hint, mSize, vMem.pageGranularity, i);
+      if (candidate == 0)
+        continue;
+
+      rx = ::MapViewOfFileEx(hMapping, FILE_MAP_READ | FILE_MAP_EXECUTE, 0, 0, mSize, (LPVOID)candidate);
+      if (rx != nullptr && !vMemIsNear(rx, mSize, hint)) {
+        ::UnmapViewOfFile(rx);
+        rx = nullptr;
+      }
+    }
+  }
+
+  if (rx == nullptr)
+    rx = ::MapViewOfFile(hMapping, FILE_MAP_READ | FILE_MAP_EXECUTE, 0, 0, mSize);
+  void* rw = ::MapViewOfFile(hMapping, FILE_MAP_READ | FILE_MAP_WRITE, 0, 0, mSize);
+
+  // Views keep the mapping object alive, the handle is not needed anymore.
+  ::CloseHandle(hMapping);
+
+  if (rx == nullptr || rw == nullptr) {
+    if (rx) ::UnmapViewOfFile(rx);
+    if (rw) ::UnmapViewOfFile(rw);
+    return nullptr;
+  }
+
+  if (allocated != nullptr)
+    *allocated = mSize;
+
+  *rwPtr = rw;
+  return rx;
+}
+
+Error VMemUtil::releaseDualMapping(void* rxPtr, void* rwPtr, size_t /* length */) noexcept {
+  bool ok = ::UnmapViewOfFile(rxPtr) != 0;
+  ok &= ::UnmapViewOfFile(rwPtr) != 0;
+  return ok ? kErrorOk : kErrorInvalidState;
+}
 #endif // ASMJIT_OS_WINDOWS
 
 // ============================================================================
@@ -167,6 +334,7 @@ Error VMemUtil::releaseProcessMemory(HANDLE hProcess, void* addr, size_t /* leng
 struct VMemLocal {
   size_t pageSize;
   size_t pageGranularity;
+  size_t hugePageSize;
 };
 static VMemLocal vMemLocal;
 
@@ -177,6 +345,7 @@ static const VMemLocal& vMemGet() noexcept {
     size_t pageSize = ::getpagesize();
     vMem.pageSize = pageSize;
     vMem.pageGranularity = Utils::iMax<size_t>(pageSize, 65536);
+    vMem.hugePageSize = Utils::iMax<size_t>(pageSize, 2 * 1024 * 1024);
   }
 
   return vMem;
@@ -192,7 +361,96 @@ size_t VMemUtil::getPageGranularity() noexcept {
   return vMem.pageGranularity;
 }
 
-void* VMemUtil::alloc(size_t length, size_t* allocated, uint32_t flags) noexcept {
+size_t VMemUtil::getHugePageSize() noexcept {
+  const VMemLocal& vMem = vMemGet();
+  return vMem.hugePageSize;
+}
+
+//! \internal
+//!
+//! Map `msize` bytes near `hint`, `MAP_FAILED` if there is no free region in
+//! reach. `MAP_FIXED_NOREPLACE` makes `mmap()` fail instead of using another
+//! address if the probed one is not free, the result is checked anyway as
+//! older kernels ignore it.
+static void* vMemMapNear(size_t msize, int protection, int flags, int fd, const void* hint) noexcept {
+  const VMemLocal& vMem = vMemGet();
+
+#if defined(MAP_FIXED_NOREPLACE)
+  flags |= MAP_FIXED_NOREPLACE;
+#endif // MAP_FIXED_NOREPLACE
+
+  for (uint32_t i = 0; i < kVMemNearProbeCount; i++) {
+    uintptr_t candidate = vMemGetNearCandidate(hint, msize, vMem.pageGranularity, i);
+    if (candidate == 0)
+      continue;
+
+    void* p = ::mmap((void*)candidate, msize, protection, flags, fd, 0);
+    if (p == MAP_FAILED)
+      continue;
+
+    if (vMemIsNear(p, msize, hint))
+      return p;
+    ::munmap(p, msize);
+  }
+
+  return MAP_FAILED;
+}
+
+//! \internal
+//!
+//! Allocate memory aligned to a huge page, which is backed by huge pages if
+//! the system has them preallocated (`MAP_HUGETLB`) or if it supports
+//! transparent huge pages (`MADV_HUGEPAGE`).
+static void* vMemAllocHugePages(size_t length, size_t* allocated, int protection, const void* hint) noexcept {
+  const VMemLocal& vMem = vMemGet();
+  size_t hugePageSize = vMem.hugePageSize;
+  size_t msize = Utils::alignTo<size_t>(length, hugePageSize);
+
+#if defined(MAP_HUGETLB)
+  // Preallocated huge pages are only probed without a hint, near placement
+  // is preferred over them.
+  if (hint == nullptr) {
+    void* hbase = ::mmap(nullptr, msize, protection, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (hbase != MAP_FAILED) {
+      if (allocated != nullptr)
+        *allocated = msize;
+      return hbase;
+    }
+  }
+#endif // MAP_HUGETLB
+
+  // Reserve one more huge page and unmap the unaligned head and tail.
+  size_t rsize = msize + hugePageSize;
+  void* rbase = MAP_FAILED;
+
+  if (hint != nullptr)
+    rbase = vMemMapNear(rsize, protection, MAP_PRIVATE | MAP_ANONYMOUS, -1, hint);
+
+  if (rbase == MAP_FAILED)
+    rbase = ::mmap(nullptr, rsize, protection, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+  if (rbase == MAP_FAILED)
+    return nullptr;
+
+  uint8_t* mbase = reinterpret_cast<uint8_t*>(
+    Utils::alignTo<uintptr_t>((uintptr_t)rbase, hugePageSize));
+
+  size_t head = (size_t)(mbase - static_cast<uint8_t*>(rbase));
+  size_t tail = rsize - head - msize;
+
+  if (head != 0) ::munmap(rbase, head);
+  if (tail != 0) ::munmap(mbase + msize, tail);
+
+#if defined(MADV_HUGEPAGE)
+  ::madvise(mbase, msize, MADV_HUGEPAGE);
+#endif // MADV_HUGEPAGE
+
+  if (allocated != nullptr)
+    *allocated = msize;
+  return mbase;
+}
+
+void* VMemUtil::alloc(size_t length, size_t* allocated, uint32_t flags, const void* hint) noexcept {
   const VMemLocal& vMem = vMemGet();
   size_t msize = Utils::alignTo<size_t>(length, vMem.pageSize);
   int protection = PROT_READ;
@@ -200,7 +458,16 @@ void* VMemUtil::alloc(size_t length, size_t* allocated, uint32_t flags) noexcept
   if (flags & kVMemFlagWritable  ) protection |= PROT_WRITE;
   if (flags & kVMemFlagExecutable) protection |= PROT_EXEC;
 
-  void* mbase = ::mmap(nullptr, msize, protection, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (flags & kVMemFlagHugePages)
+    return vMemAllocHugePages(length, allocated, protection, hint);
+
+  void* mbase = MAP_FAILED;
+  if (hint != nullptr)
+    mbase = vMemMapNear(msize, protection, MAP_PRIVATE | MAP_ANONYMOUS, -1, hint);
+
+  if (mbase == MAP_FAILED)
+    mbase = ::mmap(nullptr, msize, protection, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
   if (mbase == MAP_FAILED)
     return nullptr;
 
@@ -215,6 +482,85 @@ Error VMemUtil::release(void* addr, size_t length) noexcept {
 
   return kErrorOk;
 }
+
+//! \internal
+//!
+//! Create an anonymous file descriptor that can be mapped, -1 on failure.
+static int vMemOpenAnonymousFile() noexcept {
+#if ASMJIT_OS_LINUX && defined(__NR_memfd_create)
+  // Use `memfd_create()` through `syscall()` as older C libraries don't have
+  // a wrapper for it. If the kernel doesn't support it use `shm_open()`.
+  int fd = static_cast<int>(::syscall(__NR_memfd_create, "asmjit", 1 /* MFD_CLOEXEC */));
+  if (fd >= 0)
+    return fd;
+#endif // ASMJIT_OS_LINUX && __NR_memfd_create
+
+  static volatile uint32_t vMemShmCounter;
+
+  for (uint32_t attempt = 0; attempt < 16; attempt++) {
+    char name[64];
+    uint32_t counter = vMemShmCounter++;
+
+    snprintf(name, ASMJIT_ARRAY_SIZE(name), "/asmjit-%u-%u-%u",
+      static_cast<unsigned int>(::getpid()),
+      static_cast<unsigned int>(counter),
+      static_cast<unsigned int>(attempt));
+
+    int fd = ::shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd >= 0) {
+      // Unlink immediately, the file lives as long as it's open or mapped.
+      ::shm_unlink(name);
+      return fd;
+    }
+  }
+
+  return -1;
+}
+
+void* VMemUtil::allocDualMapping(size_t length, size_t* allocated, void** rwPtr, const void* hint) noexcept {
+  if (length == 0)
+    return nullptr;
+
+  const VMemLocal& vMem = vMemGet();
+  size_t msize = Utils::alignTo<size_t>(length, vMem.pageSize);
+
+  int fd = vMemOpenAnonymousFile();
+  if (fd < 0)
+    return nullptr;
+
+  void* rx = MAP_FAILED;
+  void* rw = MAP_FAILED;
+
+  if (::ftruncate(fd, static_cast<off_t>(msize)) == 0) {
+    if (hint != nullptr)
+      rx = vMemMapNear(msize, PROT_READ | PROT_EXEC, MAP_SHARED, fd, hint);
+
+    if (rx == MAP_FAILED)
+      rx = ::mmap(nullptr, msize, PROT_READ | PROT_EXEC, MAP_SHARED, fd, 0);
+    rw = ::mmap(nullptr, msize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  }
+
+  // Mappings keep the file alive, the descriptor is not needed anymore.
+  ::close(fd);
+
+  if (rx == MAP_FAILED || rw == MAP_FAILED) {
+    if (rx != MAP_FAILED) ::munmap(rx, msize);
+    if (rw != MAP_FAILED) ::munmap(rw, msize);
+    return nullptr;
+  }
+
+  if (allocated != nullptr)
+    *allocated = msize;
+
+  *rwPtr = rw;
+  return rx;
+}
+
+Error VMemUtil::releaseDualMapping(void* rxPtr, void* rwPtr, size_t length) noexcept {
+  bool ok = ::munmap(rxPtr, length) == 0;
+  ok &= ::munmap(rwPtr, length) == 0;
+  return ok ? kErrorOk : kErrorInvalidState;
+}
 #endif // ASMJIT_OS_POSIX
 
 // ============================================================================
@@ -266,6 +612,11 @@ static void _SetBits(size_t* buf, size_t index, size_t len) noexcept {
 typedef VMemMgr::RbNode RbNode;
 typedef VMemMgr::MemNode MemNode;
 typedef VMemMgr::PermanentNode PermanentNode;
+typedef VMemMgr::ThreadCache ThreadCache;
+typedef VMemMgr::CacheTable CacheTable;
+typedef VMemMgr::HugeRegion HugeRegion;
+typedef VMemMgr::Slab Slab;
+typedef VMemMgr::SlabHeap SlabHeap;
 
 // ============================================================================
 // [asmjit::VMemMgr::RbNode]
@@ -371,6 +722,7 @@ struct VMemMgr::MemNode : public RbNode {
 
     baUsed = other->baUsed;
     baCont = other->baCont;
+    rwDelta = other->rwDelta;
   }
 
   // --------------------------------------------------------------------------
@@ -388,6 +740,7 @@ struct VMemMgr::MemNode : public RbNode {
 
   size_t* baUsed;        // Contains bits about used blocks       (0 = unused, 1 = used).
   size_t* baCont;        // Contains bits about continuous blocks (0 = stop  , 1 = continue).
+  intptr_t rwDelta;      // Difference between RW and RX address (dual mapping).
 };
 
 // ============================================================================
@@ -415,504 +768,1689 @@ struct VMemMgr::PermanentNode {
   uint8_t* mem;          // Base pointer (virtual memory address).
   size_t size;           // Count of bytes allocated.
   size_t used;           // Count of bytes used.
+  intptr_t rwDelta;      // Difference between RW and RX address (dual mapping).
 };
 
 // ============================================================================
-// [asmjit::VMemMgr - Private]
+// [asmjit::VMemMgr::HugeRegion]
 // ============================================================================
 
+//! \internal
+enum {
+  //! Count of slots each `HugeRegion` is divided to.
+  kHugeRegionSlotCount = 32
+};
+
 //! \internal
 //!
-//! Helper to avoid `#ifdef`s in the code.
-ASMJIT_INLINE uint8_t* vMemMgrAllocVMem(VMemMgr* self, size_t size, size_t* vSize) noexcept {
-  uint32_t flags = kVMemFlagWritable | kVMemFlagExecutable;
-#if !ASMJIT_OS_WINDOWS
-  return static_cast<uint8_t*>(VMemUtil::alloc(size, vSize, flags));
-#else
-  return static_cast<uint8_t*>(VMemUtil::allocProcessMemory(self->_hProcess, size, vSize, flags));
-#endif
-}
+//! Huge region.
+//!
+//! Memory allocated with `kVMemFlagHugePages`, which is divided into slots of
+//! the same size. Memory of both freeable and permanent nodes is carved out
+//! of continuous slots.
+struct VMemMgr::HugeRegion {
+  HugeRegion* next;      // Next region in list.
+  uint8_t* mem;          // Base pointer (virtual memory address).
+  size_t size;           // Count of bytes allocated.
+  size_t slotSize;       // Count of bytes of a single slot.
+  intptr_t rwDelta;      // Difference between RW and RX address (dual mapping).
+  uint32_t usedSlots;    // Bit-mask of used slots.
+  uint32_t permSlots;    // Bit-mask of slots used by permanent nodes.
+};
 
 //! \internal
 //!
-//! Helper to avoid `#ifdef`s in the code.
-ASMJIT_INLINE Error vMemMgrReleaseVMem(VMemMgr* self, void* p, size_t vSize) noexcept {
-#if !ASMJIT_OS_WINDOWS
-  return VMemUtil::release(p, vSize);
-#else
-  return VMemUtil::releaseProcessMemory(self->_hProcess, p, vSize);
-#endif
+//! Get a bit-mask of `count` slots starting at `index`.
+static ASMJIT_INLINE uint32_t vMemMgrSlotMask(uint32_t index, uint32_t count) noexcept {
+  uint32_t mask = count >= kHugeRegionSlotCount ? ~static_cast<uint32_t>(0) : (static_cast<uint32_t>(1) << count) - 1;
+  return mask << index;
 }
 
+// ============================================================================
+// [asmjit::VMemMgr::ThreadCache]
+// ============================================================================
+
+//! \internal
+enum {
+  //! Count of size classes cached by `ThreadCache`.
+  kThreadCacheClassCount = 8,
+  //! The largest allocation that can be served by `ThreadCache`.
+  kThreadCacheMaxSize = 1024,
+  //! Maximum count of blocks cached per size class.
+  kThreadCacheBinCapacity = 32,
+  //! How many bytes to take from the shared nodes per refill (per class).
+  kThreadCacheRefillSize = 4096,
+  //! Maximum count of releases kept by `ThreadCache` before they are returned.
+  kThreadCachePendingCapacity = 64
+};
+
 //! \internal
 //!
-//! Check whether the Red-Black tree is valid.
-static bool vMemMgrCheckTree(VMemMgr* self) noexcept {
-  return rbAssert(self->_root) > 0;
-}
+//! Size of each class, all sizes have to be multiples of `_blockDensity`.
+static const uint32_t vMemMgrThreadCacheClassSize[kThreadCacheClassCount] = {
+  64, 128, 192, 256, 384, 512, 768, 1024
+};
 
 //! \internal
 //!
-//! Alloc virtual memory including a heap memory needed for `MemNode` data.
+//! Thread cache.
 //!
-//! Returns set-up `MemNode*` or nullptr if allocation failed.
-static MemNode* vMemMgrCreateNode(VMemMgr* self, size_t size, size_t density) noexcept {
-  size_t vSize;
-  uint8_t* vmem = vMemMgrAllocVMem(self, size, &vSize);
+//! Each thread has its own cache, which is only accessed by the thread that
+//! owns it. Allocations from the cache and releases of cached blocks don't
+//! need the shared `_lock`, it's only required when the cache is refilled,
+//! when pending releases are returned (in one batch), and when the cache is
+//! registered or unregistered.
+struct VMemMgr::ThreadCache {
+  // --------------------------------------------------------------------------
+  // [Bin]
+  // --------------------------------------------------------------------------
 
-  // Out of memory.
-  if (vmem == nullptr)
-    return nullptr;
+  //! Blocks of the same size class, allocated in shared nodes.
+  struct Bin {
+    uint32_t count;
+    void* data[kThreadCacheBinCapacity];
+    intptr_t rwDelta[kThreadCacheBinCapacity];
+    uint32_t slot[kThreadCacheBinCapacity];
+  };
 
-  size_t blocks = (vSize / density);
-  size_t bsize = (((blocks + 7) >> 3) + sizeof(size_t) - 1) & ~(size_t)(sizeof(size_t) - 1);
+  // --------------------------------------------------------------------------
+  // [Members]
+  // --------------------------------------------------------------------------
 
-  MemNode* node = static_cast<MemNode*>(ASMJIT_ALLOC(sizeof(MemNode)));
-  uint8_t* data = static_cast<uint8_t*>(ASMJIT_ALLOC(bsize * 2));
+  VMemMgr* mgr;          // Memory manager that owns this cache.
+  ThreadCache* prev;     // Prev cache in list.
+  ThreadCache* next;     // Next cache in list.
 
-  // Out of memory.
-  if (node == nullptr || data == nullptr) {
-    vMemMgrReleaseVMem(self, vmem, vSize);
-    if (node) ASMJIT_FREE(node);
-    if (data) ASMJIT_FREE(data);
-    return nullptr;
-  }
+  uint32_t pendingCount; // Count of releases not returned yet.
+  void* pending[kThreadCachePendingCapacity];
+  uint32_t pendingSlot[kThreadCachePendingCapacity];
 
-  // Initialize RbNode data.
-  node->node[0] = nullptr;
-  node->node[1] = nullptr;
-  node->mem = vmem;
-  node->red = 1;
+  Bin bins[kThreadCacheClassCount];
+};
 
-  // Initialize MemNode data.
-  node->prev = nullptr;
-  node->next = nullptr;
+// ============================================================================
+// [asmjit::VMemMgr::CacheTable]
+// ============================================================================
 
-  node->size = vSize;
-  node->used = 0;
-  node->blocks = blocks;
-  node->density = density;
-  node->largestBlock = vSize;
+//! \internal
+enum {
+  //! Count of blocks tracked by `CacheTable` (must be a power of 2).
+  kCacheTableSize = 4096,
+  //! Count of `CacheTable` slots probed per block.
+  kCacheTableMaxProbe = 16
+};
 
-  ::memset(data, 0, bsize * 2);
-  node->baUsed = reinterpret_cast<size_t*>(data);
-  node->baCont = reinterpret_cast<size_t*>(data + bsize);
+//! \internal
+//!
+//! State of a block tracked by `CacheTable`, stored in the low bits of its
+//! address (all blocks are aligned to `_blockDensity`, which is 64).
+enum {
+  //! Block is in a bin of a thread cache.
+  kCacheStateBinned = 1,
+  //! Block was allocated from a thread cache and not released yet.
+  kCacheStateUsed = 2,
+  //! Block was released and waits in a thread cache to be returned.
+  kCacheStatePending = 3,
+  //! Mask of the state.
+  kCacheStateMask = 7,
+  //! Slot that was used by a block, which is not tracked anymore.
+  kCacheSlotRemoved = kCacheStateMask
+};
 
-  return node;
-}
+//! \internal
+//!
+//! Blocks of all thread caches.
+//!
+//! Each block refilled into a thread cache gets a slot that holds its address
+//! and its state in a single word, which is changed atomically. Slots are only
+//! assigned under `_lock`, but looked up by any thread without it. A release
+//! changes the state from `kCacheStateUsed` to `kCacheStatePending`, so the
+//! second release of the same block fails regardless of the thread that did
+//! the first one.
+struct VMemMgr::CacheTable {
+  uintptr_t slots[kCacheTableSize];  // Address and state, zero if empty.
+  intptr_t rwDelta[kCacheTableSize]; // Difference between RW and RX address.
+  uint8_t classId[kCacheTableSize];  // Size class of the block.
+};
 
-static void vMemMgrInsertNode(VMemMgr* self, MemNode* node) noexcept {
-  if (self->_root == nullptr) {
-    // Empty tree case.
-    self->_root = node;
-  }
-  else {
-    // False tree root.
-    RbNode head = { { nullptr, nullptr }, 0, 0 };
+// ============================================================================
+// [asmjit::VMemMgr::Slab]
+// ============================================================================
 
-    // Grandparent & parent.
-    RbNode* g = nullptr;
-    RbNode* t = &head;
+//! \internal
+enum {
+  //! Count of slab size classes.
+  kSlabClassCount = 12,
+  //! The largest allocation that can be served by slabs.
+  kSlabMaxSize = 4096,
+  //! Size of memory used by a single slab.
+  kSlabSize = 65536,
+  //! Maximum count of blocks of a single slab (blocks of the smallest class).
+  kSlabMaxBlockCount = kSlabSize / 64,
+  //! Slabs are found by a hash table of `kSlabSize` windows (a slab spans two
+  //! windows at most as it's not aligned to its size).
+  kSlabWindowShift = 16,
+  //! Initial count of hash table buckets.
+  kSlabInitialBuckets = 64
+};
 
-    // Iterator & parent.
-    RbNode* p = nullptr;
-    RbNode* q = t->node[1] = self->_root;
+//! \internal
+//!
+//! Size of each class, all sizes have to be multiples of `_blockDensity`.
+static const uint32_t vMemMgrSlabClassSize[kSlabClassCount] = {
+  64, 128, 192, 256, 384, 512, 768, 1024, 1536, 2048, 3072, 4096
+};
 
-    int dir = 0;
-    int last = 0; // Not needed to initialize, but makes some tools happy.
+//! \internal
+//!
+//! Slab class of a size, indexed by `(size - 1) / 64`.
+static const uint8_t vMemMgrSlabClassMap[kSlabMaxSize / 64] = {
+  0 , 1 , 2 , 3 , 4 , 4 , 5 , 5 , 6 , 6 , 6 , 6 , 7 , 7 , 7 , 7 ,
+  8 , 8 , 8 , 8 , 8 , 8 , 8 , 8 , 9 , 9 , 9 , 9 , 9 , 9 , 9 , 9 ,
+  10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10,
+  11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11
+};
 
-    // Search down the tree.
-    for (;;) {
-      if (q == nullptr) {
-        // Insert new node at the bottom.
-        q = node;
-        p->node[dir] = node;
-      }
-      else if (rbIsRed(q->node[0]) && rbIsRed(q->node[1])) {
-        // Color flip.
-        q->red = 1;
-        q->node[0]->red = 0;
-        q->node[1]->red = 0;
-      }
+//! \internal
+//!
+//! Slab.
+//!
+//! Memory divided into blocks of the same size class. Indexes of free blocks
+//! are kept in a stack that follows the `Slab` header, so both allocation and
+//! release are O(1) and the executable memory is never used to store links.
+//! The `baUsed` bitmap marks allocated blocks so a release of a free block is
+//! rejected instead of pushing its index to the stack twice.
+struct VMemMgr::Slab {
+  //! Hash table link.
+  struct Link {
+    Link* next;          // Next link in bucket.
+    Slab* slab;          // Slab that owns this link.
+    uintptr_t key;       // Window index (address >> kSlabWindowShift).
+  };
+
+  Link links[2];         // Links of windows this slab spans.
+  Slab* prev;            // Prev slab in list (partial or full).
+  Slab* next;            // Next slab in list (partial or full).
 
-      // Fix red violation.
-      if (rbIsRed(q) && rbIsRed(p)) {
-        int dir2 = t->node[1] == g;
-        t->node[dir2] = q == p->node[last] ? rbRotateSingle(g, !last) : rbRotateDouble(g, !last);
-      }
+  uint8_t* mem;          // Base pointer (virtual memory address).
+  size_t vSize;          // Count of bytes allocated (virtual memory).
+  intptr_t rwDelta;      // Difference between RW and RX address (dual mapping).
 
-      // Stop if found.
-      if (q == node)
-        break;
+  uint32_t classId;      // Size class.
+  uint32_t blockSize;    // Size of a single block.
+  uint32_t blockCount;   // Count of blocks.
+  uint32_t freeCount;    // Count of free blocks.
 
-      last = dir;
-      dir = q->mem < node->mem;
+  size_t baUsed[kSlabMaxBlockCount / kBitsPerEntity];
 
-      // Update helpers.
-      if (g != nullptr)
-        t = g;
+  uint32_t freeStack[1]; // Indexes of free blocks (`blockCount` entries).
+};
 
-      g = p;
-      p = q;
-      q = q->node[dir];
-    }
+//! \internal
+//!
+//! Slab heap, holds all slabs of `VMemMgr` and the hash table to find them.
+struct VMemMgr::SlabHeap {
+  Slab* partial[kSlabClassCount]; // Slabs having at least one free block.
+  Slab* full[kSlabClassCount];    // Slabs having no free block.
+
+  Slab::Link** buckets;  // Hash table buckets.
+  uint32_t bucketCount;  // Count of buckets (power of 2).
+  uint32_t linkCount;    // Count of links in hash table.
+
+  size_t slabCount;      // Count of slabs.
+  size_t slabBytes;      // How many bytes are allocated by slabs.
+  size_t slabUsedBytes;  // How many bytes are used by blocks.
+};
 
-    // Update root.
-    self->_root = static_cast<MemNode*>(head.node[1]);
-  }
+// ============================================================================
+// [asmjit::VMemMgr - Private]
+// ============================================================================
 
-  // Make root black.
-  self->_root->red = 0;
+//! \internal
+//!
+//! Helper to avoid `#ifdef`s in the code.
+ASMJIT_INLINE uint8_t* vMemMgrAllocVMem(VMemMgr* self, size_t size, size_t* vSize, intptr_t* rwDelta, uint32_t flags) noexcept {
+  *rwDelta = 0;
 
-  // Link with others.
-  node->prev = self->_last;
+  if (self->hasOption(kVMemMgrOptionDualMapping)) {
+    void* rw;
+    void* rx = VMemUtil::allocDualMapping(size, vSize, &rw, self->_addressHint);
 
-  if (self->_first == nullptr) {
-    self->_first = node;
-    self->_last = node;
-    self->_optimal = node;
-  }
-  else {
-    node->prev = self->_last;
-    self->_last->next = node;
-    self->_last = node;
+    if (rx != nullptr)
+      *rwDelta = static_cast<intptr_t>((uintptr_t)rw - (uintptr_t)rx);
+    return static_cast<uint8_t*>(rx);
   }
+
+  flags |= kVMemFlagWritable | kVMemFlagExecutable;
+#if !ASMJIT_OS_WINDOWS
+  return static_cast<uint8_t*>(VMemUtil::alloc(size, vSize, flags, self->_addressHint));
+#else
+  return static_cast<uint8_t*>(VMemUtil::allocProcessMemory(self->_hProcess, size, vSize, flags, self->_addressHint));
+#endif
 }
 
 //! \internal
 //!
-//! Remove node from Red-Black tree.
+//! Helper to avoid `#ifdef`s in the code.
+ASMJIT_INLINE Error vMemMgrReleaseVMem(VMemMgr* self, void* p, size_t vSize, intptr_t rwDelta) noexcept {
+  if (self->hasOption(kVMemMgrOptionDualMapping))
+    return VMemUtil::releaseDualMapping(p, (void*)((uintptr_t)p + (uintptr_t)rwDelta), vSize);
+
+#if !ASMJIT_OS_WINDOWS
+  return VMemUtil::release(p, vSize);
+#else
+  return VMemUtil::releaseProcessMemory(self->_hProcess, p, vSize);
+#endif
+}
+
+//! \internal
 //!
-//! Returns node that should be freed, but it doesn't have to be necessarily
-//! the `node` passed.
-static MemNode* vMemMgrRemoveNode(VMemMgr* self, MemNode* node) noexcept {
-  // False tree root.
-  RbNode head = { { nullptr, nullptr }, 0, 0 };
+//! Allocate virtual memory of a node, which is carved out of a huge region if
+//! `kVMemMgrOptionHugePages` is enabled.
+static uint8_t* vMemMgrAllocChunk(VMemMgr* self, size_t size, size_t* vSize, intptr_t* rwDelta, bool permanent) noexcept {
+  if (!self->hasOption(kVMemMgrOptionHugePages))
+    return vMemMgrAllocVMem(self, size, vSize, rwDelta, 0);
+
+  HugeRegion* region = self->_hugeRegions;
+  uint32_t index = 0;
+  uint32_t count = 0;
+
+  // Try to find continuous slots in existing regions.
+  while (region != nullptr) {
+    size_t slotCount = (size + region->slotSize - 1) / region->slotSize;
+
+    if (slotCount <= kHugeRegionSlotCount) {
+      count = static_cast<uint32_t>(slotCount);
+      for (index = 0; index + count <= kHugeRegionSlotCount; index++) {
+        if ((region->usedSlots & vMemMgrSlotMask(index, count)) == 0)
+          goto _Found;
+      }
+    }
 
-  // Helpers.
-  RbNode* q = &head;
-  RbNode* p = nullptr;
-  RbNode* g = nullptr;
+    region = region->next;
+  }
 
-  // Found item.
-  RbNode* f = nullptr;
-  int dir = 1;
+  // Or allocate a new region, large enough to hold `size`.
+  region = static_cast<HugeRegion*>(ASMJIT_ALLOC(sizeof(HugeRegion)));
+  if (region == nullptr)
+    return nullptr;
 
-  // Set up.
-  q->node[1] = self->_root;
+  region->mem = vMemMgrAllocVMem(self,
+    Utils::alignTo<size_t>(size, VMemUtil::getHugePageSize()),
+    &region->size, &region->rwDelta, kVMemFlagHugePages);
 
-  // Search and push a red down.
-  while (q->node[dir] != nullptr) {
-    int last = dir;
+  if (region->mem == nullptr) {
+    ASMJIT_FREE(region);
+    return nullptr;
+  }
 
-    // Update helpers.
-    g = p;
-    p = q;
-    q = q->node[dir];
-    dir = q->mem < node->mem;
+  region->slotSize = region->size / kHugeRegionSlotCount;
+  region->usedSlots = 0;
+  region->permSlots = 0;
 
-    // Save found node.
-    if (q == node)
-      f = q;
+  region->next = self->_hugeRegions;
+  self->_hugeRegions = region;
 
-    // Push the red node down.
-    if (!rbIsRed(q) && !rbIsRed(q->node[dir])) {
-      if (rbIsRed(q->node[!dir])) {
-        p = p->node[last] = rbRotateSingle(q, dir);
-      }
-      else if (!rbIsRed(q->node[!dir])) {
-        RbNode* s = p->node[!last];
+  index = 0;
+  count = static_cast<uint32_t>((size + region->slotSize - 1) / region->slotSize);
 
-        if (s != nullptr) {
-          if (!rbIsRed(s->node[!last]) && !rbIsRed(s->node[last])) {
-            // Color flip.
-            p->red = 0;
-            s->red = 1;
-            q->red = 1;
-          }
-          else {
-            int dir2 = g->node[1] == p;
+_Found:
+  {
+    uint32_t mask = vMemMgrSlotMask(index, count);
 
-            if (rbIsRed(s->node[last]))
-              g->node[dir2] = rbRotateDouble(p, last);
-            else if (rbIsRed(s->node[!last]))
-              g->node[dir2] = rbRotateSingle(p, last);
+    region->usedSlots |= mask;
+    if (permanent)
+      region->permSlots |= mask;
+  }
 
-            // Ensure correct coloring.
-            q->red = g->node[dir2]->red = 1;
-            g->node[dir2]->node[0]->red = 0;
-            g->node[dir2]->node[1]->red = 0;
-          }
-        }
-      }
+  *vSize = count * region->slotSize;
+  *rwDelta = region->rwDelta;
+  return region->mem + index * region->slotSize;
+}
+
+//! \internal
+//!
+//! Release virtual memory of a node allocated by `vMemMgrAllocChunk()`. The
+//! huge region is released when none of its slots is used.
+static Error vMemMgrReleaseChunk(VMemMgr* self, uint8_t* mem, size_t vSize, intptr_t rwDelta) noexcept {
+  if (!self->hasOption(kVMemMgrOptionHugePages))
+    return vMemMgrReleaseVMem(self, mem, vSize, rwDelta);
+
+  HugeRegion** pPrev = &self->_hugeRegions;
+  HugeRegion* region;
+
+  while ((region = *pPrev) != nullptr) {
+    if (mem >= region->mem && mem < region->mem + region->size) {
+      uint32_t index = static_cast<uint32_t>((size_t)(mem - region->mem) / region->slotSize);
+      uint32_t count = static_cast<uint32_t>(vSize / region->slotSize);
+
+      region->usedSlots &= ~vMemMgrSlotMask(index, count);
+      if (region->usedSlots != 0)
+        return kErrorOk;
+
+      *pPrev = region->next;
+      Error err = vMemMgrReleaseVMem(self, region->mem, region->size, region->rwDelta);
+
+      ASMJIT_FREE(region);
+      return err;
     }
+
+    pPrev = &region->next;
   }
 
-  // Replace and remove.
-  ASMJIT_ASSERT(f != nullptr);
-  ASMJIT_ASSERT(f != &head);
-  ASMJIT_ASSERT(q != &head);
+  return kErrorInvalidArgument;
+}
 
-  if (f != q) {
-    ASMJIT_ASSERT(f != &head);
-    static_cast<MemNode*>(f)->fillData(static_cast<MemNode*>(q));
-  }
+//! \internal
+//!
+//! Get the slab class of `size`, which must be `kSlabMaxSize` or less.
+static ASMJIT_INLINE uint32_t vMemMgrGetSlabClass(size_t size) noexcept {
+  return vMemMgrSlabClassMap[(size - 1) / 64];
+}
 
-  p->node[p->node[1] == q] = q->node[q->node[0] == nullptr];
+static ASMJIT_INLINE void vMemMgrSlabListInsert(Slab** pList, Slab* slab) noexcept {
+  Slab* next = *pList;
 
-  // Update root and make it black.
-  self->_root = static_cast<MemNode*>(head.node[1]);
-  if (self->_root != nullptr)
-    self->_root->red = 0;
+  slab->prev = nullptr;
+  slab->next = next;
 
-  // Unlink.
-  MemNode* next = static_cast<MemNode*>(q)->next;
-  MemNode* prev = static_cast<MemNode*>(q)->prev;
+  if (next)
+    next->prev = slab;
+  *pList = slab;
+}
+
+static ASMJIT_INLINE void vMemMgrSlabListRemove(Slab** pList, Slab* slab) noexcept {
+  Slab* prev = slab->prev;
+  Slab* next = slab->next;
 
   if (prev)
     prev->next = next;
   else
-    self->_first = next;
+    *pList = next;
 
   if (next)
     next->prev = prev;
-  else
-    self->_last  = prev;
+}
 
-  if (self->_optimal == q)
-    self->_optimal = prev ? prev : next;
+//! \internal
+//!
+//! Double the count of hash table buckets.
+static bool vMemMgrSlabTableGrow(SlabHeap* heap) noexcept {
+  uint32_t oldCount = heap->bucketCount;
+  uint32_t newCount = oldCount ? oldCount * 2 : static_cast<uint32_t>(kSlabInitialBuckets);
+
+  Slab::Link** newBuckets = static_cast<Slab::Link**>(ASMJIT_ALLOC(newCount * sizeof(Slab::Link*)));
+  if (newBuckets == nullptr)
+    return false;
+
+  ::memset(newBuckets, 0, newCount * sizeof(Slab::Link*));
+  uint32_t mask = newCount - 1;
+
+  for (uint32_t i = 0; i < oldCount; i++) {
+    Slab::Link* link = heap->buckets[i];
+    while (link) {
+      Slab::Link* next = link->next;
+      Slab::Link** pBucket = &newBuckets[link->key & mask];
+
+      link->next = *pBucket;
+      *pBucket = link;
+      link = next;
+    }
+  }
 
-  return static_cast<MemNode*>(q);
+  ASMJIT_FREE(heap->buckets);
+  heap->buckets = newBuckets;
+  heap->bucketCount = newCount;
+  return true;
 }
 
-static MemNode* vMemMgrFindNodeByPtr(VMemMgr* self, uint8_t* mem) noexcept {
-  MemNode* node = self->_root;
-  while (node != nullptr) {
-    uint8_t* nodeMem = node->mem;
+static bool vMemMgrSlabTableInsert(SlabHeap* heap, Slab* slab) noexcept {
+  uintptr_t first = (uintptr_t)slab->mem >> kSlabWindowShift;
+  uintptr_t last = ((uintptr_t)slab->mem + slab->blockCount * slab->blockSize - 1) >> kSlabWindowShift;
+  uint32_t count = first == last ? 1 : 2;
 
-    // Go left.
-    if (mem < nodeMem) {
-      node = static_cast<MemNode*>(node->node[0]);
-      continue;
-    }
+  // Growing is only required if the table is empty, otherwise it's just slower.
+  if (heap->linkCount + count > heap->bucketCount && !vMemMgrSlabTableGrow(heap) && heap->bucketCount == 0)
+    return false;
 
-    // Go right.
-    uint8_t* nodeEnd = nodeMem + node->size;
-    if (mem >= nodeEnd) {
-      node = static_cast<MemNode*>(node->node[1]);
+  uint32_t mask = heap->bucketCount - 1;
+  for (uint32_t i = 0; i < 2; i++) {
+    Slab::Link* link = &slab->links[i];
+
+    if (i >= count) {
+      link->slab = nullptr;
       continue;
     }
 
-    // Match.
-    break;
+    Slab::Link** pBucket = &heap->buckets[(first + i) & mask];
+    link->slab = slab;
+    link->key = first + i;
+    link->next = *pBucket;
+    *pBucket = link;
   }
-  return node;
-}
-
-static void* vMemMgrAllocPermanent(VMemMgr* self, size_t vSize) noexcept {
-  static const size_t permanentAlignment = 32;
-  static const size_t permanentNodeSize  = 32768;
-
-  vSize = Utils::alignTo<size_t>(vSize, permanentAlignment);
 
-  AutoLock locked(self->_lock);
-  PermanentNode* node = self->_permanent;
+  heap->linkCount += count;
+  return true;
+}
 
-  // Try to find space in allocated chunks.
-  while (node && vSize > node->getAvailable())
-    node = node->prev;
+static void vMemMgrSlabTableRemove(SlabHeap* heap, Slab* slab) noexcept {
+  uint32_t mask = heap->bucketCount - 1;
 
-  // Or allocate new node.
-  if (node == nullptr) {
-    size_t nodeSize = permanentNodeSize;
+  for (uint32_t i = 0; i < 2; i++) {
+    Slab::Link* link = &slab->links[i];
+    if (link->slab == nullptr)
+      continue;
 
-    if (nodeSize < vSize)
-      nodeSize = vSize;
+    Slab::Link** pPrev = &heap->buckets[link->key & mask];
+    while (*pPrev != link)
+      pPrev = &(*pPrev)->next;
 
-    node = static_cast<PermanentNode*>(ASMJIT_ALLOC(sizeof(PermanentNode)));
+    *pPrev = link->next;
+    heap->linkCount--;
+  }
+}
 
-    // Out of memory.
-    if (node == nullptr)
-      return nullptr;
+//! \internal
+//!
+//! Find a slab that contains `p`, returns `nullptr` if `p` is not in any slab.
+static Slab* vMemMgrFindSlab(SlabHeap* heap, uint8_t* p) noexcept {
+  if (heap->bucketCount == 0)
+    return nullptr;
 
-    node->mem = vMemMgrAllocVMem(self, nodeSize, &node->size);
+  uintptr_t key = (uintptr_t)p >> kSlabWindowShift;
+  Slab::Link* link = heap->buckets[key & (heap->bucketCount - 1)];
 
-    // Out of memory.
-    if (node->mem == nullptr) {
-      ASMJIT_FREE(node);
-      return nullptr;
+  while (link) {
+    if (link->key == key) {
+      Slab* slab = link->slab;
+      if (p >= slab->mem && p < slab->mem + slab->blockCount * slab->blockSize)
+        return slab;
     }
-
-    node->used = 0;
-    node->prev = self->_permanent;
-    self->_permanent = node;
+    link = link->next;
   }
 
-  // Finally, copy function code to our space we reserved for.
-  uint8_t* result = node->mem + node->used;
-
-  // Update Statistics.
-  node->used += vSize;
-  self->_usedBytes += vSize;
+  return nullptr;
+}
 
-  // Code can be null to only reserve space for code.
-  return static_cast<void*>(result);
+//! \internal
+//!
+//! Get whether `p` is the start of a block allocated from `slab`.
+static bool vMemMgrSlabIsAllocated(Slab* slab, uint8_t* p) noexcept {
+  size_t offset = (size_t)(p - slab->mem);
+  if (offset % slab->blockSize != 0)
+    return false;
+
+  size_t index = offset / slab->blockSize;
+  return (slab->baUsed[index / kBitsPerEntity] & ((size_t)1 << (index % kBitsPerEntity))) != 0;
 }
 
-static void* vMemMgrAllocFreeable(VMemMgr* self, size_t vSize) noexcept {
-  // Current index.
-  size_t i;
+//! \internal
+//!
+//! Create a new slab of `classId` and add it to the partial list.
+static Slab* vMemMgrCreateSlab(VMemMgr* self, uint32_t classId) noexcept {
+  SlabHeap* heap = self->_slabHeap;
 
-  // How many we need to be freed.
-  size_t need;
-  size_t minVSize;
+  size_t vSize;
+  intptr_t rwDelta;
 
-  // Align to 32 bytes by default.
-  vSize = Utils::alignTo<size_t>(vSize, 32);
-  if (vSize == 0)
+  uint8_t* mem = vMemMgrAllocChunk(self, kSlabSize, &vSize, &rwDelta, false);
+  if (mem == nullptr)
     return nullptr;
 
-  AutoLock locked(self->_lock);
-  MemNode* node = self->_optimal;
-  minVSize = self->_blockSize;
+  // The chunk can be larger than requested (huge regions), only `kSlabSize`
+  // bytes are used so a slab never spans more than two hash table windows.
+  uint32_t blockSize = vMemMgrSlabClassSize[classId];
+  uint32_t blockCount = static_cast<uint32_t>(Utils::iMin<size_t>(vSize, kSlabSize) / blockSize);
 
-  // Try to find memory block in existing nodes.
+  Slab* slab = static_cast<Slab*>(ASMJIT_ALLOC(sizeof(Slab) + (blockCount - 1) * sizeof(uint32_t)));
+  if (slab == nullptr) {
+    vMemMgrReleaseChunk(self, mem, vSize, rwDelta);
+    return nullptr;
+  }
+
+  slab->mem = mem;
+  slab->vSize = vSize;
+  slab->rwDelta = rwDelta;
+
+  slab->classId = classId;
+  slab->blockSize = blockSize;
+  slab->blockCount = blockCount;
+  slab->freeCount = blockCount;
+  ::memset(slab->baUsed, 0, sizeof(slab->baUsed));
+
+  // Blocks are allocated from the lowest address.
+  for (uint32_t i = 0; i < blockCount; i++)
+    slab->freeStack[i] = blockCount - 1 - i;
+
+  if (!vMemMgrSlabTableInsert(heap, slab)) {
+    vMemMgrReleaseChunk(self, mem, vSize, rwDelta);
+    ASMJIT_FREE(slab);
+    return nullptr;
+  }
+
+  vMemMgrSlabListInsert(&heap->partial[classId], slab);
+
+  // Statistics.
+  heap->slabCount++;
+  heap->slabBytes += vSize;
+  self->_allocatedBytes += vSize;
+
+  return slab;
+}
+
+//! \internal
+//!
+//! Destroy an empty `slab`, which has to be unlinked by the caller.
+static void vMemMgrDestroySlab(VMemMgr* self, Slab* slab) noexcept {
+  SlabHeap* heap = self->_slabHeap;
+  vMemMgrSlabTableRemove(heap, slab);
+  vMemMgrReleaseChunk(self, slab->mem, slab->vSize, slab->rwDelta);
+
+  // Statistics.
+  heap->slabCount--;
+  heap->slabBytes -= slab->vSize;
+  self->_allocatedBytes -= slab->vSize;
+
+  ASMJIT_FREE(slab);
+}
+
+//! \internal
+//!
+//! Allocate a block from slabs, `_lock` has to be held by the caller.
+static void* vMemMgrAllocSlab(VMemMgr* self, size_t vSize, intptr_t* rwDelta) noexcept {
+  SlabHeap* heap = self->_slabHeap;
+  uint32_t classId = vMemMgrGetSlabClass(vSize);
+
+  Slab* slab = heap->partial[classId];
+  if (slab == nullptr) {
+    slab = vMemMgrCreateSlab(self, classId);
+    if (slab == nullptr)
+      return nullptr;
+  }
+
+  uint32_t index = slab->freeStack[--slab->freeCount];
+  slab->baUsed[index / kBitsPerEntity] |= (size_t)1 << (index % kBitsPerEntity);
+
+  if (slab->freeCount == 0) {
+    vMemMgrSlabListRemove(&heap->partial[classId], slab);
+    vMemMgrSlabListInsert(&heap->full[classId], slab);
+  }
+
+  // Statistics.
+  heap->slabUsedBytes += slab->blockSize;
+  self->_usedBytes += slab->blockSize;
+
+  *rwDelta = slab->rwDelta;
+  return slab->mem + index * slab->blockSize;
+}
+
+//! \internal
+//!
+//! Release a block at `p` allocated from `slab`, `_lock` has to be held by the
+//! caller.
+static Error vMemMgrReleaseSlab(VMemMgr* self, Slab* slab, uint8_t* p) noexcept {
+  SlabHeap* heap = self->_slabHeap;
+  uint32_t classId = slab->classId;
+
+  // Not the start of a block or already released.
+  if (!vMemMgrSlabIsAllocated(slab, p))
+    return kErrorInvalidArgument;
+
+  uint32_t index = static_cast<uint32_t>((size_t)(p - slab->mem) / slab->blockSize);
+  ASMJIT_ASSERT(slab->freeCount < slab->blockCount);
+
+  if (slab->freeCount == 0) {
+    vMemMgrSlabListRemove(&heap->full[classId], slab);
+    vMemMgrSlabListInsert(&heap->partial[classId], slab);
+  }
+
+  slab->baUsed[index / kBitsPerEntity] &= ~((size_t)1 << (index % kBitsPerEntity));
+  slab->freeStack[slab->freeCount++] = index;
+
+  // Statistics.
+  heap->slabUsedBytes -= slab->blockSize;
+  self->_usedBytes -= slab->blockSize;
+
+  // Release the slab if it's empty, but keep it if it's the only partial slab
+  // of its class, so a single block allocated and released repeatedly doesn't
+  // allocate and release the virtual memory each time.
+  if (slab->freeCount == slab->blockCount && (heap->partial[classId] != slab || slab->next != nullptr)) {
+    vMemMgrSlabListRemove(&heap->partial[classId], slab);
+    vMemMgrDestroySlab(self, slab);
+  }
+
+  return kErrorOk;
+}
+
+//! \internal
+//!
+//! Release all slabs, keep their virtual memory if `keepVirtualMemory` is true.
+static void vMemMgrResetSlabs(VMemMgr* self, bool keepVirtualMemory) noexcept {
+  SlabHeap* heap = self->_slabHeap;
+
+  for (uint32_t classId = 0; classId < kSlabClassCount; classId++) {
+    Slab* lists[2] = { heap->partial[classId], heap->full[classId] };
+
+    for (uint32_t i = 0; i < 2; i++) {
+      Slab* slab = lists[i];
+      while (slab) {
+        Slab* next = slab->next;
+
+        if (!keepVirtualMemory)
+          vMemMgrReleaseChunk(self, slab->mem, slab->vSize, slab->rwDelta);
+
+        ASMJIT_FREE(slab);
+        slab = next;
+      }
+    }
+  }
+
+  ASMJIT_FREE(heap->buckets);
+  ::memset(heap, 0, sizeof(SlabHeap));
+}
+
+//! \internal
+//!
+//! Check whether the Red-Black tree is valid.
+static bool vMemMgrCheckTree(VMemMgr* self) noexcept {
+  return rbAssert(self->_root) > 0;
+}
+
+//! \internal
+//!
+//! Alloc virtual memory including a heap memory needed for `MemNode` data.
+//!
+//! Returns set-up `MemNode*` or nullptr if allocation failed.
+static MemNode* vMemMgrCreateNode(VMemMgr* self, size_t size, size_t density) noexcept {
+  size_t vSize;
+  intptr_t rwDelta;
+  uint8_t* vmem = vMemMgrAllocChunk(self, size, &vSize, &rwDelta, false);
+
+  // Out of memory.
+  if (vmem == nullptr)
+    return nullptr;
+
+  size_t blocks = (vSize / density);
+  size_t bsize = (((blocks + 7) >> 3) + sizeof(size_t) - 1) & ~(size_t)(sizeof(size_t) - 1);
+
+  MemNode* node = static_cast<MemNode*>(ASMJIT_ALLOC(sizeof(MemNode)));
+  uint8_t* data = static_cast<uint8_t*>(ASMJIT_ALLOC(bsize * 2));
+
+  // Out of memory.
+  if (node == nullptr || data == nullptr) {
+    vMemMgrReleaseChunk(self, vmem, vSize, rwDelta);
+    if (node) ASMJIT_FREE(node);
+    if (data) ASMJIT_FREE(data);
+    return nullptr;
+  }
+
+  // Initialize RbNode data.
+  node->node[0] = nullptr;
+  node->node[1] = nullptr;
+  node->mem = vmem;
+  node->red = 1;
+
+  // Initialize MemNode data.
+  node->prev = nullptr;
+  node->next = nullptr;
+
+  node->size = vSize;
+  node->used = 0;
+  node->blocks = blocks;
+  node->density = density;
+  node->largestBlock = vSize;
+
+  ::memset(data, 0, bsize * 2);
+  node->baUsed = reinterpret_cast<size_t*>(data);
+  node->baCont = reinterpret_cast<size_t*>(data + bsize);
+  node->rwDelta = rwDelta;
+
+  return node;
+}
+
+static void vMemMgrInsertNode(VMemMgr* self, MemNode* node) noexcept {
+  if (self->_root == nullptr) {
+    // Empty tree case.
+    self->_root = node;
+  }
+  else {
+    // False tree root.
+    RbNode head = { { nullptr, nullptr }, 0, 0 };
+
+    // Grandparent & parent.
+    RbNode* g = nullptr;
+    RbNode* t = &head;
+
+    // Iterator & parent.
+    RbNode* p = nullptr;
+    RbNode* q = t->node[1] = self->_root;
+
+    int dir = 0;
+    int last = 0; // Not needed to initialize, but makes some tools happy.
+
+    // Search down the tree.
+    for (;;) {
+      if (q == nullptr) {
+        // Insert new node at the bottom.
+        q = node;
+        p->node[dir] = node;
+      }
+      else if (rbIsRed(q->node[0]) && rbIsRed(q->node[1])) {
+        // Color flip.
+        q->red = 1;
+        q->node[0]->red = 0;
+        q->node[1]->red = 0;
+      }
+
+      // Fix red violation.
+      if (rbIsRed(q) && rbIsRed(p)) {
+        int dir2 = t->node[1] == g;
+        t->node[dir2] = q == p->node[last] ? rbRotateSingle(g, !last) : rbRotateDouble(g, !last);
+      }
+
+      // Stop if found.
+      if (q == node)
+        break;
+
+      last = dir;
+      dir = q->mem < node->mem;
+
+      // Update helpers.
+      if (g != nullptr)
+        t = g;
+
+      g = p;
+      p = q;
+      q = q->node[dir];
+    }
+
+    // Update root.
+    self->_root = static_cast<MemNode*>(head.node[1]);
+  }
+
+  // Make root black.
+  self->_root->red = 0;
+
+  // Link with others.
+  node->prev = self->_last;
+
+  if (self->_first == nullptr) {
+    self->_first = node;
+    self->_last = node;
+    self->_optimal = node;
+  }
+  else {
+    node->prev = self->_last;
+    self->_last->next = node;
+    self->_last = node;
+  }
+}
+
+//! \internal
+//!
+//! Remove node from Red-Black tree.
+//!
+//! Returns node that should be freed, but it doesn't have to be necessarily
+//! the `node` passed.
+static MemNode* vMemMgrRemoveNode(VMemMgr* self, MemNode* node) noexcept {
+  // False tree root.
+  RbNode head = { { nullptr, nullptr }, 0, 0 };
+
+  // Helpers.
+  RbNode* q = &head;
+  RbNode* p = nullptr;
+  RbNode* g = nullptr;
+
+  // Found item.
+  RbNode* f = nullptr;
+  int dir = 1;
+
+  // Set up.
+  q->node[1] = self->_root;
+
+  // Search and push a red down.
+  while (q->node[dir] != nullptr) {
+    int last = dir;
+
+    // Update helpers.
+    g = p;
+    p = q;
+    q = q->node[dir];
+    dir = q->mem < node->mem;
+
+    // Save found node.
+    if (q == node)
+      f = q;
+
+    // Push the red node down.
+    if (!rbIsRed(q) && !rbIsRed(q->node[dir])) {
+      if (rbIsRed(q->node[!dir])) {
+        p = p->node[last] = rbRotateSingle(q, dir);
+      }
+      else if (!rbIsRed(q->node[!dir])) {
+        RbNode* s = p->node[!last];
+
+        if (s != nullptr) {
+          if (!rbIsRed(s->node[!last]) && !rbIsRed(s->node[last])) {
+            // Color flip.
+            p->red = 0;
+            s->red = 1;
+            q->red = 1;
+          }
+          else {
+            int dir2 = g->node[1] == p;
+
+            if (rbIsRed(s->node[last]))
+              g->node[dir2] = rbRotateDouble(p, last);
+            else if (rbIsRed(s->node[!last]))
+              g->node[dir2] = rbRotateSingle(p, last);
+
+            // Ensure correct coloring.
+            q->red = g->node[dir2]->red = 1;
+            g->node[dir2]->node[0]->red = 0;
+            g->node[dir2]->node[1]->red = 0;
+          }
+        }
+      }
+    }
+  }
+
+  // Replace and remove.
+  ASMJIT_ASSERT(f != nullptr);
+  ASMJIT_ASSERT(f != &head);
+  ASMJIT_ASSERT(q != &head);
+
+  if (f != q) {
+    ASMJIT_ASSERT(f != &head);
+    static_cast<MemNode*>(f)->fillData(static_cast<MemNode*>(q));
+  }
+
+  p->node[p->node[1] == q] = q->node[q->node[0] == nullptr];
+
+  // Update root and make it black.
+  self->_root = static_cast<MemNode*>(head.node[1]);
+  if (self->_root != nullptr)
+    self->_root->red = 0;
+
+  // Unlink.
+  MemNode* next = static_cast<MemNode*>(q)->next;
+  MemNode* prev = static_cast<MemNode*>(q)->prev;
+
+  if (prev)
+    prev->next = next;
+  else
+    self->_first = next;
+
+  if (next)
+    next->prev = prev;
+  else
+    self->_last  = prev;
+
+  if (self->_optimal == q)
+    self->_optimal = prev ? prev : next;
+
+  return static_cast<MemNode*>(q);
+}
+
+static MemNode* vMemMgrFindNodeByPtr(VMemMgr* self, uint8_t* mem) noexcept {
+  MemNode* node = self->_root;
+  while (node != nullptr) {
+    uint8_t* nodeMem = node->mem;
+
+    // Go left.
+    if (mem < nodeMem) {
+      node = static_cast<MemNode*>(node->node[0]);
+      continue;
+    }
+
+    // Go right.
+    uint8_t* nodeEnd = nodeMem + node->size;
+    if (mem >= nodeEnd) {
+      node = static_cast<MemNode*>(node->node[1]);
+      continue;
+    }
+
+    // Match.
+    break;
+  }
+  return node;
+}
+
+//! \internal
+//!
+//! Get whether `mem` is the start of a block allocated in `node`.
+static bool vMemMgrIsAllocatedBlock(MemNode* node, uint8_t* mem) noexcept {
+  size_t offset = (size_t)(mem - node->mem);
+  if (offset % node->density != 0)
+    return false;
+
+  size_t bitpos = M_DIV(offset, node->density);
+  if ((node->baUsed[bitpos / kBitsPerEntity] & ((size_t)1 << (bitpos % kBitsPerEntity))) == 0)
+    return false;
+
+  // The previous block must not continue to this one.
+  if (bitpos == 0)
+    return true;
+
+  bitpos--;
+  return (node->baCont[bitpos / kBitsPerEntity] & ((size_t)1 << (bitpos % kBitsPerEntity))) == 0;
+}
+
+static void* vMemMgrAllocPermanent(VMemMgr* self, size_t vSize, intptr_t* rwDelta) noexcept {
+  static const size_t permanentAlignment = 32;
+  static const size_t permanentNodeSize  = 32768;
+
+  vSize = Utils::alignTo<size_t>(vSize, permanentAlignment);
+
+  AutoLock locked(self->_lock);
+  PermanentNode* node = self->_permanent;
+
+  // Try to find space in allocated chunks.
+  while (node && vSize > node->getAvailable())
+    node = node->prev;
+
+  // Or allocate new node.
+  if (node == nullptr) {
+    size_t nodeSize = permanentNodeSize;
+
+    if (nodeSize < vSize)
+      nodeSize = vSize;
+
+    node = static_cast<PermanentNode*>(ASMJIT_ALLOC(sizeof(PermanentNode)));
+
+    // Out of memory.
+    if (node == nullptr)
+      return nullptr;
+
+    node->mem = vMemMgrAllocChunk(self, nodeSize, &node->size, &node->rwDelta, true);
+
+    // Out of memory.
+    if (node->mem == nullptr) {
+      ASMJIT_FREE(node);
+      return nullptr;
+    }
+
+    node->used = 0;
+    node->prev = self->_permanent;
+    self->_permanent = node;
+  }
+
+  // Finally, copy function code to our space we reserved for.
+  uint8_t* result = node->mem + node->used;
+
+  // Update Statistics.
+  node->used += vSize;
+  self->_usedBytes += vSize;
+
+  *rwDelta = node->rwDelta;
+
+  // Code can be null to only reserve space for code.
+  return static_cast<void*>(result);
+}
+
+//! \internal
+//!
+//! Allocate freeable memory, `_lock` has to be held by the caller.
+static void* vMemMgrAllocFreeable(VMemMgr* self, size_t vSize, intptr_t* rwDelta) noexcept {
+  // Current index.
+  size_t i;
+
+  // How many we need to be freed.
+  size_t need;
+  size_t minVSize;
+
+  // Align to 32 bytes by default.
+  vSize = Utils::alignTo<size_t>(vSize, 32);
+  if (vSize == 0)
+    return nullptr;
+
+  MemNode* node = self->_optimal;
+  minVSize = self->_blockSize;
+
+  // Try to find memory block in existing nodes.
   while (node) {
     // Skip this node?
     if ((node->getAvailable() < vSize) || (node->largestBlock < vSize && node->largestBlock != 0)) {
       MemNode* next = node->next;
 
-      if (node->getAvailable() < minVSize && node == self->_optimal && next)
-        self->_optimal = next;
+      if (node->getAvailable() < minVSize && node == self->_optimal && next)
+        self->_optimal = next;
+
+      node = next;
+      continue;
+    }
+
+    size_t* up = node->baUsed;     // Current ubits address.
+    size_t ubits;                  // Current ubits[0] value.
+    size_t bit;                    // Current bit mask.
+    size_t blocks = node->blocks;  // Count of blocks in node.
+    size_t cont = 0;               // How many bits are currently freed in find loop.
+    size_t maxCont = 0;            // Largest continuous block (bits count).
+    size_t j;
+
+    need = M_DIV((vSize + node->density - 1), node->density);
+    i = 0;
+
+    // Try to find node that is large enough.
+    while (i < blocks) {
+      ubits = *up++;
+
+      // Fast skip used blocks.
+      if (ubits == ~(size_t)0) {
+        if (cont > maxCont)
+          maxCont = cont;
+        cont = 0;
+
+        i += kBitsPerEntity;
+        continue;
+      }
+
+      size_t max = kBitsPerEntity;
+      if (i + max > blocks)
+        max = blocks - i;
+
+      for (j = 0, bit = 1; j < max; bit <<= 1) {
+        j++;
+        if ((ubits & bit) == 0) {
+          if (++cont == need) {
+            i += j;
+            i -= cont;
+            goto L_Found;
+          }
+
+          continue;
+        }
+
+        if (cont > maxCont) maxCont = cont;
+        cont = 0;
+      }
+
+      i += kBitsPerEntity;
+    }
+
+    // Because we traversed the entire node, we can set largest node size that
+    // will be used to cache next traversing.
+    node->largestBlock = maxCont * node->density;
+
+    node = node->next;
+  }
+
+  // If we are here, we failed to find existing memory block and we must
+  // allocate a new one.
+  {
+    size_t blockSize = self->_blockSize;
+    if (blockSize < vSize)
+      blockSize = vSize;
+
+    node = vMemMgrCreateNode(self, blockSize, self->_blockDensity);
+    if (node == nullptr)
+      return nullptr;
+
+    // Update binary tree.
+    vMemMgrInsertNode(self, node);
+    ASMJIT_ASSERT(vMemMgrCheckTree(self));
+
+    // Alloc first node at start.
+    i = 0;
+    need = (vSize + node->density - 1) / node->density;
+
+    // Update statistics.
+    self->_allocatedBytes += node->size;
+  }
+
+L_Found:
+  // Update bits.
+  _SetBits(node->baUsed, i, need);
+  _SetBits(node->baCont, i, need - 1);
+
+  // Update statistics.
+  {
+    size_t u = need * node->density;
+    node->used += u;
+    node->largestBlock = 0;
+    self->_usedBytes += u;
+  }
+
+  // And return pointer to allocated memory.
+  uint8_t* result = node->mem + i * node->density;
+  ASMJIT_ASSERT(result >= node->mem && result <= node->mem + node->size - vSize);
+
+  *rwDelta = node->rwDelta;
+  return result;
+}
+
+//! \internal
+//!
+//! Release freeable memory allocated either from slabs or from nodes, `_lock`
+//! has to be held by the caller.
+static Error vMemMgrReleaseFreeable(VMemMgr* self, void* p) noexcept {
+  if (self->_slabHeap != nullptr) {
+    Slab* slab = vMemMgrFindSlab(self->_slabHeap, static_cast<uint8_t*>(p));
+    if (slab != nullptr)
+      return vMemMgrReleaseSlab(self, slab, static_cast<uint8_t*>(p));
+  }
+
+  MemNode* node = vMemMgrFindNodeByPtr(self, static_cast<uint8_t*>(p));
+
+  // Not allocated by `self`, not the start of a block, or already released.
+  if (node == nullptr || !vMemMgrIsAllocatedBlock(node, static_cast<uint8_t*>(p)))
+    return kErrorInvalidArgument;
+
+  size_t offset = (size_t)((uint8_t*)p - (uint8_t*)node->mem);
+  size_t bitpos = M_DIV(offset, node->density);
+  size_t i = (bitpos / kBitsPerEntity);
+
+  size_t* up = node->baUsed + i;  // Current ubits address.
+  size_t* cp = node->baCont + i;  // Current cbits address.
+  size_t ubits = *up;             // Current ubits[0] value.
+  size_t cbits = *cp;             // Current cbits[0] value.
+  size_t bit = (size_t)1 << (bitpos % kBitsPerEntity);
+
+  size_t cont = 0;
+  bool stop;
+
+  for (;;) {
+    stop = (cbits & bit) == 0;
+    ubits &= ~bit;
+    cbits &= ~bit;
+
+    bit <<= 1;
+    cont++;
+
+    if (stop || bit == 0) {
+      *up = ubits;
+      *cp = cbits;
+      if (stop)
+        break;
+
+      ubits = *++up;
+      cbits = *++cp;
+      bit = 1;
+    }
+  }
+
+  // If the freed block is fully allocated node then it's needed to
+  // update 'optimal' pointer in memory manager.
+  if (node->used == node->size) {
+    MemNode* cur = self->_optimal;
+
+    do {
+      cur = cur->prev;
+      if (cur == node) {
+        self->_optimal = node;
+        break;
+      }
+    } while (cur);
+  }
+
+  // Statistics.
+  cont *= node->density;
+  if (node->largestBlock < cont)
+    node->largestBlock = cont;
+
+  node->used -= cont;
+  self->_usedBytes -= cont;
+
+  // If page is empty, we can free it.
+  if (node->used == 0) {
+    // Free memory associated with node (this memory is not accessed
+    // anymore so it's safe).
+    vMemMgrReleaseChunk(self, node->mem, node->size, node->rwDelta);
+    ASMJIT_FREE(node->baUsed);
+
+    node->baUsed = nullptr;
+    node->baCont = nullptr;
+
+    // Statistics.
+    self->_allocatedBytes -= node->size;
+
+    // Remove node. This function can return different node than
+    // passed into, but data is copied into previous node if needed.
+    ASMJIT_FREE(vMemMgrRemoveNode(self, node));
+    ASMJIT_ASSERT(vMemMgrCheckTree(self));
+  }
+
+  return kErrorOk;
+}
+
+//! \internal
+//!
+//! Reset the whole `VMemMgr` instance, freeing all heap memory allocated an
+//! virtual memory allocated unless `keepVirtualMemory` is true (and this is
+//! only used when writing data to a remote process).
+static void vMemMgrReset(VMemMgr* self, bool keepVirtualMemory) noexcept {
+  if (self->_slabHeap != nullptr)
+    vMemMgrResetSlabs(self, keepVirtualMemory);
+
+  MemNode* node = self->_first;
+
+  while (node != nullptr) {
+    MemNode* next = node->next;
+
+    if (!keepVirtualMemory)
+      vMemMgrReleaseChunk(self, node->mem, node->size, node->rwDelta);
+
+    ASMJIT_FREE(node->baUsed);
+    ASMJIT_FREE(node);
+
+    node = next;
+  }
+
+  self->_allocatedBytes = 0;
+  self->_usedBytes = 0;
+
+  self->_root = nullptr;
+  self->_first = nullptr;
+  self->_last = nullptr;
+  self->_optimal = nullptr;
+}
+
+//! \internal
+//!
+//! Allocate freeable memory from slabs or from nodes, `_lock` has to be held
+//! by the caller.
+static void* vMemMgrAllocLocked(VMemMgr* self, size_t vSize, intptr_t* rwDelta) noexcept {
+  uint64_t startTime = 0;
+  bool measure = self->hasOption(kVMemMgrOptionTimeStats);
+
+  if (measure)
+    startTime = Utils::getNanoTime();
+
+  void* p;
+  if (self->_slabHeap != nullptr && vSize - 1 < kSlabMaxSize)
+    p = vMemMgrAllocSlab(self, vSize, rwDelta);
+  else
+    p = vMemMgrAllocFreeable(self, vSize, rwDelta);
+
+  if (measure) {
+    self->_allocCount++;
+    self->_allocTime += Utils::getNanoTime() - startTime;
+  }
+
+  return p;
+}
+
+// ============================================================================
+// [asmjit::VMemMgr - ThreadCache]
+// ============================================================================
+
+//! \internal
+//!
+//! Get the size class of `size`, which must be `kThreadCacheMaxSize` or less.
+static ASMJIT_INLINE uint32_t vMemMgrGetCacheClass(size_t size) noexcept {
+  uint32_t classId = 0;
+  while (vMemMgrThreadCacheClassSize[classId] < size)
+    classId++;
+  return classId;
+}
+
+static ASMJIT_INLINE ThreadCache* vMemMgrGetThreadCacheSlot(VMemMgr* self) noexcept {
+#if ASMJIT_OS_WINDOWS
+  return static_cast<ThreadCache*>(::TlsGetValue(self->_threadCacheSlot));
+#else
+  return static_cast<ThreadCache*>(::pthread_getspecific(self->_threadCacheSlot));
+#endif // ASMJIT_OS_WINDOWS
+}
+
+static ASMJIT_INLINE void vMemMgrSetThreadCacheSlot(VMemMgr* self, ThreadCache* cache) noexcept {
+#if ASMJIT_OS_WINDOWS
+  ::TlsSetValue(self->_threadCacheSlot, cache);
+#else
+  ::pthread_setspecific(self->_threadCacheSlot, cache);
+#endif // ASMJIT_OS_WINDOWS
+}
+
+//! \internal
+//!
+//! Atomically load a slot of `CacheTable`.
+static ASMJIT_INLINE uintptr_t vMemMgrLoadSlot(const uintptr_t* slot) noexcept {
+#if ASMJIT_CC_MSC
+  uintptr_t word = *static_cast<const volatile uintptr_t*>(slot);
+  _ReadWriteBarrier();
+  return word;
+#else
+  return __atomic_load_n(slot, __ATOMIC_ACQUIRE);
+#endif // ASMJIT_CC_MSC
+}
+
+//! \internal
+//!
+//! Atomically store a slot of `CacheTable`.
+static ASMJIT_INLINE void vMemMgrStoreSlot(uintptr_t* slot, uintptr_t word) noexcept {
+#if ASMJIT_CC_MSC
+  _ReadWriteBarrier();
+  *static_cast<volatile uintptr_t*>(slot) = word;
+#else
+  __atomic_store_n(slot, word, __ATOMIC_RELEASE);
+#endif // ASMJIT_CC_MSC
+}
+
+//! \internal
+//!
+//! Atomically replace a slot of `CacheTable` if it's `expected`.
+static ASMJIT_INLINE bool vMemMgrSwapSlot(uintptr_t* slot, uintptr_t expected, uintptr_t word) noexcept {
+#if ASMJIT_CC_MSC
+  return (uintptr_t)::InterlockedCompareExchangePointer((PVOID volatile*)slot, (PVOID)word, (PVOID)expected) == expected;
+#else
+  return __atomic_compare_exchange_n(slot, &expected, word, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+#endif // ASMJIT_CC_MSC
+}
+
+//! \internal
+//!
+//! Get the first slot of `CacheTable` probed for `p`.
+static ASMJIT_INLINE uint32_t vMemMgrCacheHash(const void* p) noexcept {
+  uint32_t x = static_cast<uint32_t>((uintptr_t)p >> 6) * 0x9E3779B1U;
+  return (x >> 16) & (kCacheTableSize - 1);
+}
+
+//! \internal
+//!
+//! Find the slot of `p` in `table`, store its content to `word`.
+//!
+//! Returns `kCacheTableSize` if `p` is not there. Slots are assigned under
+//! `_lock`, so only a lookup done with the lock held is conclusive.
+static uint32_t vMemMgrCacheFind(CacheTable* table, const void* p, uintptr_t* word) noexcept {
+  uint32_t hash = vMemMgrCacheHash(p);
+
+  for (uint32_t i = 0; i < kCacheTableMaxProbe; i++) {
+    uint32_t slot = (hash + i) & (kCacheTableSize - 1);
+    uintptr_t w = vMemMgrLoadSlot(&table->slots[slot]);
+
+    if (w == 0)
+      break;
+
+    if ((w & ~static_cast<uintptr_t>(kCacheStateMask)) == (uintptr_t)p) {
+      *word = w;
+      return slot;
+    }
+  }
+
+  return kCacheTableSize;
+}
+
+//! \internal
+//!
+//! Assign a slot of `table` to a block `p` put to a bin, `_lock` has to be
+//! held by the caller.
+//!
+//! Returns `kCacheTableSize` if there is no free slot.
+static uint32_t vMemMgrCacheInsert(CacheTable* table, void* p, uint32_t classId, intptr_t rwDelta) noexcept {
+  uint32_t hash = vMemMgrCacheHash(p);
+
+  for (uint32_t i = 0; i < kCacheTableMaxProbe; i++) {
+    uint32_t slot = (hash + i) & (kCacheTableSize - 1);
+    uintptr_t w = vMemMgrLoadSlot(&table->slots[slot]);
+
+    // Only insertions (under `_lock`) can use an empty or a removed slot.
+    if (w == 0 || w == kCacheSlotRemoved) {
+      table->classId[slot] = static_cast<uint8_t>(classId);
+      table->rwDelta[slot] = rwDelta;
+      vMemMgrStoreSlot(&table->slots[slot], (uintptr_t)p | kCacheStateBinned);
+      return slot;
+    }
+  }
+
+  return kCacheTableSize;
+}
 
-      node = next;
-      continue;
-    }
+//! \internal
+//!
+//! Stop tracking `p` by thread caches, `_lock` has to be held by the caller.
+//!
+//! Fails if `p` is tracked, but not allocated (it's in a bin or it has been
+//! released already). Any other block is validated by the caller.
+static Error vMemMgrCacheRemove(VMemMgr* self, void* p) noexcept {
+  CacheTable* table = self->_cacheTable;
+  if (table == nullptr)
+    return kErrorOk;
 
-    size_t* up = node->baUsed;     // Current ubits address.
-    size_t ubits;                  // Current ubits[0] value.
-    size_t bit;                    // Current bit mask.
-    size_t blocks = node->blocks;  // Count of blocks in node.
-    size_t cont = 0;               // How many bits are currently freed in find loop.
-    size_t maxCont = 0;            // Largest continuous block (bits count).
-    size_t j;
+  uintptr_t word;
+  uint32_t slot = vMemMgrCacheFind(table, p, &word);
 
-    need = M_DIV((vSize + node->density - 1), node->density);
-    i = 0;
+  if (slot == kCacheTableSize)
+    return kErrorOk;
 
-    // Try to find node that is large enough.
-    while (i < blocks) {
-      ubits = *up++;
+  if ((word & kCacheStateMask) != kCacheStateUsed || !vMemMgrSwapSlot(&table->slots[slot], word, kCacheSlotRemoved))
+    return kErrorInvalidArgument;
 
-      // Fast skip used blocks.
-      if (ubits == ~(size_t)0) {
-        if (cont > maxCont)
-          maxCont = cont;
-        cont = 0;
+  return kErrorOk;
+}
 
-        i += kBitsPerEntity;
+//! \internal
+//!
+//! Release `p`, which can be tracked by thread caches, `_lock` has to be held
+//! by the caller.
+static Error vMemMgrReleaseLocked(VMemMgr* self, void* p) noexcept {
+  ASMJIT_PROPAGATE_ERROR(vMemMgrCacheRemove(self, p));
+  return vMemMgrReleaseFreeable(self, p);
+}
+
+//! \internal
+//!
+//! Return releases kept by `cache` in one batch, `_lock` has to be held by
+//! the caller.
+//!
+//! Blocks are moved to the cache's bins if there is a space and `reuse` is
+//! true, otherwise they are released to the shared nodes (or slabs).
+static void vMemMgrFlushPending(VMemMgr* self, ThreadCache* cache, bool reuse) noexcept {
+  CacheTable* table = self->_cacheTable;
+  uint32_t count = cache->pendingCount;
+
+  for (uint32_t i = 0; i < count; i++) {
+    void* p = cache->pending[i];
+    uint32_t slot = cache->pendingSlot[i];
+
+    // Only the thread that changed the state to pending can change it again.
+    ASMJIT_ASSERT(vMemMgrLoadSlot(&table->slots[slot]) == ((uintptr_t)p | kCacheStatePending));
+
+    if (reuse) {
+      ThreadCache::Bin& bin = cache->bins[table->classId[slot]];
+      if (bin.count < kThreadCacheBinCapacity) {
+        vMemMgrStoreSlot(&table->slots[slot], (uintptr_t)p | kCacheStateBinned);
+
+        bin.data[bin.count] = p;
+        bin.rwDelta[bin.count] = table->rwDelta[slot];
+        bin.slot[bin.count] = slot;
+        bin.count++;
         continue;
       }
+    }
 
-      size_t max = kBitsPerEntity;
-      if (i + max > blocks)
-        max = blocks - i;
+    vMemMgrStoreSlot(&table->slots[slot], kCacheSlotRemoved);
+    vMemMgrReleaseFreeable(self, p);
+  }
 
-      for (j = 0, bit = 1; j < max; bit <<= 1) {
-        j++;
-        if ((ubits & bit) == 0) {
-          if (++cont == need) {
-            i += j;
-            i -= cont;
-            goto L_Found;
-          }
+  cache->pendingCount = 0;
+}
 
-          continue;
-        }
+//! \internal
+//!
+//! Return everything `cache` holds to the shared nodes, `_lock` has to be held
+//! by the caller.
+static void vMemMgrDrainThreadCache(VMemMgr* self, ThreadCache* cache) noexcept {
+  CacheTable* table = self->_cacheTable;
+  uint32_t i, j;
+
+  vMemMgrFlushPending(self, cache, false);
+
+  for (i = 0; i < kThreadCacheClassCount; i++) {
+    ThreadCache::Bin& bin = cache->bins[i];
+    for (j = 0; j < bin.count; j++) {
+      vMemMgrStoreSlot(&table->slots[bin.slot[j]], kCacheSlotRemoved);
+      vMemMgrReleaseFreeable(self, bin.data[j]);
+    }
+    bin.count = 0;
+  }
+}
 
-        if (cont > maxCont) maxCont = cont;
-        cont = 0;
-      }
+//! \internal
+//!
+//! Unlink `cache` from the list of caches, `_lock` has to be held by the caller.
+static void vMemMgrUnlinkThreadCache(VMemMgr* self, ThreadCache* cache) noexcept {
+  ThreadCache* prev = cache->prev;
+  ThreadCache* next = cache->next;
 
-      i += kBitsPerEntity;
-    }
+  if (prev)
+    prev->next = next;
+  else
+    self->_threadCaches = next;
 
-    // Because we traversed the entire node, we can set largest node size that
-    // will be used to cache next traversing.
-    node->largestBlock = maxCont * node->density;
+  if (next)
+    next->prev = prev;
+}
 
-    node = node->next;
+#if !ASMJIT_OS_WINDOWS
+//! \internal
+//!
+//! Called by pthreads when a thread that has a cache exits.
+static void vMemMgrThreadCacheDestructor(void* p) noexcept {
+  ThreadCache* cache = static_cast<ThreadCache*>(p);
+  VMemMgr* self = cache->mgr;
+
+  {
+    AutoLock locked(self->_lock);
+    vMemMgrDrainThreadCache(self, cache);
+    vMemMgrUnlinkThreadCache(self, cache);
   }
 
-  // If we are here, we failed to find existing memory block and we must
-  // allocate a new one.
+  ASMJIT_FREE(cache);
+}
+#endif // !ASMJIT_OS_WINDOWS
+
+//! \internal
+//!
+//! Get the cache of the calling thread, create it if it doesn't exist.
+static ThreadCache* vMemMgrGetThreadCache(VMemMgr* self) noexcept {
+  ThreadCache* cache = vMemMgrGetThreadCacheSlot(self);
+  if (cache != nullptr)
+    return cache;
+
+  cache = static_cast<ThreadCache*>(ASMJIT_ALLOC(sizeof(ThreadCache)));
+  if (cache == nullptr)
+    return nullptr;
+
+  ::memset(cache, 0, sizeof(ThreadCache));
+  cache->mgr = self;
+
   {
-    size_t blockSize = self->_blockSize;
-    if (blockSize < vSize)
-      blockSize = vSize;
+    AutoLock locked(self->_lock);
+    cache->next = self->_threadCaches;
 
-    node = vMemMgrCreateNode(self, blockSize, self->_blockDensity);
-    if (node == nullptr)
-      return nullptr;
+    if (self->_threadCaches)
+      self->_threadCaches->prev = cache;
+    self->_threadCaches = cache;
+  }
 
-    // Update binary tree.
-    vMemMgrInsertNode(self, node);
-    ASMJIT_ASSERT(vMemMgrCheckTree(self));
+  vMemMgrSetThreadCacheSlot(self, cache);
+  return cache;
+}
 
-    // Alloc first node at start.
-    i = 0;
-    need = (vSize + node->density - 1) / node->density;
+//! \internal
+//!
+//! Allocate a small block through the calling thread's cache.
+static void* vMemMgrAllocCached(VMemMgr* self, size_t vSize, intptr_t* rwDelta) noexcept {
+  ThreadCache* cache = vMemMgrGetThreadCache(self);
 
-    // Update statistics.
-    self->_allocatedBytes += node->size;
+  if (cache == nullptr) {
+    AutoLock locked(self->_lock);
+    return vMemMgrAllocLocked(self, vSize, rwDelta);
   }
 
-L_Found:
-  // Update bits.
-  _SetBits(node->baUsed, i, need);
-  _SetBits(node->baCont, i, need - 1);
+  CacheTable* table = self->_cacheTable;
+  uint32_t classId = vMemMgrGetCacheClass(vSize);
+  ThreadCache::Bin& bin = cache->bins[classId];
 
-  // Update statistics.
-  {
-    size_t u = need * node->density;
-    node->used += u;
-    node->largestBlock = 0;
-    self->_usedBytes += u;
+  if (bin.count == 0) {
+    size_t classSize = vMemMgrThreadCacheClassSize[classId];
+    uint32_t refillCount = Utils::iMin<uint32_t>(
+      static_cast<uint32_t>(kThreadCacheRefillSize / classSize), kThreadCacheBinCapacity);
+
+    AutoLock locked(self->_lock);
+
+    // Pending releases may refill the bin without touching the shared nodes.
+    if (cache->pendingCount != 0)
+      vMemMgrFlushPending(self, cache, true);
+
+    while (bin.count < refillCount) {
+      intptr_t pDelta;
+      void* p = vMemMgrAllocLocked(self, classSize, &pDelta);
+      if (p == nullptr)
+        break;
+
+      uint32_t slot = vMemMgrCacheInsert(table, p, classId, pDelta);
+      if (slot == kCacheTableSize) {
+        vMemMgrReleaseFreeable(self, p);
+        break;
+      }
+
+      bin.data[bin.count] = p;
+      bin.rwDelta[bin.count] = pDelta;
+      bin.slot[bin.count] = slot;
+      bin.count++;
+    }
+
+    // All slots are used, allocate a block that is not cached.
+    if (bin.count == 0)
+      return vMemMgrAllocLocked(self, vSize, rwDelta);
   }
 
-  // And return pointer to allocated memory.
-  uint8_t* result = node->mem + i * node->density;
-  ASMJIT_ASSERT(result >= node->mem && result <= node->mem + node->size - vSize);
-  return result;
+  bin.count--;
+  vMemMgrStoreSlot(&table->slots[bin.slot[bin.count]], (uintptr_t)bin.data[bin.count] | kCacheStateUsed);
+
+  *rwDelta = bin.rwDelta[bin.count];
+  return bin.data[bin.count];
 }
 
 //! \internal
 //!
-//! Reset the whole `VMemMgr` instance, freeing all heap memory allocated an
-//! virtual memory allocated unless `keepVirtualMemory` is true (and this is
-//! only used when writing data to a remote process).
-static void vMemMgrReset(VMemMgr* self, bool keepVirtualMemory) noexcept {
-  MemNode* node = self->_first;
-
-  while (node != nullptr) {
-    MemNode* next = node->next;
+//! Release `p` through the calling thread's cache.
+//!
+//! A block allocated from any thread cache is released without `_lock`, its
+//! state is changed atomically so it can only be released once. The block is
+//! kept in the calling thread's bin if there is a space, otherwise it's kept
+//! as pending and returned to the shared nodes with other pending releases.
+//! Other pointers are validated and released under `_lock`.
+static Error vMemMgrReleaseCached(VMemMgr* self, void* p) noexcept {
+  ThreadCache* cache = vMemMgrGetThreadCache(self);
+  CacheTable* table = self->_cacheTable;
+
+  uintptr_t word;
+  uint32_t slot = kCacheTableSize;
+
+  if (cache != nullptr)
+    slot = vMemMgrCacheFind(table, p, &word);
+
+  if (slot == kCacheTableSize) {
+    AutoLock locked(self->_lock);
+    return vMemMgrReleaseLocked(self, p);
+  }
 
-    if (!keepVirtualMemory)
-      vMemMgrReleaseVMem(self, node->mem, node->size);
+  // Already released or never allocated (it's in a bin).
+  if ((word & kCacheStateMask) != kCacheStateUsed ||
+      !vMemMgrSwapSlot(&table->slots[slot], word, (uintptr_t)p | kCacheStatePending))
+    return kErrorInvalidArgument;
 
-    ASMJIT_FREE(node->baUsed);
-    ASMJIT_FREE(node);
+  ThreadCache::Bin& bin = cache->bins[table->classId[slot]];
+  if (bin.count < kThreadCacheBinCapacity) {
+    vMemMgrStoreSlot(&table->slots[slot], (uintptr_t)p | kCacheStateBinned);
 
-    node = next;
+    bin.data[bin.count] = p;
+    bin.rwDelta[bin.count] = table->rwDelta[slot];
+    bin.slot[bin.count] = slot;
+    bin.count++;
+    return kErrorOk;
   }
 
-  self->_allocatedBytes = 0;
-  self->_usedBytes = 0;
+  if (cache->pendingCount == kThreadCachePendingCapacity) {
+    AutoLock locked(self->_lock);
+    vMemMgrFlushPending(self, cache, false);
+  }
 
-  self->_root = nullptr;
-  self->_first = nullptr;
-  self->_last = nullptr;
-  self->_optimal = nullptr;
+  cache->pending[cache->pendingCount] = p;
+  cache->pendingSlot[cache->pendingCount] = slot;
+  cache->pendingCount++;
+  return kErrorOk;
 }
 
 // ============================================================================
@@ -920,12 +2458,20 @@ static void vMemMgrReset(VMemMgr* self, bool keepVirtualMemory) noexcept {
 // ============================================================================
 
 #if !ASMJIT_OS_WINDOWS
-VMemMgr::VMemMgr() noexcept
+VMemMgr::VMemMgr(uint32_t options) noexcept
 #else
-VMemMgr::VMemMgr(HANDLE hProcess) noexcept
+VMemMgr::VMemMgr(HANDLE hProcess, uint32_t options) noexcept
   : _hProcess(vMemGet().getSafeProcessHandle(hProcess))
 #endif // ASMJIT_OS_WINDOWS
 {
+#if ASMJIT_OS_WINDOWS
+  // Dual mapping is only possible in the current process.
+  if (_hProcess != vMemGet().hProcess)
+    options &= ~kVMemMgrOptionDualMapping;
+#endif // ASMJIT_OS_WINDOWS
+
+  _options = options;
+  _addressHint = nullptr;
   _blockSize = VMemUtil::getPageGranularity();
   _blockDensity = 64;
 
@@ -939,11 +2485,70 @@ VMemMgr::VMemMgr(HANDLE hProcess) noexcept
 
   _permanent = nullptr;
   _keepVirtualMemory = false;
+
+  _hugeRegions = nullptr;
+
+  _slabHeap = nullptr;
+  if (options & kVMemMgrOptionSlabs) {
+    _slabHeap = static_cast<SlabHeap*>(ASMJIT_ALLOC(sizeof(SlabHeap)));
+    if (_slabHeap != nullptr)
+      ::memset(_slabHeap, 0, sizeof(SlabHeap));
+    else
+      _options &= ~kVMemMgrOptionSlabs;
+  }
+
+  _allocCount = 0;
+  _allocTime = 0;
+
+  // Thread cache requires a thread-local slot, disable it if there is none.
+  _threadCaches = nullptr;
+  _cacheTable = nullptr;
+
+  if (options & kVMemMgrOptionThreadCache) {
+    _cacheTable = static_cast<CacheTable*>(ASMJIT_ALLOC(sizeof(CacheTable)));
+    if (_cacheTable != nullptr) {
+      ::memset(_cacheTable, 0, sizeof(CacheTable));
+#if ASMJIT_OS_WINDOWS
+      _threadCacheSlot = ::TlsAlloc();
+      if (_threadCacheSlot == TLS_OUT_OF_INDEXES)
+        _options &= ~kVMemMgrOptionThreadCache;
+#else
+      if (::pthread_key_create(&_threadCacheSlot, vMemMgrThreadCacheDestructor) != 0)
+        _options &= ~kVMemMgrOptionThreadCache;
+#endif // ASMJIT_OS_WINDOWS
+    }
+    else {
+      _options &= ~kVMemMgrOptionThreadCache;
+    }
+
+    if (!hasOption(kVMemMgrOptionThreadCache)) {
+      ASMJIT_FREE(_cacheTable);
+      _cacheTable = nullptr;
+    }
+  }
 }
 
 VMemMgr::~VMemMgr() noexcept {
+  // Thread caches cleanup - The memory they hold is freed by the reset below.
+  if (hasOption(kVMemMgrOptionThreadCache)) {
+    ThreadCache* cache = _threadCaches;
+    while (cache) {
+      ThreadCache* next = cache->next;
+      ASMJIT_FREE(cache);
+      cache = next;
+    }
+
+#if ASMJIT_OS_WINDOWS
+    ::TlsFree(_threadCacheSlot);
+#else
+    ::pthread_key_delete(_threadCacheSlot);
+#endif // ASMJIT_OS_WINDOWS
+  }
+
   // Freeable memory cleanup - Also frees the virtual memory if configured to.
   vMemMgrReset(this, _keepVirtualMemory);
+  ASMJIT_FREE(_slabHeap);
+  ASMJIT_FREE(_cacheTable);
 
   // Permanent memory cleanup - Never frees the virtual memory.
   PermanentNode* node = _permanent;
@@ -952,6 +2557,15 @@ VMemMgr::~VMemMgr() noexcept {
     ASMJIT_FREE(node);
     node = prev;
   }
+
+  // Huge regions cleanup - Only regions that hold permanent memory or regions
+  // kept by `_keepVirtualMemory` remain, never frees the virtual memory.
+  HugeRegion* region = _hugeRegions;
+  while (region) {
+    HugeRegion* next = region->next;
+    ASMJIT_FREE(region);
+    region = next;
+  }
 }
 
 // ============================================================================
@@ -959,6 +2573,21 @@ VMemMgr::~VMemMgr() noexcept {
 // ============================================================================
 
 void VMemMgr::reset() noexcept {
+  AutoLock locked(_lock);
+
+  // Thread caches stay registered, but they can't hold any memory anymore.
+  // Bins are accessed by their owners without the lock, that's why `reset()`
+  // must not be called while other threads use the memory manager.
+  ThreadCache* cache = _threadCaches;
+  while (cache) {
+    cache->pendingCount = 0;
+    ::memset(cache->bins, 0, sizeof(cache->bins));
+    cache = cache->next;
+  }
+
+  if (_cacheTable != nullptr)
+    ::memset(_cacheTable, 0, sizeof(CacheTable));
+
   vMemMgrReset(this, false);
 }
 
@@ -966,98 +2595,42 @@ void VMemMgr::reset() noexcept {
 // [asmjit::VMemMgr - Alloc / Release]
 // ============================================================================
 
-void* VMemMgr::alloc(size_t size, uint32_t type) noexcept {
-  if (type == kVMemAllocPermanent)
-    return vMemMgrAllocPermanent(this, size);
-  else
-    return vMemMgrAllocFreeable(this, size);
-}
-
-Error VMemMgr::release(void* p) noexcept {
-  if (p == nullptr)
-    return kErrorOk;
-
-  AutoLock locked(_lock);
-  MemNode* node = vMemMgrFindNodeByPtr(this, static_cast<uint8_t*>(p));
-
-  if (node == nullptr)
-    return kErrorInvalidArgument;
-
-  size_t offset = (size_t)((uint8_t*)p - (uint8_t*)node->mem);
-  size_t bitpos = M_DIV(offset, node->density);
-  size_t i = (bitpos / kBitsPerEntity);
-
-  size_t* up = node->baUsed + i;  // Current ubits address.
-  size_t* cp = node->baCont + i;  // Current cbits address.
-  size_t ubits = *up;             // Current ubits[0] value.
-  size_t cbits = *cp;             // Current cbits[0] value.
-  size_t bit = (size_t)1 << (bitpos % kBitsPerEntity);
-
-  size_t cont = 0;
-  bool stop;
-
-  for (;;) {
-    stop = (cbits & bit) == 0;
-    ubits &= ~bit;
-    cbits &= ~bit;
-
-    bit <<= 1;
-    cont++;
-
-    if (stop || bit == 0) {
-      *up = ubits;
-      *cp = cbits;
-      if (stop)
-        break;
-
-      ubits = *++up;
-      cbits = *++cp;
-      bit = 1;
-    }
-  }
-
-  // If the freed block is fully allocated node then it's needed to
-  // update 'optimal' pointer in memory manager.
-  if (node->used == node->size) {
-    MemNode* cur = _optimal;
-
-    do {
-      cur = cur->prev;
-      if (cur == node) {
-        _optimal = node;
-        break;
-      }
-    } while (cur);
-  }
-
-  // Statistics.
-  cont *= node->density;
-  if (node->largestBlock < cont)
-    node->largestBlock = cont;
+//! \internal
+//!
+//! Allocate memory of any `type`, store the RW/RX difference to `rwDelta`.
+static void* vMemMgrAlloc(VMemMgr* self, size_t size, uint32_t type, intptr_t* rwDelta) noexcept {
+  if (type == kVMemAllocPermanent)
+    return vMemMgrAllocPermanent(self, size, rwDelta);
 
-  node->used -= cont;
-  _usedBytes -= cont;
+  if (self->hasOption(kVMemMgrOptionThreadCache) && size - 1 < kThreadCacheMaxSize)
+    return vMemMgrAllocCached(self, size, rwDelta);
 
-  // If page is empty, we can free it.
-  if (node->used == 0) {
-    // Free memory associated with node (this memory is not accessed
-    // anymore so it's safe).
-    vMemMgrReleaseVMem(this, node->mem, node->size);
-    ASMJIT_FREE(node->baUsed);
+  AutoLock locked(self->_lock);
+  return vMemMgrAllocLocked(self, size, rwDelta);
+}
 
-    node->baUsed = nullptr;
-    node->baCont = nullptr;
+void* VMemMgr::alloc(size_t size, uint32_t type) noexcept {
+  intptr_t rwDelta;
+  return vMemMgrAlloc(this, size, type, &rwDelta);
+}
 
-    // Statistics.
-    _allocatedBytes -= node->size;
+void* VMemMgr::alloc(size_t size, uint32_t type, void** rwPtr) noexcept {
+  intptr_t rwDelta;
+  void* p = vMemMgrAlloc(this, size, type, &rwDelta);
 
-    // Remove node. This function can return different node than
-    // passed into, but data is copied into previous node if needed.
-    ASMJIT_FREE(vMemMgrRemoveNode(this, node));
-    ASMJIT_ASSERT(vMemMgrCheckTree(this));
-  }
+  *rwPtr = p ? (void*)((uintptr_t)p + (uintptr_t)rwDelta) : nullptr;
+  return p;
+}
 
-  return kErrorOk;
+Error VMemMgr::release(void* p) noexcept {
+  if (p == nullptr)
+    return kErrorOk;
+
+  if (hasOption(kVMemMgrOptionThreadCache))
+    return vMemMgrReleaseCached(this, p);
+
+  AutoLock locked(_lock);
+  return vMemMgrReleaseLocked(this, p);
 }
 
 Error VMemMgr::shrink(void* p, size_t used) noexcept {
@@ -1069,9 +2642,16 @@ Error VMemMgr::shrink(void* p, size_t used) noexcept {
 
   AutoLock locked(_lock);
 
+  // A shrunk block doesn't match its size class anymore.
+  ASMJIT_PROPAGATE_ERROR(vMemMgrCacheRemove(this, p));
+
+  // Blocks allocated from slabs can't be shrunk, but it's not an error.
   MemNode* node = vMemMgrFindNodeByPtr(this, (uint8_t*)p);
-  if (node == nullptr)
+  if (node == nullptr) {
+    if (_slabHeap != nullptr && vMemMgrFindSlab(_slabHeap, static_cast<uint8_t*>(p)) != nullptr)
+      return kErrorOk;
     return kErrorInvalidArgument;
+  }
 
   size_t offset = (size_t)((uint8_t*)p - (uint8_t*)node->mem);
   size_t bitpos = M_DIV(offset, node->density);
@@ -1142,6 +2722,159 @@ _EnterFreeLoop:
   return kErrorOk;
 }
 
+//! \internal
+//!
+//! Split memory allocated at `p`, `_lock` has to be held by the caller.
+static Error vMemMgrSplit(VMemMgr* self, void* p, const size_t* offsets, size_t count) noexcept {
+  MemNode* node = vMemMgrFindNodeByPtr(self, static_cast<uint8_t*>(p));
+  if (node == nullptr)
+    return kErrorInvalidArgument;
+
+  size_t offset = (size_t)((uint8_t*)p - (uint8_t*)node->mem);
+  size_t bitpos = M_DIV(offset, node->density);
+  size_t i;
+
+  // Validate all offsets first so the allocation is never split partially.
+  // The block that precedes each split point has to be continued, otherwise
+  // the offset points outside of the memory allocated at `p`.
+  for (i = 0; i < count; i++) {
+    size_t splitOffset = offsets[i];
+    if (splitOffset == 0)
+      continue;
+
+    if (M_MOD(splitOffset, node->density) != 0)
+      return kErrorInvalidArgument;
+
+    size_t prev = bitpos + M_DIV(splitOffset, node->density) - 1;
+    if (prev >= node->blocks)
+      return kErrorInvalidArgument;
+
+    size_t bit = (size_t)1 << (prev % kBitsPerEntity);
+    if ((node->baCont[prev / kBitsPerEntity] & bit) == 0)
+      return kErrorInvalidArgument;
+  }
+
+  for (i = 0; i < count; i++) {
+    size_t splitOffset = offsets[i];
+    if (splitOffset == 0)
+      continue;
+
+    size_t prev = bitpos + M_DIV(splitOffset, node->density) - 1;
+    node->baCont[prev / kBitsPerEntity] &= ~((size_t)1 << (prev % kBitsPerEntity));
+  }
+
+  return kErrorOk;
+}
+
+Error VMemMgr::split(void* p, const size_t* offsets, size_t count) noexcept {
+  if (p == nullptr)
+    return kErrorInvalidArgument;
+
+  AutoLock locked(_lock);
+
+  // Blocks of a split allocation don't match its size class.
+  ASMJIT_PROPAGATE_ERROR(vMemMgrCacheRemove(this, p));
+  return vMemMgrSplit(this, p, offsets, count);
+}
+
+void* VMemMgr::allocSplit(size_t size, const size_t* offsets, size_t count, void** rwPtr) noexcept {
+  intptr_t rwDelta;
+  AutoLock locked(_lock);
+
+  void* p = vMemMgrAllocFreeable(this, size, &rwDelta);
+  if (p != nullptr && vMemMgrSplit(this, p, offsets, count) != kErrorOk) {
+    vMemMgrReleaseFreeable(this, p);
+    p = nullptr;
+  }
+
+  *rwPtr = p ? (void*)((uintptr_t)p + (uintptr_t)rwDelta) : nullptr;
+  return p;
+}
+
+Error VMemMgr::releaseBatch(void* const* ptrs, size_t count) noexcept {
+  Error err = kErrorOk;
+  AutoLock locked(_lock);
+
+  for (size_t i = 0; i < count; i++) {
+    void* p = ptrs[i];
+    if (p == nullptr)
+      continue;
+
+    Error e = vMemMgrReleaseLocked(this, p);
+    if (e != kErrorOk)
+      err = e;
+  }
+
+  return err;
+}
+
+void VMemMgr::flushThreadCache() noexcept {
+  if (!hasOption(kVMemMgrOptionThreadCache))
+    return;
+
+  ThreadCache* cache = vMemMgrGetThreadCacheSlot(this);
+  if (cache == nullptr)
+    return;
+
+  AutoLock locked(_lock);
+  vMemMgrDrainThreadCache(this, cache);
+}
+
+// ============================================================================
+// [asmjit::VMemMgr - Stats]
+// ============================================================================
+
+//! \internal
+//!
+//! Get the size of the largest free block of `node`.
+static size_t vMemMgrGetLargestFreeBlock(MemNode* node) noexcept {
+  size_t largest = 0;
+  size_t cont = 0;
+
+  for (size_t i = 0; i < node->blocks; i++) {
+    if (node->baUsed[i / kBitsPerEntity] & ((size_t)1 << (i % kBitsPerEntity))) {
+      largest = Utils::iMax(largest, cont);
+      cont = 0;
+    }
+    else {
+      cont++;
+    }
+  }
+
+  return Utils::iMax(largest, cont) * node->density;
+}
+
+void VMemMgr::getStats(VMemStats* stats) noexcept {
+  AutoLock locked(_lock);
+
+  stats->allocatedBytes = _allocatedBytes;
+  stats->usedBytes = _usedBytes;
+
+  stats->nodeCount = 0;
+  stats->freeBytes = 0;
+  stats->largestFreeBlock = 0;
+
+  for (MemNode* node = _first; node; node = node->next) {
+    stats->nodeCount++;
+    stats->freeBytes += node->size - node->used;
+    stats->largestFreeBlock = Utils::iMax(stats->largestFreeBlock, vMemMgrGetLargestFreeBlock(node));
+  }
+
+  if (_slabHeap != nullptr) {
+    stats->slabCount = _slabHeap->slabCount;
+    stats->slabBytes = _slabHeap->slabBytes;
+    stats->slabUsedBytes = _slabHeap->slabUsedBytes;
+  }
+  else {
+    stats->slabCount = 0;
+    stats->slabBytes = 0;
+    stats->slabUsedBytes = 0;
+  }
+
+  stats->allocCount = _allocCount;
+  stats->allocTime = _allocTime;
+}
+
 // ============================================================================
 // [asmjit::VMem - Test]
 // ============================================================================
@@ -1186,6 +2919,441 @@ static void VMemTest_shuffle(void** a, void** b, size_t count) noexcept {
   }
 }
 
+struct VMemTestThreadData {
+  VMemMgr* memmgr;
+  uint32_t seed;
+  uint32_t failures;
+
+  // Blocks left allocated when the thread exits, released by another thread.
+  void* blocks[512];
+  uint32_t sizes[512];
+};
+
+static uint32_t VMemTest_random(uint32_t& seed) noexcept {
+  seed = seed * 1103515245 + 12345;
+  return (seed >> 16) & 0x7FFF;
+}
+
+static bool VMemTest_check(const void* p, uint32_t size, uint32_t pattern) noexcept {
+  const uint8_t* data = static_cast<const uint8_t*>(p);
+  for (uint32_t i = 0; i < size; i++)
+    if (data[i] != static_cast<uint8_t>(pattern))
+      return false;
+  return true;
+}
+
+static void VMemTest_threadStress(VMemTestThreadData* data) noexcept {
+  VMemMgr* memmgr = data->memmgr;
+  uint32_t kSlots = static_cast<uint32_t>(ASMJIT_ARRAY_SIZE(data->blocks));
+
+  for (uint32_t i = 0; i < kSlots; i++) {
+    data->blocks[i] = nullptr;
+    data->sizes[i] = 0;
+  }
+
+  for (uint32_t n = 0; n < 50000; n++) {
+    uint32_t slot = VMemTest_random(data->seed) % kSlots;
+    void* p = data->blocks[slot];
+
+    // Release a block, but check first that nobody else overwrote it.
+    if (p != nullptr) {
+      if (!VMemTest_check(p, data->sizes[slot], slot))
+        data->failures++;
+      if (memmgr->release(p) != kErrorOk)
+        data->failures++;
+
+      data->blocks[slot] = nullptr;
+      continue;
+    }
+
+    // Mostly small allocations, which are served by the thread cache.
+    uint32_t size = (VMemTest_random(data->seed) % 8) == 0
+      ? (VMemTest_random(data->seed) % 8000) + 1
+      : (VMemTest_random(data->seed) % 1000) + 1;
+
+    p = memmgr->alloc(size);
+    if (p == nullptr) {
+      data->failures++;
+      continue;
+    }
+
+    ::memset(p, static_cast<int>(slot & 0xFF), size);
+    data->blocks[slot] = p;
+    data->sizes[slot] = size;
+  }
+
+  memmgr->flushThreadCache();
+}
+
+#if ASMJIT_OS_WINDOWS
+static DWORD WINAPI VMemTest_threadEntry(LPVOID arg) {
+  VMemTest_threadStress(static_cast<VMemTestThreadData*>(arg));
+  return 0;
+}
+#else
+static void* VMemTest_threadEntry(void* arg) {
+  VMemTest_threadStress(static_cast<VMemTestThreadData*>(arg));
+  return nullptr;
+}
+#endif // ASMJIT_OS_WINDOWS
+
+static void VMemTest_threads(uint32_t options) noexcept {
+  enum { kThreadCount = 8 };
+
+  VMemMgr memmgr(options);
+  VMemTestThreadData* data = static_cast<VMemTestThreadData*>(
+    ASMJIT_ALLOC(sizeof(VMemTestThreadData) * kThreadCount));
+
+  EXPECT(data != nullptr,
+    "Couldn't allocate %u bytes on heap.", static_cast<unsigned int>(sizeof(VMemTestThreadData) * kThreadCount));
+
+  uint32_t i, j;
+  for (i = 0; i < kThreadCount; i++) {
+    data[i].memmgr = &memmgr;
+    data[i].seed = 100 + i;
+    data[i].failures = 0;
+  }
+
+#if ASMJIT_OS_WINDOWS
+  HANDLE threads[kThreadCount];
+  for (i = 0; i < kThreadCount; i++) {
+    threads[i] = ::CreateThread(nullptr, 0, VMemTest_threadEntry, &data[i], 0, nullptr);
+    EXPECT(threads[i] != nullptr, "Couldn't create thread #%u.", i);
+  }
+
+  for (i = 0; i < kThreadCount; i++) {
+    ::WaitForSingleObject(threads[i], INFINITE);
+    ::CloseHandle(threads[i]);
+  }
+#else
+  pthread_t threads[kThreadCount];
+  for (i = 0; i < kThreadCount; i++) {
+    EXPECT(::pthread_create(&threads[i], nullptr, VMemTest_threadEntry, &data[i]) == 0,
+      "Couldn't create thread #%u.", i);
+  }
+
+  for (i = 0; i < kThreadCount; i++)
+    ::pthread_join(threads[i], nullptr);
+#endif // ASMJIT_OS_WINDOWS
+
+  VMemTest_stats(memmgr);
+
+  // Verify and release what other threads left allocated.
+  for (i = 0; i < kThreadCount; i++) {
+    EXPECT(data[i].failures == 0,
+      "Thread #%u reported %u failures.", i, data[i].failures);
+
+    for (j = 0; j < ASMJIT_ARRAY_SIZE(data[i].blocks); j++) {
+      void* p = data[i].blocks[j];
+      if (p == nullptr)
+        continue;
+
+      EXPECT(VMemTest_check(p, data[i].sizes[j], j),
+        "Pattern (%p) doesn't match", p);
+      EXPECT(memmgr.release(p) == kErrorOk,
+        "Failed to free %p.", p);
+    }
+  }
+
+  memmgr.flushThreadCache();
+  VMemTest_stats(memmgr);
+
+  // Only empty slabs kept for reuse can remain allocated.
+  VMemStats stats;
+  memmgr.getStats(&stats);
+
+  EXPECT(memmgr.getUsedBytes() == 0,
+    "All memory should be released, %u bytes still used.", static_cast<unsigned int>(memmgr.getUsedBytes()));
+  EXPECT(memmgr.getAllocatedBytes() == stats.slabBytes,
+    "All memory should be released, %u bytes still allocated.", static_cast<unsigned int>(memmgr.getAllocatedBytes()));
+
+  ASMJIT_FREE(data);
+}
+
+static void VMemTest_dualMapping(uint32_t options) noexcept {
+  VMemMgr memmgr(options | kVMemMgrOptionDualMapping);
+
+  void* rw;
+  void* rx = memmgr.alloc(256, kVMemAllocFreeable, &rw);
+
+  EXPECT(rx != nullptr && rw != nullptr,
+    "Couldn't allocate dual mapped virtual memory.");
+  EXPECT(rx != rw,
+    "Dual mapped RX (%p) and RW (%p) views should be different.", rx, rw);
+
+  // Both views must share the same physical memory.
+  ::memset(rw, 0xCC, 256);
+  EXPECT(VMemTest_check(rx, 256, 0xCC),
+    "Pattern (%p) doesn't match", rx);
+
+#if ASMJIT_ARCH_X86 || ASMJIT_ARCH_X64
+  // The RX view must be executable: `mov eax, 42` and `ret`.
+  typedef int (*Func)(void);
+  static const uint8_t code[] = { 0xB8, 0x2A, 0x00, 0x00, 0x00, 0xC3 };
+
+  ::memcpy(rw, code, sizeof(code));
+  int result = asmjit_cast<Func>(rx)();
+
+  EXPECT(result == 42,
+    "Code executed through RX view returned %d, expected 42.", result);
+#endif // ASMJIT_ARCH_X86 || ASMJIT_ARCH_X64
+
+  EXPECT(memmgr.release(rx) == kErrorOk,
+    "Failed to free %p.", rx);
+
+  // Permanent memory has to be dual mapped as well.
+  rx = memmgr.alloc(64, kVMemAllocPermanent, &rw);
+  EXPECT(rx != nullptr && rw != nullptr && rx != rw,
+    "Couldn't allocate dual mapped permanent memory.");
+
+  memmgr.flushThreadCache();
+  VMemTest_stats(memmgr);
+}
+
+static void VMemTest_slabs() noexcept {
+  VMemMgr memmgr(kVMemMgrOptionSlabs | kVMemMgrOptionTimeStats);
+
+  enum { kCount = 20000 };
+  void* a[kCount];
+  uint32_t i;
+  uint32_t seed = 100;
+
+  for (i = 0; i < kCount; i++) {
+    uint32_t size = (VMemTest_random(seed) % 4096) + 1;
+
+    a[i] = memmgr.alloc(size);
+    EXPECT(a[i] != nullptr,
+      "Couldn't allocate %u bytes of virtual memory.", size);
+    ::memset(a[i], static_cast<int>(i & 0xFF), size);
+  }
+
+  VMemStats stats;
+  memmgr.getStats(&stats);
+
+  // All allocations up to 4kB are served by slabs.
+  EXPECT(stats.nodeCount == 0,
+    "No memory node should be created, %u found.", static_cast<unsigned int>(stats.nodeCount));
+  EXPECT(stats.slabUsedBytes == memmgr.getUsedBytes(),
+    "Slab used bytes don't match used bytes.");
+  EXPECT(stats.allocCount == kCount,
+    "Expected %u allocations measured, got %u.", kCount, static_cast<unsigned int>(stats.allocCount));
+
+  INFO("Slabs: %u, Utilization: %0.2f, Alloc time: %0.1f [ns].",
+    static_cast<unsigned int>(stats.slabCount),
+    stats.getSlabUtilization(),
+    stats.getAllocTimeAvg());
+
+  // Blocks larger than 4kB are allocated from nodes, which can be shrunk.
+  void* large = memmgr.alloc(kSlabMaxSize + 1);
+  EXPECT(large != nullptr && memmgr.shrink(large, 64) == kErrorOk,
+    "Couldn't allocate and shrink a large block.");
+  EXPECT(memmgr.shrink(a[0], 1) == kErrorOk,
+    "Shrinking a block allocated from a slab should be a no-op.");
+  EXPECT(memmgr.release(large) == kErrorOk,
+    "Failed to free %p.", large);
+
+  for (i = 0; i < kCount; i += 2) {
+    EXPECT(memmgr.release(a[i]) == kErrorOk,
+      "Failed to free %p.", a[i]);
+  }
+
+  EXPECT(memmgr.releaseBatch(a + 1, 1) == kErrorOk,
+    "Failed to free %p.", a[1]);
+  EXPECT(memmgr.release(static_cast<uint8_t*>(a[3]) + 1) != kErrorOk,
+    "Releasing a pointer inside of a slab block should fail.");
+
+  for (i = 3; i < kCount; i += 2) {
+    EXPECT(memmgr.release(a[i]) == kErrorOk,
+      "Failed to free %p.", a[i]);
+  }
+
+  memmgr.getStats(&stats);
+  EXPECT(memmgr.getUsedBytes() == 0,
+    "All memory should be released, %u bytes still used.", static_cast<unsigned int>(memmgr.getUsedBytes()));
+  EXPECT(stats.slabCount <= kSlabClassCount,
+    "At most one empty slab per class should be kept, %u found.", static_cast<unsigned int>(stats.slabCount));
+}
+
+static void VMemTest_split() noexcept {
+  VMemMgr memmgr;
+
+  size_t density = memmgr.getBlockDensity();
+  size_t offsets[4] = { 0, density, density * 3, density * 4 };
+
+  uint8_t* p = static_cast<uint8_t*>(memmgr.alloc(density * 6));
+  EXPECT(p != nullptr,
+    "Couldn't allocate %u bytes of virtual memory.", static_cast<unsigned int>(density * 6));
+
+  EXPECT(memmgr.split(p, offsets, 4) == kErrorOk,
+    "Failed to split %p.", p);
+
+  size_t misaligned = density / 2;
+  size_t outside = density * 7;
+
+  EXPECT(memmgr.split(p, &misaligned, 1) != kErrorOk,
+    "Split at a misaligned offset should fail.");
+  EXPECT(memmgr.split(p, &outside, 1) != kErrorOk,
+    "Split outside of the allocated memory should fail.");
+
+  // Each part has to be freeable individually.
+  EXPECT(memmgr.release(p + offsets[1]) == kErrorOk,
+    "Failed to free %p.", p + offsets[1]);
+  EXPECT(memmgr.getUsedBytes() == density * 4,
+    "Releasing a split part should free exactly 2 blocks.");
+
+  void* rest[3] = { p, p + offsets[2], p + offsets[3] };
+  EXPECT(memmgr.releaseBatch(rest, 3) == kErrorOk,
+    "Failed to free the rest of split memory.");
+  EXPECT(memmgr.getUsedBytes() == 0,
+    "All split memory should be released.");
+}
+
+static void VMemTest_invalidRelease(uint32_t options) noexcept {
+  VMemMgr memmgr(options);
+
+  // One block of a thread cache's size class and one larger than any class.
+  uint8_t* small = static_cast<uint8_t*>(memmgr.alloc(64));
+  uint8_t* large = static_cast<uint8_t*>(memmgr.alloc(2000));
+  EXPECT(small != nullptr && large != nullptr,
+    "Couldn't allocate virtual memory.");
+
+  int local;
+  EXPECT(memmgr.release(&local) == kErrorInvalidArgument,
+    "Releasing a pointer not allocated by VMemMgr should fail.");
+  EXPECT(memmgr.release(small + 1) == kErrorInvalidArgument,
+    "Releasing a pointer inside of a block should fail.");
+  EXPECT(memmgr.release(large + memmgr.getBlockDensity()) == kErrorInvalidArgument,
+    "Releasing a pointer inside of a multi-unit block should fail.");
+
+  EXPECT(memmgr.release(small) == kErrorOk,
+    "Failed to free %p.", small);
+  EXPECT(memmgr.release(small) == kErrorInvalidArgument,
+    "Releasing %p twice should fail.", small);
+
+  EXPECT(memmgr.release(large) == kErrorOk,
+    "Failed to free %p.", large);
+  EXPECT(memmgr.release(large) == kErrorInvalidArgument,
+    "Releasing %p twice should fail.", large);
+
+  // Thread caches of a manager using slabs are refilled from slabs.
+  if ((options & kVMemMgrOptionSlabs) != 0) {
+    VMemStats stats;
+    memmgr.getStats(&stats);
+    EXPECT(stats.nodeCount == 0,
+      "No memory node should be created, %u found.", static_cast<unsigned int>(stats.nodeCount));
+  }
+}
+
+//! Release of a block done by another thread.
+struct VMemTestReleaseData {
+  VMemMgr* memmgr;
+  void* p;
+  Error result;
+};
+
+#if ASMJIT_OS_WINDOWS
+static DWORD WINAPI VMemTest_releaseEntry(LPVOID arg) {
+  VMemTestReleaseData* data = static_cast<VMemTestReleaseData*>(arg);
+  data->result = data->memmgr->release(data->p);
+  return 0;
+}
+#else
+static void* VMemTest_releaseEntry(void* arg) {
+  VMemTestReleaseData* data = static_cast<VMemTestReleaseData*>(arg);
+  data->result = data->memmgr->release(data->p);
+  return nullptr;
+}
+#endif // ASMJIT_OS_WINDOWS
+
+static Error VMemTest_releaseByThread(VMemMgr& memmgr, void* p) noexcept {
+  VMemTestReleaseData data;
+  data.memmgr = &memmgr;
+  data.p = p;
+  data.result = kErrorInvalidState;
+
+#if ASMJIT_OS_WINDOWS
+  HANDLE thread = ::CreateThread(nullptr, 0, VMemTest_releaseEntry, &data, 0, nullptr);
+  EXPECT(thread != nullptr, "Couldn't create thread.");
+
+  ::WaitForSingleObject(thread, INFINITE);
+  ::CloseHandle(thread);
+#else
+  pthread_t thread;
+  EXPECT(::pthread_create(&thread, nullptr, VMemTest_releaseEntry, &data) == 0,
+    "Couldn't create thread.");
+
+  ::pthread_join(thread, nullptr);
+#endif // ASMJIT_OS_WINDOWS
+
+  return data.result;
+}
+
+static void VMemTest_threadCache(uint32_t options) noexcept {
+  enum { kBlockCount = 256 };
+
+  VMemMgr memmgr(options | kVMemMgrOptionThreadCache);
+  void* blocks[kBlockCount];
+  uint32_t i;
+
+  // A block released to the bin of this thread can't be released by another.
+  void* p = memmgr.alloc(64);
+  EXPECT(p != nullptr,
+    "Couldn't allocate 64 bytes of virtual memory.");
+  EXPECT(memmgr.release(p) == kErrorOk,
+    "Failed to free %p.", p);
+  EXPECT(VMemTest_releaseByThread(memmgr, p) == kErrorInvalidArgument,
+    "Releasing %p twice (by another thread) should fail.", p);
+
+  // And the other way around.
+  p = memmgr.alloc(64);
+  EXPECT(p != nullptr,
+    "Couldn't allocate 64 bytes of virtual memory.");
+  EXPECT(VMemTest_releaseByThread(memmgr, p) == kErrorOk,
+    "Failed to free %p by another thread.", p);
+  EXPECT(memmgr.release(p) == kErrorInvalidArgument,
+    "Releasing %p twice should fail.", p);
+
+  // More blocks than a bin can hold, the rest is returned in batches.
+  for (i = 0; i < kBlockCount; i++) {
+    blocks[i] = memmgr.alloc(64);
+    EXPECT(blocks[i] != nullptr,
+      "Couldn't allocate 64 bytes of virtual memory.");
+  }
+
+  for (i = 0; i < kBlockCount; i++)
+    EXPECT(memmgr.release(blocks[i]) == kErrorOk,
+      "Failed to free %p.", blocks[i]);
+
+  // Blocks are either in the bin, pending, or returned to the shared nodes.
+  for (i = 0; i < kBlockCount; i++)
+    EXPECT(memmgr.release(blocks[i]) == kErrorInvalidArgument,
+      "Releasing %p twice should fail.", blocks[i]);
+
+  EXPECT(memmgr.releaseBatch(blocks, kBlockCount) == kErrorInvalidArgument,
+    "Releasing blocks twice (as a batch) should fail.");
+
+  memmgr.flushThreadCache();
+  EXPECT(memmgr.getUsedBytes() == 0,
+    "All memory should be released, %u bytes still used.", static_cast<unsigned int>(memmgr.getUsedBytes()));
+}
+
+static void VMemTest_addressHint(uint32_t options) noexcept {
+  // Any function of the executable is a good hint, use this one.
+  const void* hint = (const void*)(uintptr_t)VMemTest_addressHint;
+
+  VMemMgr memmgr(options);
+  memmgr.setAddressHint(hint);
+
+  void* p = memmgr.alloc(256);
+  EXPECT(p != nullptr,
+    "Couldn't allocate 256 bytes of virtual memory.");
+  EXPECT(vMemIsNear(p, 256, hint),
+    "Memory %p is not within 2GB of the hint %p.", p, hint);
+
+  EXPECT(memmgr.release(p) == kErrorOk,
+    "Failed to free %p.", p);
+}
+
 UNIT(base_vmem) {
   VMemMgr memmgr;
 
@@ -1276,6 +3444,69 @@ UNIT(base_vmem) {
 
   ASMJIT_FREE(a);
   ASMJIT_FREE(b);
+
+  INFO("Split and batch release test.");
+  VMemTest_split();
+
+  INFO("Slab alloc/free test.");
+  VMemTest_slabs();
+
+  INFO("Invalid release test.");
+  VMemTest_invalidRelease(kVMemMgrOptionNone);
+
+  INFO("Invalid release test - thread cache.");
+  VMemTest_invalidRelease(kVMemMgrOptionThreadCache);
+
+  INFO("Invalid release test - slabs.");
+  VMemTest_invalidRelease(kVMemMgrOptionSlabs);
+
+  INFO("Invalid release test - slabs and thread cache.");
+  VMemTest_invalidRelease(kVMemMgrOptionSlabs | kVMemMgrOptionThreadCache);
+
+  INFO("Thread cache test.");
+  VMemTest_threadCache(kVMemMgrOptionNone);
+
+  INFO("Thread cache test - slabs.");
+  VMemTest_threadCache(kVMemMgrOptionSlabs);
+
+  INFO("Multi-threaded alloc/free test - shared lock.");
+  VMemTest_threads(kVMemMgrOptionNone);
+
+  INFO("Multi-threaded alloc/free test - thread cache.");
+  VMemTest_threads(kVMemMgrOptionThreadCache);
+
+  INFO("Multi-threaded alloc/free test - slabs.");
+  VMemTest_threads(kVMemMgrOptionSlabs);
+
+  INFO("Multi-threaded alloc/free test - slabs and thread cache.");
+  VMemTest_threads(kVMemMgrOptionSlabs | kVMemMgrOptionThreadCache);
+
+  INFO("Dual mapping test.");
+  VMemTest_dualMapping(kVMemMgrOptionNone);
+
+  INFO("Dual mapping test - thread cache.");
+  VMemTest_dualMapping(kVMemMgrOptionThreadCache);
+
+  INFO("Multi-threaded alloc/free test - huge pages.");
+  VMemTest_threads(kVMemMgrOptionHugePages);
+
+  INFO("Multi-threaded alloc/free test - huge pages and thread cache.");
+  VMemTest_threads(kVMemMgrOptionHugePages | kVMemMgrOptionThreadCache);
+
+  INFO("Dual mapping test - huge pages.");
+  VMemTest_dualMapping(kVMemMgrOptionHugePages);
+
+  INFO("Dual mapping test - slabs.");
+  VMemTest_dualMapping(kVMemMgrOptionSlabs);
+
+  INFO("Address hint test.");
+  VMemTest_addressHint(kVMemMgrOptionNone);
+
+  INFO("Address hint test - dual mapping.");
+  VMemTest_addressHint(kVMemMgrOptionDualMapping);
+
+  INFO("Address hint test - huge pages.");
+  VMemTest_addressHint(kVMemMgrOptionHugePages);
 }
 #endif // ASMJIT_TEST
 
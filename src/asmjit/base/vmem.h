@@ -40,7 +40,131 @@ ASMJIT_ENUM(VMemFlags) {
   //! Memory is writable.
   kVMemFlagWritable = 0x00000001,
   //! Memory is executable.
-  kVMemFlagExecutable = 0x00000002
+  kVMemFlagExecutable = 0x00000002,
+  //! Memory should be backed by huge pages if possible (size and alignment
+  //! are rounded up to `VMemUtil::getHugePageSize()`).
+  kVMemFlagHugePages = 0x00000004
+};
+
+// ============================================================================
+// [asmjit::VMemMgrOptions]
+// ============================================================================
+
+//! Options that can be passed to `VMemMgr` constructor.
+ASMJIT_ENUM(VMemMgrOptions) {
+  //! No options (default).
+  kVMemMgrOptionNone = 0x00000000,
+  //! Cache small allocations per thread.
+  //!
+  //! Each thread that allocates through the `VMemMgr` gets its own cache of
+  //! small blocks, which are refilled from the shared memory nodes in batches
+  //! (one lock per batch instead of one lock per allocation), so `alloc()`
+  //! doesn't touch the shared lock in the common case. `release()` of a cached
+  //! block doesn't take the lock either, the block is kept in the calling
+  //! thread's cache for reuse or returned to the shared nodes later, together
+  //! with other releases. A block released twice is rejected by any thread,
+  //! other pointers are validated under the shared lock as usual.
+  //!
+  //! NOTE: Memory cached by threads is reported as used by `getUsedBytes()`.
+  kVMemMgrOptionThreadCache = 0x00000001,
+  //! Map each chunk of memory twice, RX and RW (W^X).
+  //!
+  //! Memory returned by `VMemMgr::alloc()` is readable and executable, but not
+  //! writable. Use `VMemMgr::alloc()` overload that returns also the writable
+  //! view of the same memory to copy the code there. This mode never creates
+  //! pages that are writable and executable at the same time, which is required
+  //! by hardened kernels and some security policies (SELinux, PaX).
+  //!
+  //! NOTE: Not available for a remote process (Windows).
+  kVMemMgrOptionDualMapping = 0x00000002,
+  //! Reserve memory in large regions backed by huge pages.
+  //!
+  //! Regions of `VMemUtil::getHugePageSize()` bytes (2MB on most platforms)
+  //! are allocated with \ref kVMemFlagHugePages and memory nodes are carved
+  //! out of them. Keeping many small functions in a few huge pages decreases
+  //! instruction TLB misses. If the OS doesn't provide huge pages the regions
+  //! are still used, but backed by regular pages.
+  kVMemMgrOptionHugePages = 0x00000004,
+  //! Serve small allocations from size-class slabs.
+  //!
+  //! Allocations up to 4kB are rounded up to one of a few size classes and
+  //! carved out of slabs (64kB chunks divided into blocks of the same size),
+  //! which makes both `alloc()` and `release()` O(1) regardless of how much
+  //! the memory is fragmented. Larger allocations use the bitmap nodes.
+  //!
+  //! When combined with \ref kVMemMgrOptionThreadCache thread caches are
+  //! refilled from slabs as well, size classes of both are the same.
+  //!
+  //! NOTE: Memory allocated from slabs can't be split, see `VMemMgr::split()`.
+  kVMemMgrOptionSlabs = 0x00000008,
+  //! Measure time spent by allocations, see `VMemStats::allocTime`.
+  kVMemMgrOptionTimeStats = 0x00000010
+};
+
+// ============================================================================
+// [asmjit::VMemStats]
+// ============================================================================
+
+//! Statistics of \ref VMemMgr, see `VMemMgr::getStats()`.
+struct VMemStats {
+  // --------------------------------------------------------------------------
+  // [Accessors]
+  // --------------------------------------------------------------------------
+
+  //! Get external fragmentation of bitmap nodes (0.0 means no fragmentation).
+  //!
+  //! It's a ratio of free memory that isn't part of the largest free block,
+  //! thus it's 0.0 when all free memory can be used by a single allocation.
+  ASMJIT_INLINE double getFragmentation() const noexcept {
+    if (freeBytes == 0)
+      return 0.0;
+    return 1.0 - static_cast<double>(largestFreeBlock) / static_cast<double>(freeBytes);
+  }
+
+  //! Get a ratio of slab memory used by allocated blocks.
+  ASMJIT_INLINE double getSlabUtilization() const noexcept {
+    if (slabBytes == 0)
+      return 0.0;
+    return static_cast<double>(slabUsedBytes) / static_cast<double>(slabBytes);
+  }
+
+  //! Get average time of a single allocation in nanoseconds.
+  ASMJIT_INLINE double getAllocTimeAvg() const noexcept {
+    if (allocCount == 0)
+      return 0.0;
+    return static_cast<double>(allocTime) / static_cast<double>(allocCount);
+  }
+
+  // --------------------------------------------------------------------------
+  // [Members]
+  // --------------------------------------------------------------------------
+
+  //! How many bytes are allocated (same as `VMemMgr::getAllocatedBytes()`).
+  size_t allocatedBytes;
+  //! How many bytes are used (same as `VMemMgr::getUsedBytes()`).
+  size_t usedBytes;
+
+  //! Count of bitmap nodes.
+  size_t nodeCount;
+  //! How many bytes are free in bitmap nodes.
+  size_t freeBytes;
+  //! Size of the largest free block in bitmap nodes.
+  size_t largestFreeBlock;
+
+  //! Count of slabs (only used by \ref kVMemMgrOptionSlabs).
+  size_t slabCount;
+  //! How many bytes are allocated by slabs.
+  size_t slabBytes;
+  //! How many bytes of slabs are used by allocated blocks.
+  size_t slabUsedBytes;
+
+  //! Count of allocations measured (only used by \ref kVMemMgrOptionTimeStats).
+  //!
+  //! Only allocations served under the shared lock are measured, allocations
+  //! served by thread caches (\ref kVMemMgrOptionThreadCache) are not.
+  uint64_t allocCount;
+  //! Time spent by measured allocations in nanoseconds.
+  uint64_t allocTime;
 };
 
 // ============================================================================
@@ -65,18 +189,41 @@ struct VMemUtil {
   //! Get a recommended granularity for a single `alloc` call.
   static ASMJIT_API size_t getPageGranularity() noexcept;
 
+  //! Get a size/alignment of a huge page, used by \ref kVMemFlagHugePages.
+  static ASMJIT_API size_t getHugePageSize() noexcept;
+
   //! Allocate virtual memory.
   //!
   //! Pages are readable/writeable, but they are not guaranteed to be
   //! executable unless 'canExecute' is true. Returns the address of
   //! allocated memory, or `nullptr` on failure.
-  static ASMJIT_API void* alloc(size_t length, size_t* allocated, uint32_t flags) noexcept;
+  //!
+  //! If `flags` contain \ref kVMemFlagHugePages the memory is aligned to
+  //! `getHugePageSize()` and uses `MAP_HUGETLB` or `madvise(MADV_HUGEPAGE)`
+  //! on POSIX and `MEM_LARGE_PAGES` on Windows, if available.
+  //!
+  //! If `hint` is not `nullptr` free regions within ±2GB of `hint` are probed
+  //! first, so the memory can reach `hint` by a 32-bit relative displacement.
+  //! The memory is allocated anywhere if there is no such region.
+  static ASMJIT_API void* alloc(size_t length, size_t* allocated, uint32_t flags, const void* hint = nullptr) noexcept;
   //! Free memory allocated by `alloc()`.
   static ASMJIT_API Error release(void* addr, size_t length) noexcept;
 
+  //! Allocate virtual memory mapped twice.
+  //!
+  //! Both views share the same physical memory. The returned view is readable
+  //! and executable, the view stored in `rwPtr` is readable and writable. The
+  //! memory is backed by an anonymous file (`memfd_create()` or `shm_open()`
+  //! on POSIX, `CreateFileMapping()` on Windows). Returns the address of the
+  //! executable view, or `nullptr` on failure. The executable view is placed
+  //! near `hint` if possible, see `alloc()`.
+  static ASMJIT_API void* allocDualMapping(size_t length, size_t* allocated, void** rwPtr, const void* hint = nullptr) noexcept;
+  //! Free memory allocated by `allocDualMapping()`.
+  static ASMJIT_API Error releaseDualMapping(void* rxPtr, void* rwPtr, size_t length) noexcept;
+
 #if ASMJIT_OS_WINDOWS
   //! Allocate virtual memory of `hProcess` (Windows only).
-  static ASMJIT_API void* allocProcessMemory(HANDLE hProcess, size_t length, size_t* allocated, uint32_t flags) noexcept;
+  static ASMJIT_API void* allocProcessMemory(HANDLE hProcess, size_t length, size_t* allocated, uint32_t flags, const void* hint = nullptr) noexcept;
 
   //! Release virtual memory of `hProcess` (Windows only).
   static ASMJIT_API Error releaseProcessMemory(HANDLE hProcess, void* addr, size_t length) noexcept;
@@ -97,14 +244,18 @@ class VMemMgr {
 
 #if !ASMJIT_OS_WINDOWS
   //! Create a `VMemMgr` instance.
-  ASMJIT_API VMemMgr() noexcept;
+  //!
+  //! The `options` parameter is a combination of \ref VMemMgrOptions.
+  ASMJIT_API VMemMgr(uint32_t options = kVMemMgrOptionNone) noexcept;
 #else
   //! Create a `VMemMgr` instance.
   //!
+  //! The `options` parameter is a combination of \ref VMemMgrOptions.
+  //!
   //! NOTE: When running on Windows it's possible to specify a `hProcess` to
   //! be used for memory allocation. Using `hProcess` allows to allocate memory
   //! of a remote process.
-  ASMJIT_API VMemMgr(HANDLE hProcess = static_cast<HANDLE>(0)) noexcept;
+  ASMJIT_API VMemMgr(HANDLE hProcess = static_cast<HANDLE>(0), uint32_t options = kVMemMgrOptionNone) noexcept;
 #endif // ASMJIT_OS_WINDOWS
 
   //! Destroy the `VMemMgr` instance and free all blocks.
@@ -115,6 +266,10 @@ class VMemMgr {
   // --------------------------------------------------------------------------
 
   //! Free all allocated memory.
+  //!
+  //! NOTE: Must not be called while other threads allocate or release memory
+  //! of this `VMemMgr`, memory cached by their thread caches is discarded
+  //! without synchronizing with them.
   ASMJIT_API void reset() noexcept;
 
   // --------------------------------------------------------------------------
@@ -128,6 +283,40 @@ class VMemMgr {
   }
 #endif // ASMJIT_OS_WINDOWS
 
+  //! Get options passed to the constructor, see \ref VMemMgrOptions.
+  ASMJIT_INLINE uint32_t getOptions() const noexcept {
+    return _options;
+  }
+
+  //! Get whether the `option` is enabled, see \ref VMemMgrOptions.
+  ASMJIT_INLINE bool hasOption(uint32_t option) const noexcept {
+    return (_options & option) != 0;
+  }
+
+  //! Get the address hint, see \ref setAddressHint.
+  ASMJIT_INLINE const void* getAddressHint() const noexcept {
+    return _addressHint;
+  }
+
+  //! Set the address hint used to allocate new chunks of virtual memory.
+  //!
+  //! Chunks are allocated within ±2GB of `hint` if possible, so code placed
+  //! there can call or jump to `hint` (for example a function of the host
+  //! executable) and its neighbourhood by a 32-bit relative displacement,
+  //! without a trampoline or veneer. Only affects chunks allocated after the
+  //! call, `nullptr` (default) means no preference.
+  ASMJIT_INLINE void setAddressHint(const void* hint) noexcept {
+    _addressHint = hint;
+  }
+
+  //! Get the granularity (and minimum alignment) of freeable allocations.
+  ASMJIT_INLINE size_t getBlockDensity() const noexcept {
+    return _blockDensity;
+  }
+
+  //! Get statistics, which require walking all memory nodes (slow).
+  ASMJIT_API void getStats(VMemStats* stats) noexcept;
+
   //! Get how many bytes are currently allocated.
   ASMJIT_INLINE size_t getAllocatedBytes() const noexcept {
     return _allocatedBytes;
@@ -172,12 +361,44 @@ class VMemMgr {
   //! manager that allocated memory will be never freed.
   ASMJIT_API void* alloc(size_t size, uint32_t type = kVMemAllocFreeable) noexcept;
 
+  //! Allocate a `size` bytes of virtual memory and store the address of its
+  //! writable view to `rwPtr`.
+  //!
+  //! If \ref kVMemMgrOptionDualMapping is enabled the returned memory is not
+  //! writable and the code has to be written through `rwPtr`, otherwise `rwPtr`
+  //! is the same as the returned address.
+  ASMJIT_API void* alloc(size_t size, uint32_t type, void** rwPtr) noexcept;
+
   //! Free previously allocated memory at a given `address`.
   ASMJIT_API Error release(void* p) noexcept;
 
   //! Free extra memory allocated with `p`.
   ASMJIT_API Error shrink(void* p, size_t used) noexcept;
 
+  //! Split memory allocated at `p` into separate allocations.
+  //!
+  //! Each of `count` `offsets` (relative to `p`) starts a new allocation that
+  //! can be released independently of others. All offsets must be multiples
+  //! of `getBlockDensity()` and must be within the memory allocated at `p`.
+  ASMJIT_API Error split(void* p, const size_t* offsets, size_t count) noexcept;
+
+  //! Allocate `size` bytes of freeable memory and split it at `offsets`.
+  //!
+  //! This is the same as `alloc()` followed by `split()`, but it's done under
+  //! a single lock and it never uses slabs or thread caches, so splitting
+  //! can't fail. The writable view is stored to `rwPtr`.
+  ASMJIT_API void* allocSplit(size_t size, const size_t* offsets, size_t count, void** rwPtr) noexcept;
+
+  //! Free `count` allocations at once (the lock is acquired only once).
+  ASMJIT_API Error releaseBatch(void* const* ptrs, size_t count) noexcept;
+
+  //! Return all memory cached by the calling thread to the shared memory
+  //! nodes (only useful if \ref kVMemMgrOptionThreadCache is enabled).
+  //!
+  //! This happens automatically when the thread exits (POSIX only) and when
+  //! the `VMemMgr` is destroyed or reset.
+  ASMJIT_API void flushThreadCache() noexcept;
+
   // --------------------------------------------------------------------------
   // [Members]
   // --------------------------------------------------------------------------
@@ -189,6 +410,10 @@ class VMemMgr {
 
   //! Lock to enable thread-safe functionality.
   Lock _lock;
+  //! Options, see \ref VMemMgrOptions.
+  uint32_t _options;
+  //! Address hint, see \ref setAddressHint.
+  const void* _addressHint;
 
   //! Default block size.
   size_t _blockSize;
@@ -209,6 +434,11 @@ class VMemMgr {
   struct RbNode;
   struct MemNode;
   struct PermanentNode;
+  struct ThreadCache;
+  struct CacheTable;
+  struct HugeRegion;
+  struct Slab;
+  struct SlabHeap;
 
   // Memory nodes root.
   MemNode* _root;
@@ -219,6 +449,27 @@ class VMemMgr {
   // Permanent memory.
   PermanentNode* _permanent;
 
+  // Huge regions (only used by `kVMemMgrOptionHugePages`).
+  HugeRegion* _hugeRegions;
+
+  // Slabs (only used by `kVMemMgrOptionSlabs`).
+  SlabHeap* _slabHeap;
+
+  // Allocations measured (only used by `kVMemMgrOptionTimeStats`).
+  uint64_t _allocCount;
+  uint64_t _allocTime;
+
+  // Thread caches (only used by `kVMemMgrOptionThreadCache`).
+  ThreadCache* _threadCaches;
+  // Blocks of all thread caches.
+  CacheTable* _cacheTable;
+  // Thread-local slot that holds the calling thread's `ThreadCache`.
+#if ASMJIT_OS_WINDOWS
+  DWORD _threadCacheSlot;
+#else
+  pthread_key_t _threadCacheSlot;
+#endif // ASMJIT_OS_WINDOWS
+
   //! \}
 };
 
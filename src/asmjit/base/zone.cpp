@@ -74,6 +74,20 @@ void Zone::reset(bool releaseMemory) noexcept {
   }
 }
 
+// ============================================================================
+// [asmjit::Zone - Accessors]
+// ============================================================================
+
+size_t Zone::getUsedSize() const noexcept {
+  size_t size = 0;
+
+  // Blocks after the current one are not used, see `reset()`.
+  for (const Block* cur = _block; cur != nullptr; cur = cur->prev)
+    size += (size_t)(cur->pos - cur->data);
+
+  return size;
+}
+
 // ============================================================================
 // [asmjit::Zone - Alloc]
 // ============================================================================
@@ -119,6 +119,11 @@ class Zone {
     return _blockSize;
   }
 
+  //! Get count of bytes allocated since the zone was created or reset.
+  //!
+  //! NOTE: Walks all blocks in use, it's meant for statistics.
+  ASMJIT_API size_t getUsedSize() const noexcept;
+
   // --------------------------------------------------------------------------
   // [Alloc]
   // --------------------------------------------------------------------------
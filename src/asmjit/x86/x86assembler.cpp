@@ -521,8 +521,11 @@ size_t X86Assembler::_relocCode(void* _dst, Ptr baseAddress) const noexcept {
     ASMJIT_ASSERT(offset + rd.size <= static_cast<Ptr>(maxCodeSize));
 
     // Whether to use trampoline, can be only used if relocation type is
-    // kRelocAbsToRel on 64-bit.
+    // kRelocAbsToRel on 64-bit. The absolute address is read either from a
+    // veneer shared by all functions of the runtime or from a slot that is
+    // appended to the function.
     bool useTrampoline = false;
+    bool useVeneer = false;
 
     switch (rd.type) {
       case kRelocAbsToAbs:
@@ -539,7 +542,17 @@ size_t X86Assembler::_relocCode(void* _dst, Ptr baseAddress) const noexcept {
       case kRelocTrampoline:
         ptr -= baseAddress + rd.from + 4;
         if (!Utils::isInt32(static_cast<SignedPtr>(ptr))) {
-          ptr = (Ptr)tramp - (baseAddress + rd.from + 4);
+          Ptr veneer = _runtime->_getVeneer(rd.data, baseAddress + rd.from + 4);
+
+          if (veneer != 0) {
+            ptr = veneer - (baseAddress + rd.from + 4);
+            useVeneer = true;
+          }
+          else {
+            // The trampoline is relative to `baseAddress`, not to `dst`, which
+            // can be a different (writable) view of the same memory.
+            ptr = (Ptr)(tramp - dst) - (rd.from + 4);
+          }
           useTrampoline = true;
         }
         break;
@@ -579,15 +592,17 @@ size_t X86Assembler::_relocCode(void* _dst, Ptr baseAddress) const noexcept {
       dst[offset - 2] = byte0;
       dst[offset - 1] = byte1;
 
-      // Absolute address.
-      Utils::writeU64u(tramp, static_cast<uint64_t>(rd.data));
+      if (!useVeneer) {
+        // Absolute address.
+        Utils::writeU64u(tramp, static_cast<uint64_t>(rd.data));
 
-      // Advance trampoline pointer.
-      tramp += 8;
+        // Advance trampoline pointer.
+        tramp += 8;
+      }
 
 #if !defined(ASMJIT_DISABLE_LOGGER)
       if (logger)
-        logger->logFormat(Logger::kStyleComment, "; Trampoline %llX\n", rd.data);
+        logger->logFormat(Logger::kStyleComment, useVeneer ? "; Veneer %llX\n" : "; Trampoline %llX\n", rd.data);
 #endif // !ASMJIT_DISABLE_LOGGER
     }
   }
@@ -912,6 +927,219 @@ static const Operand::VRegOp x86PatchedHiRegs[4] = {
 };
 #undef HI_REG
 
+//! \internal
+//!
+//! Get whether `op` is a GP register that can be encoded by the fast path
+//! (32-bit, or 64-bit in 64-bit mode).
+template<int Arch>
+static ASMJIT_INLINE bool X86Assembler_isFastGp(const Operand* op) {
+  return op->isRegType(kX86RegTypeGpd) || (Arch == kArchX64 && op->isRegType(kX86RegTypeGpq));
+}
+
+//! \internal
+//!
+//! Get whether `mem` can be encoded by the fast path - [base + index * scale +
+//! disp] having a GP base of the native width and no segment override.
+template<int Arch>
+static ASMJIT_INLINE bool X86Assembler_isFastMem(const X86Mem* mem) {
+  if (!mem->isBaseIndexType() || !mem->hasBase() || mem->hasSegment())
+    return false;
+
+  if (mem->hasGpdBase() != (Arch == kArchX86))
+    return false;
+
+  return !mem->hasIndex() || (mem->getIndex() & 0x07) != kX86RegIndexSp;
+}
+
+//! \internal
+//!
+//! Encode the most common forms of MOV and arithmetic instructions (ADC, ADD,
+//! AND, CMP, OR, SBB, SUB, and XOR) - reg/reg, reg/imm, reg/mem, and mem/reg
+//! having 32-bit or 64-bit GP operands, which make the majority of the code
+//! generated by `X86Compiler`.
+//!
+//! Opcodes are taken from the instruction table, only operands are checked
+//! here. Returns the new cursor or `nullptr` if the instruction has to be
+//! encoded by the generic path, nothing is written in such case. The caller
+//! guarantees that there are no instruction options, no logger, and at least
+//! 16 bytes of space. The output is the same as of the generic path.
+template<int Arch>
+static ASMJIT_INLINE uint8_t* X86Assembler_emitFast(uint32_t code, const Operand* o0, const Operand* o1, const Operand* o2, uint8_t* cursor) {
+  const X86InstInfo& info = _x86InstInfo[code];
+  uint32_t encoding = info.getEncoding();
+
+  if ((encoding != kX86InstEncodingX86Arith && encoding != kX86InstEncodingX86Mov) || !o2->isNone())
+    return nullptr;
+
+  uint32_t encoded = o0->getOp() + (o1->getOp() << 3);
+  bool isMov = encoding == kX86InstEncodingX86Mov;
+
+  // Instruction opcode (single byte).
+  uint32_t opCode = info.getPrimaryOpCode() & 0xFF;
+  // ModR/M opcode or register code, `kInvalidReg` if there is no ModR/M.
+  uint32_t opReg;
+  // ModR/M register code, or register added to `opCode`.
+  uint32_t rmReg = 0;
+  // ModR/M memory operand.
+  const X86Mem* rmMem = nullptr;
+  // Register that determines the operand size.
+  const Operand* sizeReg;
+
+  // Immediate value.
+  int64_t imVal = 0;
+  // Immediate length.
+  uint32_t imLen = 0;
+
+  switch (encoded) {
+    case ENC_OPS(Reg, Reg, None):
+      if (!X86Assembler_isFastGp<Arch>(o1))
+        return nullptr;
+
+      opCode = isMov ? 0x8B : opCode + 3;
+      opReg = x86OpReg(o0);
+      rmReg = x86OpReg(o1);
+      sizeReg = o0;
+      break;
+
+    case ENC_OPS(Reg, Mem, None):
+      rmMem = x86OpMem(o1);
+      if (!X86Assembler_isFastMem<Arch>(rmMem))
+        return nullptr;
+
+      opCode = isMov ? 0x8B : opCode + 3;
+      opReg = x86OpReg(o0);
+      sizeReg = o0;
+      break;
+
+    case ENC_OPS(Mem, Reg, None):
+      rmMem = x86OpMem(o0);
+      if (!X86Assembler_isFastMem<Arch>(rmMem))
+        return nullptr;
+
+      opCode = isMov ? 0x89 : opCode + 1;
+      opReg = x86OpReg(o1);
+      sizeReg = o1;
+      break;
+
+    case ENC_OPS(Reg, Imm, None):
+      imVal = static_cast<const Imm*>(o1)->getInt64();
+      imLen = 4;
+      rmReg = x86OpReg(o0);
+      sizeReg = o0;
+
+      if (isMov) {
+        // MOV r32, imm32 / MOV r64, imm64 (B8+r), or MOV r64, simm32 (C7 /0).
+        if (Arch == kArchX64 && o0->getSize() == 8 && Utils::isInt32(imVal)) {
+          opCode = 0xC7;
+          opReg = 0;
+        }
+        else {
+          opCode = 0xB8;
+          opReg = kInvalidReg;
+          imLen = o0->getSize();
+        }
+      }
+      else {
+        opReg = x86ExtractO(info.getPrimaryOpCode());
+
+        if (Utils::isInt8(imVal)) {
+          opCode = 0x83;
+          imLen = 1;
+        }
+        else if (rmReg == 0) {
+          // Alternate form - EAX, RAX.
+          opCode = (opReg << 3) | 0x05;
+          opReg = kInvalidReg;
+        }
+        else {
+          opCode = 0x81;
+        }
+      }
+      break;
+
+    default:
+      return nullptr;
+  }
+
+  if (!X86Assembler_isFastGp<Arch>(sizeReg))
+    return nullptr;
+
+  uint32_t mBase = 0;
+  uint32_t mIndex = kInvalidReg;
+
+  if (rmMem != nullptr) {
+    mBase = rmMem->getBase();
+    if (rmMem->hasIndex())
+      mIndex = rmMem->getIndex();
+  }
+
+  // Rex prefix (64-bit only).
+  if (Arch == kArchX64) {
+    uint32_t rex = static_cast<uint32_t>(sizeReg->getSize() == 8) << 3; // Rex.W (0x08).
+
+    if (opReg != kInvalidReg) {
+      rex += (opReg & 0x08) >> 1;                          // Rex.R (0x04).
+      opReg &= 0x07;
+    }
+
+    if (rmMem != nullptr) {
+      rex += static_cast<uint32_t>(mIndex - 8 < 8) << 1;   // Rex.X (0x02).
+      rex += static_cast<uint32_t>(mBase  - 8 < 8);        // Rex.B (0x01).
+      mBase &= 0x07;
+    }
+    else {
+      rex += rmReg >> 3;                                   // Rex.B (0x01).
+      rmReg &= 0x07;
+    }
+
+    if (rex != 0)
+      EMIT_BYTE(kX86ByteRex | rex);
+  }
+
+  if (rmMem != nullptr) {
+    // Opcode, ModR/M, [SIB], and [Disp8 / Disp32].
+    int32_t dispOffset = rmMem->getDisplacement();
+    uint32_t mod = 0;
+
+    if (mBase == kX86RegIndexBp || dispOffset != 0)
+      mod = Utils::isInt8(dispOffset) ? 1 : 2;
+
+    EMIT_BYTE(opCode);
+    if (mIndex == kInvalidReg && mBase != kX86RegIndexSp) {
+      EMIT_BYTE(x86EncodeMod(mod, opReg, mBase));
+    }
+    else {
+      EMIT_BYTE(x86EncodeMod(mod, opReg, 4));
+      if (mIndex == kInvalidReg)
+        EMIT_BYTE(x86EncodeSib(0, 4, 4));
+      else
+        EMIT_BYTE(x86EncodeSib(rmMem->getShift(), mIndex & 0x07, mBase));
+    }
+
+    if (mod == 1)
+      EMIT_BYTE(static_cast<int8_t>(dispOffset));
+    else if (mod == 2)
+      EMIT_DWORD(static_cast<int32_t>(dispOffset));
+  }
+  else if (opReg != kInvalidReg) {
+    // Opcode and ModR/M.
+    EMIT_BYTE(opCode);
+    EMIT_BYTE(x86EncodeMod(3, opReg, rmReg));
+  }
+  else {
+    // Opcode with register (`rmReg` is zero in case of the alternate form).
+    EMIT_BYTE(opCode + rmReg);
+  }
+
+  switch (imLen) {
+    case 1: EMIT_BYTE (imVal & 0x000000FF); break;
+    case 4: EMIT_DWORD(imVal & 0xFFFFFFFF); break;
+    case 8: EMIT_QWORD(imVal             ); break;
+  }
+
+  return cursor;
+}
+
 template<int Arch>
 static ASMJIT_INLINE Error X86Assembler_emit(Assembler* self_, uint32_t code, const Operand* o0, const Operand* o1, const Operand* o2, const Operand* o3) {
   X86Assembler* self = static_cast<X86Assembler*>(self_);
@@ -934,6 +1162,19 @@ static ASMJIT_INLINE Error X86Assembler_emit(Assembler* self_, uint32_t code, co
     cursor = self->getCursor();
   }
 
+  // --------------------------------------------------------------------------
+  // [Fast Path]
+  // --------------------------------------------------------------------------
+
+  if (options == 0 && self->_logger == nullptr) {
+    uint8_t* end = X86Assembler_emitFast<Arch>(code, o0, o1, o2, cursor);
+    if (end != nullptr) {
+      self->_comment = nullptr;
+      self->setCursor(end);
+      return kErrorOk;
+    }
+  }
+
   // --------------------------------------------------------------------------
   // [Prepare]
   // --------------------------------------------------------------------------
@@ -4170,6 +4411,25 @@ _EmitXopM:
   // prefix) and to patch the `jmp/call` instruction to read the address from
   // a memory in case the trampoline is needed.
 _EmitJmpOrCallAbs:
+  // Position independent code reads the address from a RIP-relative data
+  // slot (`jmp/call [rip + slot]`), which is embedded after the code.
+  if (Arch == kArchX64 && self->hasAsmOption(Assembler::kOptionPIC)) {
+    uint32_t slotId = self->_getPICSlot(static_cast<Ptr>(imVal));
+    if (slotId == kInvalidValue)
+      return self->getLastError();
+
+    label = self->getLabelData(slotId);
+
+    EMIT_BYTE(0xFF);
+    EMIT_BYTE(x86EncodeMod(0, opCode == 0xE8 ? 2 : 4, 5));
+
+    imLen = 0;
+    dispOffset = -4;
+    dispSize = 4;
+    relocId = -1;
+    goto _EmitDisplacement;
+  }
+
   {
     RelocData rd;
     rd.type = kRelocAbsToRel;
@@ -4281,18 +4541,32 @@ _EmitDone:
 }
 
 Error X86Assembler::_emit(uint32_t code, const Operand& o0, const Operand& o1, const Operand& o2, const Operand& o3) {
+  uint64_t startTime = 0;
+  bool measure = hasAsmOption(kOptionProfile);
+
+  if (measure)
+    startTime = Utils::getNanoTime();
+
+  Error error;
 #if defined(ASMJIT_BUILD_X86) && !defined(ASMJIT_BUILD_X64)
   ASMJIT_ASSERT(_arch == kArchX86);
-  return X86Assembler_emit<kArchX86>(this, code, &o0, &o1, &o2, &o3);
+  error = X86Assembler_emit<kArchX86>(this, code, &o0, &o1, &o2, &o3);
 #elif !defined(ASMJIT_BUILD_X86) && defined(ASMJIT_BUILD_X64)
   ASMJIT_ASSERT(_arch == kArchX64);
-  return X86Assembler_emit<kArchX64>(this, code, &o0, &o1, &o2, &o3);
+  error = X86Assembler_emit<kArchX64>(this, code, &o0, &o1, &o2, &o3);
 #else
   if (_arch == kArchX86)
-    return X86Assembler_emit<kArchX86>(this, code, &o0, &o1, &o2, &o3);
+    error = X86Assembler_emit<kArchX86>(this, code, &o0, &o1, &o2, &o3);
   else
-    return X86Assembler_emit<kArchX64>(this, code, &o0, &o1, &o2, &o3);
+    error = X86Assembler_emit<kArchX64>(this, code, &o0, &o1, &o2, &o3);
 #endif
+
+  if (measure) {
+    _stats._encodeCount++;
+    _stats._encodeTime += Utils::getNanoTime() - startTime;
+  }
+
+  return error;
 }
 
 } // asmjit namespace
@@ -251,6 +251,421 @@ void X86Compiler::reset(bool releaseMemory) noexcept {
 // [asmjit::X86Compiler - Finalize]
 // ============================================================================
 
+//! \internal
+//!
+//! Functions of a single `X86Compiler` compiled concurrently by `finalize()`.
+//!
+//! The node list is split into units, each unit starts with a function (or
+//! with the first node) and ends before the next function. Each unit is
+//! compiled by a worker `X86Compiler` that shares variables and labels with
+//! the owner, but allocates nodes by its own zone. Units are serialized in
+//! their order by the owner afterwards, so references to labels of other
+//! functions (calls, addresses) are resolved by the assembler as usual.
+struct X86CompilerJob {
+  //! A function and nodes that follow it.
+  struct Unit {
+    //! First node.
+    HLNode* first;
+    //! Last node.
+    HLNode* last;
+    //! Result of the compilation.
+    Error error;
+  };
+
+  //! Worker compiler and its thread.
+  struct Worker {
+    //! Job the worker belongs to.
+    X86CompilerJob* job;
+    //! Compiler used to create nodes.
+    X86Compiler compiler;
+
+    //! Thread handle.
+#if ASMJIT_OS_WINDOWS
+    HANDLE thread;
+#else
+    pthread_t thread;
+#endif // ASMJIT_OS_WINDOWS
+  };
+
+  //! Units.
+  PodVector<Unit> units;
+  //! Count of units that start with a function.
+  uint32_t funcCount;
+  //! Index of the next unit to compile (protected by `lock`).
+  uint32_t unitIndex;
+
+  //! Lock that protects `unitIndex`.
+  Lock lock;
+  //! Lock of the assembler's labels (trampolines are created during compile).
+  Lock labelLock;
+};
+
+//! \internal
+//!
+//! Split the code of `self` into units of `job`. Returns `false` if units
+//! can't be compiled concurrently - each variable and each label jumped to
+//! has to be used by a single unit.
+static bool X86Compiler_splitUnits(X86Compiler* self, X86CompilerJob* job) {
+  // A label jumped to before it's bound is marked as pending by the unit.
+  const uint32_t kPendingFlag = 0x80000000U;
+
+  uint32_t varCount = static_cast<uint32_t>(self->_varList.getLength());
+  uint32_t labelCount = static_cast<uint32_t>(self->getAssembler()->getLabelsCount());
+
+  uint32_t* varOwner = static_cast<uint32_t*>(
+    self->_zoneAllocator.alloc((varCount + labelCount) * sizeof(uint32_t)));
+  if (varOwner == nullptr)
+    return false;
+
+  uint32_t* labelOwner = varOwner + varCount;
+  ::memset(varOwner, 0xFF, (varCount + labelCount) * sizeof(uint32_t));
+
+  uint32_t unitIndex = 0;
+  X86CompilerJob::Unit unit;
+  HLNode* node = self->getFirstNode();
+
+#define CLAIM_VAR(id) \
+  do { \
+    uint32_t _Index_ = OperandUtil::isVarId(id) ? (id) & Operand::kIdIndexMask : varCount; \
+    if (_Index_ < varCount) { \
+      if (varOwner[_Index_] != unitIndex && varOwner[_Index_] != kInvalidValue) \
+        return false; \
+      varOwner[_Index_] = unitIndex; \
+    } \
+  } while (0)
+
+#define CLAIM_OPS(opList, opCount) \
+  do { \
+    for (uint32_t _I_ = 0; _I_ < (opCount); _I_++) { \
+      const Operand* _Op_ = &(opList)[_I_]; \
+      if (_Op_->isVar()) { \
+        CLAIM_VAR(_Op_->getId()); \
+      } \
+      else if (_Op_->isMem()) { \
+        CLAIM_VAR(static_cast<const X86Mem*>(_Op_)->getBase()); \
+        CLAIM_VAR(static_cast<const X86Mem*>(_Op_)->getIndex()); \
+      } \
+    } \
+  } while (0)
+
+  unit.first = node;
+  unit.error = kErrorOk;
+  job->funcCount = 0;
+
+  for (;;) {
+    switch (node->getType()) {
+      case HLNode::kTypeLabel: {
+        uint32_t labelId = static_cast<HLLabel*>(node)->getLabelId();
+        if (labelId >= labelCount)
+          return false;
+
+        uint32_t owner = labelOwner[labelId];
+        if (owner != kInvalidValue && owner != (unitIndex | kPendingFlag))
+          return false;
+
+        labelOwner[labelId] = unitIndex;
+        break;
+      }
+
+      case HLNode::kTypeInst: {
+        HLInst* inst = static_cast<HLInst*>(node);
+        CLAIM_OPS(inst->getOpList(), inst->getOpCount());
+
+        if (inst->isJmpOrJcc()) {
+          HLLabel* target = static_cast<HLJump*>(inst)->getTarget();
+          if (target != nullptr) {
+            uint32_t labelId = target->getLabelId();
+            if (labelId >= labelCount)
+              return false;
+
+            uint32_t owner = labelOwner[labelId];
+            if (owner == kInvalidValue)
+              labelOwner[labelId] = unitIndex | kPendingFlag;
+            else if ((owner & ~kPendingFlag) != unitIndex)
+              return false;
+          }
+        }
+        break;
+      }
+
+      case HLNode::kTypeHint: {
+        CLAIM_VAR(static_cast<HLHint*>(node)->getVd()->getId());
+        break;
+      }
+
+      case HLNode::kTypeFunc: {
+        X86FuncNode* func = static_cast<X86FuncNode*>(node);
+        for (uint32_t i = 0, argCount = func->getNumArgs(); i < argCount; i++) {
+          VarData* vd = func->getArg(i);
+          if (vd != nullptr)
+            CLAIM_VAR(vd->getId());
+        }
+
+        job->funcCount++;
+        break;
+      }
+
+      case HLNode::kTypeRet: {
+        CLAIM_OPS(static_cast<HLRet*>(node)->_ret, 2);
+        break;
+      }
+
+      case HLNode::kTypeCall: {
+        X86CallNode* call = static_cast<X86CallNode*>(node);
+        CLAIM_OPS(&call->_target, 1);
+        CLAIM_OPS(call->_ret, 2);
+        CLAIM_OPS(call->_args, call->_x86Decl.getNumArgs());
+        break;
+      }
+
+      default:
+        break;
+    }
+
+    HLNode* next = node->getNext();
+    if (next == nullptr || next->getType() == HLNode::kTypeFunc) {
+      unit.last = node;
+      if (job->units.append(unit) != kErrorOk)
+        return false;
+
+      if (next == nullptr)
+        break;
+
+      unit.first = next;
+      unitIndex++;
+    }
+
+    node = next;
+  }
+
+#undef CLAIM_OPS
+#undef CLAIM_VAR
+
+  return true;
+}
+
+//! \internal
+//!
+//! Compile units of `job` by `worker` until there is no unit left.
+static void X86Compiler_runJob(X86CompilerJob* job, X86Compiler* worker) noexcept {
+  X86Context context(worker);
+  uint32_t unitCount = static_cast<uint32_t>(job->units.getLength());
+
+  for (;;) {
+    uint32_t unitIndex;
+    {
+      AutoLock locked(job->lock);
+      unitIndex = job->unitIndex++;
+    }
+
+    if (unitIndex >= unitCount)
+      break;
+
+    X86CompilerJob::Unit& unit = job->units[unitIndex];
+    if (unit.first->getType() != HLNode::kTypeFunc)
+      continue;
+
+    // The unit is detached from its neighbors, nodes added or removed at its
+    // boundaries update the worker's first and last node.
+    worker->_firstNode = unit.first;
+    worker->_lastNode = unit.last;
+    worker->_resetTokenGenerator();
+
+    unit.error = context.compile(static_cast<X86FuncNode*>(unit.first));
+    unit.first = worker->_firstNode;
+    unit.last = worker->_lastNode;
+
+    context.cleanup();
+    context.reset(false);
+  }
+}
+
+#if ASMJIT_OS_WINDOWS
+static DWORD WINAPI X86Compiler_threadEntry(LPVOID arg) noexcept {
+  X86CompilerJob::Worker* worker = static_cast<X86CompilerJob::Worker*>(arg);
+  X86Compiler_runJob(worker->job, &worker->compiler);
+  return 0;
+}
+#else
+static void* X86Compiler_threadEntry(void* arg) noexcept {
+  X86CompilerJob::Worker* worker = static_cast<X86CompilerJob::Worker*>(arg);
+  X86Compiler_runJob(worker->job, &worker->compiler);
+  return nullptr;
+}
+#endif // ASMJIT_OS_WINDOWS
+
+//! \internal
+//!
+//! Make `worker` share the target, features, variables and labels of `self`.
+static Error X86Compiler_initWorker(X86Compiler* worker, X86Compiler* self, Lock* labelLock) noexcept {
+  // The worker is not attached, see `X86Compiler_finiWorker()`.
+  worker->_runtime = self->_runtime;
+  worker->_assembler = self->_assembler;
+  worker->_exId = self->_exId;
+  worker->_arch = self->_arch;
+  worker->_regSize = self->_regSize;
+  worker->_lastError = kErrorOk;
+
+  worker->_features = self->_features;
+  worker->_maxLookAhead = self->_maxLookAhead;
+  worker->_targetVarMapping = self->_targetVarMapping;
+  worker->_labelLock = labelLock;
+
+  worker->_regCount = self->_regCount;
+  worker->zax = self->zax;
+  worker->zcx = self->zcx;
+  worker->zdx = self->zdx;
+  worker->zbx = self->zbx;
+  worker->zsp = self->zsp;
+  worker->zbp = self->zbp;
+  worker->zsi = self->zsi;
+  worker->zdi = self->zdi;
+
+  // Variables created by the worker get ids after all variables of `self`.
+  size_t varCount = self->_varList.getLength();
+  ASMJIT_PROPAGATE_ERROR(worker->_varList._reserve(varCount));
+
+  for (size_t i = 0; i < varCount; i++)
+    worker->_varList.append(self->_varList[i]);
+
+  return kErrorOk;
+}
+
+//! \internal
+//!
+//! Undo `X86Compiler_initWorker()`, so the worker can be destroyed.
+static void X86Compiler_finiWorker(X86Compiler* worker) noexcept {
+  worker->_runtime = nullptr;
+  worker->_assembler = nullptr;
+  worker->_exId = 0;
+  worker->_labelLock = nullptr;
+}
+
+//! \internal
+//!
+//! Compile functions by `threadCount` threads (including the calling one) and
+//! serialize them, the result is stored to `error`. Returns `false` without
+//! changing anything if the functions can't be compiled concurrently.
+static bool X86Compiler_finalizeParallel(X86Compiler* self, X86Context& context, uint32_t threadCount, Error& error) noexcept {
+  X86Assembler* assembler = self->getAssembler();
+
+  X86CompilerJob job;
+  job.unitIndex = 0;
+
+  if (!X86Compiler_splitUnits(self, &job))
+    return false;
+
+  threadCount = Utils::iMin<uint32_t>(threadCount, job.funcCount);
+  if (threadCount < 2)
+    return false;
+
+  X86CompilerJob::Worker* workers = static_cast<X86CompilerJob::Worker*>(
+    ASMJIT_ALLOC((threadCount - 1) * sizeof(X86CompilerJob::Worker)));
+  if (workers == nullptr)
+    return false;
+
+  // The calling thread uses a worker as well, so `self` is not modified
+  // until all units are compiled.
+  X86Compiler mainWorker;
+  if (X86Compiler_initWorker(&mainWorker, self, &job.labelLock) != kErrorOk) {
+    X86Compiler_finiWorker(&mainWorker);
+    ASMJIT_FREE(workers);
+    return false;
+  }
+
+  uint32_t i;
+  uint32_t unitCount = static_cast<uint32_t>(job.units.getLength());
+  uint32_t workerCount = 0;
+
+  // Detach units from each other.
+  for (i = 1; i < unitCount; i++) {
+    job.units[i - 1].last->_next = nullptr;
+    job.units[i].first->_prev = nullptr;
+  }
+
+  for (i = 0; i < threadCount - 1; i++) {
+    X86CompilerJob::Worker* worker = new(&workers[i]) X86CompilerJob::Worker();
+    worker->job = &job;
+
+    bool created = X86Compiler_initWorker(&worker->compiler, self, &job.labelLock) == kErrorOk;
+    if (created) {
+#if ASMJIT_OS_WINDOWS
+      worker->thread = ::CreateThread(nullptr, 0, X86Compiler_threadEntry, worker, 0, nullptr);
+      created = worker->thread != nullptr;
+#else
+      created = ::pthread_create(&worker->thread, nullptr, X86Compiler_threadEntry, worker) == 0;
+#endif // ASMJIT_OS_WINDOWS
+    }
+
+    if (!created) {
+      X86Compiler_finiWorker(&worker->compiler);
+      worker->~Worker();
+      break;
+    }
+
+    workerCount++;
+  }
+
+  X86Compiler_runJob(&job, &mainWorker);
+
+  for (i = 0; i < workerCount; i++) {
+#if ASMJIT_OS_WINDOWS
+    ::WaitForSingleObject(workers[i].thread, INFINITE);
+    ::CloseHandle(workers[i].thread);
+#else
+    ::pthread_join(workers[i].thread, nullptr);
+#endif // ASMJIT_OS_WINDOWS
+  }
+
+  // Link units together again and serialize them in their order.
+  self->_firstNode = job.units[0].first;
+  self->_lastNode = job.units[unitCount - 1].last;
+
+  for (i = 1; i < unitCount; i++) {
+    job.units[i - 1].last->_next = job.units[i].first;
+    job.units[i].first->_prev = job.units[i - 1].last;
+  }
+
+  bool profile = self->hasFeature(kCompilerFeatureProfile);
+
+  error = kErrorOk;
+  for (i = 0; i < unitCount; i++) {
+    error = job.units[i].error;
+    if (error != kErrorOk)
+      break;
+
+    HLNode* start = job.units[i].first;
+    HLNode* stop = job.units[i].last->getNext();
+
+    if (profile)
+      context.beginPhase();
+
+    error = context.serialize(assembler, start, stop);
+    if (error != kErrorOk)
+      break;
+
+    if (profile)
+      context.endPhase(kCompilerPhaseSerialize, start, stop);
+  }
+
+  // Nodes are referenced until they are serialized, release workers now.
+  self->_stats.add(mainWorker.getStats());
+  X86Compiler_finiWorker(&mainWorker);
+
+  for (i = 0; i < workerCount; i++) {
+    self->_stats.add(workers[i].compiler.getStats());
+    X86Compiler_finiWorker(&workers[i].compiler);
+    workers[i].~Worker();
+  }
+  ASMJIT_FREE(workers);
+
+  // Errors of workers are reported by the calling thread.
+  if (error != kErrorOk)
+    self->setLastError(error);
+
+  return true;
+}
+
 Error X86Compiler::finalize() noexcept {
   X86Assembler* assembler = getAssembler();
   if (assembler == nullptr)
@@ -270,9 +685,24 @@ Error X86Compiler::finalize() noexcept {
   X86Context context(this);
   Error error = kErrorOk;
 
+  // Compile functions concurrently if possible. Errors and logs are reported
+  // by the calling thread only.
+  uint32_t threadCount = _threadCount;
+  if (threadCount == 0)
+    threadCount = CpuInfo::getHost().getHwThreadsCount();
+
+  if (threadCount > 1 && !assembler->hasLogger() && assembler->getErrorHandler() == nullptr) {
+    if (X86Compiler_finalizeParallel(this, context, threadCount, error)) {
+      reset(false);
+      return error;
+    }
+  }
+
   HLNode* node = _firstNode;
   HLNode* start;
 
+  bool profile = hasFeature(kCompilerFeatureProfile);
+
   // Find all functions and use the `X86Context` to translate/emit them.
   do {
     start = node;
@@ -290,7 +720,13 @@ Error X86Compiler::finalize() noexcept {
       node = node->getNext();
     } while (node != nullptr && node->getType() != HLNode::kTypeFunc);
 
+    if (profile)
+      context.beginPhase();
+
     error = context.serialize(assembler, start, node);
+    if (profile && error == kErrorOk)
+      context.endPhase(kCompilerPhaseSerialize, start, node);
+
     context.cleanup();
     context.reset(false);
 
@@ -59,6 +59,32 @@ ASMJIT_VARAPI const uint8_t _x86VarMapping[kX86VarTypeCount];
 ASMJIT_VARAPI const uint8_t _x64VarMapping[kX86VarTypeCount];
 #endif // ASMJIT_BUILD_X64
 
+// ============================================================================
+// [asmjit::X86PeepholeRule]
+// ============================================================================
+
+//! X86/X64 peephole rules, see `kCompilerFeaturePeephole`.
+ASMJIT_ENUM(X86PeepholeRule) {
+  //! Remove a move of a register to itself (`mov reg, reg`).
+  kX86PeepholeRuleMovSelf = 0,
+  //! Remove a load of a stack slot right after it was saved from the same register.
+  kX86PeepholeRuleLoadAfterSave = 1,
+  //! Remove a save of a stack slot right after it was loaded to the same register.
+  kX86PeepholeRuleSaveAfterLoad = 2,
+  //! Remove a jump (`jmp` or `jcc`) to a label that immediately follows.
+  kX86PeepholeRuleJmpNext = 3,
+  //! Replace `cmp reg, 0` by `test reg, reg`, which has a shorter encoding.
+  kX86PeepholeRuleCmpZero = 4,
+  //! Remove `cmp` or `test` that is identical to the preceding instruction,
+  //! conditional jumps in between are skipped.
+  kX86PeepholeRuleCmpSame = 5,
+  //! Remove `test reg, reg` following `and`, `or` or `xor` that wrote `reg`.
+  kX86PeepholeRuleTestAfterLogic = 6,
+
+  //! Count of peephole rules.
+  kX86PeepholeRuleCount = 7
+};
+
 // ============================================================================
 // [asmjit::X86FuncNode]
 // ============================================================================
@@ -672,6 +672,7 @@ void X86Context::emitLoad(VarData* vd, uint32_t regIndex, const char* reason) {
   ASMJIT_ASSERT(regIndex != kInvalidReg);
 
   X86Compiler* compiler = getCompiler();
+  compiler->_stats._loadCount++;
   X86Mem m = getVarMem(vd);
 
   HLNode* node = nullptr;
@@ -744,6 +745,7 @@ void X86Context::emitSave(VarData* vd, uint32_t regIndex, const char* reason) {
   ASMJIT_ASSERT(regIndex != kInvalidReg);
 
   X86Compiler* compiler = getCompiler();
+  compiler->_stats._saveCount++;
   X86Mem m = getVarMem(vd);
 
   HLNode* node = nullptr;
@@ -816,6 +818,7 @@ void X86Context::emitMove(VarData* vd, uint32_t toRegIndex, uint32_t fromRegInde
   ASMJIT_ASSERT(fromRegIndex != kInvalidReg);
 
   X86Compiler* compiler = getCompiler();
+  compiler->_stats._moveCount++;
   HLNode* node = nullptr;
 
   switch (vd->getType()) {
@@ -877,6 +880,7 @@ void X86Context::emitSwapGp(VarData* aVd, VarData* bVd, uint32_t aIndex, uint32_
   ASMJIT_ASSERT(bIndex != kInvalidReg);
 
   X86Compiler* compiler = getCompiler();
+  compiler->_stats._moveCount++;
   HLNode* node = nullptr;
 
 #if defined(ASMJIT_BUILD_X64)
@@ -2137,6 +2141,706 @@ static ASMJIT_INLINE Error X86Context_insertHLCallArg(
   }
 }
 
+// ============================================================================
+// [asmjit::X86Context - Fold Constants]
+// ============================================================================
+
+//! \internal
+//!
+//! Value of a variable tracked by `X86Context::foldConstants()`.
+struct X86ConstSlot {
+  //! Value (zero extended from the size of the variable).
+  uint64_t value;
+  //! `mov var, imm` that set the value and hasn't been read yet, or `nullptr`.
+  HLInst* def;
+  //! Generation of the basic block the value is valid in.
+  uint32_t gen;
+};
+
+//! \internal
+//!
+//! Maximum count of nodes visited to check whether EFLAGS are used.
+static const uint32_t kX86FoldMaxLookAhead = 32;
+
+static ASMJIT_INLINE uint64_t X86Context_sizeMask(uint32_t size) {
+  return size >= 8 ? ~static_cast<uint64_t>(0) : (static_cast<uint64_t>(1) << (size * 8)) - 1;
+}
+
+static ASMJIT_INLINE int64_t X86Context_signExtend(uint64_t x, uint32_t size) {
+  uint32_t shift = 64 - size * 8;
+  return static_cast<int64_t>(x << shift) >> shift;
+}
+
+//! \internal
+//!
+//! Get whether EFLAGS written by `node` are overwritten before being read.
+static bool X86Context_areEFlagsDead(HLInst* node) {
+  uint32_t flags = _x86InstInfo[node->getInstId()].getExtendedInfo().getEFlagsOut();
+  HLNode* next = node->getNext();
+
+  for (uint32_t i = 0; flags != 0; i++) {
+    if (next == nullptr || i == kX86FoldMaxLookAhead)
+      return false;
+
+    if (next->getType() == HLNode::kTypeInst) {
+      HLInst* inst = static_cast<HLInst*>(next);
+      const X86InstExtendedInfo& extendedInfo = _x86InstInfo[inst->getInstId()].getExtendedInfo();
+
+      // Flags can be used at the jump target.
+      if (inst->isJmpOrJcc() || (extendedInfo.getEFlagsIn() & flags) != 0)
+        return false;
+      flags &= ~extendedInfo.getEFlagsOut();
+    }
+    else if (next->getType() == HLNode::kTypeRet || next->getType() == HLNode::kTypeCall) {
+      // EFLAGS are not preserved across a call nor returned by a function.
+      return true;
+    }
+    else if (next->getType() != HLNode::kTypeComment) {
+      return false;
+    }
+
+    next = next->getNext();
+  }
+
+  return true;
+}
+
+//! \internal
+//!
+//! Compute `instId` of `size` bytes on `a` and `b` (ignored by unary
+//! instructions), returns `false` if `instId` can't be folded.
+static bool X86Context_foldArith(uint32_t instId, uint32_t size, uint64_t a, uint64_t b, uint64_t& out) {
+  uint32_t count = static_cast<uint32_t>(b) & (size == 8 ? 63 : 31);
+
+  switch (instId) {
+    case kX86InstIdAdd : out = a + b; break;
+    case kX86InstIdSub : out = a - b; break;
+    case kX86InstIdAnd : out = a & b; break;
+    case kX86InstIdOr  : out = a | b; break;
+    case kX86InstIdXor : out = a ^ b; break;
+    case kX86InstIdImul: out = a * b; break;
+    case kX86InstIdSal :
+    case kX86InstIdShl : out = a << count; break;
+    case kX86InstIdShr : out = (a & X86Context_sizeMask(size)) >> count; break;
+    case kX86InstIdSar : out = static_cast<uint64_t>(X86Context_signExtend(a, size) >> count); break;
+    case kX86InstIdNeg : out = static_cast<uint64_t>(0) - a; break;
+    case kX86InstIdNot : out = ~a; break;
+    case kX86InstIdInc : out = a + 1; break;
+    case kX86InstIdDec : out = a - 1; break;
+
+    default:
+      return false;
+  }
+
+  out &= X86Context_sizeMask(size);
+  return true;
+}
+
+Error X86Context::foldConstants() {
+  ASMJIT_TLOG("[C] ======= Fold Constants (Begin)\n");
+
+  X86Compiler* compiler = getCompiler();
+  CompilerStats& stats = compiler->_stats;
+
+  size_t slotCount = compiler->_varList.getLength();
+  if (slotCount == 0)
+    return kErrorOk;
+
+  X86ConstSlot* slots = static_cast<X86ConstSlot*>(
+    _zoneAllocator.alloc(slotCount * sizeof(X86ConstSlot)));
+
+  if (slots == nullptr)
+    return setLastError(kErrorNoHeapMemory);
+  ::memset(slots, 0, slotCount * sizeof(X86ConstSlot));
+
+  // Values are only tracked within a basic block, starting a new generation
+  // forgets all of them.
+  uint32_t gen = 1;
+
+  HLNode* node_ = getFunc();
+  HLNode* stop = getStop();
+
+  while (node_ != stop) {
+    HLNode* next = node_->getNext();
+
+    if (node_->getType() != HLNode::kTypeInst) {
+      if (node_->getType() != HLNode::kTypeComment)
+        gen++;
+      node_ = next;
+      continue;
+    }
+
+    HLInst* node = static_cast<HLInst*>(node_);
+    uint32_t instId = node->getInstId();
+
+    Operand* opList = node->getOpList();
+    uint32_t opCount = node->getOpCount();
+
+    const X86InstExtendedInfo& extendedInfo = _x86InstInfo[instId].getExtendedInfo();
+    bool isShift = instId == kX86InstIdRcl || instId == kX86InstIdRcr ||
+                   instId == kX86InstIdRol || instId == kX86InstIdRor ||
+                   instId == kX86InstIdSal || instId == kX86InstIdSar ||
+                   instId == kX86InstIdShl || instId == kX86InstIdShr;
+
+    // ------------------------------------------------------------------------
+    // [Propagate]
+    // ------------------------------------------------------------------------
+
+    // Only the last operand can be an immediate. Special instructions use
+    // implicit registers except shifts by a variable and two operand `imul`.
+    uint32_t immIndex = opCount - 1;
+    if (opCount >= 2 && opList[immIndex].isVar() && !(node->getOptions() & kX86InstOptionLock) &&
+        (!extendedInfo.isSpecial() || isShift || (instId == kX86InstIdImul && opCount == 2))) {
+      const X86GpVar& var = static_cast<const X86GpVar&>(opList[immIndex]);
+      VarData* vd = compiler->getVdById(var.getId());
+      X86ConstSlot& slot = slots[var.getId() & Operand::kIdIndexMask];
+
+      uint32_t opFlags = extendedInfo.getOperandFlags(immIndex);
+      bool hasImmForm = (opFlags & kX86InstOpImm) != 0 &&
+                        (opFlags & (kX86InstOpGb | kX86InstOpGw | kX86InstOpGd | kX86InstOpGq)) != 0;
+
+      // Bit test of a memory operand by a register can address any bit.
+      if (instId == kX86InstIdBt || instId == kX86InstIdBtc || instId == kX86InstIdBtr || instId == kX86InstIdBts)
+        hasImmForm = false;
+
+      if (instId == kX86InstIdImul)
+        hasImmForm = true;
+
+      if (hasImmForm && slot.gen == gen && vd->getClass() == kX86RegClassGp && !var.isGpbHi()) {
+        uint32_t size = var.getSize();
+        int64_t value = X86Context_signExtend(slot.value, size);
+        bool fits = true;
+
+        if (isShift) {
+          uint32_t dstSize = opList[0].getSize();
+          value &= dstSize == 8 ? 63 : 31;
+          fits = dstSize != 0;
+        }
+        else if (size == 8 && !(instId == kX86InstIdMov && opList[0].isVar())) {
+          fits = Utils::isInt32(value);
+        }
+
+        if (fits) {
+          Imm& immOp = static_cast<Imm&>(opList[immIndex]);
+          immOp._init_packed_op_sz_b0_b1_id(Operand::kTypeImm, 0, 0, 0, kInvalidValue);
+          immOp.setInt64(value);
+          stats._propagateCount++;
+        }
+      }
+    }
+
+    // ------------------------------------------------------------------------
+    // [Fold]
+    // ------------------------------------------------------------------------
+
+    X86ConstSlot* dst = nullptr;
+    uint32_t dstSize = 0;
+
+    if (opCount >= 1 && opList[0].isVar() && !(node->getOptions() & kX86InstOptionLock) &&
+        (!extendedInfo.isSpecial() || isShift || (instId == kX86InstIdImul && opCount == 2))) {
+      const X86GpVar& var = static_cast<const X86GpVar&>(opList[0]);
+      VarData* vd = compiler->getVdById(var.getId());
+
+      // Only writes of the whole variable are tracked.
+      if (vd->getClass() == kX86RegClassGp && var.getSize() == vd->getSize() && !var.isGpbHi()) {
+        dst = &slots[var.getId() & Operand::kIdIndexMask];
+        dstSize = vd->getSize();
+      }
+    }
+
+    if (dst != nullptr) {
+      uint64_t value = 0;
+      bool isConst = false;
+
+      if (instId == kX86InstIdMov && opCount == 2 && opList[1].isImm()) {
+        value = static_cast<const Imm&>(opList[1]).getUInt64() & X86Context_sizeMask(dstSize);
+        isConst = true;
+      }
+      else if ((instId == kX86InstIdXor || instId == kX86InstIdSub) && opCount == 2 &&
+               opList[1].isVar() && opList[1].getId() == opList[0].getId() && opList[1].getSize() == dstSize) {
+        // Zero idiom doesn't depend on the previous value, but it can't be
+        // removed as it also writes EFLAGS.
+        if (dst->gen == gen && dst->def != nullptr) {
+          compiler->removeNode(dst->def);
+          stats._foldCount++;
+        }
+
+        dst->value = 0;
+        dst->def = nullptr;
+        dst->gen = gen;
+
+        node_ = next;
+        continue;
+      }
+      else if (dst->gen == gen && (opCount == 1 || (opCount == 2 && opList[1].isImm()))) {
+        uint64_t b = 0;
+        if (opCount == 2) {
+          b = static_cast<const Imm&>(opList[1]).getUInt64();
+          // 64-bit instructions sign-extend 32-bit immediates.
+          if (dstSize == 8)
+            b = static_cast<uint64_t>(X86Context_signExtend(b, 4));
+        }
+
+        if (X86Context_foldArith(instId, dstSize, dst->value, b, value) &&
+            (extendedInfo.getEFlagsOut() == 0 || X86Context_areEFlagsDead(node))) {
+          HLInst* folded = compiler->newInst(kX86InstIdMov, opList[0], imm(X86Context_signExtend(value, dstSize)));
+          if (folded == nullptr)
+            return setLastError(kErrorNoHeapMemory);
+
+          folded->setComment(node->getComment());
+          compiler->addNodeBefore(folded, node);
+          compiler->removeNode(node);
+
+          node = folded;
+          isConst = true;
+          stats._foldCount++;
+        }
+      }
+
+      if (isConst) {
+        // The previous value has never been read, remove its `mov`.
+        if (dst->gen == gen && dst->def != nullptr) {
+          compiler->removeNode(dst->def);
+          stats._foldCount++;
+        }
+
+        dst->value = value;
+        dst->def = node;
+        dst->gen = gen;
+
+        node_ = next;
+        continue;
+      }
+    }
+
+    // ------------------------------------------------------------------------
+    // [Update]
+    // ------------------------------------------------------------------------
+
+    // Every variable is read except the first operand of write-only
+    // instructions, which is written only if the instruction is not special.
+    // All reads are processed before writes, as the destination can be also
+    // a source (`movzx x, x.r8()`, `lea x, [x + 4]`), in which case the `mov`
+    // that set its value has been read and has to be kept.
+    uint32_t access = extendedInfo.getFlags() & kX86InstFlagRW;
+    bool isWriteOnly = access == kX86InstFlagWO && !extendedInfo.isSpecial();
+
+    uint32_t i;
+    for (i = 0; i < opCount; i++) {
+      Operand* op = &opList[i];
+
+      if (op->isVar()) {
+        VarData* vd = compiler->getVdById(op->getId());
+        if (i != 0 || !isWriteOnly || op->getSize() != vd->getSize())
+          slots[op->getId() & Operand::kIdIndexMask].def = nullptr;
+      }
+      else if (op->isMem()) {
+        const X86Mem* m = static_cast<const X86Mem*>(op);
+
+        if (m->isBaseIndexType() && OperandUtil::isVarId(m->getBase()))
+          slots[m->getBase() & Operand::kIdIndexMask].def = nullptr;
+
+        if (OperandUtil::isVarId(m->getIndex()))
+          slots[m->getIndex() & Operand::kIdIndexMask].def = nullptr;
+      }
+    }
+
+    for (i = 0; i < opCount; i++) {
+      Operand* op = &opList[i];
+      if (!op->isVar())
+        continue;
+
+      bool isWritten = extendedInfo.isSpecial() ||
+                       (i == 0 && (access & kX86InstFlagWO) != 0) ||
+                       (i == 0 && access == 0) ||
+                       (i == 1 && extendedInfo.isXchg());
+
+      if (isWritten) {
+        X86ConstSlot& slot = slots[op->getId() & Operand::kIdIndexMask];
+
+        // Overwritten without being read.
+        if (slot.gen == gen && slot.def != nullptr) {
+          compiler->removeNode(slot.def);
+          stats._foldCount++;
+        }
+        slot.gen = 0;
+      }
+    }
+
+    // Values can be used at the jump target.
+    if (node->isJmpOrJcc() || extendedInfo.isFlow())
+      gen++;
+
+    node_ = next;
+  }
+
+  ASMJIT_TLOG("[C] ======= Fold Constants (Done)\n");
+  return kErrorOk;
+}
+
+// ============================================================================
+// [asmjit::X86Context - Common Subexpressions]
+// ============================================================================
+
+//! \internal
+//!
+//! Count of 32-bit words of an expression key (header and four operands).
+static const uint32_t kX86CseKeySize = 4 + 4 * 4;
+
+//! \internal
+//!
+//! Count of expressions tracked per basic block (must be a power of 2).
+static const uint32_t kX86CseTableSize = 64;
+
+//! \internal
+//!
+//! Count of table entries probed before an expression is dropped.
+static const uint32_t kX86CseMaxProbe = 8;
+
+//! \internal
+//!
+//! Value number of a variable tracked by `X86Context::eliminateCommonSubexpr()`.
+struct X86CseSlot {
+  //! Value number.
+  uint32_t value;
+  //! Generation of the basic block the value number is valid in.
+  uint32_t gen;
+};
+
+//! \internal
+//!
+//! Expression computed by an instruction and the variable that holds it.
+struct X86CseEntry {
+  //! Instruction id, options, operands and memory generation.
+  uint32_t key[kX86CseKeySize];
+  //! Hash of `key`.
+  uint32_t hash;
+  //! Generation of the basic block the entry is valid in.
+  uint32_t gen;
+  //! Value number of the result.
+  uint32_t value;
+  //! Id of the variable that held the result when it was computed.
+  uint32_t varId;
+};
+
+//! \internal
+//!
+//! Get value number of variable `id`, a new one if not known in `gen`.
+static ASMJIT_INLINE uint32_t X86Context_getValueNumber(X86CseSlot* slots, uint32_t id, uint32_t gen, uint32_t& counter) {
+  X86CseSlot& slot = slots[id & Operand::kIdIndexMask];
+  if (slot.gen != gen) {
+    slot.value = ++counter;
+    slot.gen = gen;
+  }
+  return slot.value;
+}
+
+Error X86Context::eliminateCommonSubexpr() {
+  ASMJIT_TLOG("[S] ======= Common Subexpressions (Begin)\n");
+
+  X86Compiler* compiler = getCompiler();
+  CompilerStats& stats = compiler->_stats;
+
+  size_t slotCount = compiler->_varList.getLength();
+  if (slotCount == 0)
+    return kErrorOk;
+
+  X86CseSlot* slots = static_cast<X86CseSlot*>(
+    _zoneAllocator.alloc(slotCount * sizeof(X86CseSlot)));
+  X86CseEntry* table = static_cast<X86CseEntry*>(
+    _zoneAllocator.alloc(kX86CseTableSize * sizeof(X86CseEntry)));
+
+  if (slots == nullptr || table == nullptr)
+    return setLastError(kErrorNoHeapMemory);
+
+  ::memset(slots, 0, slotCount * sizeof(X86CseSlot));
+  ::memset(table, 0, kX86CseTableSize * sizeof(X86CseEntry));
+
+  // Value numbers and expressions are only tracked within a basic block,
+  // starting a new generation forgets all of them. Loads also depend on the
+  // memory generation, which changes each time memory may be written.
+  uint32_t gen = 1;
+  uint32_t memGen = 0;
+  uint32_t counter = 0;
+
+  HLNode* node_ = getFunc();
+  HLNode* stop = getStop();
+
+  while (node_ != stop) {
+    HLNode* next = node_->getNext();
+
+    if (node_->getType() != HLNode::kTypeInst) {
+      if (node_->getType() != HLNode::kTypeComment)
+        gen++;
+      node_ = next;
+      continue;
+    }
+
+    HLInst* node = static_cast<HLInst*>(node_);
+    uint32_t instId = node->getInstId();
+
+    Operand* opList = node->getOpList();
+    uint32_t opCount = node->getOpCount();
+
+    const X86InstExtendedInfo& extendedInfo = _x86InstInfo[instId].getExtendedInfo();
+
+    // The first operand is read and written if the table doesn't say otherwise.
+    uint32_t access = extendedInfo.getFlags() & kX86InstFlagRW;
+    if (access == 0)
+      access = kX86InstFlagRW;
+
+    // Shifts and two or three operand `imul` are the only special instructions
+    // without implicit operands (the shift count is in a variable here).
+    bool isSpecial = extendedInfo.isSpecial();
+    if (isSpecial) {
+      switch (instId) {
+        case kX86InstIdSal:
+        case kX86InstIdSar:
+        case kX86InstIdShl:
+        case kX86InstIdShr:
+          isSpecial = false;
+          break;
+
+        case kX86InstIdImul:
+          isSpecial = opCount == 1;
+          break;
+      }
+    }
+
+    bool isPure = opCount >= 2 && opCount <= 4 && !isSpecial && !node->isJmpOrJcc() &&
+                  !extendedInfo.isXchg() && extendedInfo.getEFlagsIn() == 0 &&
+                  !extendedInfo.hasFlag(kX86InstFlagFlow | kX86InstFlagFp | kX86InstFlagSpecialMem | kX86InstFlagVolatile) &&
+                  !(node->getOptions() & kX86InstOptionLock);
+
+    // ------------------------------------------------------------------------
+    // [Key]
+    // ------------------------------------------------------------------------
+
+    // The result has to be a whole general purpose variable (32-bit writes
+    // zero extend) so it can be copied by `mov`.
+    VarData* dstVd = nullptr;
+    if (isPure && opList[0].isVar() && (access & kX86InstFlagWO)) {
+      VarData* vd = compiler->getVdById(opList[0].getId());
+      uint32_t size = opList[0].getSize();
+
+      if (vd->getClass() == kX86RegClassGp && (size == vd->getSize() || size == 4))
+        dstVd = vd;
+    }
+
+    uint32_t key[kX86CseKeySize];
+    bool hasKey = dstVd != nullptr;
+    bool hasSource = false;
+
+    if (hasKey) {
+      ::memset(key, 0, sizeof(key));
+      key[0] = instId;
+      key[1] = node->getOptions();
+      key[2] = opCount;
+
+      // Write-only instructions don't depend on their destination, but its
+      // width still selects the result (`mov r32, m` vs `mov r64, m`), so
+      // values are only reused between holders of the same width.
+      key[4] = (opList[0].getRegType() << 8) | opList[0].getSize();
+
+      uint32_t i = access == kX86InstFlagWO ? 1 : 0;
+      for (; i < opCount; i++) {
+        Operand op(opList[i]);
+
+        if (op.isVar()) {
+          // Only the register type and size identify a variable operand.
+          key[4 + i * 4] = (op.getRegType() << 8) | op.getSize();
+          key[5 + i * 4] = X86Context_getValueNumber(slots, op.getId(), gen, counter);
+          hasSource = true;
+          continue;
+        }
+
+        if (op.isMem()) {
+          X86Mem& m = static_cast<X86Mem&>(op);
+          uint32_t memType = m.getMemType();
+
+          // Stack slots of variables and physical registers can change by
+          // writing the variable or the register.
+          if (memType == kMemTypeStackIndex || memType == kMemTypeRip ||
+              (memType == kMemTypeBaseIndex && m.hasBase() && !OperandUtil::isVarId(m.getBase())) ||
+              (m.hasIndex() && !OperandUtil::isVarId(m.getIndex()))) {
+            hasKey = false;
+            break;
+          }
+
+          if (memType == kMemTypeBaseIndex && m.hasBase())
+            m.setBase(X86Context_getValueNumber(slots, m.getBase(), gen, counter));
+
+          if (m.hasIndex())
+            m.setIndex(X86Context_getValueNumber(slots, m.getIndex(), gen, counter));
+
+          // Except `lea` the memory is read.
+          if (instId != kX86InstIdLea)
+            key[3] = memGen;
+          hasSource = true;
+        }
+        else if (!op.isImm()) {
+          hasKey = false;
+          break;
+        }
+
+        ::memcpy(&key[4 + i * 4], &op, sizeof(Operand));
+      }
+
+      // Copies are handled below and reusing a `mov var, imm` only makes
+      // the live range of the other variable longer.
+      if (instId == kX86InstIdMov && (!hasSource || opList[1].isVar()))
+        hasKey = false;
+    }
+
+    // ------------------------------------------------------------------------
+    // [Reuse]
+    // ------------------------------------------------------------------------
+
+    if (hasKey && hasSource) {
+      uint32_t hash = 0x811C9DC5;
+      for (uint32_t i = 0; i < kX86CseKeySize; i++)
+        hash = (hash ^ key[i]) * 0x01000193;
+
+      X86CseEntry* entry = nullptr;
+      X86CseEntry* empty = nullptr;
+
+      for (uint32_t i = 0; i < kX86CseMaxProbe; i++) {
+        X86CseEntry* e = &table[(hash + i) & (kX86CseTableSize - 1)];
+
+        if (e->gen != gen) {
+          if (empty == nullptr)
+            empty = e;
+          continue;
+        }
+
+        if (e->hash == hash && ::memcmp(e->key, key, sizeof(key)) == 0) {
+          entry = e;
+          break;
+        }
+      }
+
+      X86CseSlot& dst = slots[opList[0].getId() & Operand::kIdIndexMask];
+      uint32_t dstId = opList[0].getId();
+
+      if (entry != nullptr) {
+        X86CseSlot& src = slots[entry->varId & Operand::kIdIndexMask];
+
+        // The variable still holds the value, replace the instruction by
+        // a move (or remove it if the destination holds it already).
+        if (src.gen == gen && src.value == entry->value &&
+            (extendedInfo.getEFlagsOut() == 0 || X86Context_areEFlagsDead(node))) {
+          if (entry->varId == dstId && dst.gen == gen && dst.value == entry->value) {
+            compiler->removeNode(node);
+          }
+          else {
+            Operand srcOp(opList[0]);
+            srcOp._vreg.id = entry->varId;
+
+            HLInst* reused = compiler->newInst(kX86InstIdMov, opList[0], srcOp);
+            if (reused == nullptr)
+              return setLastError(kErrorNoHeapMemory);
+
+            reused->setComment(node->getComment());
+            compiler->addNodeBefore(reused, node);
+            compiler->removeNode(node);
+          }
+
+          dst.value = entry->value;
+          dst.gen = gen;
+          stats._reuseCount++;
+
+          node_ = next;
+          continue;
+        }
+
+        // The holder has been overwritten, this variable holds it from now.
+        entry->value = ++counter;
+        entry->varId = dstId;
+      }
+      else if (empty != nullptr) {
+        ::memcpy(empty->key, key, sizeof(key));
+        empty->hash = hash;
+        empty->gen = gen;
+        empty->value = ++counter;
+        empty->varId = dstId;
+        entry = empty;
+      }
+      else {
+        dst.value = ++counter;
+        dst.gen = gen;
+
+        node_ = next;
+        continue;
+      }
+
+      dst.value = entry->value;
+      dst.gen = gen;
+
+      node_ = next;
+      continue;
+    }
+
+    // ------------------------------------------------------------------------
+    // [Update]
+    // ------------------------------------------------------------------------
+
+    // A copy of a whole variable holds the same value.
+    if (instId == kX86InstIdMov && opCount == 2 && opList[0].isVar() && opList[1].isVar()) {
+      VarData* dstVd = compiler->getVdById(opList[0].getId());
+      VarData* srcVd = compiler->getVdById(opList[1].getId());
+      uint32_t size = opList[0].getSize();
+
+      if (dstVd->getClass() == srcVd->getClass() && size == opList[1].getSize() &&
+          size == dstVd->getSize() && size == srcVd->getSize()) {
+        uint32_t value = X86Context_getValueNumber(slots, opList[1].getId(), gen, counter);
+        X86CseSlot& dst = slots[opList[0].getId() & Operand::kIdIndexMask];
+
+        dst.value = value;
+        dst.gen = gen;
+
+        node_ = next;
+        continue;
+      }
+    }
+
+    for (uint32_t i = 0; i < opCount; i++) {
+      Operand* op = &opList[i];
+
+      bool isWritten = extendedInfo.isSpecial() ||
+                       (i == 0 && (access & kX86InstFlagWO) != 0) ||
+                       (i == 1 && extendedInfo.isXchg());
+
+      if (op->isVar()) {
+        if (isWritten)
+          slots[op->getId() & Operand::kIdIndexMask].gen = 0;
+      }
+      else if (op->isMem()) {
+        const X86Mem* m = static_cast<const X86Mem*>(op);
+
+        // Writing a stack slot of a variable changes the variable.
+        if (m->getMemType() == kMemTypeStackIndex)
+          slots[m->getBase() & Operand::kIdIndexMask].gen = 0;
+
+        if (isWritten)
+          memGen++;
+      }
+    }
+
+    // Special instructions can write memory through implicit operands.
+    if (extendedInfo.isSpecial() || extendedInfo.hasFlag(kX86InstFlagSpecialMem | kX86InstFlagFp | kX86InstFlagVolatile))
+      memGen++;
+
+    // Values can be used at the jump target.
+    if (node->isJmpOrJcc() || extendedInfo.isFlow())
+      gen++;
+
+    node_ = next;
+  }
+
+  ASMJIT_TLOG("[S] ======= Common Subexpressions (Done)\n");
+  return kErrorOk;
+}
+
 // ============================================================================
 // [asmjit::X86Context - Fetch]
 // ============================================================================
@@ -2971,1032 +3675,2447 @@ _NoMemory:
 }
 
 // ============================================================================
-// [asmjit::X86Context - Annotate]
+// [asmjit::X86Context - Dead Code]
 // ============================================================================
 
-Error X86Context::annotate() {
-#if !defined(ASMJIT_DISABLE_LOGGER)
-  HLFunc* func = getFunc();
+//! \internal
+//!
+//! Get whether `node` has no side effects other than writing its destination
+//! variable and EFLAGS, thus can be removed if they are not used.
+static bool X86Context_isPureInst(HLInst* node) {
+  uint32_t instId = node->getInstId();
+  uint32_t opCount = node->getOpCount();
+  const Operand* opList = node->getOpList();
+  const X86InstExtendedInfo& extendedInfo = _x86InstInfo[instId].getExtendedInfo();
+
+  if (opCount == 0 || node->isJmpOrJcc() || node->isSpecial() || node->isFp())
+    return false;
+
+  if (extendedInfo.isSpecial() || extendedInfo.isXchg() ||
+      extendedInfo.hasFlag(kX86InstFlagFlow | kX86InstFlagFp | kX86InstFlagSpecialMem | kX86InstFlagVolatile))
+    return false;
+
+  if (node->getOptions() & kX86InstOptionLock)
+    return false;
+
+  // The first operand is read and written if the table doesn't say otherwise.
+  uint32_t firstAccess = extendedInfo.getFlags() & kX86InstFlagRW;
+  if (firstAccess == 0)
+    firstAccess = kX86InstFlagRW;
+
+  if (firstAccess & kX86InstFlagWO) {
+    // Memory or physical register destination.
+    if (!opList[0].isVar())
+      return false;
+  }
+  else {
+    // Instructions that don't write anything (prefetch, clflush, ...) are
+    // there for their side effects.
+    if (extendedInfo.getEFlagsOut() == 0)
+      return false;
+  }
 
-  HLNode* node_ = func;
-  HLNode* end = func->getEnd();
+  return true;
+}
 
-  Zone& sa = _compiler->_stringAllocator;
-  StringBuilderTmp<128> sb;
+Error X86Context::removeDeadNodes(uint32_t& count) {
+  ASMJIT_TLOG("[D] ======= Dead Code (Begin)\n");
 
-  uint32_t maxLen = 0;
-  while (node_ != end) {
-    if (node_->getComment() == nullptr) {
-      if (node_->getType() == HLNode::kTypeInst) {
-        HLInst* node = static_cast<HLInst*>(node_);
-        X86Context_annotateInstruction(this, sb, node->getInstId(), node->getOpList(), node->getOpCount());
+  X86Compiler* compiler = getCompiler();
 
-        node_->setComment(static_cast<char*>(sa.dup(sb.getData(), sb.getLength() + 1)));
-        maxLen = Utils::iMax<uint32_t>(maxLen, static_cast<uint32_t>(sb.getLength()));
+  HLNode* node_ = getFunc();
+  HLNode* stop = getStop();
 
-        sb.clear();
-      }
+  while (node_ != stop) {
+    HLNode* next = node_->getNext();
+
+    if (node_->getType() != HLNode::kTypeInst || next == nullptr || !next->hasLiveness()) {
+      node_ = next;
+      continue;
     }
 
-    node_ = node_->getNext();
+    HLInst* node = static_cast<HLInst*>(node_);
+    X86VarMap* map = node->getMap<X86VarMap>();
+
+    if (map == nullptr || !X86Context_isPureInst(node)) {
+      node_ = next;
+      continue;
+    }
+
+    // Liveness of the next node tells which variables are used afterwards.
+    BitArray* liveness = next->getLiveness();
+    VarAttr* vaList = map->getVaList();
+    uint32_t vaCount = map->getVaCount();
+    uint32_t i;
+
+    for (i = 0; i < vaCount; i++) {
+      VarAttr* va = &vaList[i];
+      if ((va->getFlags() & kVarAttrWAll) && liveness->getBit(va->getVd()->getLocalId()))
+        break;
+    }
+
+    if (i == vaCount && X86Context_areEFlagsDead(node)) {
+      ASMJIT_TSEC({
+        this->_traceNode(this, node, "[REMOVED DEAD] ");
+      });
+
+      compiler->removeNode(node);
+      count++;
+    }
+
+    node_ = next;
   }
-  _annotationLength = maxLen + 1;
-#endif // !ASMJIT_DISABLE_LOGGER
 
+  ASMJIT_TLOG("[D] ======= Dead Code (Done)\n");
   return kErrorOk;
 }
 
 // ============================================================================
-// [asmjit::X86BaseAlloc]
+// [asmjit::X86Context - Coalesce]
 // ============================================================================
 
-struct X86BaseAlloc {
-  // --------------------------------------------------------------------------
-  // [Construction / Destruction]
-  // --------------------------------------------------------------------------
+//! \internal
+//!
+//! Variable can't be renamed to another variable (it's referenced by a node
+//! that is not an instruction, return or call, or has its own home).
+static const uint8_t kX86CoalesceFixed = 0x01;
 
-  ASMJIT_INLINE X86BaseAlloc(X86Context* context) {
-    _context = context;
-    _compiler = context->getCompiler();
-  }
-  ASMJIT_INLINE ~X86BaseAlloc() {}
+//! \internal
+//!
+//! Variable can't be renamed to another variable (its home is referenced as
+//! memory, or it was already renamed), but others can be renamed to it.
+static const uint8_t kX86CoalescePinned = 0x02;
 
-  // --------------------------------------------------------------------------
-  // [Accessors]
-  // --------------------------------------------------------------------------
+//! \internal
+//!
+//! Variable is required in more than one physical register.
+static const uint8_t kX86CoalesceManyRegs = 0xFE;
 
-  //! Get the context.
-  ASMJIT_INLINE X86Context* getContext() const { return _context; }
-  //! Get the current state (always the same instance as X86Context::_x86State).
-  ASMJIT_INLINE X86VarState* getState() const { return _context->getState(); }
+//! \internal
+//!
+//! Record physical register `index` required by `va` in `vdRegs`.
+static ASMJIT_INLINE void X86Context_addCoalesceReg(uint8_t* vdRegs, VarAttr* va, uint32_t index) {
+  uint8_t& reg = vdRegs[va->getVd()->getLocalId()];
+
+  if (reg == kInvalidReg)
+    reg = static_cast<uint8_t>(index);
+  else if (reg != index)
+    reg = kX86CoalesceManyRegs;
+}
 
-  //! Get the node.
-  ASMJIT_INLINE HLNode* getNode() const { return _node; }
+//! \internal
+//!
+//! Get whether `node` copies a whole variable to another variable of the same
+//! class and size.
+static bool X86Context_isVarCopy(X86Compiler* compiler, HLInst* node) {
+  switch (node->getInstId()) {
+    case kX86InstIdMov:
+    case kX86InstIdMovapd:
+    case kX86InstIdMovaps:
+    case kX86InstIdMovdqa:
+    case kX86InstIdMovdqu:
+    case kX86InstIdMovupd:
+    case kX86InstIdMovups:
+      break;
 
-  //! Get VarAttr list (all).
-  ASMJIT_INLINE VarAttr* getVaList() const { return _vaList[0]; }
-  //! Get VarAttr list (per class).
-  ASMJIT_INLINE VarAttr* getVaListByClass(uint32_t rc) const { return _vaList[rc]; }
+    default:
+      return false;
+  }
 
-  //! Get VarAttr count (all).
-  ASMJIT_INLINE uint32_t getVaCount() const { return _vaCount; }
-  //! Get VarAttr count (per class).
-  ASMJIT_INLINE uint32_t getVaCountByClass(uint32_t rc) const { return _count.get(rc); }
+  const Operand* opList = node->getOpList();
+  if (node->getOpCount() != 2 || node->getOptions() != 0 || !opList[0].isVar() || !opList[1].isVar())
+    return false;
 
-  //! Get whether all variables of class `c` are done.
-  ASMJIT_INLINE bool isVaDone(uint32_t rc) const { return _done.get(rc) == _count.get(rc); }
+  if (opList[0].getId() == opList[1].getId())
+    return false;
 
-  //! Get how many variables have been allocated.
-  ASMJIT_INLINE uint32_t getVaDone(uint32_t rc) const { return _done.get(rc); }
-  //! Add to the count of variables allocated.
-  ASMJIT_INLINE void addVaDone(uint32_t rc, uint32_t n = 1) { _done.add(rc, n); }
+  VarData* dstVd = compiler->getVdById(opList[0].getId());
+  VarData* srcVd = compiler->getVdById(opList[1].getId());
 
-  //! Get number of allocable registers per class.
-  ASMJIT_INLINE uint32_t getGaRegs(uint32_t rc) const {
-    return _context->_gaRegs[rc];
-  }
+  return dstVd->getClass() == srcVd->getClass() &&
+         dstVd->getSize() == srcVd->getSize() &&
+         opList[0].getSize() == dstVd->getSize() &&
+         opList[1].getSize() == srcVd->getSize();
+}
 
-  // --------------------------------------------------------------------------
-  // [Init / Cleanup]
-  // --------------------------------------------------------------------------
+//! \internal
+//!
+//! Get whether variables `aVd` and `bVd` connected by a `copy` can hold
+//! different values at a node where both are alive, or are referenced by the
+//! same node. Being alive at the same node is fine as long as neither of them
+//! is written there - both hold the value copied.
+static bool X86Context_isCoalesceInterfering(X86Context* self, HLNode* copy, VarData* aVd, VarData* bVd) {
+  X86Compiler* compiler = self->getCompiler();
+  HLNode* func = self->getFunc();
+  HLNode* stop = self->getStop();
 
-protected:
-  // Just to prevent calling these methods by X86Context::translate().
+  uint32_t aId = aVd->getLocalId();
+  uint32_t bId = bVd->getLocalId();
 
-  ASMJIT_INLINE void init(HLNode* node, X86VarMap* map);
-  ASMJIT_INLINE void cleanup();
+  for (HLNode* node = func; node != stop; node = node->getNext()) {
+    if (node == copy || !node->hasLiveness())
+      continue;
 
-  // --------------------------------------------------------------------------
-  // [Unuse]
-  // --------------------------------------------------------------------------
+    BitArray* liveness = node->getLiveness();
+    bool aLive = liveness->getBit(aId);
+    bool bLive = liveness->getBit(bId);
 
-  template<int C>
-  ASMJIT_INLINE void unuseBefore();
+    if (!aLive && !bLive)
+      continue;
 
-  template<int C>
-  ASMJIT_INLINE void unuseAfter();
+    X86VarMap* map = node->getMap<X86VarMap>();
+    VarAttr* aVa = map != nullptr ? map->findVa(aVd) : nullptr;
+    VarAttr* bVa = map != nullptr ? map->findVa(bVd) : nullptr;
 
-  // --------------------------------------------------------------------------
-  // [Members]
-  // --------------------------------------------------------------------------
+    if (aVa != nullptr && bVa != nullptr) {
+      // Another copy between both variables becomes a copy to itself, which
+      // is removed as well.
+      if (node->getType() == HLNode::kTypeInst && X86Context_isVarCopy(compiler, static_cast<HLInst*>(node)))
+        continue;
 
-  //! Context.
-  X86Context* _context;
-  //! Compiler.
-  X86Compiler* _compiler;
+      // A node can't reference a variable twice once they are merged.
+      return true;
+    }
 
-  //! Node.
-  HLNode* _node;
+    if (!aLive || !bLive)
+      continue;
 
-  //! Variable map.
-  X86VarMap* _map;
-  //! VarAttr list (per register class).
-  VarAttr* _vaList[_kX86RegClassManagedCount];
+    // Function arguments are written by the function node, anything else
+    // alive there is undefined.
+    if (node == func)
+      return true;
 
-  //! Count of all VarAttr's.
-  uint32_t _vaCount;
+    // Hints and other nodes that aren't instructions apply to one variable.
+    uint32_t type = node->getType();
+    if ((aVa != nullptr || bVa != nullptr) &&
+        type != HLNode::kTypeInst && type != HLNode::kTypeRet && type != HLNode::kTypeCall) {
+      return true;
+    }
 
-  //! VarAttr's total counter.
-  X86RegCount _count;
-  //! VarAttr's done counter.
-  X86RegCount _done;
-};
+    if ((aVa != nullptr && (aVa->getFlags() & kVarAttrWAll)) ||
+        (bVa != nullptr && (bVa->getFlags() & kVarAttrWAll)))
+      return true;
+  }
 
-// ============================================================================
-// [asmjit::X86BaseAlloc - Init / Cleanup]
-// ============================================================================
+  return false;
+}
 
-ASMJIT_INLINE void X86BaseAlloc::init(HLNode* node, X86VarMap* map) {
-  _node = node;
-  _map = map;
+//! \internal
+//!
+//! Replace all references of variable `fromId` in `opList` by `toId`.
+static void X86Context_renameVar(Operand* opList, uint32_t opCount, uint32_t fromId, uint32_t toId) {
+  for (uint32_t i = 0; i < opCount; i++) {
+    Operand* op = &opList[i];
 
-  // We have to set the correct cursor in case any instruction is emitted
-  // during the allocation phase; it has to be emitted before the current
-  // instruction.
-  _compiler->_setCursor(node->getPrev());
+    if (op->isVar()) {
+      if (op->getId() == fromId)
+        op->_vreg.id = toId;
+    }
+    else if (op->isMem()) {
+      X86Mem* m = static_cast<X86Mem*>(op);
 
-  // Setup the lists of variables.
-  {
-    VarAttr* va = map->getVaList();
-    _vaList[kX86RegClassGp ] = va;
-    _vaList[kX86RegClassMm ] = va + map->getVaStart(kX86RegClassMm );
-    _vaList[kX86RegClassK  ] = va + map->getVaStart(kX86RegClassK  );
-    _vaList[kX86RegClassXyz] = va + map->getVaStart(kX86RegClassXyz);
+      if (m->isBaseIndexType() && m->getBase() == fromId)
+        m->_vmem.base = toId;
+
+      if (m->getIndex() == fromId)
+        m->_vmem.index = toId;
+    }
   }
+}
 
-  // Setup counters.
-  _vaCount = map->getVaCount();
+Error X86Context::coalesceCopies(uint32_t& count) {
+  ASMJIT_TLOG("[K] ======= Coalesce (Begin)\n");
 
-  _count = map->_count;
-  _done.reset();
+  X86Compiler* compiler = getCompiler();
+  uint32_t vdCount = static_cast<uint32_t>(_contextVd.getLength());
 
-  // Connect Vd->Va.
-  for (uint32_t i = 0; i < _vaCount; i++) {
-    VarAttr* va = &_vaList[0][i];
-    VarData* vd = va->getVd();
+  if (vdCount < 2)
+    return kErrorOk;
 
-    vd->setVa(va);
-  }
-}
+  uint8_t* vdFlags = static_cast<uint8_t*>(_zoneAllocator.allocZeroed(vdCount));
+  uint8_t* vdRegs = static_cast<uint8_t*>(_zoneAllocator.alloc(vdCount));
 
-ASMJIT_INLINE void X86BaseAlloc::cleanup() {
-  // Disconnect Vd->Va.
-  for (uint32_t i = 0; i < _vaCount; i++) {
-    VarAttr* va = &_vaList[0][i];
-    VarData* vd = va->getVd();
+  if (vdFlags == nullptr || vdRegs == nullptr)
+    return compiler->setLastError(kErrorNoHeapMemory);
+  ::memset(vdRegs, kInvalidReg, vdCount);
 
-    vd->setVa(nullptr);
+  HLNode* func = getFunc();
+  HLNode* stop = getStop();
+  HLNode* node_;
+  uint32_t i;
+
+  // Find variables that can't be renamed. Hints, function arguments and
+  // stack arguments of calls keep the variable they were created for.
+  for (i = 0; i < vdCount; i++) {
+    VarData* vd = _contextVd[i];
+
+    if (vd->isStack())
+      vdFlags[i] |= kX86CoalescePinned;
+    else if (vd->isMemArg() || vd->isCalculated() || vd->saveOnUnuse())
+      vdFlags[i] |= kX86CoalesceFixed;
   }
-}
 
-// ============================================================================
-// [asmjit::X86BaseAlloc - Unuse]
-// ============================================================================
+  for (node_ = func; node_ != stop; node_ = node_->getNext()) {
+    uint32_t type = node_->getType();
 
-template<int C>
-ASMJIT_INLINE void X86BaseAlloc::unuseBefore() {
-  VarAttr* list = getVaListByClass(C);
-  uint32_t count = getVaCountByClass(C);
+    // Find physical registers variables are required in (function arguments,
+    // return values and special instructions). Renaming a variable to one
+    // required in a different register only moves the copy elsewhere.
+    X86VarMap* map = node_->getMap<X86VarMap>();
+    if (map != nullptr) {
+      VarAttr* vaList = map->getVaList();
+      uint32_t vaCount = map->getVaCount();
 
-  const uint32_t checkFlags =
-    kVarAttrXReg  |
-    kVarAttrRMem  |
-    kVarAttrRFunc |
-    kVarAttrRCall |
-    kVarAttrRConv ;
+      for (i = 0; i < vaCount; i++) {
+        VarAttr* va = &vaList[i];
 
-  for (uint32_t i = 0; i < count; i++) {
-    VarAttr* va = &list[i];
+        if (va->hasInRegIndex())
+          X86Context_addCoalesceReg(vdRegs, va, va->getInRegIndex());
+        else if (Utils::isPowerOf2(va->getInRegs()))
+          X86Context_addCoalesceReg(vdRegs, va, Utils::findFirstBit(va->getInRegs()));
 
-    if ((va->getFlags() & checkFlags) == kVarAttrWReg) {
-      _context->unuse<C>(va->getVd());
+        if (va->hasOutRegIndex())
+          X86Context_addCoalesceReg(vdRegs, va, va->getOutRegIndex());
+      }
     }
-  }
-}
 
-template<int C>
-ASMJIT_INLINE void X86BaseAlloc::unuseAfter() {
-  VarAttr* list = getVaListByClass(C);
-  uint32_t count = getVaCountByClass(C);
+    if (type == HLNode::kTypeInst) {
+      HLInst* node = static_cast<HLInst*>(node_);
+      if (!node->hasMemOp())
+        continue;
 
-  for (uint32_t i = 0; i < count; i++) {
-    VarAttr* va = &list[i];
+      const X86Mem* m = node->getMemOp<X86Mem>();
+      if (m->getMemType() == kMemTypeStackIndex && OperandUtil::isVarId(m->getBase())) {
+        VarData* vd = compiler->getVdById(m->getBase());
+        if (vd->getLocalId() < vdCount)
+          vdFlags[vd->getLocalId()] |= kX86CoalescePinned;
+      }
+    }
+    else if (type != HLNode::kTypeRet && type != HLNode::kTypeCall) {
+      if (map == nullptr)
+        continue;
 
-    if (va->getFlags() & kVarAttrUnuse)
-      _context->unuse<C>(va->getVd());
+      VarAttr* vaList = map->getVaList();
+      uint32_t vaCount = map->getVaCount();
+
+      for (i = 0; i < vaCount; i++)
+        vdFlags[vaList[i].getVd()->getLocalId()] |= kX86CoalesceFixed;
+    }
   }
-}
 
-// ============================================================================
-// [asmjit::X86VarAlloc]
-// ============================================================================
+  node_ = func;
+  while (node_ != stop) {
+    HLNode* next = node_->getNext();
 
-//! \internal
-//!
-//! Register allocator context (asm instructions).
-struct X86VarAlloc : public X86BaseAlloc {
-  // --------------------------------------------------------------------------
-  // [Construction / Destruction]
-  // --------------------------------------------------------------------------
+    if (node_->getType() != HLNode::kTypeInst || !node_->hasLiveness()) {
+      node_ = next;
+      continue;
+    }
 
-  ASMJIT_INLINE X86VarAlloc(X86Context* context) : X86BaseAlloc(context) {}
-  ASMJIT_INLINE ~X86VarAlloc() {}
+    HLInst* node = static_cast<HLInst*>(node_);
+    if (!X86Context_isVarCopy(compiler, node)) {
+      node_ = next;
+      continue;
+    }
 
-  // --------------------------------------------------------------------------
-  // [Run]
-  // --------------------------------------------------------------------------
+    VarData* fromVd = compiler->getVdById(node->getOpList()[0].getId());
+    VarData* toVd = compiler->getVdById(node->getOpList()[1].getId());
 
-  ASMJIT_INLINE Error run(HLNode* node);
+    uint32_t fromId = fromVd->getLocalId();
+    uint32_t toId = toVd->getLocalId();
 
-  // --------------------------------------------------------------------------
-  // [Init / Cleanup]
-  // --------------------------------------------------------------------------
+    uint32_t kept = kX86CoalesceFixed | kX86CoalescePinned;
+    if ((vdFlags[fromId] & kept) && (vdFlags[toId] & kept)) {
+      node_ = next;
+      continue;
+    }
 
-protected:
-  // Just to prevent calling these methods by X86Context::translate().
+    if (vdRegs[fromId] != kInvalidReg && vdRegs[toId] != kInvalidReg &&
+        (vdRegs[fromId] != vdRegs[toId] || vdRegs[fromId] == kX86CoalesceManyRegs)) {
+      node_ = next;
+      continue;
+    }
 
-  ASMJIT_INLINE void init(HLNode* node, X86VarMap* map);
-  ASMJIT_INLINE void cleanup();
+    // Prefer renaming the destination, the source can be a function argument.
+    if (vdFlags[fromId] & kept) {
+      VarData* tmpVd = fromVd;
+      fromVd = toVd;
+      toVd = tmpVd;
 
-  // --------------------------------------------------------------------------
-  // [Plan / Spill / Alloc]
-  // --------------------------------------------------------------------------
+      fromId = fromVd->getLocalId();
+      toId = toVd->getLocalId();
+    }
 
-  template<int C>
-  ASMJIT_INLINE void plan();
-
-  template<int C>
-  ASMJIT_INLINE void spill();
+    if (X86Context_isCoalesceInterfering(this, node, fromVd, toVd)) {
+      node_ = next;
+      continue;
+    }
 
-  template<int C>
-  ASMJIT_INLINE void alloc();
+    ASMJIT_TSEC({
+      this->_traceNode(this, node, "[COALESCED] ");
+    });
 
-  // --------------------------------------------------------------------------
-  // [GuessAlloc / GuessSpill]
-  // --------------------------------------------------------------------------
+    // Rename, the liveness of the merged variable is the union of both.
+    uint32_t fromOpId = fromVd->getId();
+    uint32_t toOpId = toVd->getId();
 
-  //! Guess which register is the best candidate for 'vd' from
-  //! 'allocableRegs'.
-  //!
-  //! The guess is based on looking ahead and inspecting register allocator
-  //! instructions. The main reason is to prevent allocation to a register
-  //! which is needed by next instruction(s). The guess look tries to go as far
-  //! as possible, after the remaining registers are zero, the mask of previous
-  //! registers (called 'safeRegs') is returned.
-  template<int C>
-  ASMJIT_INLINE uint32_t guessAlloc(VarData* vd, uint32_t allocableRegs);
+    HLNode* cur = func;
+    while (cur != stop) {
+      HLNode* curNext = cur->getNext();
+      if (cur == node) {
+        cur = curNext;
+        continue;
+      }
 
-  //! Guess whether to move the given 'vd' instead of spill.
-  template<int C>
-  ASMJIT_INLINE uint32_t guessSpill(VarData* vd, uint32_t allocableRegs);
+      if (cur->hasLiveness()) {
+        BitArray* liveness = cur->getLiveness();
+        if (liveness->getBit(fromId)) {
+          liveness->delBit(fromId);
+          liveness->setBit(toId);
+        }
+      }
 
-  // --------------------------------------------------------------------------
-  // [Modified]
-  // --------------------------------------------------------------------------
+      X86VarMap* map = cur->getMap<X86VarMap>();
+      VarAttr* va = map != nullptr ? map->findVa(fromVd) : nullptr;
 
-  template<int C>
-  ASMJIT_INLINE void modified();
+      if (va == nullptr) {
+        cur = curNext;
+        continue;
+      }
 
-  // --------------------------------------------------------------------------
-  // [Members]
-  // --------------------------------------------------------------------------
+      // Other copies between both variables would copy the variable to itself.
+      if (map->findVa(toVd) != nullptr) {
+        if (next == cur)
+          next = curNext;
 
-  //! Will alloc to these registers.
-  X86RegMask _willAlloc;
-  //! Will spill these registers.
-  X86RegMask _willSpill;
-};
+        compiler->removeNode(cur);
+        cur = curNext;
+        continue;
+      }
 
-// ============================================================================
-// [asmjit::X86VarAlloc - Run]
-// ============================================================================
+      va->setVd(toVd);
 
-ASMJIT_INLINE Error X86VarAlloc::run(HLNode* node_) {
-  // Initialize.
-  X86VarMap* map = node_->getMap<X86VarMap>();
-  if (map == nullptr)
-    return kErrorOk;
+      switch (cur->getType()) {
+        case HLNode::kTypeInst: {
+          HLInst* inst = static_cast<HLInst*>(cur);
+          X86Context_renameVar(inst->getOpList(), inst->getOpCount(), fromOpId, toOpId);
+          break;
+        }
 
-  // Initialize the allocator; connect Vd->Va.
-  init(node_, map);
+        case HLNode::kTypeRet: {
+          HLRet* ret = static_cast<HLRet*>(cur);
+          X86Context_renameVar(ret->_ret, 2, fromOpId, toOpId);
+          break;
+        }
 
-  // Unuse overwritten variables.
-  unuseBefore<kX86RegClassGp>();
-  unuseBefore<kX86RegClassMm>();
-  unuseBefore<kX86RegClassXyz>();
+        case HLNode::kTypeCall: {
+          X86CallNode* call = static_cast<X86CallNode*>(cur);
+          X86Context_renameVar(&call->_target, 1, fromOpId, toOpId);
+          X86Context_renameVar(call->_ret, 2, fromOpId, toOpId);
+          X86Context_renameVar(call->_args, call->_x86Decl.getNumArgs(), fromOpId, toOpId);
+          break;
+        }
 
-  // Plan the allocation. Planner assigns input/output registers for each
-  // variable and decides whether to allocate it in register or stack.
-  plan<kX86RegClassGp>();
-  plan<kX86RegClassMm>();
-  plan<kX86RegClassXyz>();
+        default:
+          ASMJIT_NOT_REACHED();
+      }
 
-  // Spill all variables marked by plan().
-  spill<kX86RegClassGp>();
-  spill<kX86RegClassMm>();
-  spill<kX86RegClassXyz>();
+      cur = curNext;
+    }
 
-  // Alloc all variables marked by plan().
-  alloc<kX86RegClassGp>();
-  alloc<kX86RegClassMm>();
-  alloc<kX86RegClassXyz>();
+    compiler->removeNode(node);
+    vdFlags[fromId] |= kX86CoalescePinned;
+    if (vdRegs[toId] == kInvalidReg)
+      vdRegs[toId] = vdRegs[fromId];
+    count++;
 
-  // Translate node operands.
-  if (node_->getType() == HLNode::kTypeInst) {
-    HLInst* node = static_cast<HLInst*>(node_);
-    ASMJIT_PROPAGATE_ERROR(X86Context_translateOperands(_context, node->getOpList(), node->getOpCount()));
+    node_ = next;
   }
-  else if (node_->getType() == HLNode::kTypeCallArg) {
-    HLCallArg* node = static_cast<HLCallArg*>(node_);
 
-    X86CallNode* call = static_cast<X86CallNode*>(node->getCall());
-    X86FuncDecl* decl = call->getDecl();
+  // Coalesce variables with registers used to pass them to calls and returns
+  // - the register becomes their preferred (home) register.
+  for (node_ = func; node_ != stop; node_ = node_->getNext()) {
+    uint32_t type = node_->getType();
+    if (type != HLNode::kTypeRet && type != HLNode::kTypeCall)
+      continue;
 
-    uint32_t argIndex = 0;
-    uint32_t argMask = node->_args;
+    X86VarMap* map = node_->getMap<X86VarMap>();
+    if (map == nullptr)
+      continue;
 
-    VarData* sVd = node->getSVd();
-    VarData* cVd = node->getCVd();
+    VarAttr* vaList = map->getVaList();
+    uint32_t vaCount = map->getVaCount();
 
-    // Convert first.
-    ASMJIT_ASSERT(sVd->getRegIndex() != kInvalidReg);
+    for (i = 0; i < vaCount; i++) {
+      VarAttr* va = &vaList[i];
+      VarData* vd = va->getVd();
 
-    if (cVd != nullptr) {
-      ASMJIT_ASSERT(cVd->getRegIndex() != kInvalidReg);
-      _context->emitConvertVarToVar(
-        cVd->getType(), cVd->getRegIndex(),
-        sVd->getType(), sVd->getRegIndex());
-      sVd = cVd;
+      if (Utils::isPowerOf2(va->getInRegs()))
+        vd->addHomeIndex(Utils::findFirstBit(va->getInRegs()));
+      else if (va->hasOutRegIndex())
+        vd->addHomeIndex(va->getOutRegIndex());
     }
+  }
 
-    while (argMask != 0) {
-      if (argMask & 0x1) {
-        FuncInOut& arg = decl->getArg(argIndex);
-        ASMJIT_ASSERT(arg.hasStackOffset());
+  ASMJIT_TLOG("[K] ======= Coalesce (Done)\n");
+  return kErrorOk;
+}
 
-        X86Mem dst = x86::ptr(_context->_zsp, -static_cast<int>(_context->getRegSize()) + arg.getStackOffset());
-        _context->emitMoveVarOnStack(arg.getVarType(), &dst, sVd->getType(), sVd->getRegIndex());
-      }
+// ============================================================================
+// [asmjit::X86Context - Live Intervals]
+// ============================================================================
 
-      argIndex++;
-      argMask >>= 1;
+//! \internal
+//!
+//! Get mask of a register in `regs` that makes the code of a variable used by
+//! `uses` nodes the shortest - each instruction that uses a register above 7
+//! needs a REX prefix, `saved` registers have to be saved and restored by the
+//! function prolog and epilog (they are not preferred if the costs are equal).
+static ASMJIT_INLINE uint32_t X86Context_getShortestReg(uint32_t regs, uint32_t saved, uint32_t uses) {
+  uint32_t i;
+  uint32_t bestMask = 0;
+  uint32_t bestCost = 0;
+
+  for (i = 0; regs != 0; i++, regs >>= 1) {
+    if (!(regs & 0x1))
+      continue;
+
+    uint32_t mask = Utils::mask(i);
+    uint32_t cost = (i >= 8 ? uses : 0) + ((saved & mask) != 0 ? 2 : 0);
+    cost = (cost << 1) | ((saved & mask) != 0);
+
+    if (bestMask == 0 || cost < bestCost) {
+      bestMask = mask;
+      bestCost = cost;
     }
   }
 
-  // Mark variables as modified.
-  modified<kX86RegClassGp>();
-  modified<kX86RegClassMm>();
-  modified<kX86RegClassXyz>();
+  return bestMask;
+}
 
-  // Cleanup; disconnect Vd->Va.
-  cleanup();
+Error X86Context::allocIntervals() {
+  ASMJIT_TLOG("[K] ======= Live Intervals (Begin)\n");
 
-  // Update clobbered mask.
-  _context->_clobberedRegs.or_(_willAlloc);
-  _context->_clobberedRegs.or_(map->_clobberedRegs);
+  X86Compiler* compiler = getCompiler();
+  uint32_t vdCount = static_cast<uint32_t>(_contextVd.getLength());
 
-  // Unuse.
-  unuseAfter<kX86RegClassGp>();
-  unuseAfter<kX86RegClassMm>();
-  unuseAfter<kX86RegClassXyz>();
+  if (vdCount == 0)
+    return kErrorOk;
 
-  return kErrorOk;
-}
+  X86FuncNode* func = getFunc();
+  HLNode* stop = getStop();
+  HLNode* node;
 
-// ============================================================================
-// [asmjit::X86VarAlloc - Init / Cleanup]
-// ============================================================================
+  uint32_t i;
+  uint32_t flowCount = func->getEnd()->getFlowId() + 1;
+
+  uint8_t* liveReg = static_cast<uint8_t*>(_zoneAllocator.alloc(vdCount));
+  uint32_t* vdAllowed = static_cast<uint32_t*>(
+    _zoneAllocator.alloc(static_cast<size_t>(vdCount) * sizeof(uint32_t)));
+  uint32_t* vdFixed = static_cast<uint32_t*>(
+    _zoneAllocator.allocZeroed(static_cast<size_t>(vdCount) * sizeof(uint32_t)));
+  uint32_t* vdUses = static_cast<uint32_t*>(
+    _zoneAllocator.allocZeroed(static_cast<size_t>(vdCount) * sizeof(uint32_t)));
+  uint32_t* starts = static_cast<uint32_t*>(
+    _zoneAllocator.allocZeroed(static_cast<size_t>(flowCount + 1) * sizeof(uint32_t)));
+  VarData** sorted = static_cast<VarData**>(
+    _zoneAllocator.alloc(static_cast<size_t>(vdCount) * sizeof(VarData*)));
+
+  if (liveReg == nullptr || vdAllowed == nullptr || vdFixed == nullptr || vdUses == nullptr || starts == nullptr || sorted == nullptr)
+    return compiler->setLastError(kErrorNoHeapMemory);
+
+  ::memset(liveReg, kInvalidReg, vdCount);
+  ::memset(vdAllowed, 0xFF, static_cast<size_t>(vdCount) * sizeof(uint32_t));
+
+  // Registers each variable can be allocated in, registers it's required in
+  // (function arguments, return values and special instructions), and count
+  // of nodes that use it.
+  for (node = func; node != stop; node = node->getNext()) {
+    X86VarMap* map = node->getMap<X86VarMap>();
+    if (map == nullptr)
+      continue;
 
-ASMJIT_INLINE void X86VarAlloc::init(HLNode* node, X86VarMap* map) {
-  X86BaseAlloc::init(node, map);
+    VarAttr* vaList = map->getVaList();
+    uint32_t vaCount = map->getVaCount();
 
-  // These will block planner from assigning them during planning. Planner will
-  // add more registers when assigning registers to variables that don't need
-  // any specific register.
-  _willAlloc = map->_inRegs;
-  _willAlloc.or_(map->_outRegs);
-  _willSpill.reset();
-}
+    for (i = 0; i < vaCount; i++) {
+      VarAttr* va = &vaList[i];
+      uint32_t localId = va->getVd()->getLocalId();
 
-ASMJIT_INLINE void X86VarAlloc::cleanup() {
-  X86BaseAlloc::cleanup();
-}
+      vdUses[localId]++;
 
-// ============================================================================
-// [asmjit::X86VarAlloc - Plan / Spill / Alloc]
-// ============================================================================
+      uint32_t fixed = 0;
+      if (va->hasInRegIndex())
+        fixed |= Utils::mask(va->getInRegIndex());
+      else if (Utils::isPowerOf2(va->getInRegs()))
+        fixed |= va->getInRegs();
 
-template<int C>
-ASMJIT_INLINE void X86VarAlloc::plan() {
-  if (isVaDone(C))
-    return;
+      if (va->hasOutRegIndex())
+        fixed |= Utils::mask(va->getOutRegIndex());
 
-  uint32_t i;
-  uint32_t willAlloc = _willAlloc.get(C);
-  uint32_t willFree = 0;
+      // A fixed register is only preferred, the variable is moved to it.
+      if (fixed != 0)
+        vdFixed[localId] |= fixed;
+      else if (va->getAllocableRegs() != 0)
+        vdAllowed[localId] &= va->getAllocableRegs();
+    }
+  }
 
-  VarAttr* list = getVaListByClass(C);
-  uint32_t count = getVaCountByClass(C);
-  X86VarState* state = getState();
+  // Sort intervals by their start, flow ids are dense so they are counted.
+  uint32_t sortedCount = 0;
+  for (i = 0; i < vdCount; i++) {
+    VarData* vd = _contextVd[i];
+    uint32_t start = getLiveStart(vd);
 
-  // Calculate 'willAlloc' and 'willFree' masks based on mandatory masks.
-  for (i = 0; i < count; i++) {
-    VarAttr* va = &list[i];
-    VarData* vd = va->getVd();
+    if (getLiveEnd(vd) != 0 && start < flowCount && !vd->isStack())
+      starts[start + 1]++;
+  }
 
-    uint32_t vaFlags = va->getFlags();
-    uint32_t regIndex = vd->getRegIndex();
-    uint32_t regMask = (regIndex != kInvalidReg) ? Utils::mask(regIndex) : 0;
+  for (i = 0; i < flowCount; i++)
+    starts[i + 1] += starts[i];
 
-    if ((vaFlags & kVarAttrXReg) != 0) {
-      // Planning register allocation. First check whether the variable is
-      // already allocated in register and if it can stay allocated there.
-      //
-      // The following conditions may happen:
-      //
-      // a) Allocated register is one of the mandatoryRegs.
-      // b) Allocated register is one of the allocableRegs.
-      uint32_t mandatoryRegs = va->getInRegs();
-      uint32_t allocableRegs = va->getAllocableRegs();
+  for (i = 0; i < vdCount; i++) {
+    VarData* vd = _contextVd[i];
+    uint32_t start = getLiveStart(vd);
 
-      ASMJIT_TLOG("[RA-PLAN] %s (%s)\n",
-        vd->getName(),
-        (vaFlags & kVarAttrXReg) == kVarAttrWReg ? "R-Reg" : "X-Reg");
+    if (getLiveEnd(vd) != 0 && start < flowCount && !vd->isStack()) {
+      sorted[starts[start]++] = vd;
+      sortedCount++;
+    }
+  }
 
-      ASMJIT_TLOG("[RA-PLAN] RegMask=%08X Mandatory=%08X Allocable=%08X\n",
-        regMask, mandatoryRegs, allocableRegs);
+  // Linear scan - intervals are visited in order, `active` contains those
+  // that have a register and are alive at the start of the current one.
+  for (uint32_t rc = 0; rc < _kX86RegClassManagedCount; rc++) {
+    VarData* active[32];
+    uint32_t activeCount = 0;
 
-      if (regMask != 0) {
-        // Special path for planning output-only registers.
-        if ((vaFlags & kVarAttrXReg) == kVarAttrWReg) {
-          uint32_t outRegIndex = va->getOutRegIndex();
-          mandatoryRegs = (outRegIndex != kInvalidReg) ? Utils::mask(outRegIndex) : 0;
+    // End of the last interval each used register was assigned to.
+    uint32_t regEnd[32];
 
-          if ((mandatoryRegs | allocableRegs) & regMask) {
-            va->setOutRegIndex(regIndex);
-            va->orFlags(kVarAttrAllocWDone);
+    uint32_t gaRegs = _gaRegs[rc];
+    uint32_t freeRegs = gaRegs;
+    uint32_t usedRegs = 0;
+    uint32_t preserved = func->getDecl()->getPreserved(rc);
 
-            if (mandatoryRegs & regMask) {
-              // Case 'a' - 'willAlloc' contains initially all inRegs from all VarAttr's.
-              ASMJIT_ASSERT((willAlloc & regMask) != 0);
-            }
-            else {
-              // Case 'b'.
-              va->setOutRegIndex(regIndex);
-              willAlloc |= regMask;
-            }
+    for (uint32_t k = 0; k < sortedCount; k++) {
+      VarData* vd = sorted[k];
+      if (vd->getClass() != rc)
+        continue;
 
-            ASMJIT_TLOG("[RA-PLAN] WillAlloc\n");
-            addVaDone(C);
+      uint32_t localId = vd->getLocalId();
+      uint32_t start = getLiveStart(vd);
+      uint32_t j;
 
-            continue;
-          }
+      for (j = 0; j < activeCount; ) {
+        if (getLiveEnd(active[j]) < start) {
+          uint32_t activeReg = liveReg[active[j]->getLocalId()];
+          regEnd[activeReg] = getLiveEnd(active[j]);
+          freeRegs |= Utils::mask(activeReg);
+          active[j] = active[--activeCount];
         }
         else {
-          if ((mandatoryRegs | allocableRegs) & regMask) {
-            va->setInRegIndex(regIndex);
-            va->orFlags(kVarAttrAllocRDone);
-
-            if (mandatoryRegs & regMask) {
-              // Case 'a' - 'willAlloc' contains initially all inRegs from all VarAttr's.
-              ASMJIT_ASSERT((willAlloc & regMask) != 0);
-            }
-            else {
-              // Case 'b'.
-              va->addInRegs(regMask);
-              willAlloc |= regMask;
-            }
+          j++;
+        }
+      }
 
-            ASMJIT_TLOG("[RA-PLAN] WillAlloc\n");
-            addVaDone(C);
+      uint32_t allowed = vdAllowed[localId] & gaRegs;
+      if (allowed == 0)
+        continue;
 
+      uint32_t candidateRegs = freeRegs & allowed;
+      if (candidateRegs == 0) {
+        // Take the register of the interval that is the cheapest to spill,
+        // the one that ends last if the costs are equal.
+        uint32_t victim = activeCount;
+        for (j = 0; j < activeCount; j++) {
+          VarData* other = active[j];
+          if (!(Utils::mask(liveReg[other->getLocalId()]) & allowed))
             continue;
-          }
+
+          if (victim == activeCount ||
+              other->getSpillCost() < active[victim]->getSpillCost() ||
+              (other->getSpillCost() == active[victim]->getSpillCost() && getLiveEnd(other) > getLiveEnd(active[victim])))
+            victim = j;
         }
 
-        // Trace it here so we don't pollute log by `WillFree` of zero regMask.
-        ASMJIT_TLOG("[RA-PLAN] WillFree\n");
-      }
+        if (victim == activeCount)
+          continue;
 
-      // Variable is not allocated or allocated in register that doesn't
-      // match inRegs or allocableRegs. The next step is to pick the best
-      // register for this variable. If `inRegs` contains any register the
-      // decision is simple - we have to follow, in other case will use
-      // the advantage of `guessAlloc()` to find a register (or registers)
-      // by looking ahead. But the best way to find a good register is not
-      // here since now we have no information about the registers that
-      // will be freed. So instead of finding register here, we just mark
-      // the current register (if variable is allocated) as `willFree` so
-      // the planner can use this information in the second step to plan the
-      // allocation as a whole.
-      willFree |= regMask;
-      continue;
-    }
-    else {
-      // Memory access - if variable is allocated it has to be freed.
-      ASMJIT_TLOG("[RA-PLAN] %s (Memory)\n", vd->getName());
+        VarData* other = active[victim];
+        if (other->getSpillCost() > vd->getSpillCost() ||
+            (other->getSpillCost() == vd->getSpillCost() && getLiveEnd(other) <= getLiveEnd(vd)))
+          continue;
 
-      if (regMask != 0) {
-        ASMJIT_TLOG("[RA-PLAN] WillFree\n");
-        willFree |= regMask;
-        continue;
+        candidateRegs = Utils::mask(liveReg[other->getLocalId()]);
+        liveReg[other->getLocalId()] = kInvalidReg;
+        active[victim] = active[--activeCount];
       }
-      else {
-        ASMJIT_TLOG("[RA-PLAN] Done\n");
-        va->orFlags(kVarAttrAllocRDone);
-        addVaDone(C);
-        continue;
+      else if (candidateRegs & vdFixed[localId]) {
+        candidateRegs &= vdFixed[localId];
       }
-    }
-  }
+      else {
+        // Variables alive after a call prefer preserved registers.
+        if (isLiveAcrossCall(vd) && (candidateRegs & preserved))
+          candidateRegs &= preserved;
+        candidateRegs = X86Context_getShortestReg(candidateRegs, preserved & ~usedRegs, vdUses[localId]);
+
+        // Intervals are visited in the order they start, so a register that
+        // needs REX prefix can be left to a variable used more than the one
+        // that got a register that doesn't. Swap them if the register was
+        // free during all of the other interval.
+        uint32_t rexIndex = Utils::findFirstBit(candidateRegs);
+        if (rexIndex >= 8) {
+          uint32_t rexMask = Utils::mask(rexIndex);
+          uint32_t swapIndex = activeCount;
+
+          for (j = 0; j < activeCount; j++) {
+            VarData* other = active[j];
+            uint32_t otherId = other->getLocalId();
+            uint32_t otherMask = Utils::mask(liveReg[otherId]);
+
+            if (liveReg[otherId] >= 8 || !(otherMask & allowed) || (otherMask & vdFixed[otherId]) != 0)
+              continue;
 
-  // Occupied registers without 'willFree' registers; contains basically
-  // all the registers we can use to allocate variables without inRegs
-  // speficied.
-  uint32_t occupied = state->_occupied.get(C) & ~willFree;
-  uint32_t willSpill = 0;
+            if (!(vdAllowed[otherId] & rexMask) || (isLiveAcrossCall(other) && !(preserved & rexMask)))
+              continue;
 
-  // Find the best registers for variables that are not allocated yet.
-  for (i = 0; i < count; i++) {
-    VarAttr* va = &list[i];
-    VarData* vd = va->getVd();
+            if ((usedRegs & rexMask) != 0 && regEnd[rexIndex] >= getLiveStart(other))
+              continue;
 
-    uint32_t vaFlags = va->getFlags();
+            if (vdUses[otherId] < vdUses[localId] &&
+                (swapIndex == activeCount || vdUses[otherId] < vdUses[active[swapIndex]->getLocalId()]))
+              swapIndex = j;
+          }
 
-    if ((vaFlags & kVarAttrXReg) != 0) {
-      if ((vaFlags & kVarAttrXReg) == kVarAttrWReg) {
-        if (vaFlags & kVarAttrAllocWDone)
-          continue;
+          if (swapIndex != activeCount) {
+            uint32_t otherId = active[swapIndex]->getLocalId();
 
-        // Skip all registers that have assigned outRegIndex. Spill if occupied.
-        if (va->hasOutRegIndex()) {
-          uint32_t outRegs = Utils::mask(va->getOutRegIndex());
-          willSpill |= occupied & outRegs;
-          continue;
-        }
-      }
-      else {
-        if (vaFlags & kVarAttrAllocRDone)
-          continue;
+            candidateRegs = Utils::mask(liveReg[otherId]);
+            liveReg[otherId] = static_cast<uint8_t>(rexIndex);
 
-        // We skip all registers that have assigned inRegIndex, indicates that
-        // the register to allocate in is known.
-        if (va->hasInRegIndex()) {
-          uint32_t inRegs = va->getInRegs();
-          willSpill |= occupied & inRegs;
-          continue;
+            freeRegs &= ~rexMask;
+            usedRegs |= rexMask;
+          }
         }
       }
 
-      uint32_t m = va->getInRegs();
-      if (va->hasOutRegIndex())
-        m |= Utils::mask(va->getOutRegIndex());
+      uint32_t regIndex = Utils::findFirstBit(candidateRegs);
+      liveReg[localId] = static_cast<uint8_t>(regIndex);
+      freeRegs &= ~Utils::mask(regIndex);
+      usedRegs |= Utils::mask(regIndex);
+      active[activeCount++] = vd;
+    }
+  }
 
-      m = va->getAllocableRegs() & ~(willAlloc ^ m);
-      m = guessAlloc<C>(vd, m);
-      ASMJIT_ASSERT(m != 0);
+  _liveReg = liveReg;
 
-      uint32_t candidateRegs = m & ~occupied;
-      uint32_t homeMask = vd->getHomeMask();
+  ASMJIT_TLOG("[K] ======= Live Intervals (Done)\n");
+  return kErrorOk;
+}
 
-      uint32_t regIndex;
-      uint32_t regMask;
+// ============================================================================
+// [asmjit::X86Context - Annotate]
+// ============================================================================
 
-      if (candidateRegs == 0) {
-        candidateRegs = m & occupied & ~state->_modified.get(C);
-        if (candidateRegs == 0)
-          candidateRegs = m;
-      }
+Error X86Context::annotate() {
+#if !defined(ASMJIT_DISABLE_LOGGER)
+  HLFunc* func = getFunc();
 
-      // printf("CANDIDATE: %s %08X\n", vd->getName(), homeMask);
-      if (candidateRegs & homeMask)
-        candidateRegs &= homeMask;
+  HLNode* node_ = func;
+  HLNode* end = func->getEnd();
 
-      regIndex = Utils::findFirstBit(candidateRegs);
-      regMask = Utils::mask(regIndex);
+  Zone& sa = _compiler->_stringAllocator;
+  StringBuilderTmp<128> sb;
 
-      if ((vaFlags & kVarAttrXReg) == kVarAttrWReg) {
-        va->setOutRegIndex(regIndex);
-      }
-      else {
-        va->setInRegIndex(regIndex);
-        va->setInRegs(regMask);
-      }
+  uint32_t maxLen = 0;
+  while (node_ != end) {
+    if (node_->getComment() == nullptr) {
+      if (node_->getType() == HLNode::kTypeInst) {
+        HLInst* node = static_cast<HLInst*>(node_);
+        X86Context_annotateInstruction(this, sb, node->getInstId(), node->getOpList(), node->getOpCount());
 
-      willAlloc |= regMask;
-      willSpill |= regMask & occupied;
-      willFree  &=~regMask;
-      occupied  |= regMask;
+        node_->setComment(static_cast<char*>(sa.dup(sb.getData(), sb.getLength() + 1)));
+        maxLen = Utils::iMax<uint32_t>(maxLen, static_cast<uint32_t>(sb.getLength()));
 
-      continue;
-    }
-    else if ((vaFlags & kVarAttrXMem) != 0) {
-      uint32_t regIndex = vd->getRegIndex();
-      if (regIndex != kInvalidReg && (vaFlags & kVarAttrXMem) != kVarAttrWMem) {
-        willSpill |= Utils::mask(regIndex);
+        sb.clear();
       }
     }
+
+    node_ = node_->getNext();
   }
+  _annotationLength = maxLen + 1;
+#endif // !ASMJIT_DISABLE_LOGGER
 
-  // Set calculated masks back to the allocator; needed by spill() and alloc().
-  _willSpill.set(C, willSpill);
-  _willAlloc.set(C, willAlloc);
+  return kErrorOk;
 }
 
-template<int C>
-ASMJIT_INLINE void X86VarAlloc::spill() {
-  uint32_t m = _willSpill.get(C);
-  uint32_t i = static_cast<uint32_t>(0) - 1;
+// ============================================================================
+// [asmjit::X86BaseAlloc]
+// ============================================================================
 
-  if (m == 0)
-    return;
+struct X86BaseAlloc {
+  // --------------------------------------------------------------------------
+  // [Construction / Destruction]
+  // --------------------------------------------------------------------------
 
-  X86VarState* state = getState();
-  VarData** sVars = state->getListByClass(C);
+  ASMJIT_INLINE X86BaseAlloc(X86Context* context) {
+    _context = context;
+    _compiler = context->getCompiler();
+  }
+  ASMJIT_INLINE ~X86BaseAlloc() {}
 
-  // Available registers for decision if move has any benefit over spill.
-  uint32_t availableRegs = getGaRegs(C) & ~(state->_occupied.get(C) | m | _willAlloc.get(C));
+  // --------------------------------------------------------------------------
+  // [Accessors]
+  // --------------------------------------------------------------------------
 
-  do {
-    // We always advance one more to destroy the bit that we have found.
-    uint32_t bitIndex = Utils::findFirstBit(m) + 1;
+  //! Get the context.
+  ASMJIT_INLINE X86Context* getContext() const { return _context; }
+  //! Get the current state (always the same instance as X86Context::_x86State).
+  ASMJIT_INLINE X86VarState* getState() const { return _context->getState(); }
 
-    i += bitIndex;
-    m >>= bitIndex;
+  //! Get the node.
+  ASMJIT_INLINE HLNode* getNode() const { return _node; }
 
-    VarData* vd = sVars[i];
-    ASMJIT_ASSERT(vd != nullptr);
+  //! Get VarAttr list (all).
+  ASMJIT_INLINE VarAttr* getVaList() const { return _vaList[0]; }
+  //! Get VarAttr list (per class).
+  ASMJIT_INLINE VarAttr* getVaListByClass(uint32_t rc) const { return _vaList[rc]; }
 
-    VarAttr* va = vd->getVa();
-    ASMJIT_ASSERT(va == nullptr || !va->hasFlag(kVarAttrXReg));
+  //! Get VarAttr count (all).
+  ASMJIT_INLINE uint32_t getVaCount() const { return _vaCount; }
+  //! Get VarAttr count (per class).
+  ASMJIT_INLINE uint32_t getVaCountByClass(uint32_t rc) const { return _count.get(rc); }
 
-    if (vd->isModified() && availableRegs) {
-      // Don't check for alternatives if the variable has to be spilled.
-      if (va == nullptr || !va->hasFlag(kVarAttrSpill)) {
-        uint32_t altRegs = guessSpill<C>(vd, availableRegs);
+  //! Get whether all variables of class `c` are done.
+  ASMJIT_INLINE bool isVaDone(uint32_t rc) const { return _done.get(rc) == _count.get(rc); }
 
-        if (altRegs != 0) {
-          uint32_t regIndex = Utils::findFirstBit(altRegs);
-          uint32_t regMask = Utils::mask(regIndex);
+  //! Get how many variables have been allocated.
+  ASMJIT_INLINE uint32_t getVaDone(uint32_t rc) const { return _done.get(rc); }
+  //! Add to the count of variables allocated.
+  ASMJIT_INLINE void addVaDone(uint32_t rc, uint32_t n = 1) { _done.add(rc, n); }
 
-          _context->move<C>(vd, regIndex);
-          availableRegs ^= regMask;
-          continue;
-        }
-      }
-    }
+  //! Get number of allocable registers per class.
+  ASMJIT_INLINE uint32_t getGaRegs(uint32_t rc) const {
+    return _context->_gaRegs[rc];
+  }
 
-    _context->spill<C>(vd);
-  } while (m != 0);
-}
+  // --------------------------------------------------------------------------
+  // [Init / Cleanup]
+  // --------------------------------------------------------------------------
 
-template<int C>
-ASMJIT_INLINE void X86VarAlloc::alloc() {
-  if (isVaDone(C))
-    return;
+protected:
+  // Just to prevent calling these methods by X86Context::translate().
 
-  uint32_t i;
-  bool didWork;
+  ASMJIT_INLINE void init(HLNode* node, X86VarMap* map);
+  ASMJIT_INLINE void cleanup();
 
-  VarAttr* list = getVaListByClass(C);
-  uint32_t count = getVaCountByClass(C);
+  // --------------------------------------------------------------------------
+  // [Unuse]
+  // --------------------------------------------------------------------------
 
-  // Alloc 'in' regs.
-  do {
-    didWork = false;
-    for (i = 0; i < count; i++) {
-      VarAttr* aVa = &list[i];
-      VarData* aVd = aVa->getVd();
+  template<int C>
+  ASMJIT_INLINE void unuseBefore();
 
-      if ((aVa->getFlags() & (kVarAttrRReg | kVarAttrAllocRDone)) != kVarAttrRReg)
-        continue;
+  template<int C>
+  ASMJIT_INLINE void unuseAfter();
 
-      uint32_t aIndex = aVd->getRegIndex();
-      uint32_t bIndex = aVa->getInRegIndex();
+  // --------------------------------------------------------------------------
+  // [Members]
+  // --------------------------------------------------------------------------
 
-      // Shouldn't be the same.
-      ASMJIT_ASSERT(aIndex != bIndex);
+  //! Context.
+  X86Context* _context;
+  //! Compiler.
+  X86Compiler* _compiler;
 
-      VarData* bVd = getState()->getListByClass(C)[bIndex];
-      if (bVd != nullptr) {
-        // Gp registers only - Swap two registers if we can solve two
-        // allocation tasks by a single 'xchg' instruction, swapping
-        // two registers required by the instruction/node or one register
-        // required with another non-required.
-        if (C == kX86RegClassGp && aIndex != kInvalidReg) {
-          VarAttr* bVa = bVd->getVa();
-          _context->swapGp(aVd, bVd);
+  //! Node.
+  HLNode* _node;
 
-          aVa->orFlags(kVarAttrAllocRDone);
-          addVaDone(C);
+  //! Variable map.
+  X86VarMap* _map;
+  //! VarAttr list (per register class).
+  VarAttr* _vaList[_kX86RegClassManagedCount];
 
-          // Doublehit, two registers allocated by a single swap.
-          if (bVa != nullptr && bVa->getInRegIndex() == aIndex) {
-            bVa->orFlags(kVarAttrAllocRDone);
-            addVaDone(C);
-          }
+  //! Count of all VarAttr's.
+  uint32_t _vaCount;
 
-          didWork = true;
-          continue;
-        }
-      }
-      else if (aIndex != kInvalidReg) {
-        _context->move<C>(aVd, bIndex);
+  //! VarAttr's total counter.
+  X86RegCount _count;
+  //! VarAttr's done counter.
+  X86RegCount _done;
+};
 
-        aVa->orFlags(kVarAttrAllocRDone);
-        addVaDone(C);
+// ============================================================================
+// [asmjit::X86BaseAlloc - Init / Cleanup]
+// ============================================================================
 
-        didWork = true;
-        continue;
-      }
-      else {
-        _context->alloc<C>(aVd, bIndex);
+ASMJIT_INLINE void X86BaseAlloc::init(HLNode* node, X86VarMap* map) {
+  _node = node;
+  _map = map;
 
-        aVa->orFlags(kVarAttrAllocRDone);
-        addVaDone(C);
+  // We have to set the correct cursor in case any instruction is emitted
+  // during the allocation phase; it has to be emitted before the current
+  // instruction.
+  _compiler->_setCursor(node->getPrev());
 
-        didWork = true;
-        continue;
-      }
-    }
-  } while (didWork);
+  // Setup the lists of variables.
+  {
+    VarAttr* va = map->getVaList();
+    _vaList[kX86RegClassGp ] = va;
+    _vaList[kX86RegClassMm ] = va + map->getVaStart(kX86RegClassMm );
+    _vaList[kX86RegClassK  ] = va + map->getVaStart(kX86RegClassK  );
+    _vaList[kX86RegClassXyz] = va + map->getVaStart(kX86RegClassXyz);
+  }
 
-  // Alloc 'out' regs.
-  for (i = 0; i < count; i++) {
-    VarAttr* va = &list[i];
-    VarData* vd = va->getVd();
+  // Setup counters.
+  _vaCount = map->getVaCount();
 
-    if ((va->getFlags() & (kVarAttrXReg | kVarAttrAllocWDone)) != kVarAttrWReg)
-      continue;
+  _count = map->_count;
+  _done.reset();
 
-    uint32_t regIndex = va->getOutRegIndex();
-    ASMJIT_ASSERT(regIndex != kInvalidReg);
+  // Connect Vd->Va.
+  for (uint32_t i = 0; i < _vaCount; i++) {
+    VarAttr* va = &_vaList[0][i];
+    VarData* vd = va->getVd();
 
-    if (vd->getRegIndex() != regIndex) {
-      ASMJIT_ASSERT(getState()->getListByClass(C)[regIndex] == nullptr);
-      _context->attach<C>(vd, regIndex, false);
-    }
+    vd->setVa(va);
+  }
+}
 
-    va->orFlags(kVarAttrAllocWDone);
-    addVaDone(C);
+ASMJIT_INLINE void X86BaseAlloc::cleanup() {
+  // Disconnect Vd->Va.
+  for (uint32_t i = 0; i < _vaCount; i++) {
+    VarAttr* va = &_vaList[0][i];
+    VarData* vd = va->getVd();
+
+    vd->setVa(nullptr);
   }
 }
 
 // ============================================================================
-// [asmjit::X86VarAlloc - GuessAlloc / GuessSpill]
+// [asmjit::X86BaseAlloc - Unuse]
 // ============================================================================
 
-#if 0
-// TODO: This works, but should be improved a bit. The idea is to follow code
-// flow and to restrict the possible registers where to allocate as much as
-// possible so we won't allocate to a register which is home of some variable
-// that's gonna be used together with `vd`. The previous implementation didn't
-// care about it and produced suboptimal results even in code which didn't
-// require any allocs & spills.
-enum { kMaxGuessFlow = 10 };
+template<int C>
+ASMJIT_INLINE void X86BaseAlloc::unuseBefore() {
+  VarAttr* list = getVaListByClass(C);
+  uint32_t count = getVaCountByClass(C);
 
-struct GuessFlowData {
-  ASMJIT_INLINE void init(HLNode* node, uint32_t counter, uint32_t safeRegs) {
-    _node = node;
-    _counter = counter;
-    _safeRegs = safeRegs;
-  }
+  const uint32_t checkFlags =
+    kVarAttrXReg  |
+    kVarAttrRMem  |
+    kVarAttrRFunc |
+    kVarAttrRCall |
+    kVarAttrRConv ;
 
-  //! Node to start.
-  HLNode* _node;
-  //! Number of instructions processed from the beginning.
-  uint32_t _counter;
-  //! Safe registers, which can be used for the allocation.
-  uint32_t _safeRegs;
-};
+  for (uint32_t i = 0; i < count; i++) {
+    VarAttr* va = &list[i];
+
+    if ((va->getFlags() & checkFlags) == kVarAttrWReg) {
+      _context->unuse<C>(va->getVd());
+    }
+  }
+}
 
 template<int C>
-ASMJIT_INLINE uint32_t X86VarAlloc::guessAlloc(VarData* vd, uint32_t allocableRegs) {
-  ASMJIT_TLOG("[RA-GUESS] === %s (Input=%08X) ===\n", vd->getName(), allocableRegs);
-  ASMJIT_ASSERT(allocableRegs != 0);
+ASMJIT_INLINE void X86BaseAlloc::unuseAfter() {
+  VarAttr* list = getVaListByClass(C);
+  uint32_t count = getVaCountByClass(C);
 
-  return allocableRegs;
+  for (uint32_t i = 0; i < count; i++) {
+    VarAttr* va = &list[i];
 
-  // Stop now if there is only one bit (register) set in `allocableRegs` mask.
-  uint32_t safeRegs = allocableRegs;
-  if (Utils::isPowerOf2(safeRegs))
-    return safeRegs;
+    if (va->getFlags() & kVarAttrUnuse)
+      _context->unuse<C>(va->getVd());
+  }
+}
 
-  uint32_t counter = 0;
-  uint32_t maxInst = _compiler->getMaxLookAhead();
+// ============================================================================
+// [asmjit::X86VarAlloc]
+// ============================================================================
 
-  uint32_t localId = vd->getLocalId();
-  uint32_t localToken = _compiler->_generateUniqueToken();
+//! \internal
+//!
+//! Register allocator context (asm instructions).
+struct X86VarAlloc : public X86BaseAlloc {
+  // --------------------------------------------------------------------------
+  // [Construction / Destruction]
+  // --------------------------------------------------------------------------
 
-  uint32_t gfIndex = 0;
-  GuessFlowData gfArray[kMaxGuessFlow];
+  ASMJIT_INLINE X86VarAlloc(X86Context* context) : X86BaseAlloc(context) {}
+  ASMJIT_INLINE ~X86VarAlloc() {}
 
-  HLNode* node = _node;
+  // --------------------------------------------------------------------------
+  // [Run]
+  // --------------------------------------------------------------------------
 
-  // Mark this node and also exit node, it will terminate the loop if encountered.
-  node->setTokenId(localToken);
-  _context->getFunc()->getExitNode()->setTokenId(localToken);
+  ASMJIT_INLINE Error run(HLNode* node);
 
-  // TODO: I don't like this jump, maybe some refactor would help to eliminate it.
-  goto _Advance;
+  // --------------------------------------------------------------------------
+  // [Init / Cleanup]
+  // --------------------------------------------------------------------------
 
-  // Look ahead and calculate mask of special registers on both - input/output.
-  for (;;) {
-    do {
-      ASMJIT_TSEC({
-        _context->_traceNode(_context, node, "  ");
-      });
+protected:
+  // Just to prevent calling these methods by X86Context::translate().
 
-      // Terminate if we have seen this node already.
-      if (node->hasTokenId(localToken))
-        break;
+  ASMJIT_INLINE void init(HLNode* node, X86VarMap* map);
+  ASMJIT_INLINE void cleanup();
 
-      node->setTokenId(localToken);
-      counter++;
+  // --------------------------------------------------------------------------
+  // [Plan / Spill / Alloc]
+  // --------------------------------------------------------------------------
 
-      // Terminate if the variable is dead here.
-      if (node->hasLiveness() && !node->getLiveness()->getBit(localId)) {
-        ASMJIT_TLOG("[RA-GUESS] %s (Terminating, Not alive here)\n", vd->getName());
-        break;
-      }
+  template<int C>
+  ASMJIT_INLINE void plan();
 
-      if (node->hasState()) {
-        // If this node contains a state, we have to consider only the state
-        // and then we can terminate safely - this happens if we jumped to a
-        // label that is backward (i.e. start of the loop). If we survived
-        // the liveness check it means that the variable is actually used.
-        X86VarState* state = node->getState<X86VarState>();
-        uint32_t homeRegs = 0;
-        uint32_t tempRegs = 0;
+  template<int C>
+  ASMJIT_INLINE void spill();
 
-        VarData** vdArray = state->getListByClass(C);
-        uint32_t vdCount = _compiler->getRegCount().get(C);
+  template<int C>
+  ASMJIT_INLINE void alloc();
 
-        for (uint32_t vdIndex = 0; vdIndex < vdCount; vdIndex++) {
-          if (vdArray[vdIndex] != nullptr)
-            tempRegs |= Utils::mask(vdIndex);
+  // --------------------------------------------------------------------------
+  // [GuessAlloc / GuessSpill]
+  // --------------------------------------------------------------------------
 
-          if (vdArray[vdIndex] == vd)
-            homeRegs = Utils::mask(vdIndex);
-        }
+  //! Guess which register is the best candidate for 'vd' from
+  //! 'allocableRegs'.
+  //!
+  //! The guess is based on looking ahead and inspecting register allocator
+  //! instructions. The main reason is to prevent allocation to a register
+  //! which is needed by next instruction(s). The guess look tries to go as far
+  //! as possible, after the remaining registers are zero, the mask of previous
+  //! registers (called 'safeRegs') is returned.
+  template<int C>
+  ASMJIT_INLINE uint32_t guessAlloc(VarData* vd, uint32_t allocableRegs);
 
-        tempRegs = safeRegs & ~tempRegs;
-        if (!tempRegs)
-          goto _Done;
-        safeRegs = tempRegs;
+  //! Guess whether to move the given 'vd' instead of spill.
+  template<int C>
+  ASMJIT_INLINE uint32_t guessSpill(VarData* vd, uint32_t allocableRegs);
 
-        tempRegs = safeRegs & homeRegs;
-        if (!tempRegs)
-          goto _Done;
-        safeRegs = tempRegs;
+  // --------------------------------------------------------------------------
+  // [Modified]
+  // --------------------------------------------------------------------------
 
-        goto _Done;
-      }
-      else {
-        // Process the current node if it has any variables associated in.
-        X86VarMap* map = node->getMap<X86VarMap>();
+  template<int C>
+  ASMJIT_INLINE void modified();
+
+  // --------------------------------------------------------------------------
+  // [Members]
+  // --------------------------------------------------------------------------
+
+  //! Will alloc to these registers.
+  X86RegMask _willAlloc;
+  //! Will spill these registers.
+  X86RegMask _willSpill;
+};
+
+// ============================================================================
+// [asmjit::X86VarAlloc - Run]
+// ============================================================================
+
+ASMJIT_INLINE Error X86VarAlloc::run(HLNode* node_) {
+  // Initialize.
+  X86VarMap* map = node_->getMap<X86VarMap>();
+  if (map == nullptr)
+    return kErrorOk;
+
+  // Initialize the allocator; connect Vd->Va.
+  init(node_, map);
+
+  // Unuse overwritten variables.
+  unuseBefore<kX86RegClassGp>();
+  unuseBefore<kX86RegClassMm>();
+  unuseBefore<kX86RegClassXyz>();
+
+  // Plan the allocation. Planner assigns input/output registers for each
+  // variable and decides whether to allocate it in register or stack.
+  plan<kX86RegClassGp>();
+  plan<kX86RegClassMm>();
+  plan<kX86RegClassXyz>();
+
+  // Spill all variables marked by plan().
+  spill<kX86RegClassGp>();
+  spill<kX86RegClassMm>();
+  spill<kX86RegClassXyz>();
+
+  // Alloc all variables marked by plan().
+  alloc<kX86RegClassGp>();
+  alloc<kX86RegClassMm>();
+  alloc<kX86RegClassXyz>();
+
+  // Translate node operands.
+  if (node_->getType() == HLNode::kTypeInst) {
+    HLInst* node = static_cast<HLInst*>(node_);
+    ASMJIT_PROPAGATE_ERROR(X86Context_translateOperands(_context, node->getOpList(), node->getOpCount()));
+  }
+  else if (node_->getType() == HLNode::kTypeCallArg) {
+    HLCallArg* node = static_cast<HLCallArg*>(node_);
+
+    X86CallNode* call = static_cast<X86CallNode*>(node->getCall());
+    X86FuncDecl* decl = call->getDecl();
+
+    uint32_t argIndex = 0;
+    uint32_t argMask = node->_args;
+
+    VarData* sVd = node->getSVd();
+    VarData* cVd = node->getCVd();
+
+    // Convert first.
+    ASMJIT_ASSERT(sVd->getRegIndex() != kInvalidReg);
+
+    if (cVd != nullptr) {
+      ASMJIT_ASSERT(cVd->getRegIndex() != kInvalidReg);
+      _context->emitConvertVarToVar(
+        cVd->getType(), cVd->getRegIndex(),
+        sVd->getType(), sVd->getRegIndex());
+      sVd = cVd;
+    }
+
+    while (argMask != 0) {
+      if (argMask & 0x1) {
+        FuncInOut& arg = decl->getArg(argIndex);
+        ASMJIT_ASSERT(arg.hasStackOffset());
+
+        X86Mem dst = x86::ptr(_context->_zsp, -static_cast<int>(_context->getRegSize()) + arg.getStackOffset());
+        _context->emitMoveVarOnStack(arg.getVarType(), &dst, sVd->getType(), sVd->getRegIndex());
+      }
+
+      argIndex++;
+      argMask >>= 1;
+    }
+  }
+
+  // Mark variables as modified.
+  modified<kX86RegClassGp>();
+  modified<kX86RegClassMm>();
+  modified<kX86RegClassXyz>();
+
+  // Cleanup; disconnect Vd->Va.
+  cleanup();
+
+  // Update clobbered mask.
+  _context->_clobberedRegs.or_(_willAlloc);
+  _context->_clobberedRegs.or_(map->_clobberedRegs);
+
+  // Unuse.
+  unuseAfter<kX86RegClassGp>();
+  unuseAfter<kX86RegClassMm>();
+  unuseAfter<kX86RegClassXyz>();
+
+  return kErrorOk;
+}
+
+// ============================================================================
+// [asmjit::X86VarAlloc - Init / Cleanup]
+// ============================================================================
+
+ASMJIT_INLINE void X86VarAlloc::init(HLNode* node, X86VarMap* map) {
+  X86BaseAlloc::init(node, map);
+
+  // These will block planner from assigning them during planning. Planner will
+  // add more registers when assigning registers to variables that don't need
+  // any specific register.
+  _willAlloc = map->_inRegs;
+  _willAlloc.or_(map->_outRegs);
+  _willSpill.reset();
+}
+
+ASMJIT_INLINE void X86VarAlloc::cleanup() {
+  X86BaseAlloc::cleanup();
+}
+
+// ============================================================================
+// [asmjit::X86VarAlloc - Plan / Spill / Alloc]
+// ============================================================================
+
+//! \internal
+//!
+//! Get mask of a register in `regs` that holds the variable which is the
+//! cheapest to spill, zero if `regs` is zero.
+//!
+//! Variables with the lowest spill cost are preferred, variables that don't
+//! have to be saved (not modified) are preferred if the costs are equal.
+template<int C>
+static ASMJIT_INLINE uint32_t X86Context_getCheapestSpill(X86Context* self, uint32_t regs) {
+  X86VarState* state = self->getState();
+  VarData** sVars = state->getListByClass(C);
+  uint32_t modified = state->_modified.get(C);
+
+  uint32_t i;
+  uint32_t bestMask = 0;
+  uint64_t bestCost = 0;
+
+  for (i = 0; regs != 0; i++, regs >>= 1) {
+    if (!(regs & 0x1))
+      continue;
+
+    VarData* vd = sVars[i];
+    ASMJIT_ASSERT(vd != nullptr);
+
+    uint32_t mask = Utils::mask(i);
+    uint64_t cost = (static_cast<uint64_t>(vd->getSpillCost()) << 1) | ((modified & mask) != 0);
+
+    if (bestMask == 0 || cost < bestCost) {
+      bestMask = mask;
+      bestCost = cost;
+    }
+  }
+
+  return bestMask;
+}
+
+template<int C>
+ASMJIT_INLINE void X86VarAlloc::plan() {
+  if (isVaDone(C))
+    return;
+
+  uint32_t i;
+  uint32_t willAlloc = _willAlloc.get(C);
+  uint32_t willFree = 0;
+
+  VarAttr* list = getVaListByClass(C);
+  uint32_t count = getVaCountByClass(C);
+  X86VarState* state = getState();
+
+  // Calculate 'willAlloc' and 'willFree' masks based on mandatory masks.
+  for (i = 0; i < count; i++) {
+    VarAttr* va = &list[i];
+    VarData* vd = va->getVd();
+
+    uint32_t vaFlags = va->getFlags();
+    uint32_t regIndex = vd->getRegIndex();
+    uint32_t regMask = (regIndex != kInvalidReg) ? Utils::mask(regIndex) : 0;
+
+    if ((vaFlags & kVarAttrXReg) != 0) {
+      // Planning register allocation. First check whether the variable is
+      // already allocated in register and if it can stay allocated there.
+      //
+      // The following conditions may happen:
+      //
+      // a) Allocated register is one of the mandatoryRegs.
+      // b) Allocated register is one of the allocableRegs and it's not one of
+      //    the mandatory registers of other variables (`otherRegs`).
+      uint32_t mandatoryRegs = va->getInRegs();
+      uint32_t allocableRegs = va->getAllocableRegs();
+
+      uint32_t otherRegs = willAlloc & ~mandatoryRegs;
+      if (va->hasOutRegIndex())
+        otherRegs &= ~Utils::mask(va->getOutRegIndex());
+
+      ASMJIT_TLOG("[RA-PLAN] %s (%s)\n",
+        vd->getName(),
+        (vaFlags & kVarAttrXReg) == kVarAttrWReg ? "R-Reg" : "X-Reg");
+
+      ASMJIT_TLOG("[RA-PLAN] RegMask=%08X Mandatory=%08X Allocable=%08X\n",
+        regMask, mandatoryRegs, allocableRegs);
+
+      if (regMask != 0) {
+        // Special path for planning output-only registers.
+        if ((vaFlags & kVarAttrXReg) == kVarAttrWReg) {
+          uint32_t outRegIndex = va->getOutRegIndex();
+          mandatoryRegs = (outRegIndex != kInvalidReg) ? Utils::mask(outRegIndex) : 0;
+
+          if ((mandatoryRegs & regMask) || (allocableRegs & ~otherRegs & regMask)) {
+            va->setOutRegIndex(regIndex);
+            va->orFlags(kVarAttrAllocWDone);
+
+            if (mandatoryRegs & regMask) {
+              // Case 'a' - 'willAlloc' contains initially all inRegs from all VarAttr's.
+              ASMJIT_ASSERT((willAlloc & regMask) != 0);
+            }
+            else {
+              // Case 'b'.
+              va->setOutRegIndex(regIndex);
+              willAlloc |= regMask;
+            }
+
+            ASMJIT_TLOG("[RA-PLAN] WillAlloc\n");
+            addVaDone(C);
+
+            continue;
+          }
+        }
+        else {
+          if ((mandatoryRegs & regMask) || (allocableRegs & ~otherRegs & regMask)) {
+            va->setInRegIndex(regIndex);
+            va->orFlags(kVarAttrAllocRDone);
+
+            if (mandatoryRegs & regMask) {
+              // Case 'a' - 'willAlloc' contains initially all inRegs from all VarAttr's.
+              ASMJIT_ASSERT((willAlloc & regMask) != 0);
+            }
+            else {
+              // Case 'b'.
+              va->addInRegs(regMask);
+              willAlloc |= regMask;
+            }
+
+            ASMJIT_TLOG("[RA-PLAN] WillAlloc\n");
+            addVaDone(C);
+
+            continue;
+          }
+        }
+
+        // Trace it here so we don't pollute log by `WillFree` of zero regMask.
+        ASMJIT_TLOG("[RA-PLAN] WillFree\n");
+      }
+
+      // Variable is not allocated or allocated in register that doesn't
+      // match inRegs or allocableRegs. The next step is to pick the best
+      // register for this variable. If `inRegs` contains any register the
+      // decision is simple - we have to follow, in other case will use
+      // the advantage of `guessAlloc()` to find a register (or registers)
+      // by looking ahead. But the best way to find a good register is not
+      // here since now we have no information about the registers that
+      // will be freed. So instead of finding register here, we just mark
+      // the current register (if variable is allocated) as `willFree` so
+      // the planner can use this information in the second step to plan the
+      // allocation as a whole.
+      willFree |= regMask;
+      continue;
+    }
+    else {
+      // Memory access - if variable is allocated it has to be freed.
+      ASMJIT_TLOG("[RA-PLAN] %s (Memory)\n", vd->getName());
+
+      if (regMask != 0) {
+        ASMJIT_TLOG("[RA-PLAN] WillFree\n");
+        willFree |= regMask;
+        continue;
+      }
+      else {
+        ASMJIT_TLOG("[RA-PLAN] Done\n");
+        va->orFlags(kVarAttrAllocRDone);
+        addVaDone(C);
+        continue;
+      }
+    }
+  }
+
+  // Occupied registers without 'willFree' registers; contains basically
+  // all the registers we can use to allocate variables without inRegs
+  // speficied.
+  uint32_t occupied = state->_occupied.get(C) & ~willFree;
+  uint32_t willSpill = 0;
+
+  // Find the best registers for variables that are not allocated yet.
+  for (i = 0; i < count; i++) {
+    VarAttr* va = &list[i];
+    VarData* vd = va->getVd();
+
+    uint32_t vaFlags = va->getFlags();
+
+    if ((vaFlags & kVarAttrXReg) != 0) {
+      if ((vaFlags & kVarAttrXReg) == kVarAttrWReg) {
+        if (vaFlags & kVarAttrAllocWDone)
+          continue;
+
+        // Skip all registers that have assigned outRegIndex. Spill if occupied.
+        if (va->hasOutRegIndex()) {
+          uint32_t outRegs = Utils::mask(va->getOutRegIndex());
+          willSpill |= occupied & outRegs;
+          continue;
+        }
+      }
+      else {
+        if (vaFlags & kVarAttrAllocRDone)
+          continue;
+
+        // We skip all registers that have assigned inRegIndex, indicates that
+        // the register to allocate in is known.
+        if (va->hasInRegIndex()) {
+          uint32_t inRegs = va->getInRegs();
+          willSpill |= occupied & inRegs;
+          continue;
+        }
+      }
+
+      uint32_t m = va->getInRegs();
+      if (va->hasOutRegIndex())
+        m |= Utils::mask(va->getOutRegIndex());
+
+      m = va->getAllocableRegs() & ~(willAlloc ^ m);
+      m = guessAlloc<C>(vd, m);
+      ASMJIT_ASSERT(m != 0);
+
+      uint32_t candidateRegs = m & ~occupied;
+      uint32_t homeMask = vd->getHomeMask();
+
+      uint32_t regIndex;
+      uint32_t regMask;
+
+      if (candidateRegs == 0) {
+        candidateRegs = X86Context_getCheapestSpill<C>(_context, m & occupied);
+        if (candidateRegs == 0)
+          candidateRegs = m;
+      }
+
+      // printf("CANDIDATE: %s %08X\n", vd->getName(), homeMask);
+      if (candidateRegs & homeMask) {
+        candidateRegs &= homeMask;
+      }
+      else if (_context->hasLiveIntervals()) {
+        // Use the register assigned to the live interval if it's free.
+        uint32_t intervalReg = _context->getIntervalReg(vd);
+        if (intervalReg != kInvalidReg && (candidateRegs & Utils::mask(intervalReg)))
+          candidateRegs = Utils::mask(intervalReg);
+      }
+
+      regIndex = Utils::findFirstBit(candidateRegs);
+      regMask = Utils::mask(regIndex);
+
+      if ((vaFlags & kVarAttrXReg) == kVarAttrWReg) {
+        va->setOutRegIndex(regIndex);
+      }
+      else {
+        va->setInRegIndex(regIndex);
+        va->setInRegs(regMask);
+      }
+
+      willAlloc |= regMask;
+      willSpill |= regMask & occupied;
+      willFree  &=~regMask;
+      occupied  |= regMask;
+
+      continue;
+    }
+    else if ((vaFlags & kVarAttrXMem) != 0) {
+      uint32_t regIndex = vd->getRegIndex();
+      if (regIndex != kInvalidReg && (vaFlags & kVarAttrXMem) != kVarAttrWMem) {
+        willSpill |= Utils::mask(regIndex);
+      }
+    }
+  }
+
+  // Set calculated masks back to the allocator; needed by spill() and alloc().
+  _willSpill.set(C, willSpill);
+  _willAlloc.set(C, willAlloc);
+}
+
+template<int C>
+ASMJIT_INLINE void X86VarAlloc::spill() {
+  uint32_t m = _willSpill.get(C);
+  uint32_t i = static_cast<uint32_t>(0) - 1;
+
+  if (m == 0)
+    return;
+
+  X86VarState* state = getState();
+  VarData** sVars = state->getListByClass(C);
+
+  // Available registers for decision if move has any benefit over spill.
+  uint32_t availableRegs = getGaRegs(C) & ~(state->_occupied.get(C) | m | _willAlloc.get(C));
+
+  do {
+    // We always advance one more to destroy the bit that we have found.
+    uint32_t bitIndex = Utils::findFirstBit(m) + 1;
+
+    i += bitIndex;
+    m >>= bitIndex;
+
+    VarData* vd = sVars[i];
+    ASMJIT_ASSERT(vd != nullptr);
+
+    VarAttr* va = vd->getVa();
+    ASMJIT_ASSERT(va == nullptr || !va->hasFlag(kVarAttrXReg));
+
+    if (vd->isModified() && availableRegs) {
+      // Don't check for alternatives if the variable has to be spilled.
+      if (va == nullptr || !va->hasFlag(kVarAttrSpill)) {
+        uint32_t altRegs = guessSpill<C>(vd, availableRegs);
+
+        if (altRegs != 0) {
+          uint32_t regIndex = Utils::findFirstBit(altRegs);
+          uint32_t regMask = Utils::mask(regIndex);
+
+          _context->move<C>(vd, regIndex);
+          _context->_clobberedRegs.or_(C, regMask);
+          availableRegs ^= regMask;
+          continue;
+        }
+      }
+    }
+
+    _context->spill<C>(vd);
+  } while (m != 0);
+}
+
+template<int C>
+ASMJIT_INLINE void X86VarAlloc::alloc() {
+  if (isVaDone(C))
+    return;
+
+  uint32_t i;
+  bool didWork;
+
+  VarAttr* list = getVaListByClass(C);
+  uint32_t count = getVaCountByClass(C);
+
+  // Alloc 'in' regs.
+  do {
+    didWork = false;
+    for (i = 0; i < count; i++) {
+      VarAttr* aVa = &list[i];
+      VarData* aVd = aVa->getVd();
+
+      if ((aVa->getFlags() & (kVarAttrRReg | kVarAttrAllocRDone)) != kVarAttrRReg)
+        continue;
+
+      uint32_t aIndex = aVd->getRegIndex();
+      uint32_t bIndex = aVa->getInRegIndex();
+
+      // Shouldn't be the same.
+      ASMJIT_ASSERT(aIndex != bIndex);
+
+      VarData* bVd = getState()->getListByClass(C)[bIndex];
+      if (bVd != nullptr) {
+        // Gp registers only - Swap two registers if we can solve two
+        // allocation tasks by a single 'xchg' instruction, swapping
+        // two registers required by the instruction/node or one register
+        // required with another non-required.
+        if (C == kX86RegClassGp && aIndex != kInvalidReg) {
+          VarAttr* bVa = bVd->getVa();
+          _context->swapGp(aVd, bVd);
+
+          aVa->orFlags(kVarAttrAllocRDone);
+          addVaDone(C);
+
+          // Doublehit, two registers allocated by a single swap.
+          if (bVa != nullptr && bVa->getInRegIndex() == aIndex) {
+            bVa->orFlags(kVarAttrAllocRDone);
+            addVaDone(C);
+          }
+
+          didWork = true;
+          continue;
+        }
+      }
+      else if (aIndex != kInvalidReg) {
+        _context->move<C>(aVd, bIndex);
+
+        aVa->orFlags(kVarAttrAllocRDone);
+        addVaDone(C);
+
+        didWork = true;
+        continue;
+      }
+      else {
+        _context->alloc<C>(aVd, bIndex);
+
+        aVa->orFlags(kVarAttrAllocRDone);
+        addVaDone(C);
+
+        didWork = true;
+        continue;
+      }
+    }
+  } while (didWork);
+
+  // Alloc 'out' regs.
+  for (i = 0; i < count; i++) {
+    VarAttr* va = &list[i];
+    VarData* vd = va->getVd();
+
+    if ((va->getFlags() & (kVarAttrXReg | kVarAttrAllocWDone)) != kVarAttrWReg)
+      continue;
+
+    uint32_t regIndex = va->getOutRegIndex();
+    ASMJIT_ASSERT(regIndex != kInvalidReg);
+
+    if (vd->getRegIndex() != regIndex) {
+      ASMJIT_ASSERT(getState()->getListByClass(C)[regIndex] == nullptr);
+      _context->attach<C>(vd, regIndex, false);
+    }
+
+    va->orFlags(kVarAttrAllocWDone);
+    addVaDone(C);
+  }
+}
+
+// ============================================================================
+// [asmjit::X86VarAlloc - GuessAlloc / GuessSpill]
+// ============================================================================
+
+#if 0
+// TODO: This works, but should be improved a bit. The idea is to follow code
+// flow and to restrict the possible registers where to allocate as much as
+// possible so we won't allocate to a register which is home of some variable
+// that's gonna be used together with `vd`. The previous implementation didn't
+// care about it and produced suboptimal results even in code which didn't
+// require any allocs & spills.
+enum { kMaxGuessFlow = 10 };
+
+struct GuessFlowData {
+  ASMJIT_INLINE void init(HLNode* node, uint32_t counter, uint32_t safeRegs) {
+    _node = node;
+    _counter = counter;
+    _safeRegs = safeRegs;
+  }
+
+  //! Node to start.
+  HLNode* _node;
+  //! Number of instructions processed from the beginning.
+  uint32_t _counter;
+  //! Safe registers, which can be used for the allocation.
+  uint32_t _safeRegs;
+};
+
+template<int C>
+ASMJIT_INLINE uint32_t X86VarAlloc::guessAlloc(VarData* vd, uint32_t allocableRegs) {
+  ASMJIT_TLOG("[RA-GUESS] === %s (Input=%08X) ===\n", vd->getName(), allocableRegs);
+  ASMJIT_ASSERT(allocableRegs != 0);
+
+  return allocableRegs;
+
+  // Stop now if there is only one bit (register) set in `allocableRegs` mask.
+  uint32_t safeRegs = allocableRegs;
+  if (Utils::isPowerOf2(safeRegs))
+    return safeRegs;
+
+  uint32_t counter = 0;
+  uint32_t maxInst = _compiler->getMaxLookAhead();
+
+  uint32_t localId = vd->getLocalId();
+  uint32_t localToken = _compiler->_generateUniqueToken();
+
+  uint32_t gfIndex = 0;
+  GuessFlowData gfArray[kMaxGuessFlow];
+
+  HLNode* node = _node;
+
+  // Mark this node and also exit node, it will terminate the loop if encountered.
+  node->setTokenId(localToken);
+  _context->getFunc()->getExitNode()->setTokenId(localToken);
+
+  // TODO: I don't like this jump, maybe some refactor would help to eliminate it.
+  goto _Advance;
+
+  // Look ahead and calculate mask of special registers on both - input/output.
+  for (;;) {
+    do {
+      ASMJIT_TSEC({
+        _context->_traceNode(_context, node, "  ");
+      });
+
+      // Terminate if we have seen this node already.
+      if (node->hasTokenId(localToken))
+        break;
+
+      node->setTokenId(localToken);
+      counter++;
+
+      // Terminate if the variable is dead here.
+      if (node->hasLiveness() && !node->getLiveness()->getBit(localId)) {
+        ASMJIT_TLOG("[RA-GUESS] %s (Terminating, Not alive here)\n", vd->getName());
+        break;
+      }
+
+      if (node->hasState()) {
+        // If this node contains a state, we have to consider only the state
+        // and then we can terminate safely - this happens if we jumped to a
+        // label that is backward (i.e. start of the loop). If we survived
+        // the liveness check it means that the variable is actually used.
+        X86VarState* state = node->getState<X86VarState>();
+        uint32_t homeRegs = 0;
+        uint32_t tempRegs = 0;
+
+        VarData** vdArray = state->getListByClass(C);
+        uint32_t vdCount = _compiler->getRegCount().get(C);
+
+        for (uint32_t vdIndex = 0; vdIndex < vdCount; vdIndex++) {
+          if (vdArray[vdIndex] != nullptr)
+            tempRegs |= Utils::mask(vdIndex);
+
+          if (vdArray[vdIndex] == vd)
+            homeRegs = Utils::mask(vdIndex);
+        }
+
+        tempRegs = safeRegs & ~tempRegs;
+        if (!tempRegs)
+          goto _Done;
+        safeRegs = tempRegs;
+
+        tempRegs = safeRegs & homeRegs;
+        if (!tempRegs)
+          goto _Done;
+        safeRegs = tempRegs;
+
+        goto _Done;
+      }
+      else {
+        // Process the current node if it has any variables associated in.
+        X86VarMap* map = node->getMap<X86VarMap>();
         if (map != nullptr) {
           VarAttr* vaList = map->getVaListByClass(C);
           uint32_t vaCount = map->getVaCountByClass(C);
 
-          uint32_t homeRegs = 0;
-          uint32_t tempRegs = safeRegs;
-          bool found = false;
+          uint32_t homeRegs = 0;
+          uint32_t tempRegs = safeRegs;
+          bool found = false;
+
+          for (uint32_t vaIndex = 0; vaIndex < vaCount; vaIndex++) {
+            VarAttr* va = &vaList[vaIndex];
+
+            if (va->getVd() == vd) {
+              found = true;
+
+              // Terminate if the variable is overwritten here.
+              if (!(va->getFlags() & kVarAttrRAll))
+                goto _Done;
+
+              uint32_t mask = va->getAllocableRegs();
+              if (mask != 0) {
+                tempRegs &= mask;
+                if (!tempRegs)
+                  goto _Done;
+                safeRegs = tempRegs;
+              }
+
+              mask = va->getInRegs();
+              if (mask != 0) {
+                tempRegs &= mask;
+                if (!tempRegs)
+                  goto _Done;
+
+                safeRegs = tempRegs;
+                goto _Done;
+              }
+            }
+            else {
+              // It happens often that one variable is used across many blocks of
+              // assembly code. It can sometimes cause one variable to be allocated
+              // in a different register, which can cause state switch to generate
+              // moves in case of jumps and state intersections. We try to prevent
+              // this case by also considering variables' home registers.
+              homeRegs |= va->getVd()->getHomeMask();
+            }
+          }
+
+          tempRegs &= ~(map->_outRegs.get(C) | map->_clobberedRegs.get(C));
+          if (!found)
+            tempRegs &= ~map->_inRegs.get(C);
+
+          if (!tempRegs)
+            goto _Done;
+          safeRegs = tempRegs;
+
+          if (homeRegs) {
+            tempRegs = safeRegs & ~homeRegs;
+            if (!tempRegs)
+              goto _Done;
+            safeRegs = tempRegs;
+          }
+        }
+      }
+
+_Advance:
+      // Terminate if this is a return node.
+      if (node->hasFlag(HLNode::kFlagIsRet))
+        goto _Done;
+
+      // Advance on non-conditional jump.
+      if (node->hasFlag(HLNode::kFlagIsJmp)) {
+        // Stop on a jump that is not followed.
+        node = static_cast<HLJump*>(node)->getTarget();
+        if (node == nullptr)
+          break;
+        continue;
+      }
+
+      // Split flow on a conditional jump.
+      if (node->hasFlag(HLNode::kFlagIsJcc)) {
+        // Put the next node on the stack and follow the target if possible.
+        HLNode* next = node->getNext();
+        if (next != nullptr && gfIndex < kMaxGuessFlow)
+          gfArray[gfIndex++].init(next, counter, safeRegs);
+
+        node = static_cast<HLJump*>(node)->getTarget();
+        if (node == nullptr)
+          break;
+        continue;
+      }
+
+      node = node->getNext();
+      ASMJIT_ASSERT(node != nullptr);
+    } while (counter < maxInst);
+
+_Done:
+    for (;;) {
+      if (gfIndex == 0)
+        goto _Ret;
+
+      GuessFlowData* data = &gfArray[--gfIndex];
+      node = data->_node;
+      counter = data->_counter;
+
+      uint32_t tempRegs = safeRegs & data->_safeRegs;
+      if (!tempRegs)
+        continue;
+
+      safeRegs = tempRegs;
+      break;
+    }
+  }
+
+_Ret:
+  ASMJIT_TLOG("[RA-GUESS] === %s (Output=%08X) ===\n", vd->getName(), safeRegs);
+  return safeRegs;
+}
+#endif
+
+template<int C>
+ASMJIT_INLINE uint32_t X86VarAlloc::guessAlloc(VarData* vd, uint32_t allocableRegs) {
+  ASMJIT_ASSERT(allocableRegs != 0);
+
+  // Stop now if there is only one bit (register) set in `allocableRegs` mask,
+  // or if the variable is spilled after the node anyway (baseline).
+  if (Utils::isPowerOf2(allocableRegs) || _compiler->hasFeature(kCompilerFeatureBaseline))
+    return allocableRegs;
+
+  uint32_t localId = vd->getLocalId();
+  uint32_t safeRegs = allocableRegs;
+
+  uint32_t i;
+  uint32_t maxLookAhead = _compiler->getMaxLookAhead();
+
+  // Look ahead and calculate mask of special registers on both - input/output.
+  HLNode* node = _node;
+  for (i = 0; i < maxLookAhead; i++) {
+    BitArray* liveness = node->getLiveness();
+
+    // If the variable becomes dead it doesn't make sense to continue.
+    if (liveness != nullptr && !liveness->getBit(localId))
+      break;
+
+    // Stop on `HLSentinel` and `HLRet`.
+    if (node->hasFlag(HLNode::kFlagIsRet))
+      break;
+
+    // Stop on conditional jump, we don't follow them.
+    if (node->hasFlag(HLNode::kFlagIsJcc))
+      break;
+
+    // Advance on non-conditional jump.
+    if (node->hasFlag(HLNode::kFlagIsJmp)) {
+      node = static_cast<HLJump*>(node)->getTarget();
+      // Stop on jump that is not followed.
+      if (node == nullptr)
+        break;
+    }
+
+    node = node->getNext();
+    ASMJIT_ASSERT(node != nullptr);
+
+    X86VarMap* map = node->getMap<X86VarMap>();
+    if (map != nullptr) {
+      VarAttr* va = map->findVaByClass(C, vd);
+      uint32_t mask;
+
+      if (va != nullptr) {
+        // If the variable is overwritten it doesn't mase sense to continue.
+        if (!(va->getFlags() & kVarAttrRAll))
+          break;
+
+        mask = va->getAllocableRegs();
+        if (mask != 0) {
+          allocableRegs &= mask;
+          if (allocableRegs == 0)
+            break;
+          safeRegs = allocableRegs;
+        }
+
+        mask = va->getInRegs();
+        if (mask != 0) {
+          allocableRegs &= mask;
+          if (allocableRegs == 0)
+            break;
+          safeRegs = allocableRegs;
+          break;
+        }
+
+        allocableRegs &= ~(map->_outRegs.get(C) | map->_clobberedRegs.get(C));
+        if (allocableRegs == 0)
+          break;
+      }
+      else {
+        allocableRegs &= ~(map->_inRegs.get(C) | map->_outRegs.get(C) | map->_clobberedRegs.get(C));
+        if (allocableRegs == 0)
+          break;
+      }
+
+      safeRegs = allocableRegs;
+    }
+  }
+
+  return safeRegs;
+}
+
+template<int C>
+ASMJIT_INLINE uint32_t X86VarAlloc::guessSpill(VarData* vd, uint32_t allocableRegs) {
+  ASMJIT_ASSERT(allocableRegs != 0);
+
+  // A move to a free register is cheaper than a store now and a load later,
+  // which would be repeated by each iteration if the variable is used in
+  // a loop.
+  if (vd->getLoopDepth() != 0)
+    return allocableRegs;
+
+  return 0;
+}
+
+// ============================================================================
+// [asmjit::X86VarAlloc - Modified]
+// ============================================================================
+
+template<int C>
+ASMJIT_INLINE void X86VarAlloc::modified() {
+  VarAttr* list = getVaListByClass(C);
+  uint32_t count = getVaCountByClass(C);
+
+  for (uint32_t i = 0; i < count; i++) {
+    VarAttr* va = &list[i];
+
+    if (va->hasFlag(kVarAttrWReg)) {
+      VarData* vd = va->getVd();
+
+      uint32_t regIndex = vd->getRegIndex();
+      uint32_t regMask = Utils::mask(regIndex);
+
+      vd->setModified(true);
+      _context->_x86State._modified.or_(C, regMask);
+    }
+  }
+}
+
+// ============================================================================
+// [asmjit::X86CallAlloc]
+// ============================================================================
+
+//! \internal
+//!
+//! Register allocator context (function call).
+struct X86CallAlloc : public X86BaseAlloc {
+  // --------------------------------------------------------------------------
+  // [Construction / Destruction]
+  // --------------------------------------------------------------------------
+
+  ASMJIT_INLINE X86CallAlloc(X86Context* context) : X86BaseAlloc(context) {}
+  ASMJIT_INLINE ~X86CallAlloc() {}
+
+  // --------------------------------------------------------------------------
+  // [Accessors]
+  // --------------------------------------------------------------------------
+
+  //! Get the node.
+  ASMJIT_INLINE X86CallNode* getNode() const { return static_cast<X86CallNode*>(_node); }
+
+  // --------------------------------------------------------------------------
+  // [Run]
+  // --------------------------------------------------------------------------
+
+  ASMJIT_INLINE Error run(X86CallNode* node);
+
+  // --------------------------------------------------------------------------
+  // [Init / Cleanup]
+  // --------------------------------------------------------------------------
+
+protected:
+  // Just to prevent calling these methods from X86Context::translate().
+  ASMJIT_INLINE void init(X86CallNode* node, X86VarMap* map);
+  ASMJIT_INLINE void cleanup();
+
+  // --------------------------------------------------------------------------
+  // [Plan / Alloc / Spill / Move]
+  // --------------------------------------------------------------------------
+
+  template<int C>
+  ASMJIT_INLINE void plan();
+
+  template<int C>
+  ASMJIT_INLINE void spill();
+
+  template<int C>
+  ASMJIT_INLINE void alloc();
+
+  // --------------------------------------------------------------------------
+  // [AllocImmsOnStack]
+  // --------------------------------------------------------------------------
+
+  ASMJIT_INLINE void allocImmsOnStack();
+
+  // --------------------------------------------------------------------------
+  // [Duplicate]
+  // --------------------------------------------------------------------------
+
+  template<int C>
+  ASMJIT_INLINE void duplicate();
+
+  // --------------------------------------------------------------------------
+  // [GuessAlloc / GuessSpill]
+  // --------------------------------------------------------------------------
+
+  template<int C>
+  ASMJIT_INLINE uint32_t guessAlloc(VarData* vd, uint32_t allocableRegs);
+
+  template<int C>
+  ASMJIT_INLINE uint32_t guessSpill(VarData* vd, uint32_t allocableRegs);
+
+  // --------------------------------------------------------------------------
+  // [Save]
+  // --------------------------------------------------------------------------
+
+  template<int C>
+  ASMJIT_INLINE void save();
+
+  // --------------------------------------------------------------------------
+  // [Clobber]
+  // --------------------------------------------------------------------------
+
+  template<int C>
+  ASMJIT_INLINE void clobber();
+
+  // --------------------------------------------------------------------------
+  // [Ret]
+  // --------------------------------------------------------------------------
+
+  ASMJIT_INLINE void ret();
+
+  // --------------------------------------------------------------------------
+  // [Members]
+  // --------------------------------------------------------------------------
+
+  //! Will alloc to these registers.
+  X86RegMask _willAlloc;
+  //! Will spill these registers.
+  X86RegMask _willSpill;
+};
+
+// ============================================================================
+// [asmjit::X86CallAlloc - Run]
+// ============================================================================
+
+ASMJIT_INLINE Error X86CallAlloc::run(X86CallNode* node) {
+  // Initialize.
+  X86VarMap* map = node->getMap<X86VarMap>();
+  if (map == nullptr)
+    return kErrorOk;
+
+  // Initialize the allocator; prepare basics and connect Vd->Va.
+  init(node, map);
+
+  // Plan register allocation. Planner is only able to assign one register per
+  // variable. If any variable is used multiple times it will be handled later.
+  plan<kX86RegClassGp >();
+  plan<kX86RegClassMm >();
+  plan<kX86RegClassXyz>();
+
+  // Spill.
+  spill<kX86RegClassGp >();
+  spill<kX86RegClassMm >();
+  spill<kX86RegClassXyz>();
+
+  // Alloc.
+  alloc<kX86RegClassGp >();
+  alloc<kX86RegClassMm >();
+  alloc<kX86RegClassXyz>();
+
+  // Unuse clobbered registers that are not used to pass function arguments and
+  // save variables used to pass function arguments that will be reused later on.
+  save<kX86RegClassGp >();
+  save<kX86RegClassMm >();
+  save<kX86RegClassXyz>();
+
+  // Allocate immediates in registers and on the stack.
+  allocImmsOnStack();
+
+  // Duplicate.
+  duplicate<kX86RegClassGp >();
+  duplicate<kX86RegClassMm >();
+  duplicate<kX86RegClassXyz>();
+
+  // Translate call operand.
+  ASMJIT_PROPAGATE_ERROR(X86Context_translateOperands(_context, &node->_target, 1));
+
+  // To emit instructions after call.
+  _compiler->_setCursor(node);
+
+  // If the callee pops stack it has to be manually adjusted back.
+  X86FuncDecl* decl = node->getDecl();
+  if (decl->getCalleePopsStack() && decl->getArgStackSize() != 0) {
+    _compiler->emit(kX86InstIdSub, _context->_zsp, static_cast<int>(decl->getArgStackSize()));
+  }
+
+  // Clobber.
+  clobber<kX86RegClassGp >();
+  clobber<kX86RegClassMm >();
+  clobber<kX86RegClassXyz>();
+
+  // Return.
+  ret();
+
+  // Unuse.
+  unuseAfter<kX86RegClassGp >();
+  unuseAfter<kX86RegClassMm >();
+  unuseAfter<kX86RegClassXyz>();
+
+  // Cleanup; disconnect Vd->Va.
+  cleanup();
+
+  return kErrorOk;
+}
+
+// ============================================================================
+// [asmjit::X86CallAlloc - Init / Cleanup]
+// ============================================================================
+
+ASMJIT_INLINE void X86CallAlloc::init(X86CallNode* node, X86VarMap* map) {
+  X86BaseAlloc::init(node, map);
+
+  // Create mask of all registers that will be used to pass function arguments.
+  _willAlloc = node->_usedArgs;
+  _willSpill.reset();
+}
+
+ASMJIT_INLINE void X86CallAlloc::cleanup() {
+  X86BaseAlloc::cleanup();
+}
+
+// ============================================================================
+// [asmjit::X86CallAlloc - Plan / Spill / Alloc]
+// ============================================================================
+
+template<int C>
+ASMJIT_INLINE void X86CallAlloc::plan() {
+  uint32_t i;
+  uint32_t clobbered = _map->_clobberedRegs.get(C);
+
+  uint32_t willAlloc = _willAlloc.get(C);
+  uint32_t willFree = clobbered & ~willAlloc;
+
+  VarAttr* list = getVaListByClass(C);
+  uint32_t count = getVaCountByClass(C);
+
+  X86VarState* state = getState();
+
+  // Calculate 'willAlloc' and 'willFree' masks based on mandatory masks.
+  for (i = 0; i < count; i++) {
+    VarAttr* va = &list[i];
+    VarData* vd = va->getVd();
+
+    uint32_t vaFlags = va->getFlags();
+    uint32_t regIndex = vd->getRegIndex();
+    uint32_t regMask = (regIndex != kInvalidReg) ? Utils::mask(regIndex) : 0;
+
+    if ((vaFlags & kVarAttrRReg) != 0) {
+      // Planning register allocation. First check whether the variable is
+      // already allocated in register and if it can stay there. Function
+      // arguments are passed either in a specific register or in stack so
+      // we care mostly of mandatory registers.
+      uint32_t inRegs = va->getInRegs();
+
+      if (inRegs == 0) {
+        inRegs = va->getAllocableRegs();
+      }
+
+      // Optimize situation where the variable has to be allocated in a
+      // mandatory register, but it's already allocated in register that
+      // is not clobbered (i.e. it will survive function call).
+      if ((regMask & inRegs) != 0 || ((regMask & ~clobbered) != 0 && (vaFlags & kVarAttrUnuse) == 0)) {
+        va->setInRegIndex(regIndex);
+        va->orFlags(kVarAttrAllocRDone);
+        addVaDone(C);
+      }
+      else {
+        willFree |= regMask;
+      }
+    }
+    else {
+      // Memory access - if variable is allocated it has to be freed.
+      if (regMask != 0) {
+        willFree |= regMask;
+      }
+      else {
+        va->orFlags(kVarAttrAllocRDone);
+        addVaDone(C);
+      }
+    }
+  }
+
+  // Occupied registers without 'willFree' registers; contains basically
+  // all the registers we can use to allocate variables without inRegs
+  // speficied.
+  uint32_t occupied = state->_occupied.get(C) & ~willFree;
+  uint32_t willSpill = 0;
+
+  // Find the best registers for variables that are not allocated yet. Only
+  // useful for Gp registers used as call operand.
+  for (i = 0; i < count; i++) {
+    VarAttr* va = &list[i];
+    VarData* vd = va->getVd();
+
+    uint32_t vaFlags = va->getFlags();
+    if ((vaFlags & kVarAttrAllocRDone) != 0 || (vaFlags & kVarAttrRReg) == 0)
+      continue;
 
-          for (uint32_t vaIndex = 0; vaIndex < vaCount; vaIndex++) {
-            VarAttr* va = &vaList[vaIndex];
+    // All registers except Gp used by call itself must have inRegIndex.
+    uint32_t m = va->getInRegs();
+    if (C != kX86RegClassGp || m) {
+      ASMJIT_ASSERT(m != 0);
+      va->setInRegIndex(Utils::findFirstBit(m));
+      willSpill |= occupied & m;
+      continue;
+    }
 
-            if (va->getVd() == vd) {
-              found = true;
+    m = va->getAllocableRegs() & ~(willAlloc ^ m);
+    m = guessAlloc<C>(vd, m);
+    ASMJIT_ASSERT(m != 0);
 
-              // Terminate if the variable is overwritten here.
-              if (!(va->getFlags() & kVarAttrRAll))
-                goto _Done;
+    uint32_t candidateRegs = m & ~occupied;
+    if (candidateRegs == 0) {
+      candidateRegs = X86Context_getCheapestSpill<C>(_context, m & occupied);
+      if (candidateRegs == 0)
+        candidateRegs = m;
+    }
 
-              uint32_t mask = va->getAllocableRegs();
-              if (mask != 0) {
-                tempRegs &= mask;
-                if (!tempRegs)
-                  goto _Done;
-                safeRegs = tempRegs;
-              }
+    if (!(vaFlags & (kVarAttrWReg | kVarAttrUnuse)) && (candidateRegs & ~clobbered))
+      candidateRegs &= ~clobbered;
 
-              mask = va->getInRegs();
-              if (mask != 0) {
-                tempRegs &= mask;
-                if (!tempRegs)
-                  goto _Done;
+    uint32_t regIndex = Utils::findFirstBit(candidateRegs);
+    uint32_t regMask = Utils::mask(regIndex);
 
-                safeRegs = tempRegs;
-                goto _Done;
-              }
-            }
-            else {
-              // It happens often that one variable is used across many blocks of
-              // assembly code. It can sometimes cause one variable to be allocated
-              // in a different register, which can cause state switch to generate
-              // moves in case of jumps and state intersections. We try to prevent
-              // this case by also considering variables' home registers.
-              homeRegs |= va->getVd()->getHomeMask();
-            }
-          }
+    va->setInRegIndex(regIndex);
+    va->setInRegs(regMask);
 
-          tempRegs &= ~(map->_outRegs.get(C) | map->_clobberedRegs.get(C));
-          if (!found)
-            tempRegs &= ~map->_inRegs.get(C);
+    willAlloc |= regMask;
+    willSpill |= regMask & occupied;
+    willFree &= ~regMask;
 
-          if (!tempRegs)
-            goto _Done;
-          safeRegs = tempRegs;
+    occupied |= regMask;
+    continue;
+  }
 
-          if (homeRegs) {
-            tempRegs = safeRegs & ~homeRegs;
-            if (!tempRegs)
-              goto _Done;
-            safeRegs = tempRegs;
+  // Set calculated masks back to the allocator; needed by spill() and alloc().
+  _willSpill.set(C, willSpill);
+  _willAlloc.set(C, willAlloc);
+}
+
+template<int C>
+ASMJIT_INLINE void X86CallAlloc::spill() {
+  uint32_t m = _willSpill.get(C);
+  uint32_t i = static_cast<uint32_t>(0) - 1;
+
+  if (m == 0)
+    return;
+
+  X86VarState* state = getState();
+  VarData** sVars = state->getListByClass(C);
+
+  // Available registers for decision if move has any benefit over spill.
+  uint32_t availableRegs = getGaRegs(C) & ~(state->_occupied.get(C) | m | _willAlloc.get(C));
+
+  do {
+    // We always advance one more to destroy the bit that we have found.
+    uint32_t bitIndex = Utils::findFirstBit(m) + 1;
+
+    i += bitIndex;
+    m >>= bitIndex;
+
+    VarData* vd = sVars[i];
+    ASMJIT_ASSERT(vd != nullptr);
+    ASMJIT_ASSERT(vd->getVa() == nullptr);
+
+    if (vd->isModified() && availableRegs) {
+      uint32_t available = guessSpill<C>(vd, availableRegs);
+      if (available != 0) {
+        uint32_t regIndex = Utils::findFirstBit(available);
+        uint32_t regMask = Utils::mask(regIndex);
+
+        _context->move<C>(vd, regIndex);
+        _context->_clobberedRegs.or_(C, regMask);
+        availableRegs ^= regMask;
+        continue;
+      }
+    }
+
+    _context->spill<C>(vd);
+  } while (m != 0);
+}
+
+template<int C>
+ASMJIT_INLINE void X86CallAlloc::alloc() {
+  if (isVaDone(C))
+    return;
+
+  VarAttr* list = getVaListByClass(C);
+  uint32_t count = getVaCountByClass(C);
+
+  X86VarState* state = getState();
+  VarData** sVars = state->getListByClass(C);
+
+  uint32_t i;
+  bool didWork;
+
+  do {
+    didWork = false;
+    for (i = 0; i < count; i++) {
+      VarAttr* aVa = &list[i];
+      VarData* aVd = aVa->getVd();
+
+      if ((aVa->getFlags() & (kVarAttrRReg | kVarAttrAllocRDone)) != kVarAttrRReg)
+        continue;
+
+      uint32_t aIndex = aVd->getRegIndex();
+      uint32_t bIndex = aVa->getInRegIndex();
+
+      // Shouldn't be the same.
+      ASMJIT_ASSERT(aIndex != bIndex);
+
+      VarData* bVd = getState()->getListByClass(C)[bIndex];
+      if (bVd != nullptr) {
+        VarAttr* bVa = bVd->getVa();
+
+        // Gp registers only - Swap two registers if we can solve two
+        // allocation tasks by a single 'xchg' instruction, swapping
+        // two registers required by the instruction/node or one register
+        // required with another non-required.
+        if (C == kX86RegClassGp && aIndex != kInvalidReg) {
+          _context->swapGp(aVd, bVd);
+
+          aVa->orFlags(kVarAttrAllocRDone);
+          addVaDone(C);
+
+          // Doublehit, two registers allocated by a single swap.
+          if (bVa != nullptr && bVa->getInRegIndex() == aIndex) {
+            bVa->orFlags(kVarAttrAllocRDone);
+            addVaDone(C);
           }
+
+          didWork = true;
+          continue;
         }
+
+        // The register is clobbered by the call (others were spilled by
+        // `spill()`), a variable not used by the call has to leave it anyway.
+        if (bVa != nullptr)
+          continue;
+        _context->spill<C>(bVd);
       }
 
-_Advance:
-      // Terminate if this is a return node.
-      if (node->hasFlag(HLNode::kFlagIsRet))
-        goto _Done;
+      if (aIndex != kInvalidReg) {
+        _context->move<C>(aVd, bIndex);
+        _context->_clobberedRegs.or_(C, Utils::mask(bIndex));
 
-      // Advance on non-conditional jump.
-      if (node->hasFlag(HLNode::kFlagIsJmp)) {
-        // Stop on a jump that is not followed.
-        node = static_cast<HLJump*>(node)->getTarget();
-        if (node == nullptr)
-          break;
+        aVa->orFlags(kVarAttrAllocRDone);
+        addVaDone(C);
+
+        didWork = true;
         continue;
       }
+      else {
+        _context->alloc<C>(aVd, bIndex);
+        _context->_clobberedRegs.or_(C, Utils::mask(bIndex));
 
-      // Split flow on a conditional jump.
-      if (node->hasFlag(HLNode::kFlagIsJcc)) {
-        // Put the next node on the stack and follow the target if possible.
-        HLNode* next = node->getNext();
-        if (next != nullptr && gfIndex < kMaxGuessFlow)
-          gfArray[gfIndex++].init(next, counter, safeRegs);
+        aVa->orFlags(kVarAttrAllocRDone);
+        addVaDone(C);
 
-        node = static_cast<HLJump*>(node)->getTarget();
-        if (node == nullptr)
-          break;
+        didWork = true;
         continue;
       }
+    }
+  } while (didWork);
+}
+
+// ============================================================================
+// [asmjit::X86CallAlloc - AllocImmsOnStack]
+// ============================================================================
+
+ASMJIT_INLINE void X86CallAlloc::allocImmsOnStack() {
+  X86CallNode* node = getNode();
+  X86FuncDecl* decl = node->getDecl();
+
+  uint32_t argCount = decl->getNumArgs();
+  Operand* args = node->_args;
+
+  for (uint32_t i = 0; i < argCount; i++) {
+    Operand& op = args[i];
+
+    if (!op.isImm())
+      continue;
+
+    const Imm& imm = static_cast<const Imm&>(op);
+    const FuncInOut& arg = decl->getArg(i);
+    uint32_t varType = arg.getVarType();
+
+    if (arg.hasStackOffset()) {
+      X86Mem dst = x86::ptr(_context->_zsp, -static_cast<int>(_context->getRegSize()) + arg.getStackOffset());
+      _context->emitMoveImmOnStack(varType, &dst, &imm);
+    }
+    else {
+      _context->emitMoveImmToReg(varType, arg.getRegIndex(), &imm);
+    }
+  }
+}
+
+// ============================================================================
+// [asmjit::X86CallAlloc - Duplicate]
+// ============================================================================
+
+template<int C>
+ASMJIT_INLINE void X86CallAlloc::duplicate() {
+  VarAttr* list = getVaListByClass(C);
+  uint32_t count = getVaCountByClass(C);
+
+  for (uint32_t i = 0; i < count; i++) {
+    VarAttr* va = &list[i];
+    if (!va->hasFlag(kVarAttrRReg))
+      continue;
 
-      node = node->getNext();
-      ASMJIT_ASSERT(node != nullptr);
-    } while (counter < maxInst);
+    uint32_t inRegs = va->getInRegs();
+    if (!inRegs)
+      continue;
 
-_Done:
-    for (;;) {
-      if (gfIndex == 0)
-        goto _Ret;
+    VarData* vd = va->getVd();
+    uint32_t regIndex = vd->getRegIndex();
 
-      GuessFlowData* data = &gfArray[--gfIndex];
-      node = data->_node;
-      counter = data->_counter;
+    ASMJIT_ASSERT(regIndex != kInvalidReg);
 
-      uint32_t tempRegs = safeRegs & data->_safeRegs;
-      if (!tempRegs)
-        continue;
+    inRegs &= ~Utils::mask(regIndex);
+    if (!inRegs)
+      continue;
 
-      safeRegs = tempRegs;
-      break;
+    for (uint32_t dupIndex = 0; inRegs != 0; dupIndex++, inRegs >>= 1) {
+      if (inRegs & 0x1) {
+        _context->emitMove(vd, dupIndex, regIndex, "Duplicate");
+        _context->_clobberedRegs.or_(C, Utils::mask(dupIndex));
+      }
     }
   }
-
-_Ret:
-  ASMJIT_TLOG("[RA-GUESS] === %s (Output=%08X) ===\n", vd->getName(), safeRegs);
-  return safeRegs;
 }
-#endif
+
+// ============================================================================
+// [asmjit::X86CallAlloc - GuessAlloc / GuessSpill]
+// ============================================================================
 
 template<int C>
-ASMJIT_INLINE uint32_t X86VarAlloc::guessAlloc(VarData* vd, uint32_t allocableRegs) {
+ASMJIT_INLINE uint32_t X86CallAlloc::guessAlloc(VarData* vd, uint32_t allocableRegs) {
   ASMJIT_ASSERT(allocableRegs != 0);
 
-  // Stop now if there is only one bit (register) set in `allocableRegs` mask.
-  if (Utils::isPowerOf2(allocableRegs))
+  // Stop now if there is only one bit (register) set in 'allocableRegs' mask,
+  // or if the variable is spilled after the node anyway (baseline).
+  if (Utils::isPowerOf2(allocableRegs) || _compiler->hasFeature(kCompilerFeatureBaseline))
     return allocableRegs;
 
-  uint32_t localId = vd->getLocalId();
-  uint32_t safeRegs = allocableRegs;
-
   uint32_t i;
+  uint32_t safeRegs = allocableRegs;
   uint32_t maxLookAhead = _compiler->getMaxLookAhead();
 
   // Look ahead and calculate mask of special registers on both - input/output.
   HLNode* node = _node;
   for (i = 0; i < maxLookAhead; i++) {
-    BitArray* liveness = node->getLiveness();
-
-    // If the variable becomes dead it doesn't make sense to continue.
-    if (liveness != nullptr && !liveness->getBit(localId))
-      break;
-
-    // Stop on `HLSentinel` and `HLRet`.
+    // Stop on 'HLRet' and 'HLSentinel.
     if (node->hasFlag(HLNode::kFlagIsRet))
       break;
 
@@ -4018,1660 +6137,1880 @@ ASMJIT_INLINE uint32_t X86VarAlloc::guessAlloc(VarData* vd, uint32_t allocableRe
     X86VarMap* map = node->getMap<X86VarMap>();
     if (map != nullptr) {
       VarAttr* va = map->findVaByClass(C, vd);
-      uint32_t mask;
-
       if (va != nullptr) {
-        // If the variable is overwritten it doesn't mase sense to continue.
-        if (!(va->getFlags() & kVarAttrRAll))
-          break;
-
-        mask = va->getAllocableRegs();
-        if (mask != 0) {
-          allocableRegs &= mask;
-          if (allocableRegs == 0)
-            break;
+        uint32_t inRegs = va->getInRegs();
+        if (inRegs != 0) {
           safeRegs = allocableRegs;
-        }
+          allocableRegs &= inRegs;
 
-        mask = va->getInRegs();
-        if (mask != 0) {
-          allocableRegs &= mask;
           if (allocableRegs == 0)
-            break;
-          safeRegs = allocableRegs;
-          break;
+            goto _UseSafeRegs;
+          else
+            return allocableRegs;
         }
-
-        allocableRegs &= ~(map->_outRegs.get(C) | map->_clobberedRegs.get(C));
-        if (allocableRegs == 0)
-          break;
-      }
-      else {
-        allocableRegs &= ~(map->_inRegs.get(C) | map->_outRegs.get(C) | map->_clobberedRegs.get(C));
-        if (allocableRegs == 0)
-          break;
       }
 
       safeRegs = allocableRegs;
+      allocableRegs &= ~(map->_inRegs.get(C) | map->_outRegs.get(C) | map->_clobberedRegs.get(C));
+
+      if (allocableRegs == 0)
+        break;
     }
   }
 
+_UseSafeRegs:
   return safeRegs;
 }
 
 template<int C>
-ASMJIT_INLINE uint32_t X86VarAlloc::guessSpill(VarData* vd, uint32_t allocableRegs) {
+ASMJIT_INLINE uint32_t X86CallAlloc::guessSpill(VarData* vd, uint32_t allocableRegs) {
   ASMJIT_ASSERT(allocableRegs != 0);
 
+  // Same as `X86VarAlloc::guessSpill()`, but only preserved registers
+  // survive the call.
+  if (vd->getLoopDepth() != 0)
+    return allocableRegs & ~_map->_clobberedRegs.get(C);
+
   return 0;
 }
 
 // ============================================================================
-// [asmjit::X86VarAlloc - Modified]
+// [asmjit::X86CallAlloc - Save]
 // ============================================================================
 
 template<int C>
-ASMJIT_INLINE void X86VarAlloc::modified() {
-  VarAttr* list = getVaListByClass(C);
-  uint32_t count = getVaCountByClass(C);
-
-  for (uint32_t i = 0; i < count; i++) {
-    VarAttr* va = &list[i];
+ASMJIT_INLINE void X86CallAlloc::save() {
+  X86VarState* state = getState();
+  VarData** sVars = state->getListByClass(C);
 
-    if (va->hasFlag(kVarAttrWReg)) {
-      VarData* vd = va->getVd();
+  uint32_t i;
+  uint32_t affected = _map->_clobberedRegs.get(C) & state->_occupied.get(C) & state->_modified.get(C);
 
-      uint32_t regIndex = vd->getRegIndex();
-      uint32_t regMask = Utils::mask(regIndex);
+  for (i = 0; affected != 0; i++, affected >>= 1) {
+    if (affected & 0x1) {
+      VarData* vd = sVars[i];
+      ASMJIT_ASSERT(vd != nullptr);
+      ASMJIT_ASSERT(vd->isModified());
 
-      vd->setModified(true);
-      _context->_x86State._modified.or_(C, regMask);
+      VarAttr* va = vd->getVa();
+      if (va == nullptr || (va->getFlags() & (kVarAttrWReg | kVarAttrUnuse)) == 0) {
+        _context->save<C>(vd);
+      }
     }
   }
 }
 
 // ============================================================================
-// [asmjit::X86CallAlloc]
-// ============================================================================
-
-//! \internal
-//!
-//! Register allocator context (function call).
-struct X86CallAlloc : public X86BaseAlloc {
-  // --------------------------------------------------------------------------
-  // [Construction / Destruction]
-  // --------------------------------------------------------------------------
-
-  ASMJIT_INLINE X86CallAlloc(X86Context* context) : X86BaseAlloc(context) {}
-  ASMJIT_INLINE ~X86CallAlloc() {}
-
-  // --------------------------------------------------------------------------
-  // [Accessors]
-  // --------------------------------------------------------------------------
-
-  //! Get the node.
-  ASMJIT_INLINE X86CallNode* getNode() const { return static_cast<X86CallNode*>(_node); }
-
-  // --------------------------------------------------------------------------
-  // [Run]
-  // --------------------------------------------------------------------------
-
-  ASMJIT_INLINE Error run(X86CallNode* node);
-
-  // --------------------------------------------------------------------------
-  // [Init / Cleanup]
-  // --------------------------------------------------------------------------
-
-protected:
-  // Just to prevent calling these methods from X86Context::translate().
-  ASMJIT_INLINE void init(X86CallNode* node, X86VarMap* map);
-  ASMJIT_INLINE void cleanup();
-
-  // --------------------------------------------------------------------------
-  // [Plan / Alloc / Spill / Move]
-  // --------------------------------------------------------------------------
-
-  template<int C>
-  ASMJIT_INLINE void plan();
-
-  template<int C>
-  ASMJIT_INLINE void spill();
-
-  template<int C>
-  ASMJIT_INLINE void alloc();
-
-  // --------------------------------------------------------------------------
-  // [AllocImmsOnStack]
-  // --------------------------------------------------------------------------
-
-  ASMJIT_INLINE void allocImmsOnStack();
-
-  // --------------------------------------------------------------------------
-  // [Duplicate]
-  // --------------------------------------------------------------------------
-
-  template<int C>
-  ASMJIT_INLINE void duplicate();
-
-  // --------------------------------------------------------------------------
-  // [GuessAlloc / GuessSpill]
-  // --------------------------------------------------------------------------
-
-  template<int C>
-  ASMJIT_INLINE uint32_t guessAlloc(VarData* vd, uint32_t allocableRegs);
-
-  template<int C>
-  ASMJIT_INLINE uint32_t guessSpill(VarData* vd, uint32_t allocableRegs);
-
-  // --------------------------------------------------------------------------
-  // [Save]
-  // --------------------------------------------------------------------------
-
-  template<int C>
-  ASMJIT_INLINE void save();
-
-  // --------------------------------------------------------------------------
-  // [Clobber]
-  // --------------------------------------------------------------------------
-
-  template<int C>
-  ASMJIT_INLINE void clobber();
-
-  // --------------------------------------------------------------------------
-  // [Ret]
-  // --------------------------------------------------------------------------
-
-  ASMJIT_INLINE void ret();
-
-  // --------------------------------------------------------------------------
-  // [Members]
-  // --------------------------------------------------------------------------
-
-  //! Will alloc to these registers.
-  X86RegMask _willAlloc;
-  //! Will spill these registers.
-  X86RegMask _willSpill;
-};
-
-// ============================================================================
-// [asmjit::X86CallAlloc - Run]
+// [asmjit::X86CallAlloc - Clobber]
 // ============================================================================
 
-ASMJIT_INLINE Error X86CallAlloc::run(X86CallNode* node) {
-  // Initialize.
-  X86VarMap* map = node->getMap<X86VarMap>();
-  if (map == nullptr)
-    return kErrorOk;
-
-  // Initialize the allocator; prepare basics and connect Vd->Va.
-  init(node, map);
-
-  // Plan register allocation. Planner is only able to assign one register per
-  // variable. If any variable is used multiple times it will be handled later.
-  plan<kX86RegClassGp >();
-  plan<kX86RegClassMm >();
-  plan<kX86RegClassXyz>();
-
-  // Spill.
-  spill<kX86RegClassGp >();
-  spill<kX86RegClassMm >();
-  spill<kX86RegClassXyz>();
-
-  // Alloc.
-  alloc<kX86RegClassGp >();
-  alloc<kX86RegClassMm >();
-  alloc<kX86RegClassXyz>();
+template<int C>
+ASMJIT_INLINE void X86CallAlloc::clobber() {
+  X86VarState* state = getState();
+  VarData** sVars = state->getListByClass(C);
 
-  // Unuse clobbered registers that are not used to pass function arguments and
-  // save variables used to pass function arguments that will be reused later on.
-  save<kX86RegClassGp >();
-  save<kX86RegClassMm >();
-  save<kX86RegClassXyz>();
+  uint32_t i;
+  uint32_t affected = _map->_clobberedRegs.get(C) & state->_occupied.get(C);
 
-  // Allocate immediates in registers and on the stack.
-  allocImmsOnStack();
+  for (i = 0; affected != 0; i++, affected >>= 1) {
+    if (affected & 0x1) {
+      VarData* vd = sVars[i];
+      ASMJIT_ASSERT(vd != nullptr);
 
-  // Duplicate.
-  duplicate<kX86RegClassGp >();
-  duplicate<kX86RegClassMm >();
-  duplicate<kX86RegClassXyz>();
+      VarAttr* va = vd->getVa();
+      uint32_t vdState = kVarStateNone;
 
-  // Translate call operand.
-  ASMJIT_PROPAGATE_ERROR(X86Context_translateOperands(_context, &node->_target, 1));
+      if (!vd->isModified() || (va != nullptr && (va->getFlags() & (kVarAttrWAll | kVarAttrUnuse)) != 0)) {
+        vdState = kVarStateMem;
+      }
 
-  // To emit instructions after call.
-  _compiler->_setCursor(node);
+      _context->unuse<C>(vd, vdState);
+    }
+  }
+}
 
-  // If the callee pops stack it has to be manually adjusted back.
+// ============================================================================
+// [asmjit::X86CallAlloc - Ret]
+// ============================================================================
+
+ASMJIT_INLINE void X86CallAlloc::ret() {
+  X86CallNode* node = getNode();
   X86FuncDecl* decl = node->getDecl();
-  if (decl->getCalleePopsStack() && decl->getArgStackSize() != 0) {
-    _compiler->emit(kX86InstIdSub, _context->_zsp, static_cast<int>(decl->getArgStackSize()));
-  }
 
-  // Clobber.
-  clobber<kX86RegClassGp >();
-  clobber<kX86RegClassMm >();
-  clobber<kX86RegClassXyz>();
+  uint32_t i;
+  Operand* rets = node->_ret;
 
-  // Return.
-  ret();
+  for (i = 0; i < 2; i++) {
+    const FuncInOut& ret = decl->getRet(i);
+    Operand* op = &rets[i];
 
-  // Unuse.
-  unuseAfter<kX86RegClassGp >();
-  unuseAfter<kX86RegClassMm >();
-  unuseAfter<kX86RegClassXyz>();
+    if (!ret.hasRegIndex() || !op->isVar())
+      continue;
 
-  // Cleanup; disconnect Vd->Va.
-  cleanup();
+    VarData* vd = _compiler->getVdById(op->getId());
+    uint32_t vf = _x86VarInfo[vd->getType()].getFlags();
+    uint32_t regIndex = ret.getRegIndex();
 
-  return kErrorOk;
-}
+    switch (vd->getClass()) {
+      case kX86RegClassGp:
+        ASMJIT_ASSERT(x86VarTypeToClass(ret.getVarType()) == vd->getClass());
 
-// ============================================================================
-// [asmjit::X86CallAlloc - Init / Cleanup]
-// ============================================================================
+        _context->unuse<kX86RegClassGp>(vd);
+        _context->attach<kX86RegClassGp>(vd, regIndex, true);
+        break;
 
-ASMJIT_INLINE void X86CallAlloc::init(X86CallNode* node, X86VarMap* map) {
-  X86BaseAlloc::init(node, map);
+      case kX86RegClassMm:
+        ASMJIT_ASSERT(x86VarTypeToClass(ret.getVarType()) == vd->getClass());
 
-  // Create mask of all registers that will be used to pass function arguments.
-  _willAlloc = node->_usedArgs;
-  _willSpill.reset();
-}
+        _context->unuse<kX86RegClassMm>(vd);
+        _context->attach<kX86RegClassMm>(vd, regIndex, true);
+        break;
 
-ASMJIT_INLINE void X86CallAlloc::cleanup() {
-  X86BaseAlloc::cleanup();
+      case kX86RegClassXyz:
+        if (ret.getVarType() == kVarTypeFp32 || ret.getVarType() == kVarTypeFp64) {
+          X86Mem m = _context->getVarMem(vd);
+          m.setSize(
+            (vf & VarInfo::kFlagSP) ? 4 :
+            (vf & VarInfo::kFlagDP) ? 8 :
+            (ret.getVarType() == kVarTypeFp32) ? 4 : 8);
+
+          _context->unuse<kX86RegClassXyz>(vd, kVarStateMem);
+          _compiler->fstp(m);
+        }
+        else {
+          ASMJIT_ASSERT(x86VarTypeToClass(ret.getVarType()) == vd->getClass());
+
+          _context->unuse<kX86RegClassXyz>(vd);
+          _context->attach<kX86RegClassXyz>(vd, regIndex, true);
+        }
+        break;
+    }
+  }
 }
 
 // ============================================================================
-// [asmjit::X86CallAlloc - Plan / Spill / Alloc]
+// [asmjit::X86Context - TranslateOperands]
 // ============================================================================
 
-template<int C>
-ASMJIT_INLINE void X86CallAlloc::plan() {
-  uint32_t i;
-  uint32_t clobbered = _map->_clobberedRegs.get(C);
-
-  uint32_t willAlloc = _willAlloc.get(C);
-  uint32_t willFree = clobbered & ~willAlloc;
+//! \internal
+static Error X86Context_translateOperands(X86Context* self, Operand* opList, uint32_t opCount) {
+  X86Compiler* compiler = self->getCompiler();
+  uint32_t hasGpdBase = compiler->getRegSize() == 4;
 
-  VarAttr* list = getVaListByClass(C);
-  uint32_t count = getVaCountByClass(C);
+  // Translate variables into registers.
+  for (uint32_t i = 0; i < opCount; i++) {
+    Operand* op = &opList[i];
 
-  X86VarState* state = getState();
+    if (op->isVar()) {
+      VarData* vd = compiler->getVdById(op->getId());
+      ASMJIT_ASSERT(vd != nullptr);
+      ASMJIT_ASSERT(vd->getRegIndex() != kInvalidReg);
 
-  // Calculate 'willAlloc' and 'willFree' masks based on mandatory masks.
-  for (i = 0; i < count; i++) {
-    VarAttr* va = &list[i];
-    VarData* vd = va->getVd();
+      op->_vreg.op = Operand::kTypeReg;
+      op->_vreg.index = vd->getRegIndex();
+    }
+    else if (op->isMem()) {
+      X86Mem* m = static_cast<X86Mem*>(op);
 
-    uint32_t vaFlags = va->getFlags();
-    uint32_t regIndex = vd->getRegIndex();
-    uint32_t regMask = (regIndex != kInvalidReg) ? Utils::mask(regIndex) : 0;
+      if (m->isBaseIndexType() && OperandUtil::isVarId(m->getBase())) {
+        VarData* vd = compiler->getVdById(m->getBase());
 
-    if ((vaFlags & kVarAttrRReg) != 0) {
-      // Planning register allocation. First check whether the variable is
-      // already allocated in register and if it can stay there. Function
-      // arguments are passed either in a specific register or in stack so
-      // we care mostly of mandatory registers.
-      uint32_t inRegs = va->getInRegs();
+        if (m->getMemType() == kMemTypeBaseIndex) {
+          ASMJIT_ASSERT(vd->getRegIndex() != kInvalidReg);
+          op->_vmem.base = vd->getRegIndex();
+        }
+        else {
+          if (!vd->isMemArg())
+            self->getVarCell(vd);
 
-      if (inRegs == 0) {
-        inRegs = va->getAllocableRegs();
+          // Offset will be patched later by X86Context_patchFuncMem().
+          m->setGpdBase(hasGpdBase);
+          m->adjust(vd->isMemArg() ? self->_argActualDisp : self->_varActualDisp);
+        }
       }
 
-      // Optimize situation where the variable has to be allocated in a
-      // mandatory register, but it's already allocated in register that
-      // is not clobbered (i.e. it will survive function call).
-      if ((regMask & inRegs) != 0 || ((regMask & ~clobbered) != 0 && (vaFlags & kVarAttrUnuse) == 0)) {
-        va->setInRegIndex(regIndex);
-        va->orFlags(kVarAttrAllocRDone);
-        addVaDone(C);
-      }
-      else {
-        willFree |= regMask;
-      }
-    }
-    else {
-      // Memory access - if variable is allocated it has to be freed.
-      if (regMask != 0) {
-        willFree |= regMask;
-      }
-      else {
-        va->orFlags(kVarAttrAllocRDone);
-        addVaDone(C);
+      if (OperandUtil::isVarId(m->getIndex())) {
+        VarData* vd = compiler->getVdById(m->getIndex());
+        ASMJIT_ASSERT(vd->getRegIndex() != kInvalidReg);
+        ASMJIT_ASSERT(vd->getRegIndex() != kX86RegIndexR12);
+        op->_vmem.index = vd->getRegIndex();
       }
     }
   }
 
-  // Occupied registers without 'willFree' registers; contains basically
-  // all the registers we can use to allocate variables without inRegs
-  // speficied.
-  uint32_t occupied = state->_occupied.get(C) & ~willFree;
-  uint32_t willSpill = 0;
+  return kErrorOk;
+}
 
-  // Find the best registers for variables that are not allocated yet. Only
-  // useful for Gp registers used as call operand.
-  for (i = 0; i < count; i++) {
-    VarAttr* va = &list[i];
-    VarData* vd = va->getVd();
+// ============================================================================
+// [asmjit::X86Context - TranslatePrologEpilog]
+// ============================================================================
 
-    uint32_t vaFlags = va->getFlags();
-    if ((vaFlags & kVarAttrAllocRDone) != 0 || (vaFlags & kVarAttrRReg) == 0)
-      continue;
+//! \internal
+static Error X86Context_initFunc(X86Context* self, X86FuncNode* func) {
+  X86Compiler* compiler = self->getCompiler();
+  X86FuncDecl* decl = func->getDecl();
 
-    // All registers except Gp used by call itself must have inRegIndex.
-    uint32_t m = va->getInRegs();
-    if (C != kX86RegClassGp || m) {
-      ASMJIT_ASSERT(m != 0);
-      va->setInRegIndex(Utils::findFirstBit(m));
-      willSpill |= occupied & m;
-      continue;
+  X86RegMask& clobberedRegs = self->_clobberedRegs;
+  uint32_t regSize = compiler->getRegSize();
+
+  // Setup "Save-Restore" registers.
+  func->_saveRestoreRegs.set(kX86RegClassGp , clobberedRegs.get(kX86RegClassGp ) & decl->getPreserved(kX86RegClassGp ));
+  func->_saveRestoreRegs.set(kX86RegClassMm , clobberedRegs.get(kX86RegClassMm ) & decl->getPreserved(kX86RegClassMm ));
+  func->_saveRestoreRegs.set(kX86RegClassK  , 0);
+  func->_saveRestoreRegs.set(kX86RegClassXyz, clobberedRegs.get(kX86RegClassXyz) & decl->getPreserved(kX86RegClassXyz));
+
+  ASMJIT_ASSERT(!func->_saveRestoreRegs.has(kX86RegClassGp, Utils::mask(kX86RegIndexSp)));
+
+  // Setup required stack alignment and kFuncFlagIsStackMisaligned.
+  {
+    uint32_t requiredStackAlignment = Utils::iMax(self->_memMaxAlign, self->getRegSize());
+
+    if (requiredStackAlignment < 16) {
+      // Require 16-byte alignment if 8-byte vars are used.
+      if (self->_mem8ByteVarsUsed)
+        requiredStackAlignment = 16;
+      else if (func->_saveRestoreRegs.get(kX86RegClassMm) || func->_saveRestoreRegs.get(kX86RegClassXyz))
+        requiredStackAlignment = 16;
+      else if (Utils::inInterval<uint32_t>(func->getRequiredStackAlignment(), 8, 16))
+        requiredStackAlignment = 16;
     }
 
-    m = va->getAllocableRegs() & ~(willAlloc ^ m);
-    m = guessAlloc<C>(vd, m);
-    ASMJIT_ASSERT(m != 0);
+    if (func->getRequiredStackAlignment() < requiredStackAlignment)
+      func->setRequiredStackAlignment(requiredStackAlignment);
+
+    func->updateRequiredStackAlignment();
+  }
+
+  // Adjust stack pointer if function is caller.
+  if (func->isCaller()) {
+    func->addFuncFlags(kFuncFlagIsStackAdjusted);
+    func->_callStackSize = Utils::alignTo<uint32_t>(func->getCallStackSize(), func->getRequiredStackAlignment());
+  }
+
+  // Adjust stack pointer if manual stack alignment is needed.
+  if (func->isStackMisaligned() && func->isNaked()) {
+    // Get a memory cell where the original stack frame will be stored.
+    VarCell* cell = self->_newStackCell(regSize, regSize);
+    if (cell == nullptr)
+      return self->getLastError(); // The error has already been set.
+
+    func->addFuncFlags(kFuncFlagIsStackAdjusted);
+    self->_stackFrameCell = cell;
 
-    uint32_t candidateRegs = m & ~occupied;
-    if (candidateRegs == 0) {
-      candidateRegs = m & occupied & ~state->_modified.get(C);
-      if (candidateRegs == 0)
-        candidateRegs = m;
+    if (decl->getArgStackSize() > 0) {
+      func->addFuncFlags(kFuncFlagX86MoveArgs);
+      func->setExtraStackSize(decl->getArgStackSize());
     }
 
-    if (!(vaFlags & (kVarAttrWReg | kVarAttrUnuse)) && (candidateRegs & ~clobbered))
-      candidateRegs &= ~clobbered;
+    // Get temporary register which will be used to align the stack frame.
+    uint32_t fRegMask = Utils::bits(self->_regCount.getGp());
+    uint32_t stackFrameCopyRegs;
 
-    uint32_t regIndex = Utils::findFirstBit(candidateRegs);
-    uint32_t regMask = Utils::mask(regIndex);
+    fRegMask &= ~(decl->getUsed(kX86RegClassGp) | Utils::mask(kX86RegIndexSp));
+    stackFrameCopyRegs = fRegMask;
 
-    va->setInRegIndex(regIndex);
-    va->setInRegs(regMask);
+    // Try to remove modified registers from the mask.
+    uint32_t tRegMask = fRegMask & ~self->getClobberedRegs(kX86RegClassGp);
+    if (tRegMask != 0)
+      fRegMask = tRegMask;
 
-    willAlloc |= regMask;
-    willSpill |= regMask & occupied;
-    willFree &= ~regMask;
+    // Try to remove preserved registers from the mask.
+    tRegMask = fRegMask & ~decl->getPreserved(kX86RegClassGp);
+    if (tRegMask != 0)
+      fRegMask = tRegMask;
 
-    occupied |= regMask;
-    continue;
-  }
+    ASMJIT_ASSERT(fRegMask != 0);
 
-  // Set calculated masks back to the allocator; needed by spill() and alloc().
-  _willSpill.set(C, willSpill);
-  _willAlloc.set(C, willAlloc);
-}
+    uint32_t fRegIndex = Utils::findFirstBit(fRegMask);
+    func->_stackFrameRegIndex = static_cast<uint8_t>(fRegIndex);
 
-template<int C>
-ASMJIT_INLINE void X86CallAlloc::spill() {
-  uint32_t m = _willSpill.get(C);
-  uint32_t i = static_cast<uint32_t>(0) - 1;
+    // We have to save the register on the stack (it will be the part of prolog
+    // and epilog), however we shouldn't save it twice, so we will remove it
+    // from '_saveRestoreRegs' in case that it is preserved.
+    fRegMask = Utils::mask(fRegIndex);
+    if ((fRegMask & decl->getPreserved(kX86RegClassGp)) != 0) {
+      func->_saveRestoreRegs.andNot(kX86RegClassGp, fRegMask);
+      func->_isStackFrameRegPreserved = true;
+    }
 
-  if (m == 0)
-    return;
+    if (func->hasFuncFlag(kFuncFlagX86MoveArgs)) {
+      uint32_t maxRegs = (func->getArgStackSize() + regSize - 1) / regSize;
+      stackFrameCopyRegs &= ~fRegMask;
 
-  X86VarState* state = getState();
-  VarData** sVars = state->getListByClass(C);
+      tRegMask = stackFrameCopyRegs & self->getClobberedRegs(kX86RegClassGp);
+      uint32_t tRegCnt = Utils::bitCount(tRegMask);
 
-  // Available registers for decision if move has any benefit over spill.
-  uint32_t availableRegs = getGaRegs(C) & ~(state->_occupied.get(C) | m | _willAlloc.get(C));
+      if (tRegCnt > 1 || (tRegCnt > 0 && tRegCnt <= maxRegs))
+        stackFrameCopyRegs = tRegMask;
+      else
+        stackFrameCopyRegs = Utils::keepNOnesFromRight(stackFrameCopyRegs, Utils::iMin<uint32_t>(maxRegs, 2));
 
-  do {
-    // We always advance one more to destroy the bit that we have found.
-    uint32_t bitIndex = Utils::findFirstBit(m) + 1;
+      func->_saveRestoreRegs.or_(kX86RegClassGp, stackFrameCopyRegs & decl->getPreserved(kX86RegClassGp));
+      Utils::indexNOnesFromRight(func->_stackFrameCopyGpIndex, stackFrameCopyRegs, maxRegs);
+    }
+  }
+  // If function is not naked we generate standard "EBP/RBP" stack frame.
+  else if (!func->isNaked()) {
+    uint32_t fRegIndex = kX86RegIndexBp;
 
-    i += bitIndex;
-    m >>= bitIndex;
+    func->_stackFrameRegIndex = static_cast<uint8_t>(fRegIndex);
+    func->_isStackFrameRegPreserved = true;
+  }
 
-    VarData* vd = sVars[i];
-    ASMJIT_ASSERT(vd != nullptr);
-    ASMJIT_ASSERT(vd->getVa() == nullptr);
+  ASMJIT_PROPAGATE_ERROR(self->resolveCellOffsets());
 
-    if (vd->isModified() && availableRegs) {
-      uint32_t available = guessSpill<C>(vd, availableRegs);
-      if (available != 0) {
-        uint32_t regIndex = Utils::findFirstBit(available);
-        uint32_t regMask = Utils::mask(regIndex);
+  // Adjust stack pointer if requested memory can't fit into "Red Zone" or "Spill Zone".
+  if (self->_memAllTotal > Utils::iMax<uint32_t>(func->getRedZoneSize(), func->getSpillZoneSize())) {
+    func->addFuncFlags(kFuncFlagIsStackAdjusted);
+  }
 
-        _context->move<C>(vd, regIndex);
-        availableRegs ^= regMask;
-        continue;
-      }
-    }
+  // Setup stack size used to save preserved registers.
+  {
+    uint32_t memGpSize  = Utils::bitCount(func->_saveRestoreRegs.get(kX86RegClassGp )) * regSize;
+    uint32_t memMmSize  = Utils::bitCount(func->_saveRestoreRegs.get(kX86RegClassMm )) * 8;
+    uint32_t memXmmSize = Utils::bitCount(func->_saveRestoreRegs.get(kX86RegClassXyz)) * 16;
 
-    _context->spill<C>(vd);
-  } while (m != 0);
-}
+    func->_pushPopStackSize = memGpSize;
+    func->_moveStackSize = memXmmSize + Utils::alignTo<uint32_t>(memMmSize, 16);
+  }
 
-template<int C>
-ASMJIT_INLINE void X86CallAlloc::alloc() {
-  if (isVaDone(C))
-    return;
+  // Setup adjusted stack size.
+  if (func->isStackMisaligned()) {
+    func->_alignStackSize = 0;
+  }
+  else {
+    // If function is aligned, the RETURN address is stored in the aligned
+    // [ZSP - PtrSize] which makes current ZSP unaligned.
+    int32_t v = static_cast<int32_t>(regSize);
 
-  VarAttr* list = getVaListByClass(C);
-  uint32_t count = getVaCountByClass(C);
+    // If we have to store function frame pointer we have to count it as well,
+    // because it is the first thing pushed on the stack.
+    if (func->hasStackFrameReg() && func->isStackFrameRegPreserved())
+      v += regSize;
 
-  X86VarState* state = getState();
-  VarData** sVars = state->getListByClass(C);
+    // Count push/pop sequence.
+    v += func->getPushPopStackSize();
 
-  uint32_t i;
-  bool didWork;
+    // Count save/restore sequence for XMM registers (should be already aligned).
+    v += func->getMoveStackSize();
 
-  do {
-    didWork = false;
-    for (i = 0; i < count; i++) {
-      VarAttr* aVa = &list[i];
-      VarData* aVd = aVa->getVd();
+    // Maximum memory required to call all functions within this function.
+    v += func->getCallStackSize();
 
-      if ((aVa->getFlags() & (kVarAttrRReg | kVarAttrAllocRDone)) != kVarAttrRReg)
-        continue;
+    // Calculate the final offset to keep stack alignment.
+    func->_alignStackSize = Utils::alignDiff<uint32_t>(v, func->getRequiredStackAlignment());
+  }
 
-      uint32_t aIndex = aVd->getRegIndex();
-      uint32_t bIndex = aVa->getInRegIndex();
+  // Memory stack size.
+  func->_memStackSize = self->_memAllTotal;
+  func->_alignedMemStackSize = Utils::alignTo<uint32_t>(func->_memStackSize, func->getRequiredStackAlignment());
 
-      // Shouldn't be the same.
-      ASMJIT_ASSERT(aIndex != bIndex);
+  if (func->isNaked()) {
+    self->_argBaseReg = kX86RegIndexSp;
 
-      VarData* bVd = getState()->getListByClass(C)[bIndex];
-      if (bVd != nullptr) {
-        VarAttr* bVa = bVd->getVa();
+    if (func->isStackAdjusted()) {
+      if (func->isStackMisaligned()) {
+        self->_argBaseOffset = static_cast<int32_t>(
+          func->getCallStackSize() +
+          func->getAlignedMemStackSize() +
+          func->getMoveStackSize() +
+          func->getAlignStackSize());
+        self->_argBaseOffset -= regSize;
+      }
+      else {
+        self->_argBaseOffset = static_cast<int32_t>(
+          func->getCallStackSize() +
+          func->getAlignedMemStackSize() +
+          func->getMoveStackSize() +
+          func->getPushPopStackSize() +
+          func->getExtraStackSize() +
+          func->getAlignStackSize());
+      }
+    }
+    else {
+      self->_argBaseOffset = func->getPushPopStackSize();
+    }
+  }
+  else {
+    self->_argBaseReg = kX86RegIndexBp;
+    // Caused by "push zbp".
+    self->_argBaseOffset = regSize;
+  }
 
-        // Gp registers only - Swap two registers if we can solve two
-        // allocation tasks by a single 'xchg' instruction, swapping
-        // two registers required by the instruction/node or one register
-        // required with another non-required.
-        if (C == kX86RegClassGp) {
-          _context->swapGp(aVd, bVd);
+  self->_varBaseReg = kX86RegIndexSp;
+  self->_varBaseOffset = func->getCallStackSize();
 
-          aVa->orFlags(kVarAttrAllocRDone);
-          addVaDone(C);
+  if (!func->isStackAdjusted()) {
+    self->_varBaseOffset = -static_cast<int32_t>(
+      func->_alignStackSize +
+      func->_alignedMemStackSize +
+      func->_moveStackSize);
+  }
 
-          // Doublehit, two registers allocated by a single swap.
-          if (bVa != nullptr && bVa->getInRegIndex() == aIndex) {
-            bVa->orFlags(kVarAttrAllocRDone);
-            addVaDone(C);
-          }
+  return kErrorOk;
+}
 
-          didWork = true;
-          continue;
-        }
-      }
-      else if (aIndex != kInvalidReg) {
-        _context->move<C>(aVd, bIndex);
-        _context->_clobberedRegs.or_(C, Utils::mask(bIndex));
+//! \internal
+static Error X86Context_patchFuncMem(X86Context* self, X86FuncNode* func, HLNode* stop) {
+  X86Compiler* compiler = self->getCompiler();
+  HLNode* node = func;
 
-        aVa->orFlags(kVarAttrAllocRDone);
-        addVaDone(C);
+  do {
+    if (node->getType() == HLNode::kTypeInst) {
+      HLInst* iNode = static_cast<HLInst*>(node);
 
-        didWork = true;
-        continue;
-      }
-      else {
-        _context->alloc<C>(aVd, bIndex);
-        _context->_clobberedRegs.or_(C, Utils::mask(bIndex));
+      if (iNode->hasMemOp()) {
+        X86Mem* m = iNode->getMemOp<X86Mem>();
 
-        aVa->orFlags(kVarAttrAllocRDone);
-        addVaDone(C);
+        if (m->getMemType() == kMemTypeStackIndex && OperandUtil::isVarId(m->getBase())) {
+          VarData* vd = compiler->getVdById(m->getBase());
+          ASMJIT_ASSERT(vd != nullptr);
+
+          if (vd->isMemArg()) {
+            m->_vmem.base = self->_argBaseReg;
+            m->_vmem.displacement += self->_argBaseOffset + vd->getMemOffset();
+          }
+          else {
+            VarCell* cell = vd->getMemCell();
+            ASMJIT_ASSERT(cell != nullptr);
 
-        didWork = true;
-        continue;
+            m->_vmem.base = self->_varBaseReg;
+            m->_vmem.displacement += self->_varBaseOffset + cell->getOffset();
+          }
+        }
       }
     }
-  } while (didWork);
-}
 
-// ============================================================================
-// [asmjit::X86CallAlloc - AllocImmsOnStack]
-// ============================================================================
+    node = node->getNext();
+  } while (node != stop);
 
-ASMJIT_INLINE void X86CallAlloc::allocImmsOnStack() {
-  X86CallNode* node = getNode();
-  X86FuncDecl* decl = node->getDecl();
+  return kErrorOk;
+}
 
-  uint32_t argCount = decl->getNumArgs();
-  Operand* args = node->_args;
+//! \internal
+static Error X86Context_translatePrologEpilog(X86Context* self, X86FuncNode* func) {
+  X86Compiler* compiler = self->getCompiler();
+  X86FuncDecl* decl = func->getDecl();
 
-  for (uint32_t i = 0; i < argCount; i++) {
-    Operand& op = args[i];
+  uint32_t regSize = compiler->getRegSize();
 
-    if (!op.isImm())
-      continue;
+  int32_t stackSize = static_cast<int32_t>(
+    func->getAlignStackSize() +
+    func->getCallStackSize() +
+    func->getAlignedMemStackSize() +
+    func->getMoveStackSize() +
+    func->getExtraStackSize());
+  int32_t stackAlignment = func->getRequiredStackAlignment();
 
-    const Imm& imm = static_cast<const Imm&>(op);
-    const FuncInOut& arg = decl->getArg(i);
-    uint32_t varType = arg.getVarType();
+  int32_t stackBase;
+  int32_t stackPtr;
 
-    if (arg.hasStackOffset()) {
-      X86Mem dst = x86::ptr(_context->_zsp, -static_cast<int>(_context->getRegSize()) + arg.getStackOffset());
-      _context->emitMoveImmOnStack(varType, &dst, &imm);
-    }
-    else {
-      _context->emitMoveImmToReg(varType, arg.getRegIndex(), &imm);
-    }
+  if (func->isStackAdjusted()) {
+    stackBase = static_cast<int32_t>(
+      func->getCallStackSize() +
+      func->getAlignedMemStackSize());
+  }
+  else {
+    stackBase = -static_cast<int32_t>(
+      func->getAlignedMemStackSize() +
+      func->getAlignStackSize() +
+      func->getExtraStackSize());
   }
-}
-
-// ============================================================================
-// [asmjit::X86CallAlloc - Duplicate]
-// ============================================================================
 
-template<int C>
-ASMJIT_INLINE void X86CallAlloc::duplicate() {
-  VarAttr* list = getVaListByClass(C);
-  uint32_t count = getVaCountByClass(C);
+  uint32_t i, mask;
+  uint32_t regsGp  = func->getSaveRestoreRegs(kX86RegClassGp );
+  uint32_t regsMm  = func->getSaveRestoreRegs(kX86RegClassMm );
+  uint32_t regsXmm = func->getSaveRestoreRegs(kX86RegClassXyz);
 
-  for (uint32_t i = 0; i < count; i++) {
-    VarAttr* va = &list[i];
-    if (!va->hasFlag(kVarAttrRReg))
-      continue;
+  bool earlyPushPop = false;
+  bool useLeaEpilog = false;
 
-    uint32_t inRegs = va->getInRegs();
-    if (!inRegs)
-      continue;
+  X86GpReg gpReg(self->_zsp);
+  X86GpReg fpReg(self->_zbp);
 
-    VarData* vd = va->getVd();
-    uint32_t regIndex = vd->getRegIndex();
+  X86Mem fpOffset;
 
-    ASMJIT_ASSERT(regIndex != kInvalidReg);
+  // --------------------------------------------------------------------------
+  // [Prolog]
+  // --------------------------------------------------------------------------
 
-    inRegs &= ~Utils::mask(regIndex);
-    if (!inRegs)
-      continue;
+  compiler->_setCursor(func->getEntryNode());
 
-    for (uint32_t dupIndex = 0; inRegs != 0; dupIndex++, inRegs >>= 1) {
-      if (inRegs & 0x1) {
-        _context->emitMove(vd, dupIndex, regIndex, "Duplicate");
-        _context->_clobberedRegs.or_(C, Utils::mask(dupIndex));
-      }
+  // Call counter, incremented before anything else so there is no need to
+  // preserve the register used to address it (r11 is never used to pass
+  // arguments and it's always clobbered by the callee in 64-bit mode).
+  uint32_t* callCounter = func->getCallCounter();
+  if (callCounter != nullptr) {
+    if (regSize == 8) {
+      X86GpReg tmpReg = x86::r11;
+      compiler->emit(kX86InstIdMov, tmpReg, imm_ptr(callCounter));
+      compiler->emit(kX86InstIdInc, x86::dword_ptr(tmpReg));
+    }
+    else {
+      compiler->emit(kX86InstIdInc, x86::dword_ptr_abs(static_cast<Ptr>((uintptr_t)callCounter)));
     }
   }
-}
-
-// ============================================================================
-// [asmjit::X86CallAlloc - GuessAlloc / GuessSpill]
-// ============================================================================
-
-template<int C>
-ASMJIT_INLINE uint32_t X86CallAlloc::guessAlloc(VarData* vd, uint32_t allocableRegs) {
-  ASMJIT_ASSERT(allocableRegs != 0);
-
-  // Stop now if there is only one bit (register) set in 'allocableRegs' mask.
-  if (Utils::isPowerOf2(allocableRegs))
-    return allocableRegs;
 
-  uint32_t i;
-  uint32_t safeRegs = allocableRegs;
-  uint32_t maxLookAhead = _compiler->getMaxLookAhead();
+  // Entry.
+  if (func->isNaked()) {
+    if (func->isStackMisaligned()) {
+      fpReg.setIndex(func->getStackFrameRegIndex());
+      fpOffset = x86::ptr(self->_zsp, self->_varBaseOffset + static_cast<int32_t>(self->_stackFrameCell->getOffset()));
 
-  // Look ahead and calculate mask of special registers on both - input/output.
-  HLNode* node = _node;
-  for (i = 0; i < maxLookAhead; i++) {
-    // Stop on 'HLRet' and 'HLSentinel.
-    if (node->hasFlag(HLNode::kFlagIsRet))
-      break;
+      earlyPushPop = true;
+      self->emitPushSequence(regsGp);
 
-    // Stop on conditional jump, we don't follow them.
-    if (node->hasFlag(HLNode::kFlagIsJcc))
-      break;
+      if (func->isStackFrameRegPreserved())
+        compiler->emit(kX86InstIdPush, fpReg);
 
-    // Advance on non-conditional jump.
-    if (node->hasFlag(HLNode::kFlagIsJmp)) {
-      node = static_cast<HLJump*>(node)->getTarget();
-      // Stop on jump that is not followed.
-      if (node == nullptr)
-        break;
+      compiler->emit(kX86InstIdMov, fpReg, self->_zsp);
     }
+  }
+  else {
+    compiler->emit(kX86InstIdPush, fpReg);
+    compiler->emit(kX86InstIdMov, fpReg, self->_zsp);
+  }
 
-    node = node->getNext();
-    ASMJIT_ASSERT(node != nullptr);
+  if (!earlyPushPop) {
+    self->emitPushSequence(regsGp);
+    if (func->isStackMisaligned() && regsGp != 0)
+      useLeaEpilog = true;
+  }
 
-    X86VarMap* map = node->getMap<X86VarMap>();
-    if (map != nullptr) {
-      VarAttr* va = map->findVaByClass(C, vd);
-      if (va != nullptr) {
-        uint32_t inRegs = va->getInRegs();
-        if (inRegs != 0) {
-          safeRegs = allocableRegs;
-          allocableRegs &= inRegs;
+  // Adjust stack pointer.
+  if (func->isStackAdjusted()) {
+    stackBase = static_cast<int32_t>(func->getAlignedMemStackSize() + func->getCallStackSize());
 
-          if (allocableRegs == 0)
-            goto _UseSafeRegs;
-          else
-            return allocableRegs;
-        }
-      }
+    if (stackSize)
+      compiler->emit(kX86InstIdSub, self->_zsp, stackSize);
 
-      safeRegs = allocableRegs;
-      allocableRegs &= ~(map->_inRegs.get(C) | map->_outRegs.get(C) | map->_clobberedRegs.get(C));
+    if (func->isStackMisaligned())
+      compiler->emit(kX86InstIdAnd, self->_zsp, -stackAlignment);
 
-      if (allocableRegs == 0)
-        break;
-    }
+    if (func->isStackMisaligned() && func->isNaked())
+      compiler->emit(kX86InstIdMov, fpOffset, fpReg);
+  }
+  else {
+    stackBase = -static_cast<int32_t>(func->getAlignStackSize() + func->getMoveStackSize());
   }
 
-_UseSafeRegs:
-  return safeRegs;
-}
-
-template<int C>
-ASMJIT_INLINE uint32_t X86CallAlloc::guessSpill(VarData* vd, uint32_t allocableRegs) {
-  ASMJIT_ASSERT(allocableRegs != 0);
-
-  return 0;
-}
+  // Save XMM/MMX/GP (Mov).
+  stackPtr = stackBase;
+  for (i = 0, mask = regsXmm; mask != 0; i++, mask >>= 1) {
+    if (mask & 0x1) {
+      compiler->emit(kX86InstIdMovaps, x86::oword_ptr(self->_zsp, stackPtr), x86::xmm(i));
+      stackPtr += 16;
+    }
+  }
 
-// ============================================================================
-// [asmjit::X86CallAlloc - Save]
-// ============================================================================
+  for (i = 0, mask = regsMm; mask != 0; i++, mask >>= 1) {
+    if (mask & 0x1) {
+      compiler->emit(kX86InstIdMovq, x86::qword_ptr(self->_zsp, stackPtr), x86::mm(i));
+      stackPtr += 8;
+    }
+  }
 
-template<int C>
-ASMJIT_INLINE void X86CallAlloc::save() {
-  X86VarState* state = getState();
-  VarData** sVars = state->getListByClass(C);
+  // --------------------------------------------------------------------------
+  // [Move-Args]
+  // --------------------------------------------------------------------------
 
-  uint32_t i;
-  uint32_t affected = _map->_clobberedRegs.get(C) & state->_occupied.get(C) & state->_modified.get(C);
+  if (func->hasFuncFlag(kFuncFlagX86MoveArgs)) {
+    uint32_t argStackPos = 0;
+    uint32_t argStackSize = decl->getArgStackSize();
 
-  for (i = 0; affected != 0; i++, affected >>= 1) {
-    if (affected & 0x1) {
-      VarData* vd = sVars[i];
-      ASMJIT_ASSERT(vd != nullptr);
-      ASMJIT_ASSERT(vd->isModified());
+    uint32_t moveIndex = 0;
+    uint32_t moveCount = (argStackSize + regSize - 1) / regSize;
 
-      VarAttr* va = vd->getVa();
-      if (va == nullptr || (va->getFlags() & (kVarAttrWReg | kVarAttrUnuse)) == 0) {
-        _context->save<C>(vd);
-      }
-    }
-  }
-}
+    X86GpReg r[8];
+    uint32_t numRegs = 0;
 
-// ============================================================================
-// [asmjit::X86CallAlloc - Clobber]
-// ============================================================================
+    for (i = 0; i < ASMJIT_ARRAY_SIZE(func->_stackFrameCopyGpIndex); i++)
+      if (func->_stackFrameCopyGpIndex[i] != kInvalidReg)
+        r[numRegs++] = gpReg.setIndex(func->_stackFrameCopyGpIndex[i]);
+    ASMJIT_ASSERT(numRegs > 0);
 
-template<int C>
-ASMJIT_INLINE void X86CallAlloc::clobber() {
-  X86VarState* state = getState();
-  VarData** sVars = state->getListByClass(C);
+    int32_t dSrc = func->getPushPopStackSize() + regSize;
+    int32_t dDst = func->getAlignStackSize() +
+                   func->getCallStackSize() +
+                   func->getAlignedMemStackSize() +
+                   func->getMoveStackSize();
 
-  uint32_t i;
-  uint32_t affected = _map->_clobberedRegs.get(C) & state->_occupied.get(C);
+    if (func->isStackFrameRegPreserved())
+      dSrc += regSize;
 
-  for (i = 0; affected != 0; i++, affected >>= 1) {
-    if (affected & 0x1) {
-      VarData* vd = sVars[i];
-      ASMJIT_ASSERT(vd != nullptr);
+    X86Mem mSrc = x86::ptr(fpReg, dSrc);
+    X86Mem mDst = x86::ptr(self->_zsp, dDst);
 
-      VarAttr* va = vd->getVa();
-      uint32_t vdState = kVarStateNone;
+    while (moveIndex < moveCount) {
+      uint32_t numMovs = Utils::iMin<uint32_t>(moveCount - moveIndex, numRegs);
 
-      if (!vd->isModified() || (va != nullptr && (va->getFlags() & (kVarAttrWAll | kVarAttrUnuse)) != 0)) {
-        vdState = kVarStateMem;
-      }
+      for (i = 0; i < numMovs; i++)
+        compiler->emit(kX86InstIdMov, r[i], mSrc.adjusted((moveIndex + i) * regSize));
+      for (i = 0; i < numMovs; i++)
+        compiler->emit(kX86InstIdMov, mDst.adjusted((moveIndex + i) * regSize), r[i]);
 
-      _context->unuse<C>(vd, vdState);
+      argStackPos += numMovs * regSize;
+      moveIndex += numMovs;
     }
   }
-}
-
-// ============================================================================
-// [asmjit::X86CallAlloc - Ret]
-// ============================================================================
-
-ASMJIT_INLINE void X86CallAlloc::ret() {
-  X86CallNode* node = getNode();
-  X86FuncDecl* decl = node->getDecl();
 
-  uint32_t i;
-  Operand* rets = node->_ret;
+  // --------------------------------------------------------------------------
+  // [Epilog]
+  // --------------------------------------------------------------------------
 
-  for (i = 0; i < 2; i++) {
-    const FuncInOut& ret = decl->getRet(i);
-    Operand* op = &rets[i];
+  compiler->_setCursor(func->getExitNode());
 
-    if (!ret.hasRegIndex() || !op->isVar())
-      continue;
+  // Restore XMM/MMX/GP (Mov).
+  stackPtr = stackBase;
+  for (i = 0, mask = regsXmm; mask != 0; i++, mask >>= 1) {
+    if (mask & 0x1) {
+      compiler->emit(kX86InstIdMovaps, x86::xmm(i), x86::oword_ptr(self->_zsp, stackPtr));
+      stackPtr += 16;
+    }
+  }
 
-    VarData* vd = _compiler->getVdById(op->getId());
-    uint32_t vf = _x86VarInfo[vd->getType()].getFlags();
-    uint32_t regIndex = ret.getRegIndex();
+  for (i = 0, mask = regsMm; mask != 0; i++, mask >>= 1) {
+    if (mask & 0x1) {
+      compiler->emit(kX86InstIdMovq, x86::mm(i), x86::qword_ptr(self->_zsp, stackPtr));
+      stackPtr += 8;
+    }
+  }
 
-    switch (vd->getClass()) {
-      case kX86RegClassGp:
-        ASMJIT_ASSERT(x86VarTypeToClass(ret.getVarType()) == vd->getClass());
+  // Adjust stack.
+  if (useLeaEpilog) {
+    compiler->emit(kX86InstIdLea, self->_zsp, x86::ptr(fpReg, -static_cast<int32_t>(func->getPushPopStackSize())));
+  }
+  else if (!func->isStackMisaligned()) {
+    if (func->isStackAdjusted() && stackSize != 0)
+      compiler->emit(kX86InstIdAdd, self->_zsp, stackSize);
+  }
 
-        _context->unuse<kX86RegClassGp>(vd);
-        _context->attach<kX86RegClassGp>(vd, regIndex, true);
-        break;
+  // Restore Gp (Push/Pop).
+  if (!earlyPushPop)
+    self->emitPopSequence(regsGp);
 
-      case kX86RegClassMm:
-        ASMJIT_ASSERT(x86VarTypeToClass(ret.getVarType()) == vd->getClass());
+  // Emms.
+  if (func->hasFuncFlag(kFuncFlagX86Emms))
+    compiler->emit(kX86InstIdEmms);
 
-        _context->unuse<kX86RegClassMm>(vd);
-        _context->attach<kX86RegClassMm>(vd, regIndex, true);
-        break;
+  // MFence/SFence/LFence.
+  if (func->hasFuncFlag(kFuncFlagX86SFence) & func->hasFuncFlag(kFuncFlagX86LFence))
+    compiler->emit(kX86InstIdMfence);
+  else if (func->hasFuncFlag(kFuncFlagX86SFence))
+    compiler->emit(kX86InstIdSfence);
+  else if (func->hasFuncFlag(kFuncFlagX86LFence))
+    compiler->emit(kX86InstIdLfence);
 
-      case kX86RegClassXyz:
-        if (ret.getVarType() == kVarTypeFp32 || ret.getVarType() == kVarTypeFp64) {
-          X86Mem m = _context->getVarMem(vd);
-          m.setSize(
-            (vf & VarInfo::kFlagSP) ? 4 :
-            (vf & VarInfo::kFlagDP) ? 8 :
-            (ret.getVarType() == kVarTypeFp32) ? 4 : 8);
+  // Leave.
+  if (func->isNaked()) {
+    if (func->isStackMisaligned()) {
+      compiler->emit(kX86InstIdMov, self->_zsp, fpOffset);
 
-          _context->unuse<kX86RegClassXyz>(vd, kVarStateMem);
-          _compiler->fstp(m);
-        }
-        else {
-          ASMJIT_ASSERT(x86VarTypeToClass(ret.getVarType()) == vd->getClass());
+      if (func->isStackFrameRegPreserved())
+        compiler->emit(kX86InstIdPop, fpReg);
 
-          _context->unuse<kX86RegClassXyz>(vd);
-          _context->attach<kX86RegClassXyz>(vd, regIndex, true);
-        }
-        break;
+      if (earlyPushPop)
+        self->emitPopSequence(regsGp);
+    }
+  }
+  else {
+    if (useLeaEpilog) {
+      compiler->emit(kX86InstIdPop, fpReg);
+    }
+    else if (func->hasFuncFlag(kFuncFlagX86Leave)) {
+      compiler->emit(kX86InstIdLeave);
+    }
+    else {
+      compiler->emit(kX86InstIdMov, self->_zsp, fpReg);
+      compiler->emit(kX86InstIdPop, fpReg);
     }
   }
+
+  // Emit return.
+  if (decl->getCalleePopsStack())
+    compiler->emit(kX86InstIdRet, static_cast<int32_t>(decl->getArgStackSize()));
+  else
+    compiler->emit(kX86InstIdRet);
+
+  return kErrorOk;
 }
 
 // ============================================================================
-// [asmjit::X86Context - TranslateOperands]
+// [asmjit::X86Context - Translate - Jump]
 // ============================================================================
 
 //! \internal
-static Error X86Context_translateOperands(X86Context* self, Operand* opList, uint32_t opCount) {
+static void X86Context_translateJump(X86Context* self, HLJump* jNode, HLLabel* jTarget) {
   X86Compiler* compiler = self->getCompiler();
-  uint32_t hasGpdBase = compiler->getRegSize() == 4;
-
-  // Translate variables into registers.
-  for (uint32_t i = 0; i < opCount; i++) {
-    Operand* op = &opList[i];
-
-    if (op->isVar()) {
-      VarData* vd = compiler->getVdById(op->getId());
-      ASMJIT_ASSERT(vd != nullptr);
-      ASMJIT_ASSERT(vd->getRegIndex() != kInvalidReg);
+  HLNode* extNode = self->getExtraBlock();
 
-      op->_vreg.op = Operand::kTypeReg;
-      op->_vreg.index = vd->getRegIndex();
-    }
-    else if (op->isMem()) {
-      X86Mem* m = static_cast<X86Mem*>(op);
+  compiler->_setCursor(extNode);
+  self->switchState(jTarget->getState());
 
-      if (m->isBaseIndexType() && OperandUtil::isVarId(m->getBase())) {
-        VarData* vd = compiler->getVdById(m->getBase());
+  // If one or more instruction has been added during switchState() it will be
+  // moved at the end of the function body.
+  if (compiler->getCursor() != extNode) {
+    // TODO: Can fail.
+    HLLabel* jTrampolineTarget = compiler->newLabelNode();
 
-        if (m->getMemType() == kMemTypeBaseIndex) {
-          ASMJIT_ASSERT(vd->getRegIndex() != kInvalidReg);
-          op->_vmem.base = vd->getRegIndex();
-        }
-        else {
-          if (!vd->isMemArg())
-            self->getVarCell(vd);
+    // Add the jump to the target.
+    compiler->jmp(jTarget->getLabel());
 
-          // Offset will be patched later by X86Context_patchFuncMem().
-          m->setGpdBase(hasGpdBase);
-          m->adjust(vd->isMemArg() ? self->_argActualDisp : self->_varActualDisp);
-        }
-      }
+    // Add the trampoline-label we jump to change the state.
+    extNode = compiler->setCursor(extNode);
+    compiler->addNode(jTrampolineTarget);
 
-      if (OperandUtil::isVarId(m->getIndex())) {
-        VarData* vd = compiler->getVdById(m->getIndex());
-        ASMJIT_ASSERT(vd->getRegIndex() != kInvalidReg);
-        ASMJIT_ASSERT(vd->getRegIndex() != kX86RegIndexR12);
-        op->_vmem.index = vd->getRegIndex();
-      }
-    }
+    // Finally, patch the jump target.
+    ASMJIT_ASSERT(jNode->getOpCount() > 0);
+    jNode->_opList[0] = jTrampolineTarget->getLabel();
+    jNode->_target = jTrampolineTarget;
   }
 
-  return kErrorOk;
+  // Store the `extNode` and load the state back.
+  self->setExtraBlock(extNode);
+  self->loadState(jNode->_state);
 }
 
 // ============================================================================
-// [asmjit::X86Context - TranslatePrologEpilog]
+// [asmjit::X86Context - Translate - Ret]
 // ============================================================================
 
-//! \internal
-static Error X86Context_initFunc(X86Context* self, X86FuncNode* func) {
+static Error X86Context_translateRet(X86Context* self, HLRet* rNode, HLLabel* exitTarget) {
   X86Compiler* compiler = self->getCompiler();
-  X86FuncDecl* decl = func->getDecl();
+  HLNode* node = rNode->getNext();
 
-  X86RegMask& clobberedRegs = self->_clobberedRegs;
-  uint32_t regSize = compiler->getRegSize();
+  // 32-bit mode requires to push floating point return value(s), handle it
+  // here as it's a special case.
+  X86VarMap* map = rNode->getMap<X86VarMap>();
+  if (map != nullptr) {
+    VarAttr* vaList = map->getVaList();
+    uint32_t vaCount = map->getVaCount();
 
-  // Setup "Save-Restore" registers.
-  func->_saveRestoreRegs.set(kX86RegClassGp , clobberedRegs.get(kX86RegClassGp ) & decl->getPreserved(kX86RegClassGp ));
-  func->_saveRestoreRegs.set(kX86RegClassMm , clobberedRegs.get(kX86RegClassMm ) & decl->getPreserved(kX86RegClassMm ));
-  func->_saveRestoreRegs.set(kX86RegClassK  , 0);
-  func->_saveRestoreRegs.set(kX86RegClassXyz, clobberedRegs.get(kX86RegClassXyz) & decl->getPreserved(kX86RegClassXyz));
+    for (uint32_t i = 0; i < vaCount; i++) {
+      VarAttr& va = vaList[i];
+      if (va.hasFlag(kVarAttrX86Fld4 | kVarAttrX86Fld8)) {
+        VarData* vd = va.getVd();
+        X86Mem m(self->getVarMem(vd));
 
-  ASMJIT_ASSERT(!func->_saveRestoreRegs.has(kX86RegClassGp, Utils::mask(kX86RegIndexSp)));
+        uint32_t flags = _x86VarInfo[vd->getType()].getFlags();
+        m.setSize(
+          (flags & VarInfo::kFlagSP) ? 4 :
+          (flags & VarInfo::kFlagDP) ? 8 :
+          va.hasFlag(kVarAttrX86Fld4) ? 4 : 8);
 
-  // Setup required stack alignment and kFuncFlagIsStackMisaligned.
-  {
-    uint32_t requiredStackAlignment = Utils::iMax(self->_memMaxAlign, self->getRegSize());
+        compiler->fld(m);
+      }
+    }
+  }
+
+  // Decide whether to `jmp` or not in case we are next to the return label.
+  while (node != nullptr) {
+    switch (node->getType()) {
+      // If we have found an exit label we just return, there is no need to
+      // emit jump to that.
+      case HLNode::kTypeLabel:
+        if (static_cast<HLLabel*>(node) == exitTarget)
+          return kErrorOk;
+        goto _EmitRet;
+
+      case HLNode::kTypeData:
+      case HLNode::kTypeInst:
+      case HLNode::kTypeCall:
+      case HLNode::kTypeRet:
+        goto _EmitRet;
+
+      // Continue iterating.
+      case HLNode::kTypeComment:
+      case HLNode::kTypeAlign:
+      case HLNode::kTypeHint:
+        break;
+
+      // Invalid node to be here.
+      case HLNode::kTypeFunc:
+        return self->getCompiler()->setLastError(kErrorInvalidState);
 
-    if (requiredStackAlignment < 16) {
-      // Require 16-byte alignment if 8-byte vars are used.
-      if (self->_mem8ByteVarsUsed)
-        requiredStackAlignment = 16;
-      else if (func->_saveRestoreRegs.get(kX86RegClassMm) || func->_saveRestoreRegs.get(kX86RegClassXyz))
-        requiredStackAlignment = 16;
-      else if (Utils::inInterval<uint32_t>(func->getRequiredStackAlignment(), 8, 16))
-        requiredStackAlignment = 16;
+      // We can't go forward from here.
+      case HLNode::kTypeSentinel:
+        return kErrorOk;
     }
 
-    if (func->getRequiredStackAlignment() < requiredStackAlignment)
-      func->setRequiredStackAlignment(requiredStackAlignment);
-
-    func->updateRequiredStackAlignment();
+    node = node->getNext();
   }
 
-  // Adjust stack pointer if function is caller.
-  if (func->isCaller()) {
-    func->addFuncFlags(kFuncFlagIsStackAdjusted);
-    func->_callStackSize = Utils::alignTo<uint32_t>(func->getCallStackSize(), func->getRequiredStackAlignment());
+_EmitRet:
+  {
+    compiler->_setCursor(rNode);
+    compiler->jmp(exitTarget->getLabel());
   }
+  return kErrorOk;
+}
 
-  // Adjust stack pointer if manual stack alignment is needed.
-  if (func->isStackMisaligned() && func->isNaked()) {
-    // Get a memory cell where the original stack frame will be stored.
-    VarCell* cell = self->_newStackCell(regSize, regSize);
-    if (cell == nullptr)
-      return self->getLastError(); // The error has already been set.
+// ============================================================================
+// [asmjit::X86Context - Translate - Baseline]
+// ============================================================================
 
-    func->addFuncFlags(kFuncFlagIsStackAdjusted);
-    self->_stackFrameCell = cell;
+//! \internal
+//!
+//! Spill all variables of class `C` that are allocated in registers.
+template<int C>
+static ASMJIT_INLINE void X86Context_spillStateVars(X86Context* self) {
+  X86VarState* state = self->getState();
+  VarData** sVars = state->getListByClass(C);
 
-    if (decl->getArgStackSize() > 0) {
-      func->addFuncFlags(kFuncFlagX86MoveArgs);
-      func->setExtraStackSize(decl->getArgStackSize());
-    }
+  uint32_t i;
+  uint32_t occupied = state->_occupied.get(C);
 
-    // Get temporary register which will be used to align the stack frame.
-    uint32_t fRegMask = Utils::bits(self->_regCount.getGp());
-    uint32_t stackFrameCopyRegs;
+  for (i = 0; occupied != 0; i++, occupied >>= 1) {
+    if (occupied & 0x1)
+      self->spill<C>(sVars[i]);
+  }
+}
 
-    fRegMask &= ~(decl->getUsed(kX86RegClassGp) | Utils::mask(kX86RegIndexSp));
-    stackFrameCopyRegs = fRegMask;
+//! \internal
+//!
+//! Spill all variables after `node` (baseline allocation).
+//!
+//! Called after each node that is not a jump, so all variables are in memory
+//! at every jump and label and states never have to be merged.
+static void X86Context_spillAfter(X86Context* self, HLNode* node) {
+  // Calls leave the cursor after the code that handles the return value.
+  if (node->getType() != HLNode::kTypeCall)
+    self->getCompiler()->_setCursor(node);
+
+  X86Context_spillStateVars<kX86RegClassGp >(self);
+  X86Context_spillStateVars<kX86RegClassMm >(self);
+  X86Context_spillStateVars<kX86RegClassXyz>(self);
+}
 
-    // Try to remove modified registers from the mask.
-    uint32_t tRegMask = fRegMask & ~self->getClobberedRegs(kX86RegClassGp);
-    if (tRegMask != 0)
-      fRegMask = tRegMask;
+// ============================================================================
+// [asmjit::X86Context - Translate - Func]
+// ============================================================================
 
-    // Try to remove preserved registers from the mask.
-    tRegMask = fRegMask & ~decl->getPreserved(kX86RegClassGp);
-    if (tRegMask != 0)
-      fRegMask = tRegMask;
+Error X86Context::translate() {
+  ASMJIT_TLOG("[T] ======= Translate (Begin)\n");
 
-    ASMJIT_ASSERT(fRegMask != 0);
+  X86Compiler* compiler = getCompiler();
+  X86FuncNode* func = getFunc();
 
-    uint32_t fRegIndex = Utils::findFirstBit(fRegMask);
-    func->_stackFrameRegIndex = static_cast<uint8_t>(fRegIndex);
+  // Register allocator contexts.
+  X86VarAlloc vAlloc(this);
+  X86CallAlloc cAlloc(this);
 
-    // We have to save the register on the stack (it will be the part of prolog
-    // and epilog), however we shouldn't save it twice, so we will remove it
-    // from '_saveRestoreRegs' in case that it is preserved.
-    fRegMask = Utils::mask(fRegIndex);
-    if ((fRegMask & decl->getPreserved(kX86RegClassGp)) != 0) {
-      func->_saveRestoreRegs.andNot(kX86RegClassGp, fRegMask);
-      func->_isStackFrameRegPreserved = true;
-    }
+  bool baseline = compiler->hasFeature(kCompilerFeatureBaseline);
 
-    if (func->hasFuncFlag(kFuncFlagX86MoveArgs)) {
-      uint32_t maxRegs = (func->getArgStackSize() + regSize - 1) / regSize;
-      stackFrameCopyRegs &= ~fRegMask;
+  // Flow.
+  HLNode* node_ = func;
+  HLNode* next = nullptr;
+  HLNode* stop = getStop();
 
-      tRegMask = stackFrameCopyRegs & self->getClobberedRegs(kX86RegClassGp);
-      uint32_t tRegCnt = Utils::bitCount(tRegMask);
+  PodList<HLNode*>::Link* jLink = _jccList.getFirst();
 
-      if (tRegCnt > 1 || (tRegCnt > 0 && tRegCnt <= maxRegs))
-        stackFrameCopyRegs = tRegMask;
-      else
-        stackFrameCopyRegs = Utils::keepNOnesFromRight(stackFrameCopyRegs, Utils::iMin<uint32_t>(maxRegs, 2));
+  for (;;) {
+    while (node_->isTranslated()) {
+      // Switch state if we went to the already translated node.
+      if (node_->getType() == HLNode::kTypeLabel) {
+        HLLabel* node = static_cast<HLLabel*>(node_);
+        compiler->_setCursor(node->getPrev());
+        switchState(node->getState());
+      }
 
-      func->_saveRestoreRegs.or_(kX86RegClassGp, stackFrameCopyRegs & decl->getPreserved(kX86RegClassGp));
-      Utils::indexNOnesFromRight(func->_stackFrameCopyGpIndex, stackFrameCopyRegs, maxRegs);
-    }
-  }
-  // If function is not naked we generate standard "EBP/RBP" stack frame.
-  else if (!func->isNaked()) {
-    uint32_t fRegIndex = kX86RegIndexBp;
+_NextGroup:
+      if (jLink == nullptr) {
+        goto _Done;
+      }
+      else {
+        node_ = jLink->getValue();
+        jLink = jLink->getNext();
 
-    func->_stackFrameRegIndex = static_cast<uint8_t>(fRegIndex);
-    func->_isStackFrameRegPreserved = true;
-  }
+        HLNode* jFlow = X86Context_getOppositeJccFlow(static_cast<HLJump*>(node_));
+        loadState(node_->getState());
 
-  ASMJIT_PROPAGATE_ERROR(self->resolveCellOffsets());
+        if (jFlow->getState()) {
+          X86Context_translateJump(this,
+            static_cast<HLJump*>(node_),
+            static_cast<HLLabel*>(jFlow));
 
-  // Adjust stack pointer if requested memory can't fit into "Red Zone" or "Spill Zone".
-  if (self->_memAllTotal > Utils::iMax<uint32_t>(func->getRedZoneSize(), func->getSpillZoneSize())) {
-    func->addFuncFlags(kFuncFlagIsStackAdjusted);
-  }
+          node_ = jFlow;
+          if (node_->isTranslated())
+            goto _NextGroup;
+        }
+        else {
+          node_ = jFlow;
+        }
 
-  // Setup stack size used to save preserved registers.
-  {
-    uint32_t memGpSize  = Utils::bitCount(func->_saveRestoreRegs.get(kX86RegClassGp )) * regSize;
-    uint32_t memMmSize  = Utils::bitCount(func->_saveRestoreRegs.get(kX86RegClassMm )) * 8;
-    uint32_t memXmmSize = Utils::bitCount(func->_saveRestoreRegs.get(kX86RegClassXyz)) * 16;
+        break;
+      }
+    }
 
-    func->_pushPopStackSize = memGpSize;
-    func->_moveStackSize = memXmmSize + Utils::alignTo<uint32_t>(memMmSize, 16);
-  }
+    next = node_->getNext();
+    node_->orFlags(HLNode::kFlagIsTranslated);
 
-  // Setup adjusted stack size.
-  if (func->isStackMisaligned()) {
-    func->_alignStackSize = 0;
-  }
-  else {
-    // If function is aligned, the RETURN address is stored in the aligned
-    // [ZSP - PtrSize] which makes current ZSP unaligned.
-    int32_t v = static_cast<int32_t>(regSize);
+    ASMJIT_TSEC({
+      this->_traceNode(this, node_, "[T] ");
+    });
 
-    // If we have to store function frame pointer we have to count it as well,
-    // because it is the first thing pushed on the stack.
-    if (func->hasStackFrameReg() && func->isStackFrameRegPreserved())
-      v += regSize;
+    switch (node_->getType()) {
+      // ----------------------------------------------------------------------
+      // [Align / Embed]
+      // ----------------------------------------------------------------------
 
-    // Count push/pop sequence.
-    v += func->getPushPopStackSize();
+      case HLNode::kTypeAlign:
+      case HLNode::kTypeData:
+        break;
 
-    // Count save/restore sequence for XMM registers (should be already aligned).
-    v += func->getMoveStackSize();
+      // ----------------------------------------------------------------------
+      // [Target]
+      // ----------------------------------------------------------------------
 
-    // Maximum memory required to call all functions within this function.
-    v += func->getCallStackSize();
+      case HLNode::kTypeLabel: {
+        HLLabel* node = static_cast<HLLabel*>(node_);
+        ASMJIT_ASSERT(!node->hasState());
+        node->setState(saveState());
+        break;
+      }
 
-    // Calculate the final offset to keep stack alignment.
-    func->_alignStackSize = Utils::alignDiff<uint32_t>(v, func->getRequiredStackAlignment());
-  }
+      // ----------------------------------------------------------------------
+      // [Inst/Call/SArg/Ret]
+      // ----------------------------------------------------------------------
 
-  // Memory stack size.
-  func->_memStackSize = self->_memAllTotal;
-  func->_alignedMemStackSize = Utils::alignTo<uint32_t>(func->_memStackSize, func->getRequiredStackAlignment());
+      case HLNode::kTypeInst:
+      case HLNode::kTypeCall:
+      case HLNode::kTypeCallArg:
+        // Update VarAttr's unuse flags based on liveness of the next node.
+        if (!node_->isJcc()) {
+          X86VarMap* map = static_cast<X86VarMap*>(node_->getMap());
+          BitArray* liveness;
 
-  if (func->isNaked()) {
-    self->_argBaseReg = kX86RegIndexSp;
+          if (map != nullptr && next != nullptr && (liveness = next->getLiveness()) != nullptr) {
+            VarAttr* vaList = map->getVaList();
+            uint32_t vaCount = map->getVaCount();
 
-    if (func->isStackAdjusted()) {
-      if (func->isStackMisaligned()) {
-        self->_argBaseOffset = static_cast<int32_t>(
-          func->getCallStackSize() +
-          func->getAlignedMemStackSize() +
-          func->getMoveStackSize() +
-          func->getAlignStackSize());
-        self->_argBaseOffset -= regSize;
-      }
-      else {
-        self->_argBaseOffset = static_cast<int32_t>(
-          func->getCallStackSize() +
-          func->getAlignedMemStackSize() +
-          func->getMoveStackSize() +
-          func->getPushPopStackSize() +
-          func->getExtraStackSize() +
-          func->getAlignStackSize());
-      }
-    }
-    else {
-      self->_argBaseOffset = func->getPushPopStackSize();
-    }
-  }
-  else {
-    self->_argBaseReg = kX86RegIndexBp;
-    // Caused by "push zbp".
-    self->_argBaseOffset = regSize;
-  }
+            for (uint32_t i = 0; i < vaCount; i++) {
+              VarAttr* va = &vaList[i];
+              VarData* vd = va->getVd();
 
-  self->_varBaseReg = kX86RegIndexSp;
-  self->_varBaseOffset = func->getCallStackSize();
+              if (!liveness->getBit(vd->getLocalId()))
+                va->orFlags(kVarAttrUnuse);
+            }
+          }
+        }
 
-  if (!func->isStackAdjusted()) {
-    self->_varBaseOffset = -static_cast<int32_t>(
-      func->_alignStackSize +
-      func->_alignedMemStackSize +
-      func->_moveStackSize);
-  }
+        if (node_->getType() == HLNode::kTypeCall) {
+          ASMJIT_PROPAGATE_ERROR(cAlloc.run(static_cast<X86CallNode*>(node_)));
+          if (baseline)
+            X86Context_spillAfter(this, node_);
+          break;
+        }
+        ASMJIT_FALLTHROUGH;
 
-  return kErrorOk;
-}
+      case HLNode::kTypeHint:
+      case HLNode::kTypeRet: {
+        ASMJIT_PROPAGATE_ERROR(vAlloc.run(node_));
 
-//! \internal
-static Error X86Context_patchFuncMem(X86Context* self, X86FuncNode* func, HLNode* stop) {
-  X86Compiler* compiler = self->getCompiler();
-  HLNode* node = func;
+        // Jumps don't use variables, everything has been spilled before.
+        if (baseline && !node_->isJmpOrJcc())
+          X86Context_spillAfter(this, node_);
 
-  do {
-    if (node->getType() == HLNode::kTypeInst) {
-      HLInst* iNode = static_cast<HLInst*>(node);
+        // Handle conditional/unconditional jump.
+        if (node_->isJmpOrJcc()) {
+          HLJump* node = static_cast<HLJump*>(node_);
+          HLLabel* jTarget = node->getTarget();
 
-      if (iNode->hasMemOp()) {
-        X86Mem* m = iNode->getMemOp<X86Mem>();
+          // Target not followed.
+          if (jTarget == nullptr) {
+            if (node->isJmp())
+              goto _NextGroup;
+            else
+              break;
+          }
 
-        if (m->getMemType() == kMemTypeStackIndex && OperandUtil::isVarId(m->getBase())) {
-          VarData* vd = compiler->getVdById(m->getBase());
-          ASMJIT_ASSERT(vd != nullptr);
+          if (node->isJmp()) {
+            if (jTarget->hasState()) {
+              compiler->_setCursor(node->getPrev());
+              switchState(jTarget->getState());
 
-          if (vd->isMemArg()) {
-            m->_vmem.base = self->_argBaseReg;
-            m->_vmem.displacement += self->_argBaseOffset + vd->getMemOffset();
+              goto _NextGroup;
+            }
+            else {
+              next = jTarget;
+            }
           }
           else {
-            VarCell* cell = vd->getMemCell();
-            ASMJIT_ASSERT(cell != nullptr);
+            HLNode* jNext = node->getNext();
 
-            m->_vmem.base = self->_varBaseReg;
-            m->_vmem.displacement += self->_varBaseOffset + cell->getOffset();
+            if (jTarget->isTranslated()) {
+              if (jNext->isTranslated()) {
+                ASMJIT_ASSERT(jNext->getType() == HLNode::kTypeLabel);
+                compiler->_setCursor(node->getPrev());
+                intersectStates(jTarget->getState(), jNext->getState());
+              }
+
+              VarState* savedState = saveState();
+              node->setState(savedState);
+
+              X86Context_translateJump(this, node, jTarget);
+              next = jNext;
+            }
+            else if (jNext->isTranslated()) {
+              ASMJIT_ASSERT(jNext->getType() == HLNode::kTypeLabel);
+
+              VarState* savedState = saveState();
+              node->setState(savedState);
+
+              compiler->_setCursor(node);
+              switchState(static_cast<HLLabel*>(jNext)->getState());
+              next = jTarget;
+            }
+            else {
+              node->setState(saveState());
+              next = X86Context_getJccFlow(node);
+            }
           }
         }
+        else if (node_->isRet()) {
+          ASMJIT_PROPAGATE_ERROR(
+            X86Context_translateRet(this, static_cast<HLRet*>(node_), func->getExitNode()));
+        }
+        break;
       }
-    }
 
-    node = node->getNext();
-  } while (node != stop);
+      // ----------------------------------------------------------------------
+      // [Func]
+      // ----------------------------------------------------------------------
 
-  return kErrorOk;
-}
+      case HLNode::kTypeFunc: {
+        ASMJIT_ASSERT(node_ == func);
 
-//! \internal
-static Error X86Context_translatePrologEpilog(X86Context* self, X86FuncNode* func) {
-  X86Compiler* compiler = self->getCompiler();
-  X86FuncDecl* decl = func->getDecl();
+        X86FuncDecl* decl = func->getDecl();
+        X86VarMap* map = func->getMap<X86VarMap>();
 
-  uint32_t regSize = compiler->getRegSize();
+        if (map != nullptr) {
+          uint32_t i;
+          uint32_t argCount = func->_x86Decl.getNumArgs();
 
-  int32_t stackSize = static_cast<int32_t>(
-    func->getAlignStackSize() +
-    func->getCallStackSize() +
-    func->getAlignedMemStackSize() +
-    func->getMoveStackSize() +
-    func->getExtraStackSize());
-  int32_t stackAlignment = func->getRequiredStackAlignment();
+          for (i = 0; i < argCount; i++) {
+            const FuncInOut& arg = decl->getArg(i);
 
-  int32_t stackBase;
-  int32_t stackPtr;
+            VarData* vd = func->getArg(i);
+            if (vd == nullptr)
+              continue;
 
-  if (func->isStackAdjusted()) {
-    stackBase = static_cast<int32_t>(
-      func->getCallStackSize() +
-      func->getAlignedMemStackSize());
-  }
-  else {
-    stackBase = -static_cast<int32_t>(
-      func->getAlignedMemStackSize() +
-      func->getAlignStackSize() +
-      func->getExtraStackSize());
-  }
+            VarAttr* va = map->findVa(vd);
+            ASMJIT_ASSERT(va != nullptr);
 
-  uint32_t i, mask;
-  uint32_t regsGp  = func->getSaveRestoreRegs(kX86RegClassGp );
-  uint32_t regsMm  = func->getSaveRestoreRegs(kX86RegClassMm );
-  uint32_t regsXmm = func->getSaveRestoreRegs(kX86RegClassXyz);
+            if (va->getFlags() & kVarAttrUnuse)
+              continue;
 
-  bool earlyPushPop = false;
-  bool useLeaEpilog = false;
+            uint32_t regIndex = va->getOutRegIndex();
+            if (regIndex != kInvalidReg && (va->getFlags() & kVarAttrWConv) == 0) {
+              switch (vd->getClass()) {
+                case kX86RegClassGp : attach<kX86RegClassGp >(vd, regIndex, true); break;
+                case kX86RegClassMm : attach<kX86RegClassMm >(vd, regIndex, true); break;
+                case kX86RegClassXyz: attach<kX86RegClassXyz>(vd, regIndex, true); break;
+              }
+            }
+            else if (va->hasFlag(kVarAttrWConv)) {
+              // TODO: [COMPILER] Function Argument Conversion.
+              ASMJIT_NOT_REACHED();
+            }
+            else {
+              vd->_isMemArg = true;
+              vd->setMemOffset(arg.getStackOffset());
+              vd->setState(kVarStateMem);
+            }
+          }
 
-  X86GpReg gpReg(self->_zsp);
-  X86GpReg fpReg(self->_zbp);
+          // Arguments have to be stored after the prolog (the entry node).
+          if (baseline)
+            X86Context_spillAfter(this, func->getEntryNode());
+        }
+        break;
+      }
 
-  X86Mem fpOffset;
+      // ----------------------------------------------------------------------
+      // [End]
+      // ----------------------------------------------------------------------
 
-  // --------------------------------------------------------------------------
-  // [Prolog]
-  // --------------------------------------------------------------------------
+      case HLNode::kTypeSentinel: {
+        goto _NextGroup;
+      }
 
-  compiler->_setCursor(func->getEntryNode());
+      default:
+        break;
+    }
 
-  // Entry.
-  if (func->isNaked()) {
-    if (func->isStackMisaligned()) {
-      fpReg.setIndex(func->getStackFrameRegIndex());
-      fpOffset = x86::ptr(self->_zsp, self->_varBaseOffset + static_cast<int32_t>(self->_stackFrameCell->getOffset()));
+    if (next == stop)
+      goto _NextGroup;
+    node_ = next;
+  }
 
-      earlyPushPop = true;
-      self->emitPushSequence(regsGp);
+_Done:
+  ASMJIT_PROPAGATE_ERROR(X86Context_initFunc(this, func));
+  ASMJIT_PROPAGATE_ERROR(X86Context_patchFuncMem(this, func, stop));
+  ASMJIT_PROPAGATE_ERROR(X86Context_translatePrologEpilog(this, func));
 
-      if (func->isStackFrameRegPreserved())
-        compiler->emit(kX86InstIdPush, fpReg);
+  ASMJIT_TLOG("[T] ======= Translate (End)\n");
+  return kErrorOk;
+}
 
-      compiler->emit(kX86InstIdMov, fpReg, self->_zsp);
-    }
-  }
-  else {
-    compiler->emit(kX86InstIdPush, fpReg);
-    compiler->emit(kX86InstIdMov, fpReg, self->_zsp);
-  }
+// ============================================================================
+// [asmjit::X86Context - Peephole]
+// ============================================================================
 
-  if (!earlyPushPop) {
-    self->emitPushSequence(regsGp);
-    if (func->isStackMisaligned() && regsGp != 0)
-      useLeaEpilog = true;
-  }
+//! \internal
+//!
+//! Peephole rule handler, returns `true` if `node` has been removed or changed.
+//!
+//! NOTE: The handler is allowed to change or remove only `node`, it can only
+//! look at its neighbours.
+typedef bool (*X86PeepholeFunc)(X86Context* self, HLInst* node);
 
-  // Adjust stack pointer.
-  if (func->isStackAdjusted()) {
-    stackBase = static_cast<int32_t>(func->getAlignedMemStackSize() + func->getCallStackSize());
+//! \internal
+//!
+//! Peephole rule, applied to instructions from `firstId` to `lastId`.
+struct X86PeepholeEntry {
+  //! First instruction id.
+  uint16_t firstId;
+  //! Last instruction id.
+  uint16_t lastId;
+  //! Rule, see \ref X86PeepholeRule.
+  uint32_t rule;
+  //! Handler.
+  X86PeepholeFunc func;
+};
 
-    if (stackSize)
-      compiler->emit(kX86InstIdSub, self->_zsp, stackSize);
+//! \internal
+//!
+//! Get whether operands `a` and `b` are the same register, memory, or immediate.
+static ASMJIT_INLINE bool X86Context_isSameOp(const Operand& a, const Operand& b) {
+  if (a.getOp() != b.getOp())
+    return false;
 
-    if (func->isStackMisaligned())
-      compiler->emit(kX86InstIdAnd, self->_zsp, -stackAlignment);
+  switch (a.getOp()) {
+    case Operand::kTypeReg:
+      return static_cast<const X86Reg&>(a) == static_cast<const X86Reg&>(b);
 
-    if (func->isStackMisaligned() && func->isNaked())
-      compiler->emit(kX86InstIdMov, fpOffset, fpReg);
-  }
-  else {
-    stackBase = -static_cast<int32_t>(func->getAlignStackSize() + func->getMoveStackSize());
+    case Operand::kTypeMem:
+      return static_cast<const X86Mem&>(a) == static_cast<const X86Mem&>(b);
+
+    case Operand::kTypeImm:
+      return static_cast<const Imm&>(a).getInt64() == static_cast<const Imm&>(b).getInt64();
+
+    default:
+      return false;
   }
+}
 
-  // Save XMM/MMX/GP (Mov).
-  stackPtr = stackBase;
-  for (i = 0, mask = regsXmm; mask != 0; i++, mask >>= 1) {
-    if (mask & 0x1) {
-      compiler->emit(kX86InstIdMovaps, x86::oword_ptr(self->_zsp, stackPtr), x86::xmm(i));
-      stackPtr += 16;
-    }
+//! \internal
+//!
+//! Get whether `op` is a stack slot of a variable.
+static ASMJIT_INLINE bool X86Context_isVarMem(const Operand& op) {
+  return op.isMem() && static_cast<const X86Mem&>(op).getMemType() == kMemTypeStackIndex;
+}
+
+//! \internal
+//!
+//! Get an instruction preceding `node` (comments and hints are skipped), or
+//! `nullptr` if there is a label or any other node in between.
+static HLInst* X86Context_getPrevInst(HLNode* node) {
+  for (;;) {
+    node = node->getPrev();
+    if (node == nullptr)
+      return nullptr;
+
+    uint32_t type = node->getType();
+    if (type == HLNode::kTypeInst)
+      return static_cast<HLInst*>(node);
+
+    if (type != HLNode::kTypeComment && type != HLNode::kTypeHint)
+      return nullptr;
   }
+}
 
-  for (i = 0, mask = regsMm; mask != 0; i++, mask >>= 1) {
-    if (mask & 0x1) {
-      compiler->emit(kX86InstIdMovq, x86::qword_ptr(self->_zsp, stackPtr), x86::mm(i));
-      stackPtr += 8;
-    }
+//! \internal
+//!
+//! `mov reg, reg` -> removed.
+static bool X86Peephole_movSelf(X86Context* self, HLInst* node) {
+  if (node->getOpCount() != 2)
+    return false;
+
+  const Operand* opList = node->getOpList();
+  if (!opList[0].isReg() || !X86Context_isSameOp(opList[0], opList[1]))
+    return false;
+
+  uint32_t regType = static_cast<const X86Reg&>(opList[0]).getRegType();
+  bool isNop;
+
+  switch (node->getInstId()) {
+    // 32-bit move clears the high part of 64-bit register.
+    case kX86InstIdMov:
+      isNop = regType <= kX86RegTypeGpq && !(regType == kX86RegTypeGpd && self->getCompiler()->getArch() == kArchX64);
+      break;
+
+    // MOVQ clears the high part of XMM register.
+    case kX86InstIdMovq:
+      isNop = regType == kX86RegTypeMm;
+      break;
+
+    // VEX encoded 128-bit move clears the high part of YMM register.
+    case kX86InstIdVmovaps:
+    case kX86InstIdVmovapd:
+    case kX86InstIdVmovdqa:
+    case kX86InstIdVmovdqu:
+    case kX86InstIdVmovups:
+    case kX86InstIdVmovupd:
+      isNop = regType == kX86RegTypeYmm;
+      break;
+
+    default:
+      isNop = regType == kX86RegTypeXmm;
+      break;
   }
 
-  // --------------------------------------------------------------------------
-  // [Move-Args]
-  // --------------------------------------------------------------------------
+  if (!isNop)
+    return false;
 
-  if (func->hasFuncFlag(kFuncFlagX86MoveArgs)) {
-    uint32_t argStackPos = 0;
-    uint32_t argStackSize = decl->getArgStackSize();
+  self->getCompiler()->removeNode(node);
+  return true;
+}
 
-    uint32_t moveIndex = 0;
-    uint32_t moveCount = (argStackSize + regSize - 1) / regSize;
+//! \internal
+//!
+//! `mov [slot], reg` + `mov reg, [slot]` -> `mov [slot], reg`.
+static bool X86Peephole_loadAfterSave(X86Context* self, HLInst* node) {
+  const Operand* opList = node->getOpList();
+  if (node->getOpCount() != 2 || !opList[0].isReg() || !X86Context_isVarMem(opList[1]))
+    return false;
 
-    X86GpReg r[8];
-    uint32_t numRegs = 0;
+  HLInst* prev = X86Context_getPrevInst(node);
+  if (prev == nullptr || prev->getInstId() != node->getInstId() || prev->getOpCount() != 2)
+    return false;
 
-    for (i = 0; i < ASMJIT_ARRAY_SIZE(func->_stackFrameCopyGpIndex); i++)
-      if (func->_stackFrameCopyGpIndex[i] != kInvalidReg)
-        r[numRegs++] = gpReg.setIndex(func->_stackFrameCopyGpIndex[i]);
-    ASMJIT_ASSERT(numRegs > 0);
+  const Operand* prevList = prev->getOpList();
+  if (!X86Context_isSameOp(prevList[0], opList[1]) || !X86Context_isSameOp(prevList[1], opList[0]))
+    return false;
 
-    int32_t dSrc = func->getPushPopStackSize() + regSize;
-    int32_t dDst = func->getAlignStackSize() +
-                   func->getCallStackSize() +
-                   func->getAlignedMemStackSize() +
-                   func->getMoveStackSize();
+  self->getCompiler()->removeNode(node);
+  return true;
+}
 
-    if (func->isStackFrameRegPreserved())
-      dSrc += regSize;
+//! \internal
+//!
+//! `mov reg, [slot]` + `mov [slot], reg` -> `mov reg, [slot]`.
+static bool X86Peephole_saveAfterLoad(X86Context* self, HLInst* node) {
+  const Operand* opList = node->getOpList();
+  if (node->getOpCount() != 2 || !X86Context_isVarMem(opList[0]) || !opList[1].isReg())
+    return false;
 
-    X86Mem mSrc = x86::ptr(fpReg, dSrc);
-    X86Mem mDst = x86::ptr(self->_zsp, dDst);
+  HLInst* prev = X86Context_getPrevInst(node);
+  if (prev == nullptr || prev->getInstId() != node->getInstId() || prev->getOpCount() != 2)
+    return false;
 
-    while (moveIndex < moveCount) {
-      uint32_t numMovs = Utils::iMin<uint32_t>(moveCount - moveIndex, numRegs);
+  const Operand* prevList = prev->getOpList();
+  if (!X86Context_isSameOp(prevList[0], opList[1]) || !X86Context_isSameOp(prevList[1], opList[0]))
+    return false;
 
-      for (i = 0; i < numMovs; i++)
-        compiler->emit(kX86InstIdMov, r[i], mSrc.adjusted((moveIndex + i) * regSize));
-      for (i = 0; i < numMovs; i++)
-        compiler->emit(kX86InstIdMov, mDst.adjusted((moveIndex + i) * regSize), r[i]);
+  self->getCompiler()->removeNode(node);
+  return true;
+}
 
-      argStackPos += numMovs * regSize;
-      moveIndex += numMovs;
-    }
-  }
+//! \internal
+//!
+//! `jmp L` + `L:` -> `L:`.
+static bool X86Peephole_jmpNext(X86Context* self, HLInst* node) {
+  if (!node->isJmpOrJcc())
+    return false;
 
-  // --------------------------------------------------------------------------
-  // [Epilog]
-  // --------------------------------------------------------------------------
+  HLLabel* target = static_cast<HLJump*>(node)->getTarget();
+  HLNode* next = node->getNext();
 
-  compiler->_setCursor(func->getExitNode());
+  while (next != nullptr) {
+    uint32_t type = next->getType();
 
-  // Restore XMM/MMX/GP (Mov).
-  stackPtr = stackBase;
-  for (i = 0, mask = regsXmm; mask != 0; i++, mask >>= 1) {
-    if (mask & 0x1) {
-      compiler->emit(kX86InstIdMovaps, x86::xmm(i), x86::oword_ptr(self->_zsp, stackPtr));
-      stackPtr += 16;
+    if (next == target) {
+      self->getCompiler()->removeNode(node);
+      return true;
     }
-  }
 
-  for (i = 0, mask = regsMm; mask != 0; i++, mask >>= 1) {
-    if (mask & 0x1) {
-      compiler->emit(kX86InstIdMovq, x86::mm(i), x86::qword_ptr(self->_zsp, stackPtr));
-      stackPtr += 8;
-    }
-  }
+    if (type != HLNode::kTypeLabel && type != HLNode::kTypeComment && type != HLNode::kTypeHint)
+      break;
 
-  // Adjust stack.
-  if (useLeaEpilog) {
-    compiler->emit(kX86InstIdLea, self->_zsp, x86::ptr(fpReg, -static_cast<int32_t>(func->getPushPopStackSize())));
-  }
-  else if (!func->isStackMisaligned()) {
-    if (func->isStackAdjusted() && stackSize != 0)
-      compiler->emit(kX86InstIdAdd, self->_zsp, stackSize);
+    next = next->getNext();
   }
 
-  // Restore Gp (Push/Pop).
-  if (!earlyPushPop)
-    self->emitPopSequence(regsGp);
+  return false;
+}
 
-  // Emms.
-  if (func->hasFuncFlag(kFuncFlagX86Emms))
-    compiler->emit(kX86InstIdEmms);
+//! \internal
+//!
+//! `cmp reg, 0` -> `test reg, reg`.
+static bool X86Peephole_cmpZero(X86Context* self, HLInst* node) {
+  ASMJIT_UNUSED(self);
 
-  // MFence/SFence/LFence.
-  if (func->hasFuncFlag(kFuncFlagX86SFence) & func->hasFuncFlag(kFuncFlagX86LFence))
-    compiler->emit(kX86InstIdMfence);
-  else if (func->hasFuncFlag(kFuncFlagX86SFence))
-    compiler->emit(kX86InstIdSfence);
-  else if (func->hasFuncFlag(kFuncFlagX86LFence))
-    compiler->emit(kX86InstIdLfence);
+  Operand* opList = node->getOpList();
+  if (node->getOpCount() != 2 || !opList[0].isReg() || !opList[1].isImm())
+    return false;
 
-  // Leave.
-  if (func->isNaked()) {
-    if (func->isStackMisaligned()) {
-      compiler->emit(kX86InstIdMov, self->_zsp, fpOffset);
+  if (static_cast<const X86Reg&>(opList[0]).getRegType() > kX86RegTypeGpq ||
+      static_cast<const Imm&>(opList[1]).getInt64() != 0)
+    return false;
 
-      if (func->isStackFrameRegPreserved())
-        compiler->emit(kX86InstIdPop, fpReg);
+  node->setInstId(kX86InstIdTest);
+  opList[1]._init(opList[0]);
+  return true;
+}
 
-      if (earlyPushPop)
-        self->emitPopSequence(regsGp);
-    }
-  }
-  else {
-    if (useLeaEpilog) {
-      compiler->emit(kX86InstIdPop, fpReg);
-    }
-    else if (func->hasFuncFlag(kFuncFlagX86Leave)) {
-      compiler->emit(kX86InstIdLeave);
-    }
-    else {
-      compiler->emit(kX86InstIdMov, self->_zsp, fpReg);
-      compiler->emit(kX86InstIdPop, fpReg);
-    }
-  }
+//! \internal
+//!
+//! `cmp a, b` + `cmp a, b` -> `cmp a, b` (register and immediate operands only).
+//!
+//! Conditional jumps in between are skipped, they don't change registers nor
+//! EFLAGS (`cmp a, b` + `jl L` + `cmp a, b` + `jg L`).
+static bool X86Peephole_cmpSame(X86Context* self, HLInst* node) {
+  HLInst* prev = X86Context_getPrevInst(node);
+  uint32_t opCount = node->getOpCount();
 
-  // Emit return.
-  if (decl->getCalleePopsStack())
-    compiler->emit(kX86InstIdRet, static_cast<int32_t>(decl->getArgStackSize()));
-  else
-    compiler->emit(kX86InstIdRet);
+  while (prev != nullptr && prev->isJmpOrJcc() && prev->getInstId() != kX86InstIdJmp)
+    prev = X86Context_getPrevInst(prev);
 
-  return kErrorOk;
-}
+  if (prev == nullptr || prev->getInstId() != node->getInstId() || prev->getOpCount() != opCount)
+    return false;
 
-// ============================================================================
-// [asmjit::X86Context - Translate - Jump]
-// ============================================================================
+  if (prev->getOptions() != node->getOptions())
+    return false;
 
-//! \internal
-static void X86Context_translateJump(X86Context* self, HLJump* jNode, HLLabel* jTarget) {
-  X86Compiler* compiler = self->getCompiler();
-  HLNode* extNode = self->getExtraBlock();
+  const Operand* opList = node->getOpList();
+  const Operand* prevList = prev->getOpList();
 
-  compiler->_setCursor(extNode);
-  self->switchState(jTarget->getState());
+  for (uint32_t i = 0; i < opCount; i++) {
+    if (opList[i].isMem() || !X86Context_isSameOp(opList[i], prevList[i]))
+      return false;
+  }
 
-  // If one or more instruction has been added during switchState() it will be
-  // moved at the end of the function body.
-  if (compiler->getCursor() != extNode) {
-    // TODO: Can fail.
-    HLLabel* jTrampolineTarget = compiler->newLabelNode();
+  self->getCompiler()->removeNode(node);
+  return true;
+}
 
-    // Add the jump to the target.
-    compiler->jmp(jTarget->getLabel());
+//! \internal
+//!
+//! `and|or|xor reg, x` + `test reg, reg` -> `and|or|xor reg, x` (both clear
+//! OF and CF and set SF, ZF and PF by the result).
+static bool X86Peephole_testAfterLogic(X86Context* self, HLInst* node) {
+  const Operand* opList = node->getOpList();
+  if (node->getOpCount() != 2 || !opList[0].isReg() || !X86Context_isSameOp(opList[0], opList[1]))
+    return false;
 
-    // Add the trampoline-label we jump to change the state.
-    extNode = compiler->setCursor(extNode);
-    compiler->addNode(jTrampolineTarget);
+  HLInst* prev = X86Context_getPrevInst(node);
+  if (prev == nullptr || prev->getOpCount() != 2)
+    return false;
 
-    // Finally, patch the jump target.
-    ASMJIT_ASSERT(jNode->getOpCount() > 0);
-    jNode->_opList[0] = jTrampolineTarget->getLabel();
-    jNode->_target = jTrampolineTarget;
-  }
+  uint32_t prevId = prev->getInstId();
+  if (prevId != kX86InstIdAnd && prevId != kX86InstIdOr && prevId != kX86InstIdXor)
+    return false;
 
-  // Store the `extNode` and load the state back.
-  self->setExtraBlock(extNode);
-  self->loadState(jNode->_state);
+  if (!X86Context_isSameOp(prev->getOpList()[0], opList[0]))
+    return false;
+
+  self->getCompiler()->removeNode(node);
+  return true;
 }
 
-// ============================================================================
-// [asmjit::X86Context - Translate - Ret]
-// ============================================================================
+//! \internal
+//!
+//! Peephole rules, multiple rules can match the same instruction, the first
+//! one that succeeds wins. An instruction changed by a rule is matched again.
+static const X86PeepholeEntry x86PeepholeRules[] = {
+  { kX86InstIdMov       , kX86InstIdMov     , kX86PeepholeRuleMovSelf       , X86Peephole_movSelf        },
+  { kX86InstIdMovq      , kX86InstIdMovq    , kX86PeepholeRuleMovSelf       , X86Peephole_movSelf        },
+  { kX86InstIdMovaps    , kX86InstIdMovaps  , kX86PeepholeRuleMovSelf       , X86Peephole_movSelf        },
+  { kX86InstIdMovapd    , kX86InstIdMovapd  , kX86PeepholeRuleMovSelf       , X86Peephole_movSelf        },
+  { kX86InstIdMovdqa    , kX86InstIdMovdqa  , kX86PeepholeRuleMovSelf       , X86Peephole_movSelf        },
+  { kX86InstIdMovdqu    , kX86InstIdMovdqu  , kX86PeepholeRuleMovSelf       , X86Peephole_movSelf        },
+  { kX86InstIdMovups    , kX86InstIdMovups  , kX86PeepholeRuleMovSelf       , X86Peephole_movSelf        },
+  { kX86InstIdMovupd    , kX86InstIdMovupd  , kX86PeepholeRuleMovSelf       , X86Peephole_movSelf        },
+  { kX86InstIdVmovaps   , kX86InstIdVmovaps , kX86PeepholeRuleMovSelf       , X86Peephole_movSelf        },
+  { kX86InstIdVmovapd   , kX86InstIdVmovapd , kX86PeepholeRuleMovSelf       , X86Peephole_movSelf        },
+  { kX86InstIdVmovdqa   , kX86InstIdVmovdqa , kX86PeepholeRuleMovSelf       , X86Peephole_movSelf        },
+  { kX86InstIdVmovdqu   , kX86InstIdVmovdqu , kX86PeepholeRuleMovSelf       , X86Peephole_movSelf        },
+  { kX86InstIdVmovups   , kX86InstIdVmovups , kX86PeepholeRuleMovSelf       , X86Peephole_movSelf        },
+  { kX86InstIdVmovupd   , kX86InstIdVmovupd , kX86PeepholeRuleMovSelf       , X86Peephole_movSelf        },
+
+  // Instructions used by `X86Context::emitLoad()` and `X86Context::emitSave()`.
+  { kX86InstIdMov       , kX86InstIdMov     , kX86PeepholeRuleLoadAfterSave , X86Peephole_loadAfterSave  },
+  { kX86InstIdMovq      , kX86InstIdMovq    , kX86PeepholeRuleLoadAfterSave , X86Peephole_loadAfterSave  },
+  { kX86InstIdMovdqa    , kX86InstIdMovdqa  , kX86PeepholeRuleLoadAfterSave , X86Peephole_loadAfterSave  },
+  { kX86InstIdMovss     , kX86InstIdMovss   , kX86PeepholeRuleLoadAfterSave , X86Peephole_loadAfterSave  },
+  { kX86InstIdMovsd     , kX86InstIdMovsd   , kX86PeepholeRuleLoadAfterSave , X86Peephole_loadAfterSave  },
+  { kX86InstIdMovaps    , kX86InstIdMovaps  , kX86PeepholeRuleLoadAfterSave , X86Peephole_loadAfterSave  },
+  { kX86InstIdMovapd    , kX86InstIdMovapd  , kX86PeepholeRuleLoadAfterSave , X86Peephole_loadAfterSave  },
+
+  { kX86InstIdMov       , kX86InstIdMov     , kX86PeepholeRuleSaveAfterLoad , X86Peephole_saveAfterLoad  },
+  { kX86InstIdMovq      , kX86InstIdMovq    , kX86PeepholeRuleSaveAfterLoad , X86Peephole_saveAfterLoad  },
+  { kX86InstIdMovdqa    , kX86InstIdMovdqa  , kX86PeepholeRuleSaveAfterLoad , X86Peephole_saveAfterLoad  },
+  { kX86InstIdMovss     , kX86InstIdMovss   , kX86PeepholeRuleSaveAfterLoad , X86Peephole_saveAfterLoad  },
+  { kX86InstIdMovsd     , kX86InstIdMovsd   , kX86PeepholeRuleSaveAfterLoad , X86Peephole_saveAfterLoad  },
+  { kX86InstIdMovaps    , kX86InstIdMovaps  , kX86PeepholeRuleSaveAfterLoad , X86Peephole_saveAfterLoad  },
+  { kX86InstIdMovapd    , kX86InstIdMovapd  , kX86PeepholeRuleSaveAfterLoad , X86Peephole_saveAfterLoad  },
+
+  { _kX86InstIdJbegin   , _kX86InstIdJend   , kX86PeepholeRuleJmpNext       , X86Peephole_jmpNext        },
+
+  { kX86InstIdCmp       , kX86InstIdCmp     , kX86PeepholeRuleCmpZero       , X86Peephole_cmpZero        },
+  { kX86InstIdCmp       , kX86InstIdCmp     , kX86PeepholeRuleCmpSame       , X86Peephole_cmpSame        },
+  { kX86InstIdTest      , kX86InstIdTest    , kX86PeepholeRuleCmpSame       , X86Peephole_cmpSame        },
+  { kX86InstIdTest      , kX86InstIdTest    , kX86PeepholeRuleTestAfterLogic, X86Peephole_testAfterLogic }
+};
 
-static Error X86Context_translateRet(X86Context* self, HLRet* rNode, HLLabel* exitTarget) {
-  X86Compiler* compiler = self->getCompiler();
-  HLNode* node = rNode->getNext();
+Error X86Context::peephole() {
+  ASMJIT_TLOG("[P] ======= Peephole (Begin)\n");
 
-  // 32-bit mode requires to push floating point return value(s), handle it
-  // here as it's a special case.
-  X86VarMap* map = rNode->getMap<X86VarMap>();
-  if (map != nullptr) {
-    VarAttr* vaList = map->getVaList();
-    uint32_t vaCount = map->getVaCount();
+  X86Compiler* compiler = getCompiler();
+  uint32_t* counts = compiler->_stats._peepholeCount;
 
-    for (uint32_t i = 0; i < vaCount; i++) {
-      VarAttr& va = vaList[i];
-      if (va.hasFlag(kVarAttrX86Fld4 | kVarAttrX86Fld8)) {
-        VarData* vd = va.getVd();
-        X86Mem m(self->getVarMem(vd));
+  HLNode* node_ = getFunc();
+  HLNode* stop = getStop();
 
-        uint32_t flags = _x86VarInfo[vd->getType()].getFlags();
-        m.setSize(
-          (flags & VarInfo::kFlagSP) ? 4 :
-          (flags & VarInfo::kFlagDP) ? 8 :
-          va.hasFlag(kVarAttrX86Fld4) ? 4 : 8);
+  while (node_ != stop) {
+    // Rules can only change or remove `node_`.
+    HLNode* next = node_->getNext();
 
-        compiler->fld(m);
+    if (node_->getType() == HLNode::kTypeInst) {
+      HLInst* node = static_cast<HLInst*>(node_);
+      uint32_t instId = node->getInstId();
+
+      uint32_t i = 0;
+      while (i < ASMJIT_ARRAY_SIZE(x86PeepholeRules)) {
+        const X86PeepholeEntry& entry = x86PeepholeRules[i++];
+        if (instId < entry.firstId || instId > entry.lastId || !entry.func(this, node))
+          continue;
+
+        counts[entry.rule]++;
+
+        // Stop if the instruction has been removed, match it again if changed.
+        if (node->getPrev() == nullptr || node->getInstId() == instId)
+          break;
+
+        instId = node->getInstId();
+        i = 0;
       }
     }
+
+    node_ = next;
   }
 
-  // Decide whether to `jmp` or not in case we are next to the return label.
-  while (node != nullptr) {
-    switch (node->getType()) {
-      // If we have found an exit label we just return, there is no need to
-      // emit jump to that.
-      case HLNode::kTypeLabel:
-        if (static_cast<HLLabel*>(node) == exitTarget)
-          return kErrorOk;
-        goto _EmitRet;
+  ASMJIT_TLOG("[P] ======= Peephole (Done)\n");
+  return kErrorOk;
+}
 
-      case HLNode::kTypeData:
-      case HLNode::kTypeInst:
-      case HLNode::kTypeCall:
-      case HLNode::kTypeRet:
-        goto _EmitRet;
+// ============================================================================
+// [asmjit::X86Context - Schedule]
+// ============================================================================
 
-      // Continue iterating.
-      case HLNode::kTypeComment:
-      case HLNode::kTypeAlign:
-      case HLNode::kTypeHint:
-        break;
+//! \internal
+//!
+//! Maximum count of instructions scheduled together, longer blocks are split.
+static const uint32_t kX86SchedMaxInsts = 64;
 
-      // Invalid node to be here.
-      case HLNode::kTypeFunc:
-        return self->getCompiler()->setLastError(kErrorInvalidState);
+//! \internal
+//!
+//! Memory access of an instruction, see `X86SchedInst::memFlags`.
+ASMJIT_ENUM(X86SchedMem) {
+  kX86SchedMemRead = 0x1,
+  kX86SchedMemWrite = 0x2
+};
 
-      // We can't go forward from here.
-      case HLNode::kTypeSentinel:
-        return kErrorOk;
-    }
+//! \internal
+//!
+//! Instruction as seen by the scheduler.
+struct X86SchedInst {
+  //! Instruction node.
+  HLInst* node;
+
+  //! Registers read, per register class.
+  uint32_t regsIn[_kX86RegClassManagedCount];
+  //! Registers written, per register class.
+  uint32_t regsOut[_kX86RegClassManagedCount];
+
+  //! EFLAGS read.
+  uint32_t flagsIn;
+  //! EFLAGS written.
+  uint32_t flagsOut;
+  //! EFLAGS written and used after the instruction (subset of `flagsOut`).
+  uint32_t flagsLive;
+
+  //! Memory access, see \ref X86SchedMem.
+  uint32_t memFlags;
+  //! Base register of `[base + disp]` memory operand, or `kInvalidReg`.
+  uint32_t memBase;
+  //! Displacement of `[base + disp]` memory operand.
+  int32_t memDisp;
+  //! Size of the memory operand (zero if unknown).
+  uint32_t memSize;
+
+  //! Estimated latency.
+  uint32_t latency;
+  //! Length of the longest dependency chain starting at the instruction.
+  uint32_t height;
+  //! Count of predecessors not scheduled yet.
+  uint32_t predCount;
+  //! First cycle the instruction can be issued at.
+  uint32_t readyCycle;
+  //! Successors (bit-mask of indexes in the block).
+  uint64_t succ;
+};
 
-    node = node->getNext();
+//! \internal
+//!
+//! Get register class of a physical register of `regType` that the scheduler
+//! tracks, or `kInvalidReg`.
+static ASMJIT_INLINE uint32_t X86Context_getSchedRegClass(uint32_t regType) {
+  switch (regType) {
+    case kX86RegTypeGpbLo:
+    case kX86RegTypeGpbHi:
+    case kX86RegTypeGpw:
+    case kX86RegTypeGpd:
+    case kX86RegTypeGpq:
+      return kX86RegClassGp;
+
+    case kX86RegTypeMm:
+      return kX86RegClassMm;
+
+    case kX86RegTypeK:
+      return kX86RegClassK;
+
+    case kX86RegTypeXmm:
+    case kX86RegTypeYmm:
+    case kX86RegTypeZmm:
+      return kX86RegClassXyz;
+
+    default:
+      return kInvalidReg;
   }
+}
+
+//! \internal
+//!
+//! Get estimated latency of `instId` (register operands only).
+static uint32_t X86Context_getSchedLatency(uint32_t instId) {
+  switch (instId) {
+    case kX86InstIdDivps    : case kX86InstIdDivpd    : case kX86InstIdDivss    : case kX86InstIdDivsd    :
+    case kX86InstIdVdivps   : case kX86InstIdVdivpd   : case kX86InstIdVdivss   : case kX86InstIdVdivsd   :
+    case kX86InstIdSqrtps   : case kX86InstIdSqrtpd   : case kX86InstIdSqrtss   : case kX86InstIdSqrtsd   :
+    case kX86InstIdVsqrtps  : case kX86InstIdVsqrtpd  : case kX86InstIdVsqrtss  : case kX86InstIdVsqrtsd  :
+      return 12;
+
+    case kX86InstIdMulps    : case kX86InstIdMulpd    : case kX86InstIdMulss    : case kX86InstIdMulsd    :
+    case kX86InstIdVmulps   : case kX86InstIdVmulpd   : case kX86InstIdVmulss   : case kX86InstIdVmulsd   :
+    case kX86InstIdPmulld   : case kX86InstIdPmullw   : case kX86InstIdPmulhw   : case kX86InstIdPmulhuw  :
+    case kX86InstIdPmuludq  : case kX86InstIdPmuldq   : case kX86InstIdPmaddwd  :
+    case kX86InstIdVpmulld  : case kX86InstIdVpmullw  : case kX86InstIdVpmulhw  : case kX86InstIdVpmulhuw :
+    case kX86InstIdVpmuludq : case kX86InstIdVpmuldq  : case kX86InstIdVpmaddwd :
+      return 5;
+
+    case kX86InstIdAddps    : case kX86InstIdAddpd    : case kX86InstIdAddss    : case kX86InstIdAddsd    :
+    case kX86InstIdVaddps   : case kX86InstIdVaddpd   : case kX86InstIdVaddss   : case kX86InstIdVaddsd   :
+    case kX86InstIdSubps    : case kX86InstIdSubpd    : case kX86InstIdSubss    : case kX86InstIdSubsd    :
+    case kX86InstIdVsubps   : case kX86InstIdVsubpd   : case kX86InstIdVsubss   : case kX86InstIdVsubsd   :
+    case kX86InstIdImul:
+      return 3;
 
-_EmitRet:
-  {
-    compiler->_setCursor(rNode);
-    compiler->jmp(exitTarget->getLabel());
+    default:
+      // FMA3 and FMA4.
+      if (instId >= kX86InstIdVfmadd132pd && instId <= kX86InstIdVfnmsub231ss)
+        return 5;
+      return 1;
   }
-  return kErrorOk;
 }
 
-// ============================================================================
-// [asmjit::X86Context - Translate - Func]
-// ============================================================================
-
-Error X86Context::translate() {
-  ASMJIT_TLOG("[T] ======= Translate (Begin)\n");
+//! \internal
+//!
+//! Initialize `si` from `node`, returns `false` if the instruction can't be
+//! reordered - it has implicit operands, side effects, or changes the flow.
+static bool X86Context_initSchedInst(X86SchedInst* si, HLInst* node) {
+  uint32_t instId = node->getInstId();
+  uint32_t opCount = node->getOpCount();
+  const Operand* opList = node->getOpList();
+  const X86InstExtendedInfo& extendedInfo = _x86InstInfo[instId].getExtendedInfo();
+
+  if (opCount == 0 || node->isJmpOrJcc() || node->isSpecial() || node->isFp())
+    return false;
+
+  if (extendedInfo.hasFlag(kX86InstFlagFlow | kX86InstFlagFp | kX86InstFlagSpecialMem | kX86InstFlagVolatile))
+    return false;
+
+  // Instructions marked as special in the table have implicit operands only
+  // in some forms, `fetch()` marks the node if it's the case. Shifts, rotates
+  // and `imul` don't have any other implicit operand, everything else is too
+  // risky to be moved.
+  if (extendedInfo.isSpecial()) {
+    switch (instId) {
+      case kX86InstIdImul:
+      case kX86InstIdRcl:
+      case kX86InstIdRcr:
+      case kX86InstIdRol:
+      case kX86InstIdRor:
+      case kX86InstIdSal:
+      case kX86InstIdSar:
+      case kX86InstIdShl:
+      case kX86InstIdShr:
+        break;
 
-  X86Compiler* compiler = getCompiler();
-  X86FuncNode* func = getFunc();
+      default:
+        return false;
+    }
+  }
 
-  // Register allocator contexts.
-  X86VarAlloc vAlloc(this);
-  X86CallAlloc cAlloc(this);
+  if (node->getOptions() & kX86InstOptionLock)
+    return false;
 
-  // Flow.
-  HLNode* node_ = func;
-  HLNode* next = nullptr;
-  HLNode* stop = getStop();
+  ::memset(si, 0, sizeof(X86SchedInst));
+  si->node = node;
+  si->flagsIn = extendedInfo.getEFlagsIn();
+  si->flagsOut = extendedInfo.getEFlagsOut();
+  si->memBase = kInvalidReg;
 
-  PodList<HLNode*>::Link* jLink = _jccList.getFirst();
+  // The first operand is read and written if the table doesn't say otherwise.
+  uint32_t firstAccess = extendedInfo.getFlags() & kX86InstFlagRW;
+  if (firstAccess == 0)
+    firstAccess = kX86InstFlagRW;
 
-  for (;;) {
-    while (node_->isTranslated()) {
-      // Switch state if we went to the already translated node.
-      if (node_->getType() == HLNode::kTypeLabel) {
-        HLLabel* node = static_cast<HLLabel*>(node_);
-        compiler->_setCursor(node->getPrev());
-        switchState(node->getState());
-      }
+  uint32_t latency = X86Context_getSchedLatency(instId);
+  for (uint32_t i = 0; i < opCount; i++) {
+    const Operand* op = &opList[i];
+    uint32_t access = kX86InstFlagRO;
 
-_NextGroup:
-      if (jLink == nullptr) {
-        goto _Done;
-      }
-      else {
-        node_ = jLink->getValue();
-        jLink = jLink->getNext();
+    if (i == 0)
+      access = firstAccess;
+    else if (i == 1 && extendedInfo.isXchg())
+      access = kX86InstFlagRW;
+
+    if (op->isReg()) {
+      const X86Reg* reg = static_cast<const X86Reg*>(op);
+      uint32_t rc = X86Context_getSchedRegClass(reg->getRegType());
+
+      if (rc == kInvalidReg)
+        return false;
+
+      uint32_t mask = Utils::mask(reg->getRegIndex());
+      if (access & kX86InstFlagRO)
+        si->regsIn[rc] |= mask;
+      if (access & kX86InstFlagWO)
+        si->regsOut[rc] |= mask;
+    }
+    else if (op->isMem()) {
+      const X86Mem* m = static_cast<const X86Mem*>(op);
 
-        HLNode* jFlow = X86Context_getOppositeJccFlow(static_cast<HLJump*>(node_));
-        loadState(node_->getState());
+      // Gathers write their mask, `xchg` with memory is implicitly locked.
+      if (m->getVSib() != kX86MemVSibGpz || extendedInfo.isXchg())
+        return false;
 
-        if (jFlow->getState()) {
-          X86Context_translateJump(this,
-            static_cast<HLJump*>(node_),
-            static_cast<HLLabel*>(jFlow));
+      if (m->isBaseIndexType()) {
+        if (m->hasBase())
+          si->regsIn[kX86RegClassGp] |= Utils::mask(m->getBase());
+        if (m->hasIndex())
+          si->regsIn[kX86RegClassGp] |= Utils::mask(m->getIndex());
 
-          node_ = jFlow;
-          if (node_->isTranslated())
-            goto _NextGroup;
-        }
-        else {
-          node_ = jFlow;
+        if (m->hasBase() && !m->hasIndex() && !m->hasSegment()) {
+          si->memBase = m->getBase();
+          si->memDisp = m->getDisplacement();
         }
-
-        break;
       }
-    }
 
-    next = node_->getNext();
-    node_->orFlags(HLNode::kFlagIsTranslated);
+      // LEA doesn't access the memory.
+      if (instId == kX86InstIdLea)
+        continue;
 
-    ASMJIT_TSEC({
-      this->_traceNode(this, node_, "[T] ");
-    });
+      if (access & kX86InstFlagRO) {
+        si->memFlags |= kX86SchedMemRead;
+        latency += 4;
+      }
 
-    switch (node_->getType()) {
-      // ----------------------------------------------------------------------
-      // [Align / Embed]
-      // ----------------------------------------------------------------------
+      if (access & kX86InstFlagWO)
+        si->memFlags |= kX86SchedMemWrite;
+      si->memSize = m->getSize();
+    }
+  }
 
-      case HLNode::kTypeAlign:
-      case HLNode::kTypeData:
-        break;
+  si->latency = latency;
+  return true;
+}
 
-      // ----------------------------------------------------------------------
-      // [Target]
-      // ----------------------------------------------------------------------
+//! \internal
+//!
+//! Get whether `b` depends on `a`, which precedes it.
+static bool X86Context_isSchedDependent(const X86SchedInst* a, const X86SchedInst* b) {
+  for (uint32_t rc = 0; rc < _kX86RegClassManagedCount; rc++) {
+    if ((a->regsOut[rc] & (b->regsIn[rc] | b->regsOut[rc])) | (a->regsIn[rc] & b->regsOut[rc]))
+      return true;
+  }
 
-      case HLNode::kTypeLabel: {
-        HLLabel* node = static_cast<HLLabel*>(node_);
-        ASMJIT_ASSERT(!node->hasState());
-        node->setState(saveState());
-        break;
-      }
+  // Writes of EFLAGS that are not used later can be freely reordered.
+  if ((a->flagsLive & (b->flagsIn | b->flagsOut)) | (a->flagsIn & b->flagsOut) | (a->flagsOut & b->flagsLive))
+    return true;
 
-      // ----------------------------------------------------------------------
-      // [Inst/Call/SArg/Ret]
-      // ----------------------------------------------------------------------
+  if (((a->memFlags & kX86SchedMemWrite) && b->memFlags != 0) ||
+      ((b->memFlags & kX86SchedMemWrite) && a->memFlags != 0)) {
+    // Different slots of the same base register don't alias. If the base is
+    // modified between `a` and `b` they are ordered through the register.
+    if (a->memBase == kInvalidReg || a->memBase != b->memBase || a->memSize == 0 || b->memSize == 0)
+      return true;
 
-      case HLNode::kTypeInst:
-      case HLNode::kTypeCall:
-      case HLNode::kTypeCallArg:
-        // Update VarAttr's unuse flags based on liveness of the next node.
-        if (!node_->isJcc()) {
-          X86VarMap* map = static_cast<X86VarMap*>(node_->getMap());
-          BitArray* liveness;
+    int32_t aEnd = a->memDisp + static_cast<int32_t>(a->memSize);
+    int32_t bEnd = b->memDisp + static_cast<int32_t>(b->memSize);
+    return aEnd > b->memDisp && bEnd > a->memDisp;
+  }
 
-          if (map != nullptr && next != nullptr && (liveness = next->getLiveness()) != nullptr) {
-            VarAttr* vaList = map->getVaList();
-            uint32_t vaCount = map->getVaCount();
+  return false;
+}
 
-            for (uint32_t i = 0; i < vaCount; i++) {
-              VarAttr* va = &vaList[i];
-              VarData* vd = va->getVd();
+//! \internal
+//!
+//! Schedule `count` instructions of a basic block, returns count of reordered
+//! instructions.
+static uint32_t X86Context_scheduleBlock(X86Context* self, X86SchedInst* insts, uint32_t count) {
+  if (count < 2)
+    return 0;
+
+  uint32_t i, j;
+
+  // EFLAGS liveness, all flags are considered used after the block.
+  uint32_t flagsLive = 0xFF;
+  for (i = count; i != 0; ) {
+    X86SchedInst* si = &insts[--i];
+    si->flagsLive = si->flagsOut & flagsLive;
+    flagsLive = (flagsLive & ~si->flagsOut) | si->flagsIn;
+  }
 
-              if (!liveness->getBit(vd->getLocalId()))
-                va->orFlags(kVarAttrUnuse);
-            }
-          }
-        }
+  // Dependency DAG.
+  for (j = 1; j < count; j++) {
+    for (i = 0; i < j; i++) {
+      if (X86Context_isSchedDependent(&insts[i], &insts[j])) {
+        insts[i].succ |= static_cast<uint64_t>(1) << j;
+        insts[j].predCount++;
+      }
+    }
+  }
 
-        if (node_->getType() == HLNode::kTypeCall) {
-          ASMJIT_PROPAGATE_ERROR(cAlloc.run(static_cast<X86CallNode*>(node_)));
-          break;
-        }
-        ASMJIT_FALLTHROUGH;
+  // Critical path of each instruction.
+  for (i = count; i != 0; ) {
+    X86SchedInst* si = &insts[--i];
+    uint32_t height = 0;
 
-      case HLNode::kTypeHint:
-      case HLNode::kTypeRet: {
-        ASMJIT_PROPAGATE_ERROR(vAlloc.run(node_));
+    for (j = i + 1; j < count; j++) {
+      if ((si->succ & (static_cast<uint64_t>(1) << j)) && insts[j].height > height)
+        height = insts[j].height;
+    }
+    si->height = si->latency + height;
+  }
 
-        // Handle conditional/unconditional jump.
-        if (node_->isJmpOrJcc()) {
-          HLJump* node = static_cast<HLJump*>(node_);
-          HLLabel* jTarget = node->getTarget();
+  // List scheduling - issue one instruction per cycle, prefer instructions
+  // whose operands are ready and that are on the longest dependency chain,
+  // keep the original order if there is no reason to change it.
+  Compiler* compiler = self->getCompiler();
+  HLNode* prev = insts[0].node->getPrev();
 
-          // Target not followed.
-          if (jTarget == nullptr) {
-            if (node->isJmp())
-              goto _NextGroup;
-            else
-              break;
-          }
+  uint64_t pending = ~static_cast<uint64_t>(0) >> (64 - count);
+  uint32_t cycle = 0;
+  uint32_t reordered = 0;
 
-          if (node->isJmp()) {
-            if (jTarget->hasState()) {
-              compiler->_setCursor(node->getPrev());
-              switchState(jTarget->getState());
+  for (uint32_t k = 0; k < count; k++) {
+    uint32_t best = kInvalidValue;
 
-              goto _NextGroup;
-            }
-            else {
-              next = jTarget;
-            }
-          }
-          else {
-            HLNode* jNext = node->getNext();
+    for (i = 0; i < count; i++) {
+      X86SchedInst* si = &insts[i];
+      if (!(pending & (static_cast<uint64_t>(1) << i)) || si->predCount != 0)
+        continue;
 
-            if (jTarget->isTranslated()) {
-              if (jNext->isTranslated()) {
-                ASMJIT_ASSERT(jNext->getType() == HLNode::kTypeLabel);
-                compiler->_setCursor(node->getPrev());
-                intersectStates(jTarget->getState(), jNext->getState());
-              }
+      if (best == kInvalidValue) {
+        best = i;
+        continue;
+      }
 
-              VarState* savedState = saveState();
-              node->setState(savedState);
+      X86SchedInst* bi = &insts[best];
+      bool siReady = si->readyCycle <= cycle;
+      bool biReady = bi->readyCycle <= cycle;
 
-              X86Context_translateJump(this, node, jTarget);
-              next = jNext;
-            }
-            else if (jNext->isTranslated()) {
-              ASMJIT_ASSERT(jNext->getType() == HLNode::kTypeLabel);
+      if (siReady != biReady) {
+        if (siReady)
+          best = i;
+      }
+      else if (!siReady && si->readyCycle != bi->readyCycle) {
+        if (si->readyCycle < bi->readyCycle)
+          best = i;
+      }
+      else if (si->height > bi->height) {
+        best = i;
+      }
+    }
 
-              VarState* savedState = saveState();
-              node->setState(savedState);
+    ASMJIT_ASSERT(best != kInvalidValue);
+    X86SchedInst* si = &insts[best];
+    pending &= ~(static_cast<uint64_t>(1) << best);
 
-              compiler->_setCursor(node);
-              switchState(static_cast<HLLabel*>(jNext)->getState());
-              next = jTarget;
-            }
-            else {
-              node->setState(saveState());
-              next = X86Context_getJccFlow(node);
-            }
-          }
-        }
-        else if (node_->isRet()) {
-          ASMJIT_PROPAGATE_ERROR(
-            X86Context_translateRet(this, static_cast<HLRet*>(node_), func->getExitNode()));
-        }
-        break;
+    cycle = Utils::iMax(cycle, si->readyCycle);
+    uint32_t done = cycle + si->latency;
+    cycle++;
+
+    for (j = best + 1; j < count; j++) {
+      if (si->succ & (static_cast<uint64_t>(1) << j)) {
+        insts[j].predCount--;
+        insts[j].readyCycle = Utils::iMax(insts[j].readyCycle, done);
       }
+    }
 
-      // ----------------------------------------------------------------------
-      // [Func]
-      // ----------------------------------------------------------------------
+    HLNode* node = si->node;
+    if (node->getPrev() != prev) {
+      compiler->removeNode(node);
+      compiler->addNodeAfter(node, prev);
+    }
 
-      case HLNode::kTypeFunc: {
-        ASMJIT_ASSERT(node_ == func);
+    if (best != k)
+      reordered++;
 
-        X86FuncDecl* decl = func->getDecl();
-        X86VarMap* map = func->getMap<X86VarMap>();
+    node->orFlags(HLNode::kFlagIsScheduled);
+    prev = node;
+  }
 
-        if (map != nullptr) {
-          uint32_t i;
-          uint32_t argCount = func->_x86Decl.getNumArgs();
+  return reordered;
+}
 
-          for (i = 0; i < argCount; i++) {
-            const FuncInOut& arg = decl->getArg(i);
+Error X86Context::schedule() {
+  ASMJIT_TLOG("[S] ======= Schedule (Begin)\n");
 
-            VarData* vd = func->getArg(i);
-            if (vd == nullptr)
-              continue;
+  X86SchedInst* insts = static_cast<X86SchedInst*>(
+    _zoneAllocator.alloc(kX86SchedMaxInsts * sizeof(X86SchedInst)));
 
-            VarAttr* va = map->findVa(vd);
-            ASMJIT_ASSERT(va != nullptr);
+  if (insts == nullptr)
+    return setLastError(kErrorNoHeapMemory);
 
-            if (va->getFlags() & kVarAttrUnuse)
-              continue;
+  HLNode* node_ = getFunc();
+  HLNode* stop = getStop();
 
-            uint32_t regIndex = va->getOutRegIndex();
-            if (regIndex != kInvalidReg && (va->getFlags() & kVarAttrWConv) == 0) {
-              switch (vd->getClass()) {
-                case kX86RegClassGp : attach<kX86RegClassGp >(vd, regIndex, true); break;
-                case kX86RegClassMm : attach<kX86RegClassMm >(vd, regIndex, true); break;
-                case kX86RegClassXyz: attach<kX86RegClassXyz>(vd, regIndex, true); break;
-              }
-            }
-            else if (va->hasFlag(kVarAttrWConv)) {
-              // TODO: [COMPILER] Function Argument Conversion.
-              ASMJIT_NOT_REACHED();
-            }
-            else {
-              vd->_isMemArg = true;
-              vd->setMemOffset(arg.getStackOffset());
-              vd->setState(kVarStateMem);
-            }
-          }
-        }
-        break;
-      }
+  uint32_t count = 0;
+  uint32_t reordered = 0;
 
-      // ----------------------------------------------------------------------
-      // [End]
-      // ----------------------------------------------------------------------
+  while (node_ != stop) {
+    // Scheduling only moves nodes preceding `next`.
+    HLNode* next = node_->getNext();
 
-      case HLNode::kTypeSentinel: {
-        goto _NextGroup;
+    if (node_->getType() == HLNode::kTypeInst &&
+        X86Context_initSchedInst(&insts[count], static_cast<HLInst*>(node_))) {
+      if (++count == kX86SchedMaxInsts) {
+        reordered += X86Context_scheduleBlock(this, insts, count);
+        count = 0;
       }
-
-      default:
-        break;
+    }
+    else {
+      reordered += X86Context_scheduleBlock(this, insts, count);
+      count = 0;
     }
 
-    if (next == stop)
-      goto _NextGroup;
     node_ = next;
   }
 
-_Done:
-  ASMJIT_PROPAGATE_ERROR(X86Context_initFunc(this, func));
-  ASMJIT_PROPAGATE_ERROR(X86Context_patchFuncMem(this, func, stop));
-  ASMJIT_PROPAGATE_ERROR(X86Context_translatePrologEpilog(this, func));
+  reordered += X86Context_scheduleBlock(this, insts, count);
+  getCompiler()->_stats._reorderCount += reordered;
 
-  ASMJIT_TLOG("[T] ======= Translate (End)\n");
+  ASMJIT_TLOG("[S] ======= Schedule (Done)\n");
   return kErrorOk;
 }
 
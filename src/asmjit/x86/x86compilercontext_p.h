@@ -644,12 +644,42 @@ struct X86Context : public Context {
     return mem;
   }
 
+  // --------------------------------------------------------------------------
+  // [Fold Constants]
+  // --------------------------------------------------------------------------
+
+  virtual Error foldConstants();
+
+  // --------------------------------------------------------------------------
+  // [Common Subexpressions]
+  // --------------------------------------------------------------------------
+
+  virtual Error eliminateCommonSubexpr();
+
   // --------------------------------------------------------------------------
   // [Fetch]
   // --------------------------------------------------------------------------
 
   virtual Error fetch();
 
+  // --------------------------------------------------------------------------
+  // [Dead Code]
+  // --------------------------------------------------------------------------
+
+  virtual Error removeDeadNodes(uint32_t& count);
+
+  // --------------------------------------------------------------------------
+  // [Coalesce]
+  // --------------------------------------------------------------------------
+
+  virtual Error coalesceCopies(uint32_t& count);
+
+  // --------------------------------------------------------------------------
+  // [Live Intervals]
+  // --------------------------------------------------------------------------
+
+  virtual Error allocIntervals();
+
   // --------------------------------------------------------------------------
   // [Annotate]
   // --------------------------------------------------------------------------
@@ -662,6 +692,18 @@ struct X86Context : public Context {
 
   virtual Error translate();
 
+  // --------------------------------------------------------------------------
+  // [Peephole]
+  // --------------------------------------------------------------------------
+
+  virtual Error peephole();
+
+  // --------------------------------------------------------------------------
+  // [Schedule]
+  // --------------------------------------------------------------------------
+
+  virtual Error schedule();
+
   // --------------------------------------------------------------------------
   // [Serialize]
   // --------------------------------------------------------------------------
@@ -0,0 +1,288 @@
+// [AsmJit]
+// Complete x86/x64 JIT and Remote Assembler for C++.
+//
+// [License]
+// Zlib - See LICENSE.md file in the package.
+
+// [Export]
+#define ASMJIT_EXPORTS
+
+// [Guard]
+#include "../build.h"
+#if !defined(ASMJIT_DISABLE_COMPILER) && (defined(ASMJIT_BUILD_X86) || defined(ASMJIT_BUILD_X64))
+
+// [Dependencies]
+#include "../x86/x86compileservice.h"
+
+// [Api-Begin]
+#include "../apibegin.h"
+
+namespace asmjit {
+
+// ============================================================================
+// [asmjit::X86CompileService - Worker]
+// ============================================================================
+
+//! \internal
+//!
+//! Worker thread and the code generators it reuses for all tasks.
+struct X86CompileService::Worker {
+  ASMJIT_INLINE Worker(X86CompileService* service) noexcept
+    : service(service),
+      assembler(service->_runtime),
+      compiler() {}
+
+  //! Service the worker belongs to.
+  X86CompileService* service;
+  //! Assembler, reset after each task.
+  X86Assembler assembler;
+  //! Compiler, reset after each task.
+  X86Compiler compiler;
+
+  //! Thread handle.
+#if ASMJIT_OS_WINDOWS
+  HANDLE thread;
+#else
+  pthread_t thread;
+#endif // ASMJIT_OS_WINDOWS
+};
+
+//! \internal
+//!
+//! Decrement the reference count of `task` and free it if it drops to zero.
+//!
+//! NOTE: Has to be called with the service's lock held.
+static void X86CompileService_deref(X86CompileTask* task) noexcept {
+  if (--task->_refCount != 0)
+    return;
+
+  // Nobody is interested in the function anymore.
+  if (task->_func != nullptr)
+    task->_service->_runtime->release(task->_func);
+
+  task->~X86CompileTask();
+  ASMJIT_FREE(task);
+}
+
+//! \internal
+//!
+//! Compile `task` by using `worker`'s compiler and assembler.
+static Error X86CompileService_compile(X86CompileService::Worker* worker, X86CompileTask* task, void** dst) noexcept {
+  X86Assembler& a = worker->assembler;
+  X86Compiler& c = worker->compiler;
+
+  *dst = nullptr;
+  Error error = c.attach(&a);
+
+  if (error == kErrorOk) {
+    error = task->_callback(&c, task->_data);
+
+    if (error == kErrorOk)
+      error = c.finalize();
+    else
+      c.reset(false);
+  }
+
+  if (error == kErrorOk)
+    error = a.getLastError();
+
+  if (error == kErrorOk)
+    error = a.getRuntime()->add(dst, &a);
+
+  a.reset(false);
+  return error;
+}
+
+//! \internal
+//!
+//! Worker loop - compile tasks until the service is destroyed.
+static void X86CompileService_run(X86CompileService::Worker* worker) noexcept {
+  X86CompileService* self = worker->service;
+  AutoLock locked(self->_lock);
+
+  for (;;) {
+    X86CompileTask* task = self->_queueFirst;
+
+    if (task == nullptr) {
+      if (self->_stopping)
+        break;
+
+      self->_workCond.wait(self->_lock);
+      continue;
+    }
+
+    self->_queueFirst = task->_next;
+    if (self->_queueFirst == nullptr)
+      self->_queueLast = nullptr;
+
+    // Skip tasks released before they were started.
+    if (task->_refCount > 1) {
+      void* func;
+
+      self->_lock.unlock();
+      Error error = X86CompileService_compile(worker, task, &func);
+      self->_lock.lock();
+
+      task->_func = func;
+      task->_error = error;
+    }
+    else {
+      task->_error = kErrorInvalidState;
+    }
+
+    task->_done = true;
+    X86CompileService_deref(task);
+    self->_doneCond.broadcast();
+  }
+}
+
+#if ASMJIT_OS_WINDOWS
+static DWORD WINAPI X86CompileService_threadEntry(LPVOID arg) noexcept {
+  X86CompileService_run(static_cast<X86CompileService::Worker*>(arg));
+  return 0;
+}
+#else
+static void* X86CompileService_threadEntry(void* arg) noexcept {
+  X86CompileService_run(static_cast<X86CompileService::Worker*>(arg));
+  return nullptr;
+}
+#endif // ASMJIT_OS_WINDOWS
+
+// ============================================================================
+// [asmjit::X86CompileService - Construction / Destruction]
+// ============================================================================
+
+X86CompileService::X86CompileService(Runtime* runtime, uint32_t workerCount) noexcept
+  : _runtime(runtime),
+    _queueFirst(nullptr),
+    _queueLast(nullptr),
+    _workers(nullptr),
+    _workerCount(0),
+    _stopping(false) {
+
+  if (workerCount == 0)
+    workerCount = Utils::iMax<uint32_t>(runtime->getCpuInfo().getHwThreadsCount(), 1);
+
+  _workers = static_cast<Worker*>(ASMJIT_ALLOC(workerCount * sizeof(Worker)));
+  if (_workers == nullptr)
+    return;
+
+  // Threads wait for the lock before they touch anything.
+  AutoLock locked(_lock);
+
+  for (uint32_t i = 0; i < workerCount; i++) {
+    Worker* worker = new(&_workers[i]) Worker(this);
+
+#if ASMJIT_OS_WINDOWS
+    worker->thread = ::CreateThread(nullptr, 0, X86CompileService_threadEntry, worker, 0, nullptr);
+    bool created = worker->thread != nullptr;
+#else
+    bool created = ::pthread_create(&worker->thread, nullptr, X86CompileService_threadEntry, worker) == 0;
+#endif // ASMJIT_OS_WINDOWS
+
+    if (!created) {
+      worker->~Worker();
+      break;
+    }
+
+    _workerCount++;
+  }
+}
+
+X86CompileService::~X86CompileService() noexcept {
+  uint32_t i;
+  uint32_t workerCount = _workerCount;
+
+  {
+    AutoLock locked(_lock);
+    _stopping = true;
+    _workCond.broadcast();
+  }
+
+  for (i = 0; i < workerCount; i++) {
+#if ASMJIT_OS_WINDOWS
+    ::WaitForSingleObject(_workers[i].thread, INFINITE);
+    ::CloseHandle(_workers[i].thread);
+#else
+    ::pthread_join(_workers[i].thread, nullptr);
+#endif // ASMJIT_OS_WINDOWS
+  }
+
+  for (i = 0; i < workerCount; i++)
+    _workers[i].~Worker();
+
+  if (_workers != nullptr)
+    ASMJIT_FREE(_workers);
+}
+
+// ============================================================================
+// [asmjit::X86CompileService - Interface]
+// ============================================================================
+
+Error X86CompileService::submit(X86CompileTask** out, X86CompileCallback callback, void* data) noexcept {
+  *out = nullptr;
+
+  if (_workerCount == 0)
+    return kErrorInvalidState;
+
+  void* p = ASMJIT_ALLOC(sizeof(X86CompileTask));
+  if (p == nullptr)
+    return kErrorNoHeapMemory;
+
+  X86CompileTask* task = new(p) X86CompileTask(this, callback, data);
+
+  {
+    AutoLock locked(_lock);
+
+    if (_queueLast != nullptr)
+      _queueLast->_next = task;
+    else
+      _queueFirst = task;
+
+    _queueLast = task;
+    _workCond.signal();
+  }
+
+  *out = task;
+  return kErrorOk;
+}
+
+// ============================================================================
+// [asmjit::X86CompileTask - Interface]
+// ============================================================================
+
+bool X86CompileTask::isDone() const noexcept {
+  AutoLock locked(_service->_lock);
+  return _done;
+}
+
+Error X86CompileTask::wait() noexcept {
+  X86CompileService* service = _service;
+  AutoLock locked(service->_lock);
+
+  while (!_done)
+    service->_doneCond.wait(service->_lock);
+
+  return _error;
+}
+
+void* X86CompileTask::takeFunc() noexcept {
+  AutoLock locked(_service->_lock);
+
+  void* func = _func;
+  _func = nullptr;
+  return func;
+}
+
+void X86CompileTask::release() noexcept {
+  AutoLock locked(_service->_lock);
+  X86CompileService_deref(this);
+}
+
+} // asmjit namespace
+
+// [Api-End]
+#include "../apiend.h"
+
+// [Guard]
+#endif // !ASMJIT_DISABLE_COMPILER && (ASMJIT_BUILD_X86 || ASMJIT_BUILD_X64)
@@ -0,0 +1,216 @@
+// [AsmJit]
+// Complete x86/x64 JIT and Remote Assembler for C++.
+//
+// [License]
+// Zlib - See LICENSE.md file in the package.
+
+// [Guard]
+#ifndef _ASMJIT_X86_X86COMPILESERVICE_H
+#define _ASMJIT_X86_X86COMPILESERVICE_H
+
+#include "../build.h"
+#if !defined(ASMJIT_DISABLE_COMPILER)
+
+// [Dependencies]
+#include "../base/runtime.h"
+#include "../base/utils.h"
+#include "../x86/x86compiler.h"
+
+// [Api-Begin]
+#include "../apibegin.h"
+
+namespace asmjit {
+
+//! \addtogroup asmjit_x86
+//! \{
+
+// ============================================================================
+// [Forward Declarations]
+// ============================================================================
+
+class X86CompileService;
+
+// ============================================================================
+// [asmjit::X86CompileCallback]
+// ============================================================================
+
+//! Callback that generates code by using `compiler`, see `X86CompileService`.
+//!
+//! The compiler is attached to an assembler of the runtime's architecture, the
+//! callback only adds functions and nodes, it must not call `finalize()`.
+typedef Error (*X86CompileCallback)(X86Compiler* compiler, void* data);
+
+// ============================================================================
+// [asmjit::X86CompileTask]
+// ============================================================================
+
+//! Handle of a function compiled by `X86CompileService`.
+//!
+//! The handle can be polled by `isDone()` or waited for by `wait()` from any
+//! thread. It has to be released by `release()` when not needed anymore. The
+//! compiled function is released with it unless it has been taken by
+//! `takeFunc()`, in which case the caller releases it by `Runtime::release()`.
+class X86CompileTask {
+ public:
+  ASMJIT_NO_COPY(X86CompileTask)
+
+  // --------------------------------------------------------------------------
+  // [Construction / Destruction]
+  // --------------------------------------------------------------------------
+
+  //! \internal
+  ASMJIT_INLINE X86CompileTask(X86CompileService* service, X86CompileCallback callback, void* data) noexcept
+    : _service(service),
+      _callback(callback),
+      _data(data),
+      _next(nullptr),
+      _func(nullptr),
+      _error(kErrorOk),
+      _done(false),
+      _refCount(2) {}
+
+  // --------------------------------------------------------------------------
+  // [Interface]
+  // --------------------------------------------------------------------------
+
+  //! Get whether the function has been compiled (or the compilation failed).
+  ASMJIT_API bool isDone() const noexcept;
+
+  //! Wait until the function is compiled and return the result.
+  ASMJIT_API Error wait() noexcept;
+
+  //! Get the compiled function, `nullptr` if not done or if it failed.
+  //!
+  //! NOTE: Only valid after `isDone()` returned `true` or `wait()` returned.
+  ASMJIT_INLINE void* getFunc() const noexcept { return _func; }
+
+  //! Take the compiled function, `nullptr` if not done or if it failed.
+  //!
+  //! The function is owned by the caller afterwards, it's not released by
+  //! `release()` anymore.
+  ASMJIT_API void* takeFunc() noexcept;
+
+  //! Get the result of the compilation.
+  //!
+  //! NOTE: Only valid after `isDone()` returned `true` or `wait()` returned.
+  ASMJIT_INLINE Error getError() const noexcept { return _error; }
+
+  //! Release the handle.
+  //!
+  //! If the task has not been started yet it's not compiled at all, otherwise
+  //! the function it compiles is released as soon as it's done (unless it has
+  //! been taken by `takeFunc()`).
+  ASMJIT_API void release() noexcept;
+
+  // --------------------------------------------------------------------------
+  // [Members]
+  // --------------------------------------------------------------------------
+
+  //! Service that compiles the task.
+  X86CompileService* _service;
+  //! Callback that generates the code.
+  X86CompileCallback _callback;
+  //! Data passed to `_callback`.
+  void* _data;
+  //! Next task in the queue.
+  X86CompileTask* _next;
+
+  //! Compiled function.
+  void* _func;
+  //! Result of the compilation.
+  Error _error;
+  //! Whether the task is done (protected by the service's lock).
+  bool _done;
+  //! Count of references (the caller and the service).
+  uint32_t _refCount;
+};
+
+// ============================================================================
+// [asmjit::X86CompileService]
+// ============================================================================
+
+//! Asynchronous compilation of functions on a pool of worker threads.
+//!
+//! Each task runs the whole `X86Compiler` -> `X86Assembler` -> `Runtime::add()`
+//! pipeline on a worker, so the thread that submitted it only pays for queuing
+//! the task. Each worker owns its `X86Compiler` and `X86Assembler`, which are
+//! reset (not destroyed) between tasks, so their zones and buffers are reused.
+//!
+//! A typical use is to start with a slow path (an interpreter), submit the
+//! function and switch to the compiled function when `X86CompileTask::isDone()`
+//! returns `true`.
+//!
+//! All methods are thread-safe.
+class X86CompileService {
+ public:
+  ASMJIT_NO_COPY(X86CompileService)
+
+  // --------------------------------------------------------------------------
+  // [Construction / Destruction]
+  // --------------------------------------------------------------------------
+
+  //! Create a `X86CompileService` that adds functions to `runtime` and uses
+  //! `workerCount` threads (count of hardware threads if zero).
+  ASMJIT_API X86CompileService(Runtime* runtime, uint32_t workerCount = 0) noexcept;
+  //! Destroy the `X86CompileService`, tasks already submitted are finished.
+  ASMJIT_API ~X86CompileService() noexcept;
+
+  // --------------------------------------------------------------------------
+  // [Accessors]
+  // --------------------------------------------------------------------------
+
+  //! Get the runtime.
+  ASMJIT_INLINE Runtime* getRuntime() const noexcept { return _runtime; }
+  //! Get count of worker threads (zero if no thread could be created).
+  ASMJIT_INLINE uint32_t getWorkerCount() const noexcept { return _workerCount; }
+
+  // --------------------------------------------------------------------------
+  // [Interface]
+  // --------------------------------------------------------------------------
+
+  //! Submit a function generated by `callback` to be compiled.
+  //!
+  //! The handle stored to `out` has to be released by `X86CompileTask::release()`.
+  //! Returns `kErrorInvalidState` if there is no worker thread.
+  ASMJIT_API Error submit(X86CompileTask** out, X86CompileCallback callback, void* data = nullptr) noexcept;
+
+  // --------------------------------------------------------------------------
+  // [Members]
+  // --------------------------------------------------------------------------
+
+  //! \internal
+  struct Worker;
+
+  //! Runtime.
+  Runtime* _runtime;
+
+  //! Lock that protects the queue and all tasks.
+  Lock _lock;
+  //! Signaled when a task is submitted or the service is being destroyed.
+  CondVar _workCond;
+  //! Signaled when a task is done.
+  CondVar _doneCond;
+
+  //! First task in the queue.
+  X86CompileTask* _queueFirst;
+  //! Last task in the queue.
+  X86CompileTask* _queueLast;
+
+  //! Workers.
+  Worker* _workers;
+  //! Count of workers.
+  uint32_t _workerCount;
+  //! Whether the service is being destroyed.
+  bool _stopping;
+};
+
+//! \}
+
+} // asmjit namespace
+
+// [Api-End]
+#include "../apiend.h"
+
+// [Guard]
+#endif // !ASMJIT_DISABLE_COMPILER
+#endif // _ASMJIT_X86_X86COMPILESERVICE_H
@@ -0,0 +1,535 @@
+// [AsmJit]
+// Complete x86/x64 JIT and Remote Assembler for C++.
+//
+// [License]
+// Zlib - See LICENSE.md file in the package.
+
+// [Dependencies]
+#include "../asmjit/asmjit.h"
+#include "./genblend.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if (ASMJIT_ARCH_X86 || ASMJIT_ARCH_X64) && (defined(ASMJIT_BUILD_X86) || defined(ASMJIT_BUILD_X64))
+# define BENCH_CODEGEN 1
+# if ASMJIT_CC_MSC
+#  include <intrin.h>
+# else
+#  include <x86intrin.h>
+# endif
+#endif
+
+// ============================================================================
+// [Configuration]
+// ============================================================================
+
+static const uint32_t kNumRuns = 200;
+static const uint32_t kNumElements = 4096;
+
+// ============================================================================
+// [Cycles]
+// ============================================================================
+
+#if defined(BENCH_CODEGEN)
+// Time stamp counter, serialized so the measured code can't be reordered
+// around it. The counter ticks at a constant rate on most CPUs, which is not
+// necessarily the core clock, so results are comparable on the same machine.
+struct Cycles {
+  static inline uint64_t begin() {
+    _mm_lfence();
+    uint64_t t = __rdtsc();
+    _mm_lfence();
+    return t;
+  }
+
+  static inline uint64_t end(bool hasRdtscp) {
+    uint64_t t;
+    if (hasRdtscp) {
+      unsigned int aux;
+      t = __rdtscp(&aux);
+    }
+    else {
+      _mm_lfence();
+      t = __rdtsc();
+    }
+    _mm_lfence();
+    return t;
+  }
+};
+
+// ============================================================================
+// [Data]
+// ============================================================================
+
+struct BenchData {
+  uint32_t* dst;
+  uint32_t* src;
+  int32_t* a;
+  int32_t* b;
+  uint8_t* text;
+  size_t n;
+};
+
+// Compare `a` and `b`, each byte may differ by at most `tolerance`.
+static bool compareBytes(const uint32_t* a, const uint32_t* b, size_t n, uint32_t tolerance) {
+  const uint8_t* pa = reinterpret_cast<const uint8_t*>(a);
+  const uint8_t* pb = reinterpret_cast<const uint8_t*>(b);
+
+  for (size_t i = 0; i < n * sizeof(uint32_t); i++) {
+    uint32_t diff = pa[i] > pb[i] ? pa[i] - pb[i] : pb[i] - pa[i];
+    if (diff > tolerance)
+      return false;
+  }
+
+  return true;
+}
+
+// ============================================================================
+// [Kernels - C++]
+// ============================================================================
+
+static void nativeMemcpy(uint32_t* dst, const uint32_t* src, size_t n) {
+  for (size_t i = 0; i < n; i++)
+    dst[i] = src[i];
+}
+
+static int nativeDot(const int32_t* a, const int32_t* b, size_t n) {
+  // Wraps like the generated code does, signed overflow would be undefined.
+  uint32_t acc = 0;
+  for (size_t i = 0; i < n; i++)
+    acc += static_cast<uint32_t>(a[i]) * static_cast<uint32_t>(b[i]);
+  return static_cast<int>(static_cast<int32_t>(acc));
+}
+
+static uint32_t nativeBlendPixel(uint32_t d, uint32_t s) {
+  uint32_t saInv = ~s >> 24;
+
+  uint32_t d_20 = (d     ) & 0x00FF00FF;
+  uint32_t d_31 = (d >> 8) & 0x00FF00FF;
+
+  d_20 *= saInv;
+  d_31 *= saInv;
+
+  d_20 = ((d_20 + ((d_20 >> 8) & 0x00FF00FFU) + 0x00800080U) & 0xFF00FF00U) >> 8;
+  d_31 = ((d_31 + ((d_31 >> 8) & 0x00FF00FFU) + 0x00800080U) & 0xFF00FF00U);
+
+  return d_20 + d_31 + s;
+}
+
+static void nativeBlend(void* dst, const void* src, size_t n) {
+  uint32_t* d = static_cast<uint32_t*>(dst);
+  const uint32_t* s = static_cast<const uint32_t*>(src);
+
+  for (size_t i = 0; i < n; i++)
+    d[i] = nativeBlendPixel(d[i], s[i]);
+}
+
+// FNV-1a.
+static uint32_t nativeHash(const uint8_t* p, size_t n) {
+  uint32_t h = 2166136261U;
+  for (size_t i = 0; i < n; i++) {
+    h ^= p[i];
+    h *= 16777619U;
+  }
+  return h;
+}
+
+// Counts words (1) and numbers (2), each state is a block of code in the
+// generated version, so each character is a few unpredictable branches.
+static uint32_t nativeStateMachine(const uint8_t* p, size_t n) {
+  uint32_t state = 0;
+  uint32_t count = 0;
+
+  for (size_t i = 0; i < n; i++) {
+    uint32_t c = p[i];
+
+    if (c - '0' < 10) {
+      if (state != 2)
+        count += 2;
+      state = 2;
+    }
+    else if ((c | 0x20) - 'a' < 26) {
+      if (state != 1)
+        count += 1;
+      state = 1;
+    }
+    else {
+      state = 0;
+    }
+  }
+
+  return count;
+}
+
+// ============================================================================
+// [Kernels - X86Compiler]
+// ============================================================================
+
+static void genMemcpy(asmjit::X86Compiler& c) {
+  using namespace asmjit;
+
+  X86GpVar dst = c.newIntPtr("dst");
+  X86GpVar src = c.newIntPtr("src");
+  X86GpVar n = c.newIntPtr("n");
+  X86GpVar i = c.newIntPtr("i");
+  X86GpVar t = c.newInt32("t");
+
+  Label L_Loop = c.newLabel();
+  Label L_End = c.newLabel();
+
+  c.addFunc(FuncBuilder3<Void, uint32_t*, const uint32_t*, size_t>(kCallConvHost));
+  c.setArg(0, dst);
+  c.setArg(1, src);
+  c.setArg(2, n);
+
+  c.xor_(i, i);
+  c.test(n, n);
+  c.jz(L_End);
+
+  c.bind(L_Loop);
+  c.mov(t, x86::dword_ptr(src, i, 2));
+  c.mov(x86::dword_ptr(dst, i, 2), t);
+  c.inc(i);
+  c.cmp(i, n);
+  c.jb(L_Loop);
+
+  c.bind(L_End);
+  c.endFunc();
+}
+
+static void genDot(asmjit::X86Compiler& c) {
+  using namespace asmjit;
+
+  X86GpVar a = c.newIntPtr("a");
+  X86GpVar b = c.newIntPtr("b");
+  X86GpVar n = c.newIntPtr("n");
+  X86GpVar i = c.newIntPtr("i");
+  X86GpVar t = c.newInt32("t");
+  X86GpVar acc = c.newInt32("acc");
+
+  Label L_Loop = c.newLabel();
+  Label L_End = c.newLabel();
+
+  c.addFunc(FuncBuilder3<int, const int32_t*, const int32_t*, size_t>(kCallConvHost));
+  c.setArg(0, a);
+  c.setArg(1, b);
+  c.setArg(2, n);
+
+  c.xor_(acc, acc);
+  c.xor_(i, i);
+  c.test(n, n);
+  c.jz(L_End);
+
+  c.bind(L_Loop);
+  c.mov(t, x86::dword_ptr(a, i, 2));
+  c.imul(t, x86::dword_ptr(b, i, 2));
+  c.add(acc, t);
+  c.inc(i);
+  c.cmp(i, n);
+  c.jb(L_Loop);
+
+  c.bind(L_End);
+  c.ret(acc);
+  c.endFunc();
+}
+
+static void genHash(asmjit::X86Compiler& c) {
+  using namespace asmjit;
+
+  X86GpVar p = c.newIntPtr("p");
+  X86GpVar n = c.newIntPtr("n");
+  X86GpVar i = c.newIntPtr("i");
+  X86GpVar t = c.newInt32("t");
+  X86GpVar h = c.newInt32("h");
+
+  Label L_Loop = c.newLabel();
+  Label L_End = c.newLabel();
+
+  c.addFunc(FuncBuilder2<uint32_t, const uint8_t*, size_t>(kCallConvHost));
+  c.setArg(0, p);
+  c.setArg(1, n);
+
+  c.mov(h, imm_u(2166136261U));
+  c.xor_(i, i);
+  c.test(n, n);
+  c.jz(L_End);
+
+  c.bind(L_Loop);
+  c.movzx(t, x86::byte_ptr(p, i));
+  c.xor_(h, t);
+  c.imul(h, h, imm(16777619));
+  c.inc(i);
+  c.cmp(i, n);
+  c.jb(L_Loop);
+
+  c.bind(L_End);
+  c.ret(h);
+  c.endFunc();
+}
+
+static void genStateMachine(asmjit::X86Compiler& c) {
+  using namespace asmjit;
+
+  X86GpVar p = c.newIntPtr("p");
+  X86GpVar n = c.newIntPtr("n");
+  X86GpVar i = c.newIntPtr("i");
+  X86GpVar ch = c.newInt32("ch");
+  X86GpVar t = c.newInt32("t");
+  X86GpVar count = c.newInt32("count");
+
+  // One block per state, entered by the character that leads to the state.
+  Label L_Space = c.newLabel();
+  Label L_Word = c.newLabel();
+  Label L_Number = c.newLabel();
+  Label L_EnterWord = c.newLabel();
+  Label L_EnterNumber = c.newLabel();
+  Label L_End = c.newLabel();
+
+  Label* states[3] = { &L_Space, &L_Word, &L_Number };
+
+  c.addFunc(FuncBuilder2<uint32_t, const uint8_t*, size_t>(kCallConvHost));
+  c.setArg(0, p);
+  c.setArg(1, n);
+
+  c.xor_(count, count);
+  c.xor_(i, i);
+
+  for (uint32_t state = 0; state < 3; state++) {
+    c.bind(*states[state]);
+    c.cmp(i, n);
+    c.je(L_End);
+
+    c.movzx(ch, x86::byte_ptr(p, i));
+    c.inc(i);
+
+    c.mov(t, ch);
+    c.sub(t, '0');
+    c.cmp(t, 10);
+    c.jb(state == 2 ? L_Number : L_EnterNumber);
+
+    c.or_(ch, 0x20);
+    c.sub(ch, 'a');
+    c.cmp(ch, 26);
+    c.jb(state == 1 ? L_Word : L_EnterWord);
+    c.jmp(L_Space);
+  }
+
+  c.bind(L_EnterWord);
+  c.inc(count);
+  c.jmp(L_Word);
+
+  c.bind(L_EnterNumber);
+  c.add(count, 2);
+  c.jmp(L_Number);
+
+  c.bind(L_End);
+  c.ret(count);
+  c.endFunc();
+}
+
+// ============================================================================
+// [Kernels - Invoke]
+// ============================================================================
+
+static uint64_t invokeMemcpy(void* func, BenchData& d) {
+  typedef void (*Func)(uint32_t*, const uint32_t*, size_t);
+  asmjit_cast<Func>(func)(d.dst, d.src, d.n);
+  return 0;
+}
+
+static uint64_t invokeDot(void* func, BenchData& d) {
+  typedef int (*Func)(const int32_t*, const int32_t*, size_t);
+  return static_cast<uint32_t>(asmjit_cast<Func>(func)(d.a, d.b, d.n));
+}
+
+static uint64_t invokeBlend(void* func, BenchData& d) {
+  typedef void (*Func)(void*, const void*, size_t);
+  asmjit_cast<Func>(func)(d.dst, d.src, d.n);
+  return 0;
+}
+
+static uint64_t invokeHash(void* func, BenchData& d) {
+  typedef uint32_t (*Func)(const uint8_t*, size_t);
+  return asmjit_cast<Func>(func)(d.text, d.n);
+}
+
+static uint64_t invokeStateMachine(void* func, BenchData& d) {
+  typedef uint32_t (*Func)(const uint8_t*, size_t);
+  return asmjit_cast<Func>(func)(d.text, d.n);
+}
+
+static const struct {
+  const char* name;
+  void (*generate)(asmjit::X86Compiler& c);
+  void* native;
+  uint64_t (*invoke)(void* func, BenchData& d);
+  uint32_t tolerance;
+} kernels[] = {
+  { "Memcpy"      , genMemcpy      , (void*)nativeMemcpy      , invokeMemcpy      , 0 },
+  { "Dot"         , genDot         , (void*)nativeDot         , invokeDot         , 0 },
+  // SSE2 version divides by 255 differently, components can differ by one.
+  { "Blend"       , asmgen::blend  , (void*)nativeBlend       , invokeBlend       , 1 },
+  { "Hash"        , genHash        , (void*)nativeHash        , invokeHash        , 0 },
+  { "StateMachine", genStateMachine, (void*)nativeStateMachine, invokeStateMachine, 0 }
+};
+
+static const struct {
+  const char* name;
+  uint32_t features;
+} configs[] = {
+  { "Default"  , 0 },
+  { "Optimized", asmjit::Utils::mask(asmjit::kCompilerFeatureFoldConstants,
+                                     asmjit::kCompilerFeatureEliminateCommonSubexpr,
+                                     asmjit::kCompilerFeatureEliminateDeadCode,
+                                     asmjit::kCompilerFeatureCoalesceVars) |
+                 asmjit::Utils::mask(asmjit::kCompilerFeaturePeephole) }
+};
+
+// ============================================================================
+// [Bench]
+// ============================================================================
+
+// Restore the input, kernels that write `dst` would process their own output.
+static void resetData(BenchData& d, const uint32_t* dstInit) {
+  ::memcpy(d.dst, dstInit, d.n * sizeof(uint32_t));
+}
+
+// Best of all runs in cycles per element.
+static double measure(void* func, uint64_t (*invoke)(void*, BenchData&), BenchData& d, const uint32_t* dstInit, bool hasRdtscp) {
+  uint64_t best = ~static_cast<uint64_t>(0);
+
+  for (uint32_t r = 0; r < kNumRuns; r++) {
+    resetData(d, dstInit);
+
+    uint64_t start = Cycles::begin();
+    invoke(func, d);
+    uint64_t cycles = Cycles::end(hasRdtscp) - start;
+
+    if (best > cycles)
+      best = cycles;
+  }
+
+  return static_cast<double>(best) / static_cast<double>(d.n);
+}
+
+// The blend kernel expects premultiplied pixels (each component <= alpha).
+static uint32_t premultiply(uint32_t p) {
+  uint32_t alpha = p >> 24;
+  uint32_t r = (((p >> 16) & 0xFF) * alpha) / 255;
+  uint32_t g = (((p >>  8) & 0xFF) * alpha) / 255;
+  uint32_t b = (((p      ) & 0xFF) * alpha) / 255;
+  return (alpha << 24) | (r << 16) | (g << 8) | b;
+}
+
+static void* allocAligned(void** raw, size_t size) {
+  *raw = ::malloc(size + 64);
+  return reinterpret_cast<void*>((reinterpret_cast<uintptr_t>(*raw) + 63) & ~static_cast<uintptr_t>(63));
+}
+
+int main() {
+  using namespace asmjit;
+
+  const CpuInfo& cpu = CpuInfo::getHost();
+  bool hasRdtscp = cpu.hasFeature(CpuInfo::kX86FeatureRDTSCP);
+
+  if (!cpu.hasFeature(CpuInfo::kX86FeatureRDTSC)) {
+    printf("RDTSC is not available.\n");
+    return 1;
+  }
+
+  size_t n = kNumElements;
+  void* raw[5];
+
+  BenchData d;
+  d.dst = static_cast<uint32_t*>(allocAligned(&raw[0], n * sizeof(uint32_t)));
+  d.src = static_cast<uint32_t*>(allocAligned(&raw[1], n * sizeof(uint32_t)));
+  d.a = static_cast<int32_t*>(allocAligned(&raw[2], n * sizeof(int32_t)));
+  d.b = static_cast<int32_t*>(allocAligned(&raw[3], n * sizeof(int32_t)));
+  d.text = static_cast<uint8_t*>(allocAligned(&raw[4], n));
+  d.n = n;
+
+  uint32_t* dstInit = static_cast<uint32_t*>(::malloc(n * sizeof(uint32_t)));
+  uint32_t* expectedDst = static_cast<uint32_t*>(::malloc(n * sizeof(uint32_t)));
+
+  // Deterministic input, the text mixes words, numbers and separators.
+  static const char textChars[] = "abcXYZ 0129 ,.q";
+  uint32_t seed = 0x12345678;
+
+  for (size_t i = 0; i < n; i++) {
+    seed = seed * 1103515245 + 12345;
+    uint32_t r = seed >> 8;
+
+    dstInit[i] = r * 2654435761U;
+    d.src[i] = premultiply(r ^ (r << 13));
+    d.a[i] = static_cast<int32_t>(r & 0xFFFF) - 0x8000;
+    d.b[i] = static_cast<int32_t>((r >> 8) & 0xFFF);
+    d.text[i] = static_cast<uint8_t>(textChars[r % (sizeof(textChars) - 1)]);
+  }
+
+  printf("%-12s %-9s | %8s | %-5s | %-5s | %-5s | %-5s\n",
+    "Kernel", "Compiler", "Cyc/Elem", "Loads", "Saves", "Moves", "Code");
+
+  JitRuntime runtime;
+  int returnCode = 0;
+
+  for (uint32_t k = 0; k < ASMJIT_ARRAY_SIZE(kernels); k++) {
+    // Kernels either return the result or write it to `dst`.
+    resetData(d, dstInit);
+    uint64_t expected = kernels[k].invoke(kernels[k].native, d);
+    ::memcpy(expectedDst, d.dst, n * sizeof(uint32_t));
+
+    double nativeCycles = measure(kernels[k].native, kernels[k].invoke, d, dstInit, hasRdtscp);
+    printf("%-12s %-9s | %8.3f | %-5s | %-5s | %-5s | %-5s\n",
+      kernels[k].name, "C++", nativeCycles, "-", "-", "-", "-");
+
+    for (uint32_t f = 0; f < ASMJIT_ARRAY_SIZE(configs); f++) {
+      X86Assembler a(&runtime);
+      X86Compiler c(&a);
+
+      c.setFeatures(configs[f].features);
+      kernels[k].generate(c);
+      c.finalize();
+
+      CompilerStats stats = c.getStats();
+      size_t codeSize = a.getCodeSize();
+
+      void* func = a.make();
+      if (func == nullptr) {
+        printf("%-12s %-9s | Failed to compile.\n", kernels[k].name, configs[f].name);
+        returnCode = 1;
+        continue;
+      }
+
+      resetData(d, dstInit);
+      if (kernels[k].invoke(func, d) != expected ||
+          !compareBytes(d.dst, expectedDst, n, kernels[k].tolerance)) {
+        printf("%-12s %-9s | Result differs from C++.\n", kernels[k].name, configs[f].name);
+        returnCode = 1;
+      }
+      else {
+        double cycles = measure(func, kernels[k].invoke, d, dstInit, hasRdtscp);
+        printf("%-12s %-9s | %8.3f | %-5u | %-5u | %-5u | %-5u\n",
+          kernels[k].name, configs[f].name, cycles,
+          stats.getLoadCount(), stats.getSaveCount(), stats.getMoveCount(),
+          static_cast<unsigned int>(codeSize));
+      }
+
+      runtime.release(func);
+    }
+  }
+
+  for (uint32_t i = 0; i < ASMJIT_ARRAY_SIZE(raw); i++)
+    ::free(raw[i]);
+  ::free(dstInit);
+  ::free(expectedDst);
+
+  return returnCode;
+}
+#else
+int main() {
+  printf("The benchmark requires a X86/X64 host.\n");
+  return 0;
+}
+#endif // BENCH_CODEGEN
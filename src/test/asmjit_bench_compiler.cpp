@@ -0,0 +1,469 @@
+// [AsmJit]
+// Complete x86/x64 JIT and Remote Assembler for C++.
+//
+// [License]
+// Zlib - See LICENSE.md file in the package.
+
+// [Dependencies]
+#include "../asmjit/asmjit.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// ============================================================================
+// [Configuration]
+// ============================================================================
+
+static const uint32_t kNumRepeats = 5;
+
+enum OutputFormat {
+  kOutputText = 0,
+  kOutputCsv = 1,
+  kOutputJson = 2
+};
+
+// ============================================================================
+// [Performance]
+// ============================================================================
+
+struct Performance {
+  static inline uint64_t now() {
+    return asmjit::Utils::getNanoTime();
+  }
+
+  inline void reset() {
+    tick = 0;
+    best = ~static_cast<uint64_t>(0);
+  }
+
+  inline uint64_t start() {
+    return (tick = now());
+  }
+
+  inline uint64_t diff() const {
+    return now() - tick;
+  }
+
+  inline uint64_t end() {
+    tick = diff();
+    if (best > tick)
+      best = tick;
+    return tick;
+  }
+
+  uint64_t tick;
+  uint64_t best;
+};
+
+// ============================================================================
+// [Workloads]
+// ============================================================================
+
+#if defined(ASMJIT_BUILD_X86) || defined(ASMJIT_BUILD_X64)
+static int benchCallee(int a, int b) {
+  return a * 3 + b;
+}
+
+// Pseudo-random sequence, the same for each run, so all runs compile the
+// same code.
+static inline uint32_t nextRandom(uint32_t& seed) {
+  seed = seed * 1103515245 + 12345;
+  return seed >> 8;
+}
+
+// Straight-line arithmetic on a few variables, a single basic block.
+static void genArith(asmjit::X86Compiler& c, uint32_t numInsts) {
+  using namespace asmjit;
+
+  X86GpVar vars[6];
+  uint32_t i;
+  uint32_t seed = 0x12345678;
+
+  c.addFunc(FuncBuilder2<int, int, int>(kCallConvHost));
+
+  for (i = 0; i < ASMJIT_ARRAY_SIZE(vars); i++)
+    vars[i] = c.newInt32("v%u", i);
+
+  c.setArg(0, vars[0]);
+  c.setArg(1, vars[1]);
+
+  for (i = 2; i < ASMJIT_ARRAY_SIZE(vars); i++)
+    c.lea(vars[i], x86::ptr(vars[i - 2], vars[i - 1], 1, static_cast<int32_t>(i)));
+
+  for (i = 0; i < numInsts; i++) {
+    uint32_t r = nextRandom(seed);
+
+    X86GpVar& a = vars[r % ASMJIT_ARRAY_SIZE(vars)];
+    X86GpVar& b = vars[(r >> 4) % ASMJIT_ARRAY_SIZE(vars)];
+
+    switch ((r >> 8) & 7) {
+      case 0: c.add(a, b); break;
+      case 1: c.sub(a, b); break;
+      case 2: c.xor_(a, b); break;
+      case 3: c.imul(a, b); break;
+      case 4: c.and_(a, b); break;
+      case 5: c.or_(a, b); break;
+      case 6: c.shl(a, imm((r >> 12) & 7)); break;
+      case 7: c.add(a, imm(static_cast<int32_t>((r >> 12) & 0xFF))); break;
+    }
+  }
+
+  for (i = 1; i < ASMJIT_ARRAY_SIZE(vars); i++)
+    c.add(vars[0], vars[i]);
+
+  c.ret(vars[0]);
+  c.endFunc();
+}
+
+// Loops nested `depth` times, the innermost loop has `numInsts` instructions.
+static void genLoops(asmjit::X86Compiler& c, uint32_t depth, uint32_t numInsts) {
+  using namespace asmjit;
+
+  X86GpVar counters[16];
+  X86GpVar acc = c.newInt32("acc");
+  X86GpVar n = c.newInt32("n");
+  X86GpVar t = c.newInt32("t");
+
+  Label loops[16];
+  uint32_t i;
+  uint32_t seed = 0x9E3779B9;
+
+  if (depth > ASMJIT_ARRAY_SIZE(counters))
+    depth = ASMJIT_ARRAY_SIZE(counters);
+
+  c.addFunc(FuncBuilder1<int, int>(kCallConvHost));
+  c.setArg(0, n);
+  c.mov(acc, n);
+
+  for (i = 0; i < depth; i++) {
+    counters[i] = c.newInt32("i%u", i);
+    loops[i] = c.newLabel();
+
+    c.mov(counters[i], n);
+    c.bind(loops[i]);
+  }
+
+  for (i = 0; i < numInsts; i++) {
+    uint32_t r = nextRandom(seed);
+    X86GpVar& counter = counters[r % depth];
+
+    switch ((r >> 8) & 3) {
+      case 0: c.add(acc, counter); break;
+      case 1: c.lea(t, x86::ptr(acc, counter, 2)); c.xor_(acc, t); break;
+      case 2: c.imul(acc, counter); break;
+      case 3: c.sub(acc, imm(static_cast<int32_t>(r & 0xFF))); break;
+    }
+  }
+
+  for (i = depth; i > 0; i--) {
+    c.dec(counters[i - 1]);
+    c.jnz(loops[i - 1]);
+  }
+
+  c.ret(acc);
+  c.endFunc();
+}
+
+// More variables alive than there are registers, used in a random order.
+static void genPressure(asmjit::X86Compiler& c, uint32_t numVars, uint32_t numInsts) {
+  using namespace asmjit;
+
+  X86GpVar vars[32];
+  X86GpVar src = c.newIntPtr("src");
+  X86GpVar cnt = c.newInt32("cnt");
+
+  uint32_t i;
+  uint32_t seed = 0x12345678;
+
+  if (numVars > ASMJIT_ARRAY_SIZE(vars))
+    numVars = ASMJIT_ARRAY_SIZE(vars);
+
+  c.addFunc(FuncBuilder2<int, const int*, int>(kCallConvHost));
+  c.setArg(0, src);
+  c.setArg(1, cnt);
+
+  for (i = 0; i < numVars; i++) {
+    vars[i] = c.newInt32("v%u", i);
+    c.mov(vars[i], x86::dword_ptr(src, static_cast<int32_t>(i * 4)));
+  }
+
+  Label L_Loop = c.newLabel();
+  c.bind(L_Loop);
+
+  for (i = 0; i < numInsts; i++) {
+    uint32_t r = nextRandom(seed);
+
+    X86GpVar& a = vars[r % numVars];
+    X86GpVar& b = vars[(r >> 6) % numVars];
+
+    switch ((r >> 12) & 3) {
+      case 0: c.add(a, b); break;
+      case 1: c.xor_(a, b); break;
+      case 2: c.imul(a, b); break;
+      case 3: c.add(a, x86::dword_ptr(src, static_cast<int32_t>(((r >> 14) % numVars) * 4))); break;
+    }
+  }
+
+  c.dec(cnt);
+  c.jnz(L_Loop);
+
+  for (i = 1; i < numVars; i++)
+    c.add(vars[0], vars[i]);
+
+  c.ret(vars[0]);
+  c.endFunc();
+}
+
+// Calls of a host function, a few variables are alive across each call.
+static void genCalls(asmjit::X86Compiler& c, uint32_t numCalls) {
+  using namespace asmjit;
+
+  X86GpVar x = c.newInt32("x");
+  X86GpVar y = c.newInt32("y");
+  X86GpVar acc = c.newInt32("acc");
+
+  c.addFunc(FuncBuilder2<int, int, int>(kCallConvHost));
+  c.setArg(0, x);
+  c.setArg(1, y);
+  c.mov(acc, x);
+
+  for (uint32_t i = 0; i < numCalls; i++) {
+    X86CallNode* call = c.call(imm_ptr((void*)benchCallee), FuncBuilder2<int, int, int>(kCallConvHost));
+    call->setArg(0, acc);
+    call->setArg(1, (i & 1) ? x : y);
+    call->setRet(0, acc);
+
+    c.add(x, imm(static_cast<int32_t>(i)));
+  }
+
+  c.add(acc, x);
+  c.ret(acc);
+  c.endFunc();
+}
+
+// Switch over `numCases` values, lowered to a binary search of compares and
+// conditional jumps (there are no jump tables in `X86Compiler`).
+static void genSwitchTree(asmjit::X86Compiler& c, const asmjit::X86GpVar& x, const asmjit::Label* cases, uint32_t first, uint32_t count, const asmjit::Label& L_Default) {
+  using namespace asmjit;
+
+  if (count == 1) {
+    c.cmp(x, imm(static_cast<int32_t>(first)));
+    c.je(cases[first]);
+    c.jmp(L_Default);
+    return;
+  }
+
+  uint32_t half = count / 2;
+  Label L_High = c.newLabel();
+
+  c.cmp(x, imm(static_cast<int32_t>(first + half)));
+  c.jae(L_High);
+  genSwitchTree(c, x, cases, first, half, L_Default);
+
+  c.bind(L_High);
+  genSwitchTree(c, x, cases, first + half, count - half, L_Default);
+}
+
+static void genSwitch(asmjit::X86Compiler& c, uint32_t numCases) {
+  using namespace asmjit;
+
+  X86GpVar x = c.newInt32("x");
+  X86GpVar y = c.newInt32("y");
+  X86GpVar acc = c.newInt32("acc");
+
+  Label* cases = new Label[numCases];
+  Label L_Default = c.newLabel();
+  Label L_End = c.newLabel();
+
+  uint32_t i;
+  uint32_t seed = 0xDEADBEEF;
+
+  c.addFunc(FuncBuilder2<int, int, int>(kCallConvHost));
+  c.setArg(0, x);
+  c.setArg(1, y);
+
+  for (i = 0; i < numCases; i++)
+    cases[i] = c.newLabel();
+
+  genSwitchTree(c, x, cases, 0, numCases, L_Default);
+
+  for (i = 0; i < numCases; i++) {
+    uint32_t r = nextRandom(seed);
+
+    c.bind(cases[i]);
+    c.lea(acc, x86::ptr(y, x, r & 3, static_cast<int32_t>(i)));
+    c.xor_(acc, imm(static_cast<int32_t>(r & 0xFFFF)));
+    c.jmp(L_End);
+  }
+
+  c.bind(L_Default);
+  c.mov(acc, y);
+
+  c.bind(L_End);
+  c.ret(acc);
+  c.endFunc();
+
+  delete[] cases;
+}
+
+// ============================================================================
+// [Bench]
+// ============================================================================
+
+enum Workload {
+  kWorkloadArith = 0,
+  kWorkloadLoops = 1,
+  kWorkloadPressure = 2,
+  kWorkloadCalls = 3,
+  kWorkloadSwitch = 4,
+  kWorkloadCount = 5
+};
+
+static const struct {
+  const char* name;
+  uint32_t iterations;
+} workloads[kWorkloadCount] = {
+  { "Arith"   , 200 },
+  { "Loops"   , 200 },
+  { "Pressure", 50  },
+  { "Calls"   , 200 },
+  { "Switch"  , 100 }
+};
+
+static const struct {
+  const char* name;
+  uint32_t features;
+} allocators[] = {
+  { "Default"      , 0 },
+  { "LiveIntervals", asmjit::Utils::mask(asmjit::kCompilerFeatureLiveIntervals) },
+  { "Baseline"     , asmjit::Utils::mask(asmjit::kCompilerFeatureBaseline) }
+};
+
+static void genWorkload(asmjit::X86Compiler& c, uint32_t workload) {
+  switch (workload) {
+    case kWorkloadArith   : genArith(c, 1000); break;
+    case kWorkloadLoops   : genLoops(c, 8, 200); break;
+    case kWorkloadPressure: genPressure(c, 24, 2000); break;
+    case kWorkloadCalls   : genCalls(c, 100); break;
+    case kWorkloadSwitch  : genSwitch(c, 256); break;
+  }
+}
+
+static uint32_t countNodes(asmjit::X86Compiler& c) {
+  uint32_t count = 0;
+  for (asmjit::HLNode* node = c.getFirstNode(); node != nullptr; node = node->getNext())
+    count++;
+  return count;
+}
+
+static void benchWorkload(uint32_t workload, uint32_t allocator, uint32_t format, bool last) {
+  using namespace asmjit;
+
+  JitRuntime runtime;
+  X86Assembler a(&runtime);
+  X86Compiler c;
+
+  Performance perf;
+  perf.reset();
+
+  uint32_t iterations = workloads[workload].iterations;
+  uint32_t nodeCount = 0;
+  uint32_t spillCount = 0;
+  size_t codeSize = 0;
+
+  // The whole pipeline is measured - nodes are created, compiled, encoded and
+  // relocated into executable memory.
+  for (uint32_t r = 0; r < kNumRepeats; r++) {
+    perf.start();
+    for (uint32_t i = 0; i < iterations; i++) {
+      c.attach(&a);
+      c.setFeatures(allocators[allocator].features);
+      c.resetStats();
+
+      genWorkload(c, workload);
+      if (i == 0)
+        nodeCount = countNodes(c);
+
+      c.finalize();
+      codeSize = a.getCodeSize();
+      spillCount = c.getStats().getSaveCount();
+
+      void* p = a.make();
+      runtime.release(p);
+      a.reset();
+    }
+    perf.end();
+  }
+
+  double timePerFunc = static_cast<double>(perf.best) / static_cast<double>(iterations);
+  double funcsPerSec = timePerFunc > 0.0 ? 1e9 / timePerFunc : 0.0;
+  double nsPerNode = nodeCount != 0 ? timePerFunc / static_cast<double>(nodeCount) : 0.0;
+
+  const char* workloadName = workloads[workload].name;
+  const char* allocatorName = allocators[allocator].name;
+
+  switch (format) {
+    case kOutputText:
+      printf("%-8s %-13s | Nodes: %-6u | Code: %-6u | Spills: %-5u | Time: %9.1f [us] | Speed: %9.1f [funcs/s] | %7.1f [ns/node]\n",
+        workloadName, allocatorName, nodeCount, static_cast<unsigned int>(codeSize), spillCount,
+        timePerFunc / 1000.0, funcsPerSec, nsPerNode);
+      break;
+
+    case kOutputCsv:
+      printf("%s,%s,%u,%u,%u,%.0f,%.1f,%.2f\n",
+        workloadName, allocatorName, nodeCount, static_cast<unsigned int>(codeSize), spillCount,
+        timePerFunc, funcsPerSec, nsPerNode);
+      break;
+
+    case kOutputJson:
+      printf("  {\"workload\": \"%s\", \"allocator\": \"%s\", \"nodes\": %u, \"codeSize\": %u, \"spills\": %u, "
+             "\"timeNs\": %.0f, \"funcsPerSec\": %.1f, \"nsPerNode\": %.2f}%s\n",
+        workloadName, allocatorName, nodeCount, static_cast<unsigned int>(codeSize), spillCount,
+        timePerFunc, funcsPerSec, nsPerNode, last ? "" : ",");
+      break;
+  }
+
+  fflush(stdout);
+}
+#endif
+
+// ============================================================================
+// [Main]
+// ============================================================================
+
+int main(int argc, char* argv[]) {
+  uint32_t format = kOutputText;
+
+  for (int i = 1; i < argc; i++) {
+    if (::strcmp(argv[i], "--csv") == 0) {
+      format = kOutputCsv;
+    }
+    else if (::strcmp(argv[i], "--json") == 0) {
+      format = kOutputJson;
+    }
+    else {
+      fprintf(stderr, "Usage: %s [--csv | --json]\n", argv[0]);
+      return 1;
+    }
+  }
+
+#if defined(ASMJIT_BUILD_X86) || defined(ASMJIT_BUILD_X64)
+  // Time is the best of all repeats, per compiled function, in nanoseconds.
+  if (format == kOutputCsv)
+    printf("workload,allocator,nodes,codeSize,spills,timeNs,funcsPerSec,nsPerNode\n");
+  else if (format == kOutputJson)
+    printf("[\n");
+
+  uint32_t allocatorCount = ASMJIT_ARRAY_SIZE(allocators);
+  for (uint32_t w = 0; w < kWorkloadCount; w++) {
+    for (uint32_t k = 0; k < allocatorCount; k++)
+      benchWorkload(w, k, format, w == kWorkloadCount - 1 && k == allocatorCount - 1);
+  }
+
+  if (format == kOutputJson)
+    printf("]\n");
+#endif
+
+  return 0;
+}
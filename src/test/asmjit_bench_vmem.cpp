@@ -0,0 +1,222 @@
+// [AsmJit]
+// Complete x86/x64 JIT and Remote Assembler for C++.
+//
+// [License]
+// Zlib - See LICENSE.md file in the package.
+
+// [Dependencies]
+#include "../asmjit/asmjit.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// ============================================================================
+// [Configuration]
+// ============================================================================
+
+static const uint32_t kNumRepeats = 5;
+static const uint32_t kNumRounds = 100;
+static const uint32_t kNumFunctions = 32768;
+
+// Bytes embedded after each function (never executed), to make the generated
+// code spread across many pages like a real workload would.
+static const uint32_t kPaddingSize = 192;
+
+// Count of live blocks and count of alloc/release pairs of the churn test.
+static const uint32_t kChurnBlocks = 32768;
+static const uint32_t kChurnIterations = 1000000;
+
+// ============================================================================
+// [Performance]
+// ============================================================================
+
+struct Performance {
+  static inline uint32_t now() {
+    return asmjit::Utils::getTickCount();
+  }
+
+  inline void reset() {
+    tick = 0;
+    best = 0xFFFFFFFF;
+  }
+
+  inline uint32_t start() {
+    return (tick = now());
+  }
+
+  inline uint32_t diff() const {
+    return now() - tick;
+  }
+
+  inline uint32_t end() {
+    tick = diff();
+    if (best > tick)
+      best = tick;
+    return tick;
+  }
+
+  uint32_t tick;
+  uint32_t best;
+};
+
+static double mcps(uint32_t time, uint64_t calls) {
+  if (time == 0)
+    time = 1;
+  return static_cast<double>(calls) / (static_cast<double>(time) * 1000.0);
+}
+
+// ============================================================================
+// [Main]
+// ============================================================================
+
+#if defined(ASMJIT_BUILD_X86) || defined(ASMJIT_BUILD_X64)
+typedef uint32_t (*TinyFunc)(void);
+
+static void benchCalls(const char* name, uint32_t memMgrOptions, const uint32_t* order) {
+  using namespace asmjit;
+
+  JitRuntime runtime(memMgrOptions);
+  X86Assembler a(&runtime);
+
+  TinyFunc* funcs = static_cast<TinyFunc*>(::malloc(sizeof(TinyFunc) * kNumFunctions));
+  uint8_t padding[kPaddingSize];
+  ::memset(padding, 0xCC, kPaddingSize);
+
+  uint32_t r, i;
+  Performance perf;
+
+  // --------------------------------------------------------------------------
+  // [Generate]
+  // --------------------------------------------------------------------------
+
+  perf.reset();
+  perf.start();
+  for (i = 0; i < kNumFunctions; i++) {
+    a.mov(x86::eax, i);
+    a.ret();
+    a.embed(padding, kPaddingSize);
+
+    funcs[i] = asmjit_cast<TinyFunc>(a.make());
+    a.reset();
+  }
+  perf.end();
+
+  size_t codeSize = runtime.getMemMgr()->getAllocatedBytes();
+  uint32_t genTime = perf.best;
+
+  // --------------------------------------------------------------------------
+  // [Call]
+  // --------------------------------------------------------------------------
+
+  uint32_t sum = 0;
+
+  perf.reset();
+  for (r = 0; r < kNumRepeats; r++) {
+    perf.start();
+    for (uint32_t round = 0; round < kNumRounds; round++) {
+      for (i = 0; i < kNumFunctions; i++)
+        sum += funcs[order[i]]();
+    }
+    perf.end();
+  }
+
+  // Every function returns its index, so each round sums to the same value.
+  uint32_t expected = 0;
+  for (i = 0; i < kNumFunctions; i++)
+    expected += i;
+  expected *= kNumRounds * kNumRepeats;
+
+  printf("%-12s | Code: %6u [kB] | Generate: %-5u [ms] | Call: %-5u [ms] | Speed: %7.3f [Mcalls/s]%s\n",
+    name,
+    static_cast<unsigned int>(codeSize / 1024),
+    genTime,
+    perf.best,
+    mcps(perf.best, static_cast<uint64_t>(kNumRounds) * kNumFunctions),
+    sum == expected ? "" : " (INVALID RESULT)");
+
+  for (i = 0; i < kNumFunctions; i++)
+    runtime.release(reinterpret_cast<void*>(funcs[i]));
+  ::free(funcs);
+}
+#endif
+
+static void benchChurn(const char* name, uint32_t memMgrOptions) {
+  using namespace asmjit;
+
+  VMemMgr memMgr(memMgrOptions | kVMemMgrOptionTimeStats);
+  void** blocks = static_cast<void**>(::malloc(sizeof(void*) * kChurnBlocks));
+
+  uint32_t i;
+  uint32_t seed = 100;
+
+  // Most functions are small, some are up to 4kB and a few are larger.
+  for (i = 0; i < kChurnBlocks; i++) {
+    seed = seed * 1103515245 + 12345;
+    blocks[i] = memMgr.alloc(((seed >> 8) % 1024) + 16);
+  }
+
+  Performance perf;
+  perf.reset();
+  perf.start();
+
+  for (i = 0; i < kChurnIterations; i++) {
+    seed = seed * 1103515245 + 12345;
+    uint32_t index = (seed >> 8) % kChurnBlocks;
+
+    seed = seed * 1103515245 + 12345;
+    uint32_t r = seed >> 8;
+    size_t size = (r & 0xF) == 0 ? (r % 16384) + 16 : (r % 4096) + 16;
+
+    memMgr.release(blocks[index]);
+    blocks[index] = memMgr.alloc(size);
+  }
+
+  perf.end();
+
+  VMemStats stats;
+  memMgr.getStats(&stats);
+
+  printf("%-12s | Time: %-5u [ms] | Alloc: %7.1f [ns] | Used: %6u [kB] | Allocated: %6u [kB] | Fragmentation: %0.2f\n",
+    name,
+    perf.best,
+    stats.getAllocTimeAvg(),
+    static_cast<unsigned int>(stats.usedBytes / 1024),
+    static_cast<unsigned int>(stats.allocatedBytes / 1024),
+    stats.getFragmentation());
+
+  for (i = 0; i < kChurnBlocks; i++)
+    memMgr.release(blocks[i]);
+  ::free(blocks);
+}
+
+int main() {
+#if defined(ASMJIT_BUILD_X86) || defined(ASMJIT_BUILD_X64)
+  // Call the functions in a random (but always the same) order.
+  uint32_t* order = static_cast<uint32_t*>(::malloc(sizeof(uint32_t) * kNumFunctions));
+  uint32_t i;
+  uint32_t seed = 100;
+
+  for (i = 0; i < kNumFunctions; i++)
+    order[i] = i;
+
+  for (i = kNumFunctions - 1; i > 0; i--) {
+    seed = seed * 1103515245 + 12345;
+    uint32_t j = (seed >> 8) % (i + 1);
+
+    uint32_t t = order[i];
+    order[i] = order[j];
+    order[j] = t;
+  }
+
+  benchCalls("Pages", asmjit::kVMemMgrOptionNone, order);
+  benchCalls("HugePages", asmjit::kVMemMgrOptionHugePages, order);
+
+  ::free(order);
+#endif
+
+  benchChurn("Bitmap", asmjit::kVMemMgrOptionNone);
+  benchChurn("Slabs", asmjit::kVMemMgrOptionSlabs);
+
+  return 0;
+}
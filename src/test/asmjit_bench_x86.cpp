@@ -113,6 +113,104 @@ static double mbps(uint32_t time, size_t outputSize) {
   return (bytesTotal * 1000) / (static_cast<double>(time) * 1024 * 1024);
 }
 
+// ============================================================================
+// [Pressure]
+// ============================================================================
+
+#if defined(ASMJIT_BUILD_X86) || defined(ASMJIT_BUILD_X64)
+// Generate a large function that keeps more variables alive than there are
+// registers, the variables are used in a pseudo-random order.
+static void genPressure(asmjit::X86Compiler& c, uint32_t numVars, uint32_t numInsts) {
+  using namespace asmjit;
+
+  X86GpVar vars[32];
+  X86GpVar src = c.newIntPtr("src");
+  X86GpVar cnt = c.newInt32("cnt");
+
+  uint32_t i;
+  uint32_t seed = 0x12345678;
+
+  if (numVars > ASMJIT_ARRAY_SIZE(vars))
+    numVars = ASMJIT_ARRAY_SIZE(vars);
+
+  c.addFunc(FuncBuilder2<int, const int*, int>(kCallConvHost));
+  c.setArg(0, src);
+  c.setArg(1, cnt);
+
+  for (i = 0; i < numVars; i++) {
+    vars[i] = c.newInt32("v%u", i);
+    c.mov(vars[i], x86::dword_ptr(src, static_cast<int32_t>(i * 4)));
+  }
+
+  Label L_Loop = c.newLabel();
+  c.bind(L_Loop);
+
+  for (i = 0; i < numInsts; i++) {
+    seed = seed * 1103515245 + 12345;
+
+    X86GpVar& a = vars[(seed >> 8) % numVars];
+    X86GpVar& b = vars[(seed >> 16) % numVars];
+
+    switch ((seed >> 24) & 3) {
+      case 0: c.add(a, b); break;
+      case 1: c.xor_(a, b); break;
+      case 2: c.imul(a, b); break;
+      case 3: c.add(a, x86::dword_ptr(src, static_cast<int32_t>(((seed >> 4) % numVars) * 4))); break;
+    }
+  }
+
+  c.dec(cnt);
+  c.jnz(L_Loop);
+
+  for (i = 1; i < numVars; i++)
+    c.add(vars[0], vars[i]);
+
+  c.ret(vars[0]);
+  c.endFunc();
+}
+#endif
+
+// ============================================================================
+// [FastPath]
+// ============================================================================
+
+#if defined(ASMJIT_BUILD_X86) || defined(ASMJIT_BUILD_X64)
+static const uint32_t kNumFastInsts = 256;
+
+// Emit instructions of a form handled by the fast path of `X86Assembler`. The
+// fast path is not used if an instruction has options, `long_()` changes only
+// the encoding of jumps, so `generic` emits the same code by the generic path.
+typedef void (*FastPathForm)(asmjit::X86Assembler& a, bool generic);
+
+static void fastMovRegReg(asmjit::X86Assembler& a, bool generic) {
+  for (uint32_t i = 0; i < kNumFastInsts; i++) {
+    if (generic) a.long_();
+    a.mov(a.gpz(i & 7), a.gpz((i >> 3) & 7));
+  }
+}
+
+static void fastAddRegImm(asmjit::X86Assembler& a, bool generic) {
+  for (uint32_t i = 0; i < kNumFastInsts; i++) {
+    if (generic) a.long_();
+    a.add(asmjit::x86::gpd(i & 7), static_cast<int>(i * 3));
+  }
+}
+
+static void fastMovRegMem(asmjit::X86Assembler& a, bool generic) {
+  for (uint32_t i = 0; i < kNumFastInsts; i++) {
+    if (generic) a.long_();
+    a.mov(a.gpz(i & 7), asmjit::x86::ptr(a.zsi, a.zdi, i & 3, static_cast<int32_t>(i * 4)));
+  }
+}
+
+static void fastAddMemReg(asmjit::X86Assembler& a, bool generic) {
+  for (uint32_t i = 0; i < kNumFastInsts; i++) {
+    if (generic) a.long_();
+    a.add(asmjit::x86::ptr(a.zsi, static_cast<int32_t>(i * 4)), asmjit::x86::gpd(i & 7));
+  }
+}
+#endif
+
 // ============================================================================
 // [Main]
 // ============================================================================
@@ -157,6 +255,52 @@ static void benchX86(uint32_t arch, uint32_t callConv) {
   printf("%-12s (%s) | Time: %-6u [ms] | Speed: %7.3f [MB/s]\n",
     "X86Assembler", archName, perf.best, mbps(perf.best, asmOutputSize));
 
+  // --------------------------------------------------------------------------
+  // [Bench - Fast Path]
+  // --------------------------------------------------------------------------
+
+  static const struct {
+    const char* name;
+    FastPathForm form;
+  } fastForms[] = {
+    { "mov r, r"  , fastMovRegReg },
+    { "add r, imm", fastAddRegImm },
+    { "mov r, [m]", fastMovRegMem },
+    { "add [m], r", fastAddMemReg }
+  };
+
+  for (uint32_t k = 0; k < ASMJIT_ARRAY_SIZE(fastForms); k++) {
+    uint32_t best[2];
+    uint8_t code[2][kNumFastInsts * 16];
+    size_t codeSize[2];
+
+    // Fast path first, then the generic encoder.
+    for (uint32_t generic = 0; generic < 2; generic++) {
+      perf.reset();
+      for (r = 0; r < kNumRepeats; r++) {
+        perf.start();
+        for (i = 0; i < kNumIterations; i++) {
+          fastForms[k].form(a, generic != 0);
+          a.reset();
+        }
+        perf.end();
+      }
+
+      // Keep the code to check both paths emit the same bytes.
+      fastForms[k].form(a, generic != 0);
+      best[generic] = perf.best;
+      codeSize[generic] = a.getOffset();
+      ::memcpy(code[generic], a.getBuffer(), codeSize[generic]);
+      a.reset();
+    }
+
+    bool same = codeSize[0] == codeSize[1] && ::memcmp(code[0], code[1], codeSize[0]) == 0;
+
+    printf("%-12s (%s) | Time: %-6u [ms] | Generic: %-6u [ms] | %s%s\n",
+      "X86Assembler", archName, best[0], best[1], fastForms[k].name,
+      same ? "" : " (DIFFERENT CODE)");
+  }
+
   // --------------------------------------------------------------------------
   // [Bench - Blend]
   // --------------------------------------------------------------------------
@@ -181,10 +325,54 @@ static void benchX86(uint32_t arch, uint32_t callConv) {
 
   printf("%-12s (%s) | Time: %-6u [ms] | Speed: %7.3f [MB/s]\n",
     "X86Compiler", archName, perf.best, mbps(perf.best, cmpOutputSize));
+
+  // --------------------------------------------------------------------------
+  // [Bench - Allocators]
+  // --------------------------------------------------------------------------
+
+  static const struct {
+    const char* name;
+    uint32_t features;
+  } allocators[] = {
+    { "Default"      , 0 },
+    { "LiveIntervals", Utils::mask(kCompilerFeatureLiveIntervals) },
+    { "Baseline"     , Utils::mask(kCompilerFeatureBaseline) }
+  };
+
+  for (uint32_t k = 0; k < ASMJIT_ARRAY_SIZE(allocators); k++) {
+    CompilerStats stats;
+
+    perf.reset();
+    for (r = 0; r < kNumRepeats; r++) {
+      cmpOutputSize = 0;
+      perf.start();
+
+      c.attach(&a);
+      c.setFeatures(allocators[k].features);
+      c.resetStats();
+
+      genPressure(c, 24, 20000);
+      c.finalize();
+      stats = c.getStats();
+
+      void* p = a.make();
+      runtime.release(p);
+
+      cmpOutputSize += a.getCodeSize();
+      a.reset();
+      perf.end();
+    }
+
+    printf("%-12s (%s) | Time: %-6u [ms] | Size: %-7u | Loads: %-6u | Saves: %-6u | Moves: %-6u | %s\n",
+      "X86Compiler", archName, perf.best,
+      static_cast<unsigned int>(cmpOutputSize),
+      stats.getLoadCount(), stats.getSaveCount(), stats.getMoveCount(),
+      allocators[k].name);
+  }
 }
 #endif
 
-int main(int argc, char* argv[]) {
+int main() {
 #if defined(ASMJIT_BUILD_X86)
   benchX86(asmjit::kArchX86, asmjit::kCallConvX86CDecl);
 #endif
@@ -51,6 +51,8 @@ int main(int argc, char* argv[]) {
 # endif // ASMJIT_BUILD_X64
   };
 
+  bool failed = false;
+
   for (int i = 0; i < ASMJIT_ARRAY_SIZE(infoList); i++) {
     const OpcodeDumpInfo& info = infoList[i];
 
@@ -64,6 +66,22 @@ int main(int argc, char* argv[]) {
     a.setLogger(&logger);
 
     asmgen::opcode(a, info.useRex1, info.useRex2);
+
+    // The assembler uses a faster path to encode common instructions when
+    // there is no logger, the code generated by both paths must be the same.
+    asmjit::X86Assembler b(&runtime, info.arch);
+    asmgen::opcode(b, info.useRex1, info.useRex2);
+
+    size_t codeSize = a.getOffset();
+    if (b.getOffset() != codeSize || ::memcmp(a.getBuffer(), b.getBuffer(), codeSize) != 0) {
+      size_t offset = 0;
+      while (offset < codeSize && offset < b.getOffset() && a.getBuffer()[offset] == b.getBuffer()[offset])
+        offset++;
+
+      printf("[Failure] Code generated without logger differs at offset %u.\n", static_cast<unsigned int>(offset));
+      failed = true;
+    }
+
     VoidFunc p = asmjit_cast<VoidFunc>(a.make());
 
     // Only run if disassembly makes sense.
@@ -73,5 +91,5 @@ int main(int argc, char* argv[]) {
     runtime.release((void*)p);
   }
 
-  return 0;
+  return failed ? 1 : 0;
 }
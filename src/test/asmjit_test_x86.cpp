@@ -1905,6 +1905,166 @@ struct X86Test_AllocBlend : public X86Test {
   }
 };
 
+// ============================================================================
+// [X86Test_AllocReuse]
+// ============================================================================
+
+struct X86Test_AllocReuse : public X86Test {
+  X86Test_AllocReuse() : X86Test("[Alloc] Reuse") {}
+
+  static void add(PodVector<X86Test*>& tests) {
+    tests.append(new X86Test_AllocReuse());
+  }
+
+  virtual void compile(X86Compiler& c) {
+    c.addFunc(FuncBuilder2<int, int*, intptr_t>(kCallConvHost));
+
+    X86GpVar buf = c.newIntPtr("buf");
+    X86GpVar idx = c.newIntPtr("idx");
+
+    c.setArg(0, buf);
+    c.setArg(1, idx);
+
+    X86GpVar a = c.newIntPtr("a");
+    X86GpVar b = c.newIntPtr("b");
+    X86GpVar t = c.newIntPtr("t");
+    X86GpVar u = c.newIntPtr("u");
+
+    X86GpVar x = c.newInt32("x");
+    X86GpVar y = c.newInt32("y");
+    X86GpVar z = c.newInt32("z");
+    X86GpVar w = c.newInt32("w");
+
+    c.lea(a, x86::ptr(buf, idx, 2));
+    c.mov(x, x86::dword_ptr(buf, idx, 2));
+    c.mov(y, x86::dword_ptr(buf, idx, 2));         // Same load as `x`.
+
+    c.mov(t, idx);
+    c.shl(t, 2);
+    c.mov(u, idx);
+    c.shl(u, 2);                                   // Same shift as `t`.
+
+    c.mov(w, x86::dword_ptr(buf, idx, 2, 4));
+    c.mov(x86::dword_ptr(buf, idx, 2, 4), x);      // Clobbers `w`.
+    c.mov(z, x86::dword_ptr(buf, idx, 2, 4));      // Has to be loaded again.
+
+    c.lea(b, x86::ptr(buf, idx, 2));               // Same address as `a`.
+    c.sub(b, a);
+
+    c.add(x, y);
+    c.add(x, z);
+    c.add(x, w);
+    c.add(x, b.r32());
+    c.add(x, t.r32());
+    c.add(x, u.r32());
+
+    c.ret(x);
+    c.endFunc();
+  }
+
+  virtual bool run(void* _func, StringBuilder& result, StringBuilder& expect) {
+    typedef int (*Func)(int*, intptr_t);
+    Func func = asmjit_cast<Func>(_func);
+
+    int buf[4] = { 10, 20, 30, 40 };
+    int resultRet = func(buf, 1);
+    int expectRet = 20 + 20 + 20 + 30 + 0 + 4 + 4;
+
+    result.setFormat("ret=%d, buf[2]=%d", resultRet, buf[2]);
+    expect.setFormat("ret=%d, buf[2]=%d", expectRet, 20);
+
+    return resultRet == expectRet && buf[2] == 20;
+  }
+};
+
+// ============================================================================
+// [X86Test_AllocLoopPressure]
+// ============================================================================
+
+struct X86Test_AllocLoopPressure : public X86Test {
+  X86Test_AllocLoopPressure() : X86Test("[Alloc] LoopPressure") {}
+
+  enum { kCount = 9, kColdCount = 16 };
+
+  static void add(PodVector<X86Test*>& tests) {
+    tests.append(new X86Test_AllocLoopPressure());
+  }
+
+  virtual void compile(X86Compiler& c) {
+    c.addFunc(FuncBuilder3<int, const int*, int, int>(kCallConvHost));
+
+    X86GpVar buf = c.newIntPtr("buf");
+    X86GpVar cnt = c.newInt32("cnt");
+    X86GpVar k = c.newInt32("k");
+
+    c.setArg(0, buf);
+    c.setArg(1, cnt);
+    c.setArg(2, k);
+
+    // More variables than registers, all alive across the loop, but not
+    // used by it - they should be spilled instead of `idx` and `sum`.
+    X86GpVar cold[kColdCount];
+    uint32_t i;
+
+    for (i = 0; i < kColdCount; i++) {
+      cold[i] = c.newInt32("cold");
+      c.mov(cold[i], k);
+      c.add(cold[i], static_cast<int>(i));
+    }
+
+    X86GpVar idx = c.newIntPtr("idx");
+    X86GpVar sum = c.newInt32("sum");
+    X86GpVar tmp = c.newInt32("tmp");
+
+    Label L_Loop = c.newLabel();
+    Label L_Exit = c.newLabel();
+
+    c.xor_(idx, idx);
+    c.xor_(sum, sum);
+    c.test(cnt, cnt);
+    c.jz(L_Exit);
+
+    c.bind(L_Loop);
+    c.mov(tmp, x86::dword_ptr(buf, idx, 2));
+    c.imul(tmp, k);
+    c.add(sum, tmp);
+    c.inc(idx);
+    c.dec(cnt);
+    c.jnz(L_Loop);
+
+    c.bind(L_Exit);
+    for (i = 0; i < kColdCount; i++)
+      c.add(sum, cold[i]);
+
+    c.ret(sum);
+    c.endFunc();
+  }
+
+  virtual bool run(void* _func, StringBuilder& result, StringBuilder& expect) {
+    typedef int (*Func)(const int*, int, int);
+    Func func = asmjit_cast<Func>(_func);
+
+    int buf[kCount];
+    int expectRet = 0;
+    int i;
+
+    for (i = 0; i < kCount; i++) {
+      buf[i] = i * 3 + 1;
+      expectRet += buf[i] * 7;
+    }
+
+    for (i = 0; i < kColdCount; i++)
+      expectRet += 7 + i;
+
+    int resultRet = func(buf, kCount, 7);
+
+    result.setFormat("ret=%d", resultRet);
+    expect.setFormat("ret=%d", expectRet);
+
+    return resultRet == expectRet;
+  }
+};
+
 // ============================================================================
 // [X86Test_CallBase]
 // ============================================================================
@@ -3109,6 +3269,23 @@ struct X86TestSuite {
   // --------------------------------------------------------------------------
 
   int run();
+  bool runBatch(FILE* file);
+  bool runArtifact(FILE* file);
+  bool runPIC(FILE* file);
+  bool runVeneers(FILE* file);
+  bool runAddressHint(FILE* file);
+  bool runAsync(FILE* file);
+  bool runFeatures(FILE* file);
+  bool runBaseline(FILE* file);
+  bool runLiveIntervals(FILE* file);
+  bool runScheduler(FILE* file);
+  bool runPeephole(FILE* file);
+  bool runFoldConstants(FILE* file);
+  bool runDeadCode(FILE* file);
+  bool runCommonSubexpr(FILE* file);
+  bool runCoalesce(FILE* file);
+  bool runParallel(FILE* file);
+  bool runProfile(FILE* file);
 
   // --------------------------------------------------------------------------
   // [Members]
@@ -3120,6 +3297,7 @@ struct X86TestSuite {
   int returnCode;
   int binSize;
   bool alwaysPrintLog;
+  uint32_t memMgrOptions;
 };
 
 #define ADD_TEST(_Class_) \
@@ -3128,7 +3306,8 @@ struct X86TestSuite {
 X86TestSuite::X86TestSuite() :
   returnCode(0),
   binSize(0),
-  alwaysPrintLog(false) {
+  alwaysPrintLog(false),
+  memMgrOptions(kVMemMgrOptionNone) {
 
   // Align.
   ADD_TEST(X86Test_AlignBase);
@@ -3167,6 +3346,8 @@ X86TestSuite::X86TestSuite() :
   ADD_TEST(X86Test_AllocStack2);
   ADD_TEST(X86Test_AllocMemcpy);
   ADD_TEST(X86Test_AllocBlend);
+  ADD_TEST(X86Test_AllocReuse);
+  ADD_TEST(X86Test_AllocLoopPressure);
 
   // Call.
   ADD_TEST(X86Test_CallBase);
@@ -3216,7 +3397,7 @@ int X86TestSuite::run() {
   stringLogger.addOptions(Logger::kOptionBinaryForm);
 
   for (i = 0; i < count; i++) {
-    JitRuntime runtime;
+    JitRuntime runtime(memMgrOptions);
     X86Assembler a(&runtime);
     X86Compiler c(&a);
 
@@ -3276,6 +3457,57 @@ int X86TestSuite::run() {
     fflush(file);
   }
 
+  if (!runBatch(file))
+    returnCode = 1;
+
+  if (!runArtifact(file))
+    returnCode = 1;
+
+  if (!runPIC(file))
+    returnCode = 1;
+
+  if (!runVeneers(file))
+    returnCode = 1;
+
+  if (!runAddressHint(file))
+    returnCode = 1;
+
+  if (!runAsync(file))
+    returnCode = 1;
+
+  if (!runFeatures(file))
+    returnCode = 1;
+
+  if (!runBaseline(file))
+    returnCode = 1;
+
+  if (!runLiveIntervals(file))
+    returnCode = 1;
+
+  if (!runScheduler(file))
+    returnCode = 1;
+
+  if (!runPeephole(file))
+    returnCode = 1;
+
+  if (!runFoldConstants(file))
+    returnCode = 1;
+
+  if (!runDeadCode(file))
+    returnCode = 1;
+
+  if (!runCommonSubexpr(file))
+    returnCode = 1;
+
+  if (!runCoalesce(file))
+    returnCode = 1;
+
+  if (!runParallel(file))
+    returnCode = 1;
+
+  if (!runProfile(file))
+    returnCode = 1;
+
   fputs("\n", file);
   fputs(output.getData(), file);
   fflush(file);
@@ -3283,41 +3515,1706 @@ int X86TestSuite::run() {
   return returnCode;
 }
 
-// ============================================================================
-// [CmdLine]
-// ============================================================================
+// Target of the functions that tail-jump out of the batch (needs relocation).
+static int batchTarget(void) { return 1000; }
 
-struct CmdLine {
-  ASMJIT_INLINE CmdLine(int argc, char** argv) :
-    _argc(argc),
-    _argv(argv) {}
+bool X86TestSuite::runBatch(FILE* file) {
+  enum { kBatchSize = 64 };
+  typedef int (*Func)(void);
 
-  bool hasArg(const char* arg) {
-    for (int i = 1; i < _argc; i++) {
-      if (::strcmp(_argv[i], arg) == 0)
-        return true;
+  JitRuntime runtime(memMgrOptions);
+  Assembler* assemblers[kBatchSize];
+  void* funcs[kBatchSize];
+
+  size_t i;
+  bool success = true;
+
+  // A veneer of a far target is kept by the runtime, create it first so it's
+  // not counted as memory used by the batch.
+  {
+    X86Assembler a(&runtime);
+    a.jmp(imm_ptr((void*)batchTarget));
+
+    void* func;
+    if (runtime.add(&func, &a) == kErrorOk)
+      runtime.release(func);
+  }
+  size_t usedBytes = runtime.getMemMgr()->getUsedBytes();
+
+  for (i = 0; i < kBatchSize; i++) {
+    X86Assembler* a = new X86Assembler(&runtime);
+    assemblers[i] = a;
+
+    if ((i & 7) == 7) {
+      a->jmp(imm_ptr((void*)batchTarget));
+    }
+    else {
+      a->mov(x86::eax, static_cast<uint32_t>(i));
+      a->ret();
+    }
+  }
+
+  Error err = runtime.addBatch(funcs, assemblers, kBatchSize, 32);
+  if (err != kErrorOk) {
+    fprintf(file, "[Failure] Runtime AddBatch (%s).\n", DebugUtils::errorAsString(err));
+    success = false;
+  }
+  else {
+    for (i = 0; i < kBatchSize; i++) {
+      int expected = ((i & 7) == 7) ? 1000 : static_cast<int>(i);
+      int result = asmjit_cast<Func>(funcs[i])();
+
+      if (result != expected) {
+        fprintf(file, "[Failure] Runtime AddBatch (function #%u returned %d, expected %d).\n",
+          static_cast<unsigned int>(i), result, expected);
+        success = false;
+      }
+    }
+
+    // Release every other function individually and the rest as a unit.
+    for (i = 0; i < kBatchSize; i += 2) {
+      if (runtime.release(funcs[i]) != kErrorOk)
+        success = false;
+      funcs[i] = nullptr;
+    }
+
+    if (runtime.releaseBatch(funcs, kBatchSize) != kErrorOk)
+      success = false;
+
+    if (runtime.getMemMgr()->getUsedBytes() != usedBytes)
+      success = false;
+
+    fprintf(file, "[%s] Runtime AddBatch.\n", success ? "Success" : "Failure");
+  }
+
+  for (i = 0; i < kBatchSize; i++)
+    delete assemblers[i];
+
+  fflush(file);
+  return success;
+}
+
+bool X86TestSuite::runArtifact(FILE* file) {
+  enum { kArtifactSize = 16 };
+  typedef int (*Func)(void);
+
+  static const char fileName[] = "asmjit_test_artifact.bin";
+  static const uint64_t userTag = ASMJIT_UINT64_C(0x0123456789ABCDEF);
+
+  JitRuntime runtime(memMgrOptions);
+  bool success = true;
+
+  size_t i;
+  Error err = kErrorOk;
+
+  // Generate functions and store them to the artifact.
+  {
+    CodeArtifactWriter writer(nullptr, userTag);
+
+    for (i = 0; i < kArtifactSize && err == kErrorOk; i++) {
+      X86Assembler a(&runtime);
+
+      if ((i & 3) == 3) {
+        a.jmp(imm_ptr((void*)batchTarget));
+      }
+      else {
+        a.mov(x86::eax, static_cast<uint32_t>(i * 3));
+        a.ret();
+      }
+
+      err = writer.add(CodeCacheKey(i, 0), &a);
     }
+
+    if (err == kErrorOk)
+      err = writer.save(fileName);
+  }
+
+  if (err != kErrorOk) {
+    fprintf(file, "[Failure] Runtime CodeArtifact (%s).\n", DebugUtils::errorAsString(err));
+    fflush(file);
+    ::remove(fileName);
     return false;
   }
 
-  // --------------------------------------------------------------------------
-  // [Members]
-  // --------------------------------------------------------------------------
+  // An artifact must be rejected if the CPU or the user tag doesn't match.
+  {
+    CodeArtifact artifact;
+    CpuInfo cpuInfo(CpuInfo::getHost());
+    cpuInfo.addFeature(sizeof(cpuInfo._features) * 8 - 1);
 
-  int _argc;
-  char** _argv;
-};
+    if (artifact.open(fileName, nullptr, userTag + 1) != kErrorInvalidArch ||
+        artifact.open(fileName, &cpuInfo, userTag) != kErrorInvalidArch ||
+        artifact.isOpen()) {
+      fprintf(file, "[Failure] Runtime CodeArtifact (mismatch not detected).\n");
+      success = false;
+    }
+  }
 
-// ============================================================================
-// [Main]
-// ============================================================================
+  // Load functions (in reverse order) and verify them.
+  {
+    CodeArtifact artifact;
+    void* funcs[kArtifactSize];
 
-int main(int argc, char* argv[]) {
-  X86TestSuite testSuite;
-  CmdLine cmd(argc, argv);
+    err = artifact.open(fileName, nullptr, userTag);
+    if (err != kErrorOk || artifact.getCount() != kArtifactSize) {
+      fprintf(file, "[Failure] Runtime CodeArtifact (%s).\n", DebugUtils::errorAsString(err));
+      success = false;
+    }
+    else {
+      for (i = kArtifactSize; i != 0; i--) {
+        X86Assembler a(&runtime);
+        size_t index = i - 1;
+
+        err = artifact.load(&funcs[index], CodeCacheKey(index, 0), &a);
+        if (err != kErrorOk) {
+          fprintf(file, "[Failure] Runtime CodeArtifact (%s).\n", DebugUtils::errorAsString(err));
+          success = false;
+          break;
+        }
+      }
 
-  if (cmd.hasArg("--always-print-log")) {
-    testSuite.alwaysPrintLog = true;
+      if (err == kErrorOk) {
+        for (i = 0; i < kArtifactSize; i++) {
+          int expected = ((i & 3) == 3) ? 1000 : static_cast<int>(i * 3);
+          int result = asmjit_cast<Func>(funcs[i])();
+
+          if (result != expected) {
+            fprintf(file, "[Failure] Runtime CodeArtifact (function #%u returned %d, expected %d).\n",
+              static_cast<unsigned int>(i), result, expected);
+            success = false;
+          }
+          runtime.release(funcs[i]);
+        }
+      }
+    }
+  }
+
+  ::remove(fileName);
+
+  if (success)
+    fprintf(file, "[Success] Runtime CodeArtifact.\n");
+
+  fflush(file);
+  return success;
+}
+
+#if ASMJIT_ARCH_X64
+// Second target of position independent code (first is `batchTarget`).
+static int picTarget(void) { return 7; }
+
+// Generate a function that calls `batchTarget` and `picTarget` and returns the
+// sum of their results, and a function that tail-jumps to `batchTarget`.
+static void generatePICFuncs(X86Assembler& a0, X86Assembler& a1) {
+  a0.sub(x86::rsp, 40);
+  a0.call(imm_ptr((void*)batchTarget));
+  a0.mov(x86::dword_ptr(x86::rsp, 32), x86::eax);
+  a0.call(imm_ptr((void*)picTarget));
+  a0.add(x86::eax, x86::dword_ptr(x86::rsp, 32));
+  a0.call(imm_ptr((void*)picTarget));
+  a0.add(x86::eax, x86::dword_ptr(x86::rsp, 32));
+  a0.add(x86::rsp, 40);
+  a0.ret();
+
+  a1.jmp(imm_ptr((void*)batchTarget));
+}
+#endif // ASMJIT_ARCH_X64
+
+bool X86TestSuite::runPIC(FILE* file) {
+#if ASMJIT_ARCH_X64
+  typedef int (*Func)(void);
+
+  JitRuntime runtime(memMgrOptions);
+  bool success = true;
+
+  X86Assembler a0(&runtime), a1(&runtime);
+  X86Assembler p0(&runtime), p1(&runtime);
+
+  p0.addAsmOptions(Assembler::kOptionPIC);
+  p1.addAsmOptions(Assembler::kOptionPIC);
+
+  generatePICFuncs(a0, a1);
+  generatePICFuncs(p0, p1);
+
+  // Each target is referenced through a single slot.
+  if (p0._picSlots.getLength() != 2) {
+    fprintf(file, "[Failure] Runtime PIC (slots not shared).\n");
+    success = false;
+  }
+
+  Func funcs[4];
+  Error err = kErrorOk;
+
+  if (err == kErrorOk) err = runtime.add((void**)&funcs[0], &a0);
+  if (err == kErrorOk) err = runtime.add((void**)&funcs[1], &a1);
+  if (err == kErrorOk) err = runtime.add((void**)&funcs[2], &p0);
+  if (err == kErrorOk) err = runtime.add((void**)&funcs[3], &p1);
+
+  if (err != kErrorOk) {
+    fprintf(file, "[Failure] Runtime PIC (%s).\n", DebugUtils::errorAsString(err));
+    fflush(file);
+    return false;
+  }
+
+  // Position independent code must not need any relocation or trampoline.
+  if (p0.getRelocations().getLength() != 0 || p0.getTrampolinesSize() != 0 ||
+      p1.getRelocations().getLength() != 0 || p1.getTrampolinesSize() != 0 ||
+      p0.hasPICSlots() || p1.hasPICSlots()) {
+    fprintf(file, "[Failure] Runtime PIC (code needs relocation).\n");
+    success = false;
+  }
+
+  // Must match the code relocated by the regular path.
+  int expected0 = funcs[0]();
+  int expected1 = funcs[1]();
+
+  if (expected0 != 1007 || expected1 != 1000 ||
+      funcs[2]() != expected0 || funcs[3]() != expected1) {
+    fprintf(file, "[Failure] Runtime PIC (results don't match).\n");
+    success = false;
+  }
+
+  // Copy the position independent code as is to another address.
+  {
+    X86Assembler c0(&runtime), c1(&runtime);
+    Func copies[2] = { nullptr, nullptr };
+
+    if (c0.setCode(p0.getBuffer(), p0.getOffset(), nullptr, 0, 0) != kErrorOk ||
+        c1.setCode(p1.getBuffer(), p1.getOffset(), nullptr, 0, 0) != kErrorOk ||
+        runtime.add((void**)&copies[0], &c0) != kErrorOk ||
+        runtime.add((void**)&copies[1], &c1) != kErrorOk ||
+        ::memcmp((void*)copies[0], (void*)funcs[2], p0.getOffset()) != 0 ||
+        copies[0]() != expected0 || copies[1]() != expected1) {
+      fprintf(file, "[Failure] Runtime PIC (copied code doesn't match).\n");
+      success = false;
+    }
+
+    for (size_t i = 0; i < 2; i++) {
+      if (copies[i] != nullptr)
+        runtime.release((void*)copies[i]);
+    }
+  }
+
+  for (size_t i = 0; i < 4; i++)
+    runtime.release((void*)funcs[i]);
+
+  if (success)
+    fprintf(file, "[Success] Runtime PIC.\n");
+
+  fflush(file);
+  return success;
+#else
+  ASMJIT_UNUSED(file);
+  return true;
+#endif // ASMJIT_ARCH_X64
+}
+
+bool X86TestSuite::runVeneers(FILE* file) {
+#if ASMJIT_ARCH_X64
+  enum { kFuncCount = 16 };
+  typedef int (*Func)(void);
+
+  JitRuntime runtime(memMgrOptions);
+  Func funcs[kFuncCount * 2];
+
+  size_t i;
+  bool success = true;
+
+  for (i = 0; i < kFuncCount; i++) {
+    X86Assembler a0(&runtime), a1(&runtime);
+    generatePICFuncs(a0, a1);
+
+    if (runtime.add((void**)&funcs[i * 2 + 0], &a0) != kErrorOk ||
+        runtime.add((void**)&funcs[i * 2 + 1], &a1) != kErrorOk) {
+      fprintf(file, "[Failure] Runtime Veneers (add failed).\n");
+      fflush(file);
+      return false;
+    }
+  }
+
+  for (i = 0; i < kFuncCount; i++) {
+    if (funcs[i * 2 + 0]() != 1007 || funcs[i * 2 + 1]() != 1000) {
+      fprintf(file, "[Failure] Runtime Veneers (function #%u returned a wrong value).\n",
+        static_cast<unsigned int>(i));
+      success = false;
+    }
+  }
+
+  // Far targets (if any) need a single veneer each, shared by all functions.
+  size_t veneerCount = runtime.getVeneerCount();
+  if (veneerCount != 0 && veneerCount != 2) {
+    fprintf(file, "[Failure] Runtime Veneers (%u veneers created, expected 2).\n",
+      static_cast<unsigned int>(veneerCount));
+    success = false;
+  }
+
+  // A call site that no memory can reach doesn't get a veneer and doesn't
+  // keep the page allocated for it.
+  size_t usedBytes = runtime.getMemMgr()->getUsedBytes();
+  Ptr unreachable = static_cast<Ptr>(1) << 62;
+
+  for (i = 0; i < 4; i++) {
+    if (runtime._getVeneer(static_cast<Ptr>((uintptr_t)batchTarget), unreachable) != 0) {
+      fprintf(file, "[Failure] Runtime Veneers (veneer out of reach of the call site).\n");
+      success = false;
+    }
+  }
+
+  if (runtime.getMemMgr()->getUsedBytes() != usedBytes) {
+    fprintf(file, "[Failure] Runtime Veneers (unused veneer page leaked).\n");
+    success = false;
+  }
+
+  for (i = 0; i < kFuncCount * 2; i++)
+    runtime.release((void*)funcs[i]);
+
+  if (success)
+    fprintf(file, "[Success] Runtime Veneers (%u veneers).\n", static_cast<unsigned int>(veneerCount));
+
+  fflush(file);
+  return success;
+#else
+  ASMJIT_UNUSED(file);
+  return true;
+#endif // ASMJIT_ARCH_X64
+}
+
+bool X86TestSuite::runAddressHint(FILE* file) {
+#if ASMJIT_ARCH_X64
+  typedef int (*Func)(void);
+
+  JitRuntime runtime(memMgrOptions);
+  runtime.setAddressHint((const void*)batchTarget);
+
+  X86Assembler a0(&runtime), a1(&runtime);
+  generatePICFuncs(a0, a1);
+
+  Func funcs[2];
+  if (runtime.add((void**)&funcs[0], &a0) != kErrorOk ||
+      runtime.add((void**)&funcs[1], &a1) != kErrorOk) {
+    fprintf(file, "[Failure] Runtime AddressHint (add failed).\n");
+    fflush(file);
+    return false;
+  }
+
+  bool success = true;
+  if (funcs[0]() != 1007 || funcs[1]() != 1000) {
+    fprintf(file, "[Failure] Runtime AddressHint (functions returned wrong values).\n");
+    success = false;
+  }
+
+  // Code near the hint reaches the targets directly, `jmp` is still `REX E9`.
+  const uint8_t* code = reinterpret_cast<const uint8_t*>(funcs[1]);
+  if (runtime.getVeneerCount() != 0 || code[1] != 0xE9) {
+    fprintf(file, "[Failure] Runtime AddressHint (code is not within reach of the hint).\n");
+    success = false;
+  }
+
+  runtime.release((void*)funcs[0]);
+  runtime.release((void*)funcs[1]);
+
+  if (success)
+    fprintf(file, "[Success] Runtime AddressHint.\n");
+
+  fflush(file);
+  return success;
+#else
+  ASMJIT_UNUSED(file);
+  return true;
+#endif // ASMJIT_ARCH_X64
+}
+
+static Error asyncCompile(X86Compiler* c, void* data) {
+  static_cast<X86Test*>(data)->compile(*c);
+  return kErrorOk;
+}
+
+bool X86TestSuite::runAsync(FILE* file) {
+  size_t i;
+  size_t count = tests.getLength();
+  bool success = true;
+
+  JitRuntime runtime(memMgrOptions);
+  size_t usedBytes = 0;
+
+  PodVector<X86CompileTask*> tasks;
+  if (tasks._reserve(count) != kErrorOk)
+    return false;
+
+  {
+    X86CompileService service(&runtime, 4);
+
+    // Compile all tests concurrently, then run them.
+    for (i = 0; i < count; i++) {
+      X86CompileTask* task;
+      if (service.submit(&task, asyncCompile, tests[i]) != kErrorOk) {
+        fprintf(file, "[Failure] Async Compile (submit failed).\n");
+        success = false;
+        break;
+      }
+      tasks.append(task);
+    }
+
+    for (i = 0; i < tasks.getLength(); i++) {
+      X86CompileTask* task = tasks[i];
+      X86Test* test = tests[i];
+
+      StringBuilder result;
+      StringBuilder expect;
+
+      void* func = task->wait() == kErrorOk ? task->takeFunc() : nullptr;
+      if (func == nullptr || !test->run(func, result, expect)) {
+        fprintf(file, "[Failure] Async Compile (%s).\n", test->getName());
+        success = false;
+      }
+
+      if (func != nullptr)
+        runtime.release(func);
+      task->release();
+    }
+
+    // Tasks released without taking their functions must not leak them, no
+    // matter whether they are done or not (the memory still used at this point
+    // holds veneers created by the first run).
+    usedBytes = runtime.getMemMgr()->getUsedBytes();
+    for (i = 0; i < count; i++) {
+      X86CompileTask* task;
+      if (service.submit(&task, asyncCompile, tests[i]) == kErrorOk) {
+        // Make sure that at least one task is done when released.
+        if (i == 0)
+          task->wait();
+        task->release();
+      }
+    }
+  }
+
+  if (runtime.getMemMgr()->getUsedBytes() != usedBytes) {
+    fprintf(file, "[Failure] Async Compile (functions leaked).\n");
+    success = false;
+  }
+
+  if (success)
+    fprintf(file, "[Success] Async Compile (%u functions).\n", static_cast<unsigned int>(count));
+
+  fflush(file);
+  return success;
+}
+
+static void* compileWithFeatures(JitRuntime* runtime, X86Test* test, uint32_t features, uint32_t* callCounter, CompilerStats* stats = nullptr) {
+  X86Assembler a(runtime);
+  X86Compiler c(&a);
+
+  c.setFeatures(features);
+  test->compile(c);
+
+  if (callCounter != nullptr) {
+    HLNode* node;
+    for (node = c.getFirstNode(); node != nullptr; node = node->getNext()) {
+      if (node->getType() == HLNode::kTypeFunc)
+        static_cast<HLFunc*>(node)->setCallCounter(callCounter);
+    }
+  }
+
+  c.finalize();
+  if (stats != nullptr)
+    *stats = c.getStats();
+  return a.make();
+}
+
+// ============================================================================
+// [X86PassTest]
+// ============================================================================
+
+//! Body of `intptr_t func(intptr_t arg)` compiled by `X86PassTest`, the value
+//! of `ret` is returned when `body` returns.
+typedef void (*X86PassBody)(X86Compiler& c, X86GpVar& ret, X86GpVar& arg);
+
+//! Targeted test of compiler features.
+//!
+//! Compiles small functions with the features being tested, checks values
+//! they return, and keeps statistics and code of the last one so the caller
+//! can check what a pass did.
+struct X86PassTest {
+  X86PassTest(JitRuntime* runtime, FILE* file, const char* name)
+    : runtime(runtime),
+      file(file),
+      name(name),
+      count(0),
+      success(true) {}
+
+  //! Compile `body` with `features` and check that it returns `expected` when
+  //! called with `arg`.
+  bool run(const char* caseName, X86PassBody body, uint32_t features, intptr_t arg, intptr_t expected) {
+    X86Assembler a(runtime);
+    X86Compiler c(&a);
+
+    logger.clearString();
+    a.setLogger(&logger);
+    c.setFeatures(features);
+
+    c.addFunc(FuncBuilder1<intptr_t, intptr_t>(kCallConvHost));
+
+    X86GpVar ret = c.newIntPtr("ret");
+    X86GpVar var = c.newIntPtr("arg");
+
+    c.setArg(0, var);
+    body(c, ret, var);
+
+    c.ret(ret);
+    c.endFunc();
+
+    typedef intptr_t (*Func)(intptr_t);
+    Func func = nullptr;
+
+    if (c.finalize() == kErrorOk)
+      func = asmjit_cast<Func>(a.make());
+
+    stats = c.getStats();
+    count++;
+
+    if (func == nullptr)
+      return check(caseName, false, "not compiled");
+
+    intptr_t result = func(arg);
+    runtime->release((void*)func);
+
+    if (result != expected) {
+      fprintf(file, "[Failure] %s (%s - returned %lld, expected %lld).\n%s", name, caseName,
+        static_cast<long long>(result), static_cast<long long>(expected), logger.getString());
+      success = false;
+      return false;
+    }
+
+    return true;
+  }
+
+  //! Report a failure of `caseName` and its code if `cond` is false.
+  bool check(const char* caseName, bool cond, const char* what) {
+    if (!cond) {
+      fprintf(file, "[Failure] %s (%s - %s).\n%s", name, caseName, what, logger.getString());
+      success = false;
+    }
+    return cond;
+  }
+
+  //! Get whether the code of the last function contains `s`.
+  bool hasCode(const char* s) const {
+    return ::strstr(logger.getString(), s) != nullptr;
+  }
+
+  //! Report the result of all cases.
+  bool done() {
+    if (success)
+      fprintf(file, "[Success] %s (%u cases).\n", name, count);
+
+    fflush(file);
+    return success;
+  }
+
+  JitRuntime* runtime;
+  FILE* file;
+  const char* name;
+
+  uint32_t count;
+  bool success;
+
+  CompilerStats stats;
+  StringLogger logger;
+};
+
+// ============================================================================
+// [X86TestSuite - Features]
+// ============================================================================
+
+//! Feature sets all tests are compiled with by `X86TestSuite::runFeatures()`.
+struct X86FeatureSet {
+  const char* name;
+  uint32_t features;
+};
+
+static const X86FeatureSet x86FeatureSets[] = {
+  { "Default"                    , 0 },
+  { "Baseline"                   , Utils::mask(kCompilerFeatureBaseline) },
+  { "LiveIntervals"              , Utils::mask(kCompilerFeatureLiveIntervals) },
+  { "Scheduler"                  , Utils::mask(kCompilerFeatureEnableScheduler) },
+  { "Scheduler+Baseline"         , Utils::mask(kCompilerFeatureEnableScheduler, kCompilerFeatureBaseline) },
+  { "Peephole"                   , Utils::mask(kCompilerFeaturePeephole) },
+  { "Peephole+Baseline"          , Utils::mask(kCompilerFeaturePeephole, kCompilerFeatureBaseline) },
+  { "Peephole+Scheduler"         , Utils::mask(kCompilerFeaturePeephole, kCompilerFeatureEnableScheduler) },
+  { "Fold"                       , Utils::mask(kCompilerFeatureFoldConstants) },
+  { "Fold+Peephole+Scheduler"    , Utils::mask(kCompilerFeatureFoldConstants, kCompilerFeaturePeephole, kCompilerFeatureEnableScheduler) },
+  { "DeadCode"                   , Utils::mask(kCompilerFeatureEliminateDeadCode) },
+  { "DeadCode+Fold+LiveIntervals", Utils::mask(kCompilerFeatureEliminateDeadCode, kCompilerFeatureFoldConstants, kCompilerFeatureLiveIntervals) },
+  { "CSE"                        , Utils::mask(kCompilerFeatureEliminateCommonSubexpr) },
+  { "CSE+DeadCode+Peephole"      , Utils::mask(kCompilerFeatureEliminateCommonSubexpr, kCompilerFeatureEliminateDeadCode, kCompilerFeaturePeephole) },
+  { "CSE+Baseline"               , Utils::mask(kCompilerFeatureEliminateCommonSubexpr, kCompilerFeatureBaseline) },
+  { "Coalesce"                   , Utils::mask(kCompilerFeatureCoalesceVars) },
+  { "Coalesce+LiveIntervals"     , Utils::mask(kCompilerFeatureCoalesceVars, kCompilerFeatureLiveIntervals) }
+};
+
+bool X86TestSuite::runFeatures(FILE* file) {
+  size_t i, j;
+  size_t count = tests.getLength();
+  bool success = true;
+
+  JitRuntime runtime(memMgrOptions);
+
+  for (j = 0; j < ASMJIT_ARRAY_SIZE(x86FeatureSets); j++) {
+    const X86FeatureSet& set = x86FeatureSets[j];
+    bool setSuccess = true;
+
+    CompilerStats total;
+    total.reset();
+
+    for (i = 0; i < count; i++) {
+      X86Test* test = tests[i];
+      CompilerStats stats;
+
+      void* func = compileWithFeatures(&runtime, test, set.features, nullptr, &stats);
+      total.add(stats);
+
+      StringBuilder result;
+      StringBuilder expect;
+
+      if (func == nullptr || !test->run(func, result, expect)) {
+        fprintf(file, "[Failure] Features - %s (%s).\n", set.name, test->getName());
+        if (func != nullptr)
+          fprintf(file, "Result  : %s\nExpected: %s\n", result.getData(), expect.getData());
+        setSuccess = false;
+      }
+
+      if (func != nullptr)
+        runtime.release(func);
+    }
+
+    if (setSuccess)
+      fprintf(file, "[Success] Features - %s (%u functions, %u spills, %u moves).\n",
+        set.name, static_cast<unsigned int>(count), total.getSaveCount(), total.getMoveCount());
+    else
+      success = false;
+  }
+
+  fflush(file);
+  return success;
+}
+
+// ============================================================================
+// [X86TestSuite - Baseline]
+// ============================================================================
+
+static void baselineSelf(X86Compiler& c, X86GpVar& ret, X86GpVar& arg) {
+  c.mov(ret, arg);
+  c.add(ret, ret);
+}
+
+static void baselinePartial(X86Compiler& c, X86GpVar& ret, X86GpVar& arg) {
+  c.mov(ret, arg);
+  c.mov(ret.r8(), 0x12);
+}
+
+static void baselineFlags(X86Compiler& c, X86GpVar& ret, X86GpVar& arg) {
+  X86GpVar x = c.newIntPtr("x");
+
+  // Stack slots are loaded and saved between `cmp` and `adc`.
+  c.xor_(ret, ret);
+  c.mov(x, 3);
+  c.cmp(arg, 10);
+  c.adc(ret, x);
+}
+
+bool X86TestSuite::runBaseline(FILE* file) {
+  JitRuntime runtime(memMgrOptions);
+  X86PassTest t(&runtime, file, "Baseline Compile");
+
+  uint32_t baseline = Utils::mask(kCompilerFeatureBaseline);
+
+  // Each variable lives in its stack slot, it's loaded before and saved after
+  // each instruction.
+  if (t.run("dst is src", baselineSelf, baseline, 21, 42))
+    t.check("dst is src", t.stats.getLoadCount() != 0 && t.stats.getSaveCount() != 0, "variables not in stack slots");
+
+  if (t.run("dst is src", baselineSelf, 0, 21, 42))
+    t.check("dst is src", t.stats.getLoadCount() == 0 && t.stats.getSaveCount() == 0, "default allocator spilled");
+
+  t.run("partial write", baselinePartial, baseline, 0x3456, 0x3412);
+  t.run("flags live", baselineFlags, baseline, 5, 4);
+  t.run("flags live", baselineFlags, baseline, 50, 3);
+
+  // Tier up - the baseline function counts its calls, it's compiled again by
+  // the full allocator once it's hot.
+  X86Test* test = tests[0];
+
+  uint32_t counter = 0;
+  void* func = compileWithFeatures(&runtime, test, baseline, &counter);
+
+  uint32_t n = 0;
+  while (func != nullptr && counter < 10) {
+    StringBuilder result;
+    StringBuilder expect;
+
+    if (!test->run(func, result, expect) || ++n != counter)
+      break;
+  }
+
+  t.check("call counter", func != nullptr && n == 10 && counter == 10, "wrong count of calls");
+  if (func != nullptr)
+    runtime.release(func);
+
+  func = compileWithFeatures(&runtime, test, 0, nullptr);
+  if (t.check("tier up", func != nullptr, "not compiled")) {
+    StringBuilder result;
+    StringBuilder expect;
+
+    t.check("tier up", test->run(func, result, expect), "wrong result");
+    runtime.release(func);
+  }
+
+  return t.done();
+}
+
+// ============================================================================
+// [X86TestSuite - Live Intervals]
+// ============================================================================
+
+static int intervalsCalledFunc(int a) { return a * a; }
+
+static void intervalsPressure(X86Compiler& c, X86GpVar& ret, X86GpVar& arg) {
+  enum { kCount = 15 };
+
+  X86GpVar far = c.newIntPtr("far");
+  X86GpVar v[kCount];
+  uint32_t i;
+
+  // More variables than registers, `far` is alive the longest.
+  c.lea(far, x86::ptr(arg, 100));
+  for (i = 0; i < kCount; i++) {
+    v[i] = c.newIntPtr("v%u", i);
+    c.lea(v[i], x86::ptr(arg, i));
+  }
+
+  c.mov(ret, v[0]);
+  for (i = 1; i < kCount; i++)
+    c.add(ret, v[i]);
+  c.add(ret, far);
+}
+
+static void intervalsCall(X86Compiler& c, X86GpVar& ret, X86GpVar& arg) {
+  X86GpVar x = c.newIntPtr("x");
+  X86GpVar y = c.newInt32("y");
+  X86GpVar fn = c.newIntPtr("fn");
+
+  c.lea(x, x86::ptr(arg, 1));
+  c.mov(y, arg.r32());
+  c.mov(fn, imm_ptr(intervalsCalledFunc));
+
+  X86CallNode* call = c.call(fn, FuncBuilder1<int, int>(kCallConvHost));
+  call->setArg(0, y);
+  call->setRet(0, y);
+
+  c.movsx(ret, y);
+  c.add(ret, x);
+}
+
+static void intervalsVolatile(X86Compiler& c, X86GpVar& ret, X86GpVar& arg) {
+  enum { kCount = 5 };
+
+  X86GpVar v[kCount];
+  uint32_t i;
+
+  // No call, all variables fit into registers the function doesn't preserve.
+  for (i = 0; i < kCount; i++) {
+    v[i] = c.newIntPtr("v%u", i);
+    c.lea(v[i], x86::ptr(arg, i));
+  }
+
+  c.mov(ret, v[0]);
+  for (i = 1; i < kCount; i++)
+    c.add(ret, v[i]);
+}
+
+bool X86TestSuite::runLiveIntervals(FILE* file) {
+  JitRuntime runtime(memMgrOptions);
+  X86PassTest t(&runtime, file, "Live Intervals");
+
+  uint32_t intervals = Utils::mask(kCompilerFeatureLiveIntervals);
+
+  // Intervals that don't fit into registers lose them, the variables are
+  // still allocated where they are used.
+  t.run("pressure", intervalsPressure, intervals, 3, 15 * 3 + 105 + 3 + 100);
+
+  // The variable alive after the call stays in a preserved register.
+  if (t.run("call", intervalsCall, intervals, 3, 9 + 4))
+    t.check("call", !t.hasCode("[Spill] x") && t.stats.getLoadCount() == 0, "x spilled");
+
+  // Intervals not crossing a call are assigned registers the function doesn't
+  // have to preserve.
+  if (t.run("volatile", intervalsVolatile, intervals, 3, 5 * 3 + 10))
+    t.check("volatile", !t.hasCode("push"), "preserved register used");
+
+  return t.done();
+}
+
+// ============================================================================
+// [X86TestSuite - Scheduler]
+// ============================================================================
+
+static void schedLatency(X86Compiler& c, X86GpVar& ret, X86GpVar& arg) {
+  X86GpVar x = c.newIntPtr("x");
+  X86GpVar y = c.newIntPtr("y");
+
+  // `imul` chain followed by independent instructions.
+  c.mov(x, arg);
+  c.imul(x, x);
+  c.imul(x, x);
+  c.add(x, 1);
+  c.lea(y, x86::ptr(arg, 2));
+  c.shl(y, 1);
+  c.lea(ret, x86::ptr(x, y));
+}
+
+static void schedFlags(X86Compiler& c, X86GpVar& ret, X86GpVar& arg) {
+  X86GpVar x = c.newIntPtr("x");
+  X86GpVar y = c.newIntPtr("y");
+
+  // `add y, 5` is independent of `adc`, but it can't move between `cmp` and
+  // `adc` as it writes CF.
+  c.mov(y, arg);
+  c.xor_(ret, ret);
+  c.mov(x, 3);
+  c.cmp(arg, 10);
+  c.adc(ret, x);
+  c.add(y, 5);
+  c.add(ret, y);
+}
+
+static void schedMemory(X86Compiler& c, X86GpVar& ret, X86GpVar& arg) {
+  X86Mem slot = c.newStack(8, 8);
+  slot.setSize(sizeof(intptr_t));
+
+  // Store, read-modify-write and load of the same address stay in order.
+  c.mov(slot, arg);
+  c.add(slot, 5);
+  c.mov(ret, slot);
+  c.imul(ret, ret);
+}
+
+static void schedPartial(X86Compiler& c, X86GpVar& ret, X86GpVar& arg) {
+  X86GpVar x = c.newIntPtr("x");
+  X86GpVar y = c.newIntPtr("y");
+
+  // `lea` is independent and can move above the partial write, the partial
+  // write is ready before `mov ret, x`, but it can't move above it.
+  c.mov(x, arg);
+  c.imul(x, x);
+  c.imul(x, x);
+  c.mov(ret, x);
+  c.mov(ret.r8(), 0x12);
+  c.lea(y, x86::ptr(arg, 1));
+  c.add(ret, y);
+}
+
+bool X86TestSuite::runScheduler(FILE* file) {
+  JitRuntime runtime(memMgrOptions);
+  X86PassTest t(&runtime, file, "Scheduler");
+
+  uint32_t scheduler = Utils::mask(kCompilerFeatureEnableScheduler);
+  uint32_t baseline = Utils::mask(kCompilerFeatureEnableScheduler, kCompilerFeatureBaseline);
+
+  // Independent instructions are moved before the long dependency chain.
+  if (t.run("latency", schedLatency, scheduler, 3, 82 + 10))
+    t.check("latency", t.stats.getReorderCount() != 0, "nothing reordered");
+
+  t.run("flags live", schedFlags, scheduler, 5, 4 + 10);
+  t.run("flags live", schedFlags, scheduler, 50, 3 + 55);
+  t.run("memory", schedMemory, scheduler, 2, 49);
+
+  if (t.run("partial write", schedPartial, scheduler, 3, 0x12 + 4))
+    t.check("partial write", t.stats.getReorderCount() != 0, "nothing reordered");
+
+  // Loads and saves of stack slots around each instruction.
+  t.run("latency", schedLatency, baseline, 3, 82 + 10);
+  t.run("flags live", schedFlags, baseline, 5, 4 + 10);
+  t.run("memory", schedMemory, baseline, 2, 49);
+  t.run("partial write", schedPartial, baseline, 3, 0x12 + 4);
+
+  return t.done();
+}
+
+// ============================================================================
+// [X86TestSuite - Peephole]
+// ============================================================================
+
+static void peepholeMovSelf(X86Compiler& c, X86GpVar& ret, X86GpVar& arg) {
+  c.mov(ret, arg);
+  c.mov(ret, ret);
+}
+
+static void peepholeMovSelf32(X86Compiler& c, X86GpVar& ret, X86GpVar& arg) {
+  ASMJIT_UNUSED(arg);
+
+  // 32-bit move clears the high part of 64-bit register, it's not removed.
+  c.mov(ret, -1);
+  c.mov(ret.r32(), ret.r32());
+}
+
+static void peepholeSaveAfterLoad(X86Compiler& c, X86GpVar& ret, X86GpVar& arg) {
+  X86GpVar x = c.newIntPtr("x");
+
+  c.mov(x, arg);
+  c.spill(x);
+  c.mov(ret, x.m());
+  c.mov(x.m(), ret);
+  c.add(ret, x);
+}
+
+static void peepholeJmpNext(X86Compiler& c, X86GpVar& ret, X86GpVar& arg) {
+  Label L_Next = c.newLabel();
+
+  c.mov(ret, arg);
+  c.jmp(L_Next);
+  c.bind(L_Next);
+  c.add(ret, 1);
+}
+
+static void peepholeCmpZero(X86Compiler& c, X86GpVar& ret, X86GpVar& arg) {
+  Label L_Exit = c.newLabel();
+
+  c.mov(ret, 1);
+  c.cmp(arg, 0);
+  c.jz(L_Exit);
+  c.mov(ret, 2);
+  c.bind(L_Exit);
+}
+
+static void peepholeCmpSame(X86Compiler& c, X86GpVar& ret, X86GpVar& arg) {
+  Label L_Exit = c.newLabel();
+
+  c.mov(ret, 1);
+  c.cmp(arg, 10);
+  c.jl(L_Exit);
+  c.cmp(arg, 10);
+  c.jg(L_Exit);
+  c.mov(ret, 3);
+  c.bind(L_Exit);
+}
+
+static void peepholeCmpWidth(X86Compiler& c, X86GpVar& ret, X86GpVar& arg) {
+  Label L_Exit = c.newLabel();
+
+  // The second `cmp` compares only the low 32 bits, it's not removed.
+  c.mov(ret, 1);
+  c.cmp(arg, 10);
+  c.jl(L_Exit);
+  c.cmp(arg.r32(), 10);
+  c.jg(L_Exit);
+  c.mov(ret, 3);
+  c.bind(L_Exit);
+}
+
+static void peepholeTestAfterLogic(X86Compiler& c, X86GpVar& ret, X86GpVar& arg) {
+  Label L_Exit = c.newLabel();
+
+  c.mov(ret, arg);
+  c.and_(ret, 6);
+  c.test(ret, ret);
+  c.jz(L_Exit);
+  c.add(ret, 100);
+  c.bind(L_Exit);
+}
+
+static void peepholeTestWidth(X86Compiler& c, X86GpVar& ret, X86GpVar& arg) {
+  ASMJIT_UNUSED(arg);
+
+  Label L_Exit = c.newLabel();
+
+  // `and` sets SF by bit 31, `test` of the 64-bit register by bit 63, so the
+  // `test` is not removed.
+  c.mov(ret, -1);
+  c.and_(ret.r32(), static_cast<int32_t>(0x80000000));
+  c.test(ret, ret);
+  c.js(L_Exit);
+  c.add(ret, 1);
+  c.bind(L_Exit);
+}
+
+bool X86TestSuite::runPeephole(FILE* file) {
+  JitRuntime runtime(memMgrOptions);
+  X86PassTest t(&runtime, file, "Peephole");
+
+  uint32_t peephole = Utils::mask(kCompilerFeaturePeephole);
+  uint32_t baseline = Utils::mask(kCompilerFeaturePeephole, kCompilerFeatureBaseline);
+
+  if (t.run("mov self", peepholeMovSelf, peephole, 5, 5))
+    t.check("mov self", t.stats.getPeepholeCount(kX86PeepholeRuleMovSelf) == 1, "rule not applied");
+
+  if (t.run("load after save", baselineSelf, baseline, 21, 42))
+    t.check("load after save", t.stats.getPeepholeCount(kX86PeepholeRuleLoadAfterSave) != 0, "rule not applied");
+
+  if (t.run("save after load", peepholeSaveAfterLoad, peephole, 5, 10))
+    t.check("save after load", t.stats.getPeepholeCount(kX86PeepholeRuleSaveAfterLoad) == 1, "rule not applied");
+
+  if (t.run("jmp next", peepholeJmpNext, peephole, 5, 6))
+    t.check("jmp next", t.stats.getPeepholeCount(kX86PeepholeRuleJmpNext) == 1, "rule not applied");
+
+  t.run("cmp zero", peepholeCmpZero, peephole, 5, 2);
+  if (t.run("cmp zero", peepholeCmpZero, peephole, 0, 1))
+    t.check("cmp zero", t.stats.getPeepholeCount(kX86PeepholeRuleCmpZero) == 1 && t.hasCode("test"), "rule not applied");
+
+  t.run("cmp same", peepholeCmpSame, peephole, 50, 1);
+  if (t.run("cmp same", peepholeCmpSame, peephole, 10, 3))
+    t.check("cmp same", t.stats.getPeepholeCount(kX86PeepholeRuleCmpSame) == 1, "rule not applied");
+
+  t.run("test after logic", peepholeTestAfterLogic, peephole, 1, 0);
+  if (t.run("test after logic", peepholeTestAfterLogic, peephole, 5, 104))
+    t.check("test after logic", t.stats.getPeepholeCount(kX86PeepholeRuleTestAfterLogic) == 1, "rule not applied");
+
+#if ASMJIT_ARCH_X64
+  // Partial and width-changing writes.
+  if (t.run("mov self 32-bit", peepholeMovSelf32, peephole, 0, ASMJIT_INT64_C(0xFFFFFFFF)))
+    t.check("mov self 32-bit", t.stats.getPeepholeCount(kX86PeepholeRuleMovSelf) == 0, "mov removed");
+
+  if (t.run("cmp width", peepholeCmpWidth, peephole, ASMJIT_INT64_C(0x100000005), 3))
+    t.check("cmp width", t.stats.getPeepholeCount(kX86PeepholeRuleCmpSame) == 0, "cmp removed");
+
+  if (t.run("test width", peepholeTestWidth, peephole, 0, ASMJIT_INT64_C(0x80000001)))
+    t.check("test width", t.stats.getPeepholeCount(kX86PeepholeRuleTestAfterLogic) == 0, "test removed");
+#endif // ASMJIT_ARCH_X64
+
+  return t.done();
+}
+
+// ============================================================================
+// [X86TestSuite - Fold Constants]
+// ============================================================================
+
+static void foldArith(X86Compiler& c, X86GpVar& ret, X86GpVar& arg) {
+  c.mov(ret, 5);
+  c.add(ret, 3);
+  c.shl(ret, 2);
+  c.add(ret, arg);
+}
+
+static void foldPropagate(X86Compiler& c, X86GpVar& ret, X86GpVar& arg) {
+  X86GpVar x = c.newIntPtr("x");
+
+  c.mov(x, 7);
+  c.mov(ret, arg);
+  c.imul(ret, x);
+}
+
+static void foldSelf(X86Compiler& c, X86GpVar& ret, X86GpVar& arg) {
+  c.mov(ret, 3);
+  c.add(ret, ret);
+  c.add(ret, arg);
+}
+
+static void foldMovzx(X86Compiler& c, X86GpVar& ret, X86GpVar& arg) {
+  // The destination is also the source, `mov ret, 200` is read.
+  c.mov(ret, 200);
+  c.movzx(ret, ret.r8());
+  c.add(ret, arg);
+}
+
+static void foldMovsx(X86Compiler& c, X86GpVar& ret, X86GpVar& arg) {
+  c.mov(ret, 200);
+  c.movsx(ret, ret.r8());
+  c.add(ret, arg);
+}
+
+static void foldLea(X86Compiler& c, X86GpVar& ret, X86GpVar& arg) {
+  c.mov(ret, 5);
+  c.lea(ret, x86::ptr(ret, arg, 0, 4));
+}
+
+static void foldPartial(X86Compiler& c, X86GpVar& ret, X86GpVar& arg) {
+  // Writes of a part of the variable are not tracked.
+  c.mov(ret, 0x1234);
+  c.mov(ret.r8(), 0x56);
+  c.add(ret, 1);
+  c.add(ret, arg);
+}
+
+static void foldFlags(X86Compiler& c, X86GpVar& ret, X86GpVar& arg) {
+  X86GpVar x = c.newIntPtr("x");
+
+  // CF of `sub` is used by `adc`, `sub` can't be replaced by `mov`.
+  c.mov(x, arg);
+  c.mov(ret, 5);
+  c.sub(ret, 6);
+  c.adc(x, 0);
+  c.add(ret, x);
+}
+
+bool X86TestSuite::runFoldConstants(FILE* file) {
+  JitRuntime runtime(memMgrOptions);
+  X86PassTest t(&runtime, file, "Fold Constants");
+
+  uint32_t fold = Utils::mask(kCompilerFeatureFoldConstants);
+
+  if (t.run("arith", foldArith, fold, 1, 33))
+    t.check("arith", t.stats.getFoldCount() != 0 && !t.hasCode("shl"), "not folded");
+
+  if (t.run("propagate", foldPropagate, fold, 3, 21))
+    t.check("propagate", t.stats.getPropagateCount() == 1, "not propagated");
+
+  t.run("dst is src", foldSelf, fold, 1, 7);
+  t.run("movzx", foldMovzx, fold, 1, 201);
+  t.run("movsx", foldMovsx, fold, 1, -55);
+  t.run("lea", foldLea, fold, 1, 10);
+  t.run("partial write", foldPartial, fold, 1, 0x1258);
+
+  if (t.run("flags live", foldFlags, fold, 7, 7))
+    t.check("flags live", t.hasCode("sub"), "sub folded");
+
+  return t.done();
+}
+
+// ============================================================================
+// [X86TestSuite - Dead Code]
+// ============================================================================
+
+static void deadUnused(X86Compiler& c, X86GpVar& ret, X86GpVar& arg) {
+  X86GpVar x = c.newIntPtr("x");
+
+  c.mov(x, arg);
+  c.add(x, 5);
+  c.mov(ret, arg);
+}
+
+static void deadChain(X86Compiler& c, X86GpVar& ret, X86GpVar& arg) {
+  X86GpVar x = c.newIntPtr("x");
+  X86GpVar y = c.newIntPtr("y");
+
+  // `y` is never used, then `x` is only used by `y`.
+  c.lea(x, x86::ptr(arg, 1));
+  c.lea(y, x86::ptr(x, 2));
+  c.mov(ret, arg);
+}
+
+static void deadFlags(X86Compiler& c, X86GpVar& ret, X86GpVar& arg) {
+  X86GpVar x = c.newIntPtr("x");
+
+  // `x` is never used, but CF of `add` is.
+  c.mov(ret, 0);
+  c.mov(x, arg);
+  c.add(x, -1);
+  c.adc(ret, 0);
+}
+
+static void deadStore(X86Compiler& c, X86GpVar& ret, X86GpVar& arg) {
+  X86Mem slot = c.newStack(8, 8);
+  slot.setSize(sizeof(intptr_t));
+
+  c.mov(slot, arg);
+  c.add(slot, 1);
+  c.mov(ret, slot);
+}
+
+static void deadPartial(X86Compiler& c, X86GpVar& ret, X86GpVar& arg) {
+  X86GpVar x = c.newIntPtr("x");
+
+  // The partial write merges into `x`, the full write before it is used.
+  c.mov(x, arg);
+  c.mov(x.r8(), 0x12);
+  c.mov(ret, x);
+}
+
+static void deadPartialUnused(X86Compiler& c, X86GpVar& ret, X86GpVar& arg) {
+  X86GpVar x = c.newIntPtr("x");
+
+  // `x` is never used, neither write is needed.
+  c.mov(x, arg);
+  c.mov(x.r8(), 0x12);
+  c.mov(ret, arg);
+}
+
+bool X86TestSuite::runDeadCode(FILE* file) {
+  JitRuntime runtime(memMgrOptions);
+  X86PassTest t(&runtime, file, "Dead Code");
+
+  uint32_t dead = Utils::mask(kCompilerFeatureEliminateDeadCode);
+
+  if (t.run("unused", deadUnused, dead, 3, 3))
+    t.check("unused", t.stats.getDeadCount() == 2 && !t.hasCode("add"), "not removed");
+
+  // The analysis is repeated until nothing is removed.
+  if (t.run("chain", deadChain, dead, 3, 3))
+    t.check("chain", t.stats.getDeadCount() == 2 && !t.hasCode("lea"), "not removed");
+
+  if (t.run("flags live", deadFlags, dead, 5, 1))
+    t.check("flags live", t.stats.getDeadCount() == 0, "removed");
+  t.run("flags live", deadFlags, dead, 0, 0);
+
+  if (t.run("store", deadStore, dead, 3, 4))
+    t.check("store", t.stats.getDeadCount() == 0, "removed");
+
+  if (t.run("partial write", deadPartial, dead, 0x3456, 0x3412))
+    t.check("partial write", t.stats.getDeadCount() == 0, "removed");
+
+  if (t.run("partial write", deadPartialUnused, dead, 0x3456, 0x3456))
+    t.check("partial write", t.stats.getDeadCount() == 2, "not removed");
+
+  return t.done();
+}
+
+// ============================================================================
+// [X86TestSuite - Common Subexpressions]
+// ============================================================================
+
+static void cseLoad(X86Compiler& c, X86GpVar& ret, X86GpVar& arg) {
+  X86GpVar x = c.newIntPtr("x");
+  X86GpVar y = c.newIntPtr("y");
+
+  c.mov(x, x86::ptr(arg));
+  c.mov(y, x86::ptr(arg));
+  c.mov(ret, x);
+  c.add(ret, y);
+}
+
+static void cseArith(X86Compiler& c, X86GpVar& ret, X86GpVar& arg) {
+  X86GpVar x = c.newIntPtr("x");
+  X86GpVar y = c.newIntPtr("y");
+
+  // `y` is a copy of `x`, so both `add` compute the same value.
+  c.mov(x, arg);
+  c.mov(y, arg);
+  c.add(x, arg);
+  c.add(y, arg);
+  c.mov(ret, x);
+  c.add(ret, y);
+}
+
+static void cseStore(X86Compiler& c, X86GpVar& ret, X86GpVar& arg) {
+  X86GpVar x = c.newIntPtr("x");
+  X86GpVar y = c.newIntPtr("y");
+
+  c.mov(x, x86::ptr(arg));
+  c.add(x86::ptr(arg, 0, sizeof(intptr_t)), 1);
+  c.mov(y, x86::ptr(arg));
+  c.mov(ret, x);
+  c.add(ret, y);
+}
+
+static void cseSelf(X86Compiler& c, X86GpVar& ret, X86GpVar& arg) {
+  // The second `add` reads the result of the first one.
+  c.mov(ret, arg);
+  c.add(ret, 1);
+  c.add(ret, 1);
+}
+
+static void csePartial(X86Compiler& c, X86GpVar& ret, X86GpVar& arg) {
+  X86GpVar x = c.newIntPtr("x");
+
+  // Only the low word of `x` and `ret` is written.
+  c.mov(x, arg);
+  c.mov(x.r16(), x86::word_ptr(arg));
+  c.mov(ret, 0);
+  c.mov(ret.r16(), x86::word_ptr(arg));
+}
+
+static void cseFlags(X86Compiler& c, X86GpVar& ret, X86GpVar& arg) {
+  X86GpVar x = c.newIntPtr("x");
+  X86GpVar y = c.newIntPtr("y");
+
+  // CF of the second `add` is used.
+  c.mov(ret, 0);
+  c.mov(x, arg);
+  c.mov(y, arg);
+  c.add(x, -1);
+  c.add(y, -1);
+  c.adc(ret, 0);
+}
+
+#if ASMJIT_ARCH_X64
+static void cseWidthMov(X86Compiler& c, X86GpVar& ret, X86GpVar& arg) {
+  X86GpVar a = c.newInt32("a");
+  X86GpVar b = c.newInt64("b");
+
+  c.mov(a, x86::ptr(arg));
+  c.mov(b, x86::ptr(arg));
+  c.mov(ret, b);
+}
+
+static void cseWidthMovsx(X86Compiler& c, X86GpVar& ret, X86GpVar& arg) {
+  X86GpVar a = c.newInt32("a");
+  X86GpVar b = c.newInt64("b");
+
+  c.movsx(a, x86::byte_ptr(arg));
+  c.movsx(b, x86::byte_ptr(arg));
+  c.mov(ret, b);
+}
+#endif // ASMJIT_ARCH_X64
+
+bool X86TestSuite::runCommonSubexpr(FILE* file) {
+  JitRuntime runtime(memMgrOptions);
+  X86PassTest t(&runtime, file, "Common Subexpressions");
+
+  uint32_t cse = Utils::mask(kCompilerFeatureEliminateCommonSubexpr);
+  intptr_t data[1];
+
+  data[0] = 21;
+  if (t.run("load", cseLoad, cse, (intptr_t)data, 42))
+    t.check("load", t.stats.getReuseCount() == 1, "not reused");
+
+  if (t.run("arith", cseArith, cse, 3, 12))
+    t.check("arith", t.stats.getReuseCount() == 1, "not reused");
+
+  // Memory may be written in between.
+  data[0] = 21;
+  if (t.run("store", cseStore, cse, (intptr_t)data, 43))
+    t.check("store", t.stats.getReuseCount() == 0, "reused");
+
+  if (t.run("dst is src", cseSelf, cse, 40, 42))
+    t.check("dst is src", t.stats.getReuseCount() == 0, "reused");
+
+  data[0] = 0x1234;
+  if (t.run("partial write", csePartial, cse, (intptr_t)data, 0x1234))
+    t.check("partial write", t.stats.getReuseCount() == 0, "reused");
+
+  if (t.run("flags live", cseFlags, cse, 5, 1))
+    t.check("flags live", t.stats.getReuseCount() == 0, "reused");
+  t.run("flags live", cseFlags, cse, 0, 0);
+
+#if ASMJIT_ARCH_X64
+  // A 32-bit load doesn't hold the value of a 64-bit one and vice versa.
+  data[0] = ASMJIT_INT64_C(4294967300);
+  if (t.run("width mov", cseWidthMov, cse, (intptr_t)data, ASMJIT_INT64_C(4294967300)))
+    t.check("width mov", t.stats.getReuseCount() == 0, "reused");
+
+  data[0] = 0xFE;
+  if (t.run("width movsx", cseWidthMovsx, cse, (intptr_t)data, -2))
+    t.check("width movsx", t.stats.getReuseCount() == 0, "reused");
+#endif // ASMJIT_ARCH_X64
+
+  return t.done();
+}
+
+// ============================================================================
+// [X86TestSuite - Coalesce]
+// ============================================================================
+
+static void coalesceCopy(X86Compiler& c, X86GpVar& ret, X86GpVar& arg) {
+  X86GpVar x = c.newIntPtr("x");
+
+  // `arg` is not used after it's copied to `x`.
+  c.mov(x, arg);
+  c.add(x, 1);
+  c.mov(ret, x);
+}
+
+static void coalesceChain(X86Compiler& c, X86GpVar& ret, X86GpVar& arg) {
+  X86GpVar x = c.newIntPtr("x");
+  X86GpVar y = c.newIntPtr("y");
+
+  c.mov(x, arg);
+  c.mov(y, x);
+  c.add(y, 1);
+  c.mov(ret, y);
+}
+
+static void coalesceLive(X86Compiler& c, X86GpVar& ret, X86GpVar& arg) {
+  X86GpVar x = c.newIntPtr("x");
+
+  // `arg` is still used after it's copied to `x`.
+  c.mov(x, arg);
+  c.add(x, 1);
+  c.mov(ret, arg);
+  c.add(ret, x);
+}
+
+static void coalesceSame(X86Compiler& c, X86GpVar& ret, X86GpVar& arg) {
+  X86GpVar x = c.newIntPtr("x");
+
+  // `arg` and `x` are both alive, but neither is written after the copy.
+  c.mov(x, arg);
+  c.lea(ret, x86::ptr(x, 1));
+  c.add(ret, arg);
+}
+
+static void coalesceTwice(X86Compiler& c, X86GpVar& ret, X86GpVar& arg) {
+  X86GpVar x = c.newIntPtr("x");
+
+  // The second copy holds the same value and is removed as well.
+  c.mov(x, arg);
+  c.lea(ret, x86::ptr(x, 1));
+  c.mov(x, arg);
+  c.add(ret, x);
+  c.add(ret, arg);
+}
+
+static void coalesceWritten(X86Compiler& c, X86GpVar& ret, X86GpVar& arg) {
+  X86GpVar x = c.newIntPtr("x");
+
+  // `x` is written while `arg` is alive, they hold different values.
+  c.mov(x, arg);
+  c.add(x, 1);
+  c.lea(ret, x86::ptr(x, 1));
+  c.add(ret, arg);
+}
+
+static void coalescePinned(X86Compiler& c, X86GpVar& ret, X86GpVar& arg) {
+  X86GpVar x = c.newIntPtr("x");
+  X86GpVar y = c.newIntPtr("y");
+
+  // The home of `y` is referenced as memory, `x` is renamed to `y`.
+  c.mov(y, arg);
+  c.add(y.m(), 1);
+  c.mov(x, y);
+  c.add(x, 2);
+  c.mov(ret, x);
+}
+
+bool X86TestSuite::runCoalesce(FILE* file) {
+  JitRuntime runtime(memMgrOptions);
+  X86PassTest t(&runtime, file, "Coalesce");
+
+  static const struct {
+    const char* name;
+    X86PassBody body;
+    intptr_t arg;
+    intptr_t expected;
+    uint32_t coalesced;
+  } cases[] = {
+    { "copy"         , coalesceCopy   , 41    , 42    , 1 },
+    { "chain"        , coalesceChain  , 41    , 42    , 2 },
+    { "both live"    , coalesceLive   , 20    , 41    , 0 },
+    { "same value"   , coalesceSame   , 20    , 41    , 1 },
+    { "copied twice" , coalesceTwice  , 20    , 61    , 1 },
+    { "written"      , coalesceWritten, 20    , 42    , 0 },
+    { "src pinned"   , coalescePinned , 20    , 23    , 2 }
+  };
+
+  // Each case is compiled without and with coalescing, the register allocator
+  // must not emit more moves when copies are removed.
+  static const uint32_t features[] = {
+    0,
+    Utils::mask(kCompilerFeatureLiveIntervals),
+    Utils::mask(kCompilerFeatureFoldConstants, kCompilerFeatureEliminateCommonSubexpr, kCompilerFeatureEliminateDeadCode, kCompilerFeaturePeephole)
+  };
+
+  for (size_t i = 0; i < ASMJIT_ARRAY_SIZE(cases); i++) {
+    for (size_t j = 0; j < ASMJIT_ARRAY_SIZE(features); j++) {
+      const char* name = cases[i].name;
+
+      if (!t.run(name, cases[i].body, features[j], cases[i].arg, cases[i].expected))
+        continue;
+      uint32_t moves = t.stats.getMoveCount();
+
+      if (!t.run(name, cases[i].body, features[j] | Utils::mask(kCompilerFeatureCoalesceVars), cases[i].arg, cases[i].expected))
+        continue;
+
+      if (j == 0)
+        t.check(name, t.stats.getCoalesceCount() == cases[i].coalesced, "unexpected count of copies removed");
+      t.check(name, t.stats.getMoveCount() <= moves, "more moves");
+    }
+  }
+
+  return t.done();
+}
+
+bool X86TestSuite::runParallel(FILE* file) {
+  enum { kThreadCount = 4 };
+
+  size_t i;
+  size_t count = tests.getLength();
+  bool success = true;
+
+  JitRuntime runtime(memMgrOptions);
+  Label* entries = new Label[count];
+
+  // All tests compiled as a single unit, by one and by more threads.
+  X86Assembler a0(&runtime);
+  X86Assembler a1(&runtime);
+
+  for (uint32_t pass = 0; pass < 2; pass++) {
+    X86Assembler& a = pass == 0 ? a0 : a1;
+    X86Compiler c(&a);
+
+    c.setFeatures(Utils::mask(kCompilerFeatureLiveIntervals));
+    c.setThreadCount(pass == 0 ? 1 : kThreadCount);
+
+    for (i = 0; i < count; i++) {
+      HLNode* last = c.getLastNode();
+      tests[i]->compile(c);
+
+      // The entry of the test is the first function it added.
+      HLNode* node = last != nullptr ? last->getNext() : c.getFirstNode();
+      while (node->getType() != HLNode::kTypeFunc)
+        node = node->getNext();
+      entries[i] = static_cast<HLFunc*>(node)->getEntryLabel();
+    }
+
+    if (c.finalize() != kErrorOk)
+      success = false;
+  }
+
+  if (!success || a0.getOffset() != a1.getOffset() || ::memcmp(a0.getBuffer(), a1.getBuffer(), a0.getOffset()) != 0) {
+    fprintf(file, "[Failure] Parallel Compile (code differs from code compiled by one thread).\n");
+    success = false;
+  }
+
+  uint8_t* base = static_cast<uint8_t*>(success ? a1.make() : nullptr);
+  if (base != nullptr) {
+    for (i = 0; i < count; i++) {
+      X86Test* test = tests[i];
+
+      StringBuilder result;
+      StringBuilder expect;
+
+      if (!test->run(base + a1.getLabelOffset(entries[i]), result, expect)) {
+        fprintf(file, "[Failure] Parallel Compile (%s).\n", test->getName());
+        fprintf(file, "Result  : %s\nExpected: %s\n", result.getData(), expect.getData());
+        success = false;
+      }
+    }
+
+    runtime.release(base);
+  }
+  else {
+    success = false;
+  }
+
+  if (success)
+    fprintf(file, "[Success] Parallel Compile (%u functions, %u threads).\n",
+      static_cast<unsigned int>(count), static_cast<unsigned int>(kThreadCount));
+
+  delete[] entries;
+  fflush(file);
+  return success;
+}
+
+bool X86TestSuite::runProfile(FILE* file) {
+  size_t i;
+  size_t count = tests.getLength();
+  bool success = true;
+
+  JitRuntime runtime(memMgrOptions);
+  StringLogger logger;
+
+  CompilerStats stats;
+  AssemblerStats asmStats;
+
+  stats.reset();
+  asmStats.reset();
+
+  for (i = 0; i < count; i++) {
+    X86Test* test = tests[i];
+
+    // Profiling must not change the generated code.
+    X86Assembler a0(&runtime);
+    X86Assembler a1(&runtime);
+
+    logger.clearString();
+    a1.setLogger(&logger);
+    a1.addAsmOptions(Assembler::kOptionProfile);
+
+    X86Compiler c0(&a0);
+    X86Compiler c1(&a1);
+    c1.setFeature(kCompilerFeatureProfile, true);
+
+    test->compile(c0);
+    test->compile(c1);
+
+    if (c0.finalize() != kErrorOk || c1.finalize() != kErrorOk ||
+        a0.getOffset() != a1.getOffset() || ::memcmp(a0.getBuffer(), a1.getBuffer(), a0.getOffset()) != 0) {
+      fprintf(file, "[Failure] Profile (%s - code differs).\n", test->getName());
+      success = false;
+      continue;
+    }
+
+    if (::strstr(logger.getString(), "; Phase Translate: ") == nullptr) {
+      fprintf(file, "[Failure] Profile (%s - phases not logged).\n", test->getName());
+      success = false;
+    }
+
+    void* func = a1.make();
+    StringBuilder result;
+    StringBuilder expect;
+
+    if (func == nullptr || !test->run(func, result, expect)) {
+      fprintf(file, "[Failure] Profile (%s).\n", test->getName());
+      if (func != nullptr)
+        fprintf(file, "Result  : %s\nExpected: %s\n", result.getData(), expect.getData());
+      success = false;
+    }
+
+    if (func != nullptr)
+      runtime.release(func);
+
+    stats.add(c1.getStats());
+    asmStats._encodeCount += a1.getStats().getEncodeCount();
+    asmStats._encodeTime += a1.getStats().getEncodeTime();
+    asmStats._relocCount += a1.getStats().getRelocCount();
+    asmStats._relocTime += a1.getStats().getRelocTime();
+  }
+
+  // Each function runs each phase once (annotate as the logger is attached),
+  // serialize runs once per function and once per block of nodes outside.
+  const CompilerPhaseStats& fetch = stats.getPhase(kCompilerPhaseFetch);
+  const CompilerPhaseStats& serialize = stats.getPhase(kCompilerPhaseSerialize);
+
+  for (uint32_t phase = 0; phase < kCompilerPhaseSerialize; phase++) {
+    const CompilerPhaseStats& ps = stats.getPhase(phase);
+    if (ps.runCount != fetch.runCount || ps.nodeCount == 0)
+      success = false;
+  }
+
+  if (fetch.runCount < count || fetch.varCount == 0 || fetch.zoneSize == 0 ||
+      serialize.runCount < fetch.runCount ||
+      asmStats.getEncodeCount() == 0 || asmStats.getRelocCount() != count) {
+    fprintf(file, "[Failure] Profile (statistics not collected).\n");
+    success = false;
+  }
+
+  if (success)
+    fprintf(file, "[Success] Profile (%u functions, %u compiled, %u serialized, %u instructions encoded).\n",
+      static_cast<unsigned int>(count),
+      static_cast<unsigned int>(fetch.runCount),
+      static_cast<unsigned int>(serialize.runCount),
+      static_cast<unsigned int>(asmStats.getEncodeCount()));
+
+  fflush(file);
+  return success;
+}
+
+// ============================================================================
+// [CmdLine]
+// ============================================================================
+
+struct CmdLine {
+  ASMJIT_INLINE CmdLine(int argc, char** argv) :
+    _argc(argc),
+    _argv(argv) {}
+
+  bool hasArg(const char* arg) {
+    for (int i = 1; i < _argc; i++) {
+      if (::strcmp(_argv[i], arg) == 0)
+        return true;
+    }
+    return false;
+  }
+
+  // --------------------------------------------------------------------------
+  // [Members]
+  // --------------------------------------------------------------------------
+
+  int _argc;
+  char** _argv;
+};
+
+// ============================================================================
+// [Main]
+// ============================================================================
+
+int main(int argc, char* argv[]) {
+  X86TestSuite testSuite;
+  CmdLine cmd(argc, argv);
+
+  if (cmd.hasArg("--always-print-log")) {
+    testSuite.alwaysPrintLog = true;
+  }
+
+  if (cmd.hasArg("--dual-mapping")) {
+    testSuite.memMgrOptions |= kVMemMgrOptionDualMapping;
   }
 
   return testSuite.run();